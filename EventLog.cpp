@@ -0,0 +1,333 @@
+#include "EventLog.hpp"
+#include "utility/byteswap.hpp"
+#include "utility/log.hpp"
+#include "utility/platform.hpp"
+
+#include <string.h>
+
+#if defined(PLATFORM_MSVC)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const uint8_t EVENT_LOG_MAGIC[EVENT_LOG_HEADER_SIZE] = { 'W', 'W', 'H', 'D', 'W', 'A', 'L', 1 };
+
+    uint32_t fnv1a(const uint8_t* data, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    void encodeRecord(const LogRecord& record, uint8_t* out)
+    {
+        const uint32_t world = Utility::toBigEndian(record.world);
+        const uint32_t id = Utility::toBigEndian(record.id);
+        out[0] = static_cast<uint8_t>(record.event);
+        out[1] = out[2] = out[3] = 0;
+        memcpy(out + 4, &world, sizeof(world));
+        memcpy(out + 8, &id, sizeof(id));
+        const uint32_t check = Utility::toBigEndian(fnv1a(out, 12));
+        memcpy(out + 12, &check, sizeof(check));
+    }
+
+    bool decodeRecord(const uint8_t* in, LogRecord& record)
+    {
+        uint32_t check;
+        memcpy(&check, in + 12, sizeof(check));
+        if (Utility::fromBigEndian(check) != fnv1a(in, 12) ||
+            (in[0] != static_cast<uint8_t>(LoggedEvent::ItemSend) && in[0] != static_cast<uint8_t>(LoggedEvent::LocationCheck)))
+        {
+            return false;
+        }
+        uint32_t world, id;
+        memcpy(&world, in + 4, sizeof(world));
+        memcpy(&id, in + 8, sizeof(id));
+        record.event = static_cast<LoggedEvent>(in[0]);
+        record.world = Utility::fromBigEndian(world);
+        record.id = Utility::fromBigEndian(id);
+        return true;
+    }
+
+    bool truncateFile(std::FILE* file, uint64_t length)
+    {
+    #if defined(PLATFORM_MSVC)
+        return _chsize_s(_fileno(file), static_cast<long long>(length)) == 0;
+    #else
+        return ftruncate(fileno(file), static_cast<off_t>(length)) == 0;
+    #endif
+    }
+}
+
+EventLog::EventLog() : durable(0), failed(false)
+{
+    Metrics::Registry& registry = Metrics::registry();
+    recorded = registry.counter("wwhd_event_log_records_total", "Records appended to the event log");
+    commits = registry.counter("wwhd_event_log_commits_total", "Event log batches written and synced");
+    commitErrors = registry.counter("wwhd_event_log_commit_errors_total", "Event log batches that failed to write or sync");
+    commitLatency = registry.histogram("wwhd_event_log_commit_latency_ns", "Time to write and sync one event log batch, in nanoseconds");
+    batchRecords = registry.histogram("wwhd_event_log_batch_records", "Records per event log batch");
+    failingGauge = registry.gauge("wwhd_event_log_failing", "1 while event log commits fail and nothing more is made durable");
+}
+
+EventLog::~EventLog()
+{
+    close();
+}
+
+bool EventLog::readAll(const std::string& path, std::vector<LogRecord>& out, uint64_t& validBytes, uint64_t skipRecords)
+{
+    out.clear();
+    validBytes = 0;
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (in == nullptr)
+    {
+        return skipRecords == 0;
+    }
+    uint8_t header[EVENT_LOG_HEADER_SIZE];
+    const size_t headerLength = std::fread(header, 1, sizeof(header), in);
+    if (headerLength == 0)
+    {
+        std::fclose(in);
+        return skipRecords == 0;
+    }
+    if (headerLength != sizeof(header) || memcmp(header, EVENT_LOG_MAGIC, sizeof(header)) != 0)
+    {
+        std::fclose(in);
+        return false;
+    }
+    validBytes = EVENT_LOG_HEADER_SIZE + skipRecords * EVENT_LOG_RECORD_SIZE;
+    // the skipped records are taken on trust: whoever skips them (a room
+    // snapshot) saw them intact
+    std::fseek(in, 0, SEEK_END);
+    const long fileSize = std::ftell(in);
+    if (fileSize < 0 || static_cast<uint64_t>(fileSize) < validBytes ||
+        std::fseek(in, static_cast<long>(validBytes), SEEK_SET) != 0)
+    {
+        std::fclose(in);
+        validBytes = 0;
+        return false;
+    }
+
+    std::vector<uint8_t> chunk(EVENT_LOG_RECORD_SIZE * 4096);
+    bool intact = true;
+    while (intact)
+    {
+        const size_t got = std::fread(chunk.data(), 1, chunk.size(), in);
+        for (size_t offset = 0; offset + EVENT_LOG_RECORD_SIZE <= got; offset += EVENT_LOG_RECORD_SIZE)
+        {
+            LogRecord record;
+            if (!decodeRecord(chunk.data() + offset, record))
+            {
+                intact = false;
+                break;
+            }
+            out.push_back(record);
+            validBytes += EVENT_LOG_RECORD_SIZE;
+        }
+        // a short read is the end of the file, maybe mid record
+        intact = intact && got == chunk.size();
+    }
+    std::fclose(in);
+    return true;
+}
+
+bool EventLog::open(const std::string& path, std::chrono::microseconds commitInterval,
+                    std::vector<LogRecord>* existing, uint64_t skipRecords)
+{
+    close();
+    std::vector<LogRecord> intact;
+    uint64_t validBytes = 0;
+    if (!readAll(path, intact, validBytes, skipRecords))
+    {
+        PLATFORM_LOG_ERROR(General, "%s is not an event log of at least %llu records\n", path.c_str(),
+                           static_cast<unsigned long long>(skipRecords));
+        return false;
+    }
+
+    file = std::fopen(path.c_str(), validBytes == 0 ? "wb" : "r+b");
+    if (file == nullptr)
+    {
+        PLATFORM_LOG_ERROR(General, "could not open event log %s\n", path.c_str());
+        return false;
+    }
+    if (validBytes == 0)
+    {
+        std::fwrite(EVENT_LOG_MAGIC, 1, sizeof(EVENT_LOG_MAGIC), file);
+        validBytes = EVENT_LOG_HEADER_SIZE;
+    }
+    else if (!truncateFile(file, validBytes) || std::fseek(file, static_cast<long>(validBytes), SEEK_SET) != 0)
+    {
+        PLATFORM_LOG_ERROR(General, "could not cut the torn tail off event log %s\n", path.c_str());
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+    if (!Utility::syncFile(file))
+    {
+        PLATFORM_LOG_WARN(General, "could not sync event log %s\n", path.c_str());
+    }
+
+    interval = commitInterval;
+    openBatch = 1;
+    appendedBatch = 0;
+    records = skipRecords + intact.size();
+    durable.store(0, std::memory_order_release);
+    failed.store(false, std::memory_order_release);
+    failingGauge.set(0);
+    durableBytes = validBytes;
+    running = true;
+    writerThread = std::thread(&EventLog::writerCallback, this);
+    PLATFORM_LOG_INFO(General, "logging events to %s (%llu already there)\n", path.c_str(),
+                      static_cast<unsigned long long>(records));
+    if (existing != nullptr)
+    {
+        existing->swap(intact);
+    }
+    return true;
+}
+
+void EventLog::close()
+{
+    if (file == nullptr)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        running = false;
+    }
+    pendingCondition.notify_one();
+    writerThread.join();
+    std::fclose(file);
+    file = nullptr;
+}
+
+uint64_t EventLog::append(const LogRecord& record)
+{
+    uint8_t encoded[EVENT_LOG_RECORD_SIZE];
+    encodeRecord(record, encoded);
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        wake = pending.empty();
+        pending.insert(pending.end(), encoded, encoded + sizeof(encoded));
+        appendedBatch = openBatch;
+    }
+    records++;
+    recorded.inc();
+    // the writer only needs waking for the first record of a batch
+    if (wake)
+    {
+        pendingCondition.notify_one();
+    }
+    return appendedBatch;
+}
+
+bool EventLog::commit(const std::vector<uint8_t>& data)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (std::fwrite(data.data(), 1, data.size(), file) == data.size() && Utility::syncFile(file))
+        {
+            durableBytes += data.size();
+            return true;
+        }
+        // a short write leaves a torn record, and everything after it would
+        // be cut off on the next open
+        std::clearerr(file);
+        if (!truncateFile(file, durableBytes) || std::fseek(file, static_cast<long>(durableBytes), SEEK_SET) != 0)
+        {
+            PLATFORM_LOG_ERROR(General, "could not cut a failed commit back off the event log\n");
+        }
+    }
+    return false;
+}
+
+void EventLog::writerCallback()
+{
+    // batches not yet durable; only more than one while failing
+    std::vector<uint8_t> writing;
+    std::unique_lock<std::mutex> lock(pendingMutex);
+    while (true)
+    {
+        if (writing.empty())
+        {
+            pendingCondition.wait(lock, [this] { return !running || !pending.empty(); });
+        }
+        else
+        {
+            pendingCondition.wait_for(lock, FAILED_RETRY_INTERVAL, [this] { return !running; });
+        }
+        if (running && interval.count() > 0 && writing.empty())
+        {
+            // let the batch gather; close() cuts this short
+            const auto gatherUntil = std::chrono::steady_clock::now() + interval;
+            pendingCondition.wait_until(lock, gatherUntil, [this] { return !running; });
+        }
+        const bool stopping = !running;
+        uint64_t batch = openBatch - 1;
+        if (!pending.empty())
+        {
+            batch = openBatch;
+            writing.insert(writing.end(), pending.begin(), pending.end());
+            pending.clear();
+            openBatch++;
+        }
+        lock.unlock();
+
+        if (!writing.empty())
+        {
+            const auto start = std::chrono::steady_clock::now();
+            if (commit(writing))
+            {
+                commitLatency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count()));
+                batchRecords.record(writing.size() / EVENT_LOG_RECORD_SIZE);
+                commits.inc();
+                writing.clear();
+                if (failed.load(std::memory_order_relaxed))
+                {
+                    PLATFORM_LOG_INFO(General, "event log commits work again\n");
+                    failed.store(false, std::memory_order_release);
+                    failingGauge.set(0);
+                }
+                durable.store(batch, std::memory_order_release);
+            }
+            else
+            {
+                // never published: a reply must not promise what a restart
+                // would lose
+                commitErrors.inc();
+                if (!failed.load(std::memory_order_relaxed))
+                {
+                    PLATFORM_LOG_ERROR(General, "event log commit failed, holding %zu records until one works\n",
+                                       writing.size() / EVENT_LOG_RECORD_SIZE);
+                    failed.store(true, std::memory_order_release);
+                    failingGauge.set(1);
+                }
+            }
+        }
+        else
+        {
+            durable.store(batch, std::memory_order_release);
+        }
+
+        if (stopping)
+        {
+            if (!writing.empty())
+            {
+                PLATFORM_LOG_ERROR(General, "event log closed with %zu records never committed\n",
+                                   writing.size() / EVENT_LOG_RECORD_SIZE);
+            }
+            return;
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "utility/metrics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Durable append-only log of the events that change a room's state, so a
+// restarted server can rebuild it.
+//
+// File layout (all integers big-endian): the 8 byte magic "WWHDWAL" followed
+// by the version byte, then fixed size records:
+//   u8 event, 3 zero bytes, u32 world, u32 id (item or location),
+//   u32 FNV-1a of the 12 bytes before it
+// Reading stops at the first short or corrupt record, which is where a crash
+// mid-write leaves the file.
+//
+// Group commit: the poll thread only copies records into a pending buffer
+// and gets back the batch they will be committed in. A writer thread gathers
+// a batch for up to the commit interval, writes it and syncs it to disk once,
+// then publishes it as durable. Replies that depend on an event are held
+// until its batch is durable.
+//
+// A batch that fails to write or sync is cut back off the file and tried
+// once more. If that fails too the log is failing: nothing more is
+// published as durable (so held replies stay held) and the unwritten
+// batches are retried every FAILED_RETRY_INTERVAL until one commit works.
+
+enum class LoggedEvent : uint8_t
+{
+    ItemSend = 1,
+    LocationCheck = 2,
+};
+
+struct LogRecord
+{
+    LoggedEvent event;
+    uint32_t world;
+    uint32_t id;
+};
+
+constexpr size_t EVENT_LOG_HEADER_SIZE = 8;
+constexpr size_t EVENT_LOG_RECORD_SIZE = 16;
+constexpr std::chrono::milliseconds FAILED_RETRY_INTERVAL{ 500 };
+
+class EventLog
+{
+public:
+    EventLog();
+
+    ~EventLog();
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    // Opens path for appending, creating it if needed. A torn or corrupt
+    // tail (see readAll) is cut off first, and the intact records after the
+    // first skipRecords are put in existing if given. Starts the writer
+    // thread.
+    bool open(const std::string& path, std::chrono::microseconds commitInterval,
+              std::vector<LogRecord>* existing = nullptr, uint64_t skipRecords = 0);
+
+    // commits everything pending and closes the file
+    void close();
+
+    bool isOpen() const { return file != nullptr; }
+
+    // returns the batch the record will be committed in
+    uint64_t append(const LogRecord& record);
+
+    // the newest batch anything was appended to; 0 before the first append
+    uint64_t lastBatch() const { return appendedBatch; }
+
+    // records in the log, counting those from before open(); only the
+    // appending thread
+    uint64_t recordCount() const { return records; }
+
+    // every batch up to and including this one is on disk; any thread
+    uint64_t durableBatch() const { return durable.load(std::memory_order_acquire); }
+
+    // a commit failed twice and none has worked since; any thread
+    bool failing() const { return failed.load(std::memory_order_acquire); }
+
+    // Reads every intact record of the log at path after the first
+    // skipRecords into out; validBytes is where they end. A missing file is
+    // an empty log. False if the file is not an event log or holds fewer
+    // than skipRecords records.
+    static bool readAll(const std::string& path, std::vector<LogRecord>& out, uint64_t& validBytes,
+                        uint64_t skipRecords = 0);
+private:
+    std::FILE* file = nullptr;
+    std::chrono::microseconds interval{ 0 };
+    std::thread writerThread;
+    std::mutex pendingMutex;
+    std::condition_variable pendingCondition;
+    std::vector<uint8_t> pending;
+    // the batch appends currently go to; only changes under pendingMutex
+    uint64_t openBatch = 1;
+    // only touched by the appending thread
+    uint64_t appendedBatch = 0;
+    uint64_t records = 0;
+    std::atomic<uint64_t> durable;
+    std::atomic<bool> failed;
+    // where the last durable record ends; only the writer thread once open
+    uint64_t durableBytes = 0;
+    bool running = false;
+    Metrics::Counter recorded;
+    Metrics::Counter commits;
+    Metrics::Counter commitErrors;
+    Metrics::Histogram commitLatency;
+    Metrics::Histogram batchRecords;
+    Metrics::Gauge failingGauge;
+
+    void writerCallback();
+
+    // writes and syncs data at durableBytes, cutting a failed attempt back
+    // off and trying once more
+    bool commit(const std::vector<uint8_t>& data);
+};
@@ -0,0 +1,183 @@
+#include "Executor.hpp"
+
+namespace
+{
+    // rounds of looking for work before a worker goes to sleep
+    constexpr unsigned IDLE_SPINS = 256;
+}
+
+Executor::Executor(unsigned workerCount, bool stealing) :
+    stealing(stealing)
+{
+    for (unsigned i = 0; i < std::max(1u, workerCount); i++)
+    {
+        workers.emplace_back(new Worker());
+    }
+    Metrics::Registry& registry = Metrics::registry();
+    tasksRun = registry.counter("wwhd_executor_tasks_total", "Tasks run by the executor");
+    tasksStolen = registry.counter("wwhd_executor_steals_total", "Tasks run by a worker other than the one they were posted to");
+    workerSleeps = registry.counter("wwhd_executor_sleeps_total", "Times an executor worker ran out of work and slept");
+}
+
+Executor::~Executor()
+{
+    stop();
+}
+
+void Executor::start()
+{
+    running = true;
+    for (unsigned i = 0; i < workers.size(); i++)
+    {
+        workers[i]->thread = std::thread(&Executor::workerCallback, this, i);
+    }
+}
+
+void Executor::stop()
+{
+    if (!running.exchange(false))
+    {
+        return;
+    }
+    for (const std::unique_ptr<Worker>& worker : workers)
+    {
+        wakeWorker(*worker);
+    }
+    for (const std::unique_ptr<Worker>& worker : workers)
+    {
+        worker->thread.join();
+    }
+}
+
+void Executor::post(Task* task, unsigned worker)
+{
+    Worker& target = *workers[worker % workers.size()];
+    target.inbox.push(task);
+    if (target.sleeping.load(std::memory_order_seq_cst))
+    {
+        wakeWorker(target);
+    }
+}
+
+void Executor::share(unsigned worker)
+{
+    Worker& self = *workers[worker];
+    bool moved = false;
+    while (Task* task = self.inbox.pop())
+    {
+        self.deque.push(task);
+        moved = true;
+    }
+    if (!moved)
+    {
+        return;
+    }
+    // pairs with the sleeper counting itself before its last look at the deques
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (stealing && sleepers.load(std::memory_order_relaxed) > 0)
+    {
+        wakeIdleWorker(worker);
+    }
+}
+
+void Executor::wakeWorker(Worker& worker)
+{
+    {
+        // taking the lock orders this with the worker's last look for work
+        std::lock_guard<std::mutex> lock(worker.sleepMutex);
+        worker.wakeRequested.store(true, std::memory_order_relaxed);
+    }
+    worker.wake.notify_one();
+}
+
+void Executor::wakeIdleWorker(unsigned except)
+{
+    for (unsigned i = 1; i < workers.size(); i++)
+    {
+        Worker& worker = *workers[(except + i) % workers.size()];
+        if (worker.sleeping.load(std::memory_order_seq_cst))
+        {
+            wakeWorker(worker);
+            return;
+        }
+    }
+}
+
+bool Executor::anyQueued(unsigned index) const
+{
+    if (!stealing)
+    {
+        return !workers[index]->deque.empty();
+    }
+    for (const std::unique_ptr<Worker>& worker : workers)
+    {
+        if (!worker->deque.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+Task* Executor::take(unsigned index)
+{
+    share(index);
+    Worker& self = *workers[index];
+    if (Task* task = self.deque.steal())
+    {
+        return task;
+    }
+    for (unsigned i = 1; stealing && i < workers.size(); i++)
+    {
+        if (Task* task = workers[(index + i) % workers.size()]->deque.steal())
+        {
+            tasksStolen.inc();
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void Executor::workerCallback(unsigned index)
+{
+    Worker& self = *workers[index];
+    unsigned idle = 0;
+    while (true)
+    {
+        if (Task* task = take(index))
+        {
+            idle = 0;
+            tasksRun.inc();
+            task->run(*task, index);
+            continue;
+        }
+        if (!self.inbox.empty() || anyQueued(index))
+        {
+            // mid-post, or lost a race for a task
+            continue;
+        }
+        if (!running.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        if (++idle < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        idle = 0;
+        self.sleeping.store(true, std::memory_order_seq_cst);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        if (!anyQueued(index))
+        {
+            workerSleeps.inc();
+            std::unique_lock<std::mutex> lock(self.sleepMutex);
+            self.wake.wait(lock, [&] {
+                return self.wakeRequested.load(std::memory_order_relaxed) || !self.inbox.empty() || !running.load(std::memory_order_acquire);
+            });
+            self.wakeRequested.store(false, std::memory_order_relaxed);
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        self.sleeping.store(false, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "utility/metrics.hpp"
+#include "utility/mpsc_queue.hpp"
+#include "utility/steal_deque.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A unit of work for the Executor. Intrusive: whoever posts it owns it, and
+// it must stay alive until run is called.
+struct Task
+{
+    // inbox link, owned by Utility::MpscQueue
+    std::atomic<Task*> queueNext{ nullptr };
+    // called on the worker that picked the task up
+    void (*run)(Task& task, unsigned worker) = nullptr;
+};
+
+// Work-stealing thread pool. Each task is posted to a preferred worker
+// (affinity: a room's home worker keeps its state in that core's cache).
+// Posts land in the worker's lock-free inbox; the worker moves its inbox into
+// its StealDeque and runs from there in order, and a worker with nothing of
+// its own steals the oldest task from another's deque. So when one worker
+// is stuck on a long task, whatever queued behind it moves elsewhere.
+//
+// Long tasks call share() now and then so work posted to their worker
+// meanwhile becomes stealable without waiting for the task to end.
+// Idle workers spin briefly, then sleep until a post or a busy worker
+// with spare tasks wakes them.
+class Executor
+{
+public:
+    // without stealing every task runs on the worker it was posted to
+    // (for comparison)
+    explicit Executor(unsigned workerCount, bool stealing = true);
+
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    unsigned workerCount() const { return static_cast<unsigned>(workers.size()); }
+
+    void start();
+
+    // runs everything already posted, then joins the workers
+    void stop();
+
+    // any thread; worker is taken modulo workerCount()
+    void post(Task* task, unsigned worker);
+
+    // from a task running on worker
+    void share(unsigned worker);
+private:
+    struct Worker
+    {
+        Utility::MpscQueue<Task> inbox;
+        Utility::StealDeque<Task> deque;
+        std::thread thread;
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::atomic<bool> sleeping{ false };
+        // set by a worker that has tasks to spare
+        std::atomic<bool> wakeRequested{ false };
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    bool stealing;
+    std::atomic<bool> running{ false };
+    std::atomic<unsigned> sleepers{ 0 };
+    Metrics::Counter tasksRun;
+    Metrics::Counter tasksStolen;
+    Metrics::Counter workerSleeps;
+
+    void workerCallback(unsigned index);
+
+    Task* take(unsigned index);
+
+    // whether worker index has anything it could take
+    bool anyQueued(unsigned index) const;
+
+    void wakeWorker(Worker& worker);
+
+    void wakeIdleWorker(unsigned except);
+};
@@ -0,0 +1,614 @@
+#include "LogicGraph.hpp"
+#include "utility/bits.hpp"
+#include "utility/log.hpp"
+#include "json.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <unordered_map>
+
+constexpr uint32_t LogicGraph::NO_LOCATION;
+constexpr uint32_t LogicGraph::NO_NODE;
+
+namespace
+{
+    using NameMap = std::unordered_map<std::string, uint32_t>;
+
+    struct Expr
+    {
+        enum class Kind : uint8_t
+        {
+            Nothing,
+            Item,
+            Node,
+            And,
+            Or,
+        };
+
+        Kind kind = Kind::Nothing;
+        // the item or node
+        uint32_t id = 0;
+        // for items, how many are needed
+        uint32_t count = 1;
+        std::vector<Expr> children;
+    };
+
+    // recursive descent over one requirement string
+    class Parser
+    {
+    public:
+        Parser(const std::string& text, const NameMap& items, const NameMap& macros) :
+            text(text), items(items), macros(macros)
+        {
+
+        }
+
+        bool parse(Expr& out)
+        {
+            if (!parseOr(out))
+            {
+                return false;
+            }
+            skipSpace();
+            return pos == text.size() || fail("unexpected text");
+        }
+
+        const std::string& error() const { return message; }
+    private:
+        const std::string& text;
+        const NameMap& items;
+        const NameMap& macros;
+        size_t pos = 0;
+        std::string message;
+
+        static bool isNameChar(char c)
+        {
+            return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '\'';
+        }
+
+        bool fail(const std::string& what)
+        {
+            message = what + " at offset " + std::to_string(pos);
+            return false;
+        }
+
+        void skipSpace()
+        {
+            while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos])))
+            {
+                pos++;
+            }
+        }
+
+        bool consume(char c)
+        {
+            skipSpace();
+            if (pos < text.size() && text[pos] == c)
+            {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+
+        bool expect(char c)
+        {
+            return consume(c) || fail(std::string("expected '") + c + "'");
+        }
+
+        bool keyword(const char* word)
+        {
+            skipSpace();
+            const size_t length = strlen(word);
+            if (text.compare(pos, length, word) != 0 || (pos + length < text.size() && isNameChar(text[pos + length])))
+            {
+                return false;
+            }
+            pos += length;
+            return true;
+        }
+
+        bool name(std::string& out)
+        {
+            skipSpace();
+            const size_t start = pos;
+            while (pos < text.size() && isNameChar(text[pos]))
+            {
+                pos++;
+            }
+            out.assign(text, start, pos - start);
+            return !out.empty() || fail("expected a name");
+        }
+
+        bool parseOr(Expr& out)
+        {
+            Expr first;
+            if (!parseAnd(first))
+            {
+                return false;
+            }
+            if (!keyword("or"))
+            {
+                out = std::move(first);
+                return true;
+            }
+            out.kind = Expr::Kind::Or;
+            out.children.push_back(std::move(first));
+            do
+            {
+                out.children.emplace_back();
+                if (!parseAnd(out.children.back()))
+                {
+                    return false;
+                }
+            } while (keyword("or"));
+            return true;
+        }
+
+        bool parseAnd(Expr& out)
+        {
+            Expr first;
+            if (!parseTerm(first))
+            {
+                return false;
+            }
+            if (!keyword("and"))
+            {
+                out = std::move(first);
+                return true;
+            }
+            out.kind = Expr::Kind::And;
+            out.children.push_back(std::move(first));
+            do
+            {
+                out.children.emplace_back();
+                if (!parseTerm(out.children.back()))
+                {
+                    return false;
+                }
+            } while (keyword("and"));
+            return true;
+        }
+
+        bool parseTerm(Expr& out)
+        {
+            if (consume('('))
+            {
+                return parseOr(out) && expect(')');
+            }
+            std::string word;
+            if (!name(word))
+            {
+                return false;
+            }
+            if (word == "Nothing")
+            {
+                out.kind = Expr::Kind::Nothing;
+                return true;
+            }
+            if (word == "count")
+            {
+                // count(n, Item)
+                std::string number;
+                if (!expect('(') || !name(number) || !expect(',') || !name(word) || !expect(')'))
+                {
+                    return false;
+                }
+                char* end;
+                const unsigned long count = strtoul(number.c_str(), &end, 10);
+                if (*end != '\0' || count > UINT8_MAX)
+                {
+                    return fail("bad count " + number);
+                }
+                const auto item = items.find(word);
+                if (item == items.end())
+                {
+                    return fail("unknown item " + word);
+                }
+                out.kind = count == 0 ? Expr::Kind::Nothing : Expr::Kind::Item;
+                out.id = item->second;
+                out.count = static_cast<uint32_t>(count);
+                return true;
+            }
+            const auto item = items.find(word);
+            if (item != items.end())
+            {
+                out.kind = Expr::Kind::Item;
+                out.id = item->second;
+                return true;
+            }
+            const auto macro = macros.find(word);
+            if (macro != macros.end())
+            {
+                out.kind = Expr::Kind::Node;
+                out.id = macro->second;
+                return true;
+            }
+            return fail("unknown item or macro " + word);
+        }
+    };
+
+    struct PendingClause
+    {
+        uint64_t items[ITEM_WORDS] = {};
+        std::vector<std::pair<uint8_t, uint8_t>> counts;
+        std::vector<uint32_t> nodes;
+    };
+
+    using PendingNode = std::vector<PendingClause>;
+
+    void compileOr(const Expr& expr, std::vector<PendingNode>& nodes, uint32_t node);
+
+    void compileAnd(const Expr& expr, std::vector<PendingNode>& nodes, PendingClause& clause)
+    {
+        switch (expr.kind)
+        {
+        case Expr::Kind::Nothing:
+            break;
+        case Expr::Kind::Item:
+            if (expr.count == 1)
+            {
+                clause.items[expr.id / 64] |= uint64_t(1) << (expr.id % 64);
+            }
+            else
+            {
+                clause.counts.emplace_back(static_cast<uint8_t>(expr.id), static_cast<uint8_t>(expr.count));
+            }
+            break;
+        case Expr::Kind::Node:
+            clause.nodes.push_back(expr.id);
+            break;
+        case Expr::Kind::And:
+            for (const Expr& child : expr.children)
+            {
+                compileAnd(child, nodes, clause);
+            }
+            break;
+        case Expr::Kind::Or:
+        {
+            const uint32_t helper = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+            compileOr(expr, nodes, helper);
+            clause.nodes.push_back(helper);
+            break;
+        }
+        }
+    }
+
+    void compileOr(const Expr& expr, std::vector<PendingNode>& nodes, uint32_t node)
+    {
+        if (expr.kind == Expr::Kind::Or)
+        {
+            for (const Expr& child : expr.children)
+            {
+                compileOr(child, nodes, node);
+            }
+            return;
+        }
+        // built aside: helper nodes added meanwhile can move nodes[node]
+        PendingClause clause;
+        compileAnd(expr, nodes, clause);
+        nodes[node].push_back(std::move(clause));
+    }
+
+    // turns per-key lists into the start-offset layout
+    void buildIndex(const std::vector<std::vector<uint32_t>>& lists, std::vector<uint32_t>& start, std::vector<uint32_t>& values)
+    {
+        start.assign(1, 0);
+        values.clear();
+        for (const std::vector<uint32_t>& list : lists)
+        {
+            values.insert(values.end(), list.begin(), list.end());
+            start.push_back(static_cast<uint32_t>(values.size()));
+        }
+    }
+}
+
+void LogicGraph::clear()
+{
+    clauses.clear();
+    nodeClauseStart.assign(1, 0);
+    countAtoms.clear();
+    nodeAtoms.clear();
+    itemWatchStart.clear();
+    itemWatchers.clear();
+    nodeWatchStart.clear();
+    nodeWatchers.clear();
+    nodeLocations.clear();
+    locations = 0;
+    goal = NO_NODE;
+    memset(allLocations, 0, sizeof(allLocations));
+    memset(startLocations, 0, sizeof(startLocations));
+    memset(progression, 0, sizeof(progression));
+}
+
+bool LogicGraph::loadFile(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+    {
+        PLATFORM_LOG_ERROR(General, "could not open %s\n", path.c_str());
+        clear();
+        return false;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    return loadText(text.str(), path);
+}
+
+bool LogicGraph::loadText(const std::string& text, const std::string& source)
+{
+    clear();
+    const nlohmann::json file = nlohmann::json::parse(text, nullptr, false);
+    const auto items = file.is_object() ? file.find("items") : file.end();
+    const auto macros = file.is_object() ? file.find("macros") : file.end();
+    const auto locationList = file.is_object() ? file.find("locations") : file.end();
+    if (!file.is_object() || items == file.end() || !items->is_object() ||
+        macros == file.end() || !macros->is_object() || locationList == file.end() || !locationList->is_array())
+    {
+        PLATFORM_LOG_ERROR(General, "%s is not a logic file\n", source.c_str());
+        return false;
+    }
+
+    NameMap itemIds;
+    for (auto item = items->begin(); item != items->end(); ++item)
+    {
+        if (!item.value().is_number_unsigned() || item.value().get<uint32_t>() >= MAX_ITEMS)
+        {
+            PLATFORM_LOG_ERROR(General, "%s: bad item id for %s\n", source.c_str(), item.key().c_str());
+            return false;
+        }
+        itemIds[item.key()] = item.value().get<uint32_t>();
+    }
+    // macros are nodes [0, macro count) so they can be referred to before
+    // they are compiled
+    NameMap macroNodes;
+    for (auto macro = macros->begin(); macro != macros->end(); ++macro)
+    {
+        if (!macro.value().is_string() || itemIds.count(macro.key()) != 0)
+        {
+            PLATFORM_LOG_ERROR(General, "%s: bad macro %s\n", source.c_str(), macro.key().c_str());
+            return false;
+        }
+        const uint32_t node = static_cast<uint32_t>(macroNodes.size());
+        macroNodes[macro.key()] = node;
+    }
+
+    std::vector<PendingNode> pending(macroNodes.size());
+    // (node, location)
+    std::vector<std::pair<uint32_t, uint32_t>> locationNodes;
+    uint64_t seenLocations[LOCATION_WORDS] = {};
+    const auto compile = [&](const std::string& requirement, uint32_t node, const std::string& what)
+    {
+        Expr expr;
+        Parser parser(requirement, itemIds, macroNodes);
+        if (!parser.parse(expr))
+        {
+            PLATFORM_LOG_ERROR(General, "%s: %s: %s\n", source.c_str(), what.c_str(), parser.error().c_str());
+            return false;
+        }
+        compileOr(expr, pending, node);
+        return true;
+    };
+    for (auto macro = macros->begin(); macro != macros->end(); ++macro)
+    {
+        if (!compile(macro.value().get<std::string>(), macroNodes[macro.key()], macro.key()))
+        {
+            return false;
+        }
+    }
+    for (const nlohmann::json& location : *locationList)
+    {
+        if (!location.is_array() || location.size() != 2 || !location[0].is_number_unsigned() ||
+            location[0].get<uint32_t>() >= MAX_LOCATIONS || !location[1].is_string())
+        {
+            PLATFORM_LOG_ERROR(General, "%s: malformed location %s\n", source.c_str(), location.dump().c_str());
+            return false;
+        }
+        const uint32_t id = location[0].get<uint32_t>();
+        uint64_t& seen = seenLocations[id / 64];
+        if (seen & (uint64_t(1) << (id % 64)))
+        {
+            PLATFORM_LOG_ERROR(General, "%s: location %u listed twice\n", source.c_str(), id);
+            return false;
+        }
+        seen |= uint64_t(1) << (id % 64);
+        const uint32_t node = static_cast<uint32_t>(pending.size());
+        pending.emplace_back();
+        if (!compile(location[1].get<std::string>(), node, "location " + std::to_string(id)))
+        {
+            return false;
+        }
+        locationNodes.emplace_back(node, id);
+    }
+    const auto goalField = file.find("goal");
+    if (goalField != file.end())
+    {
+        if (!goalField->is_string())
+        {
+            PLATFORM_LOG_ERROR(General, "%s: the goal is not a requirement\n", source.c_str());
+            return false;
+        }
+        const uint32_t node = static_cast<uint32_t>(pending.size());
+        pending.emplace_back();
+        if (!compile(goalField->get<std::string>(), node, "goal"))
+        {
+            return false;
+        }
+        goal = node;
+    }
+
+    // flatten, and note who watches what
+    std::vector<std::vector<uint32_t>> itemLists(MAX_ITEMS);
+    std::vector<std::vector<uint32_t>> nodeLists(pending.size());
+    for (uint32_t node = 0; node < pending.size(); node++)
+    {
+        for (const PendingClause& built : pending[node])
+        {
+            const uint32_t index = static_cast<uint32_t>(clauses.size());
+            Clause clause;
+            memcpy(clause.items, built.items, sizeof(clause.items));
+            clause.node = node;
+            clause.firstCount = static_cast<uint32_t>(countAtoms.size());
+            clause.countAtoms = static_cast<uint32_t>(built.counts.size());
+            clause.firstNode = static_cast<uint32_t>(nodeAtoms.size());
+            clause.nodeAtoms = static_cast<uint32_t>(built.nodes.size());
+            clauses.push_back(clause);
+            for (size_t i = 0; i < ITEM_WORDS; i++)
+            {
+                for (uint64_t word = built.items[i]; word != 0; word &= word - 1)
+                {
+                    const uint32_t item = static_cast<uint32_t>(i * 64 + Utility::countTrailingZeros(word));
+                    itemLists[item].push_back(index);
+                    progression[item] = std::max<uint8_t>(progression[item], 1);
+                }
+            }
+            for (const auto& count : built.counts)
+            {
+                countAtoms.push_back(CountAtom{ count.first, count.second });
+                itemLists[count.first].push_back(index);
+                progression[count.first] = std::max(progression[count.first], count.second);
+            }
+            for (const uint32_t dependency : built.nodes)
+            {
+                nodeAtoms.push_back(dependency);
+                nodeLists[dependency].push_back(index);
+            }
+        }
+        nodeClauseStart.push_back(static_cast<uint32_t>(clauses.size()));
+    }
+    buildIndex(itemLists, itemWatchStart, itemWatchers);
+    buildIndex(nodeLists, nodeWatchStart, nodeWatchers);
+    nodeLocations.assign(pending.size(), NO_LOCATION);
+    for (const auto& location : locationNodes)
+    {
+        nodeLocations[location.first] = location.second;
+        allLocations[location.second / 64] |= uint64_t(1) << (location.second % 64);
+    }
+    locations = locationNodes.size();
+
+    LogicState start;
+    const uint8_t noItems[MAX_ITEMS] = {};
+    start.evaluateAll(*this, noItems);
+    memcpy(startLocations, start.locationWords(), sizeof(startLocations));
+
+    PLATFORM_LOG_INFO(General, "loaded logic for %zu locations (%zu nodes, %zu clauses) from %s\n",
+                      locations, nodeCount(), clauses.size(), source.c_str());
+    return true;
+}
+
+bool LogicState::satisfied(const LogicGraph& graph, const LogicGraph::Clause& clause, const uint8_t* itemCounts) const
+{
+    uint64_t missing = 0;
+    for (size_t i = 0; i < ITEM_WORDS; i++)
+    {
+        missing |= clause.items[i] & ~have[i];
+    }
+    if (missing != 0)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < clause.countAtoms; i++)
+    {
+        const LogicGraph::CountAtom& atom = graph.countAtoms[clause.firstCount + i];
+        if (itemCounts[atom.item] < atom.count)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < clause.nodeAtoms; i++)
+    {
+        if (!isReachable(graph.nodeAtoms[clause.firstNode + i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LogicState::reachesGoal(const LogicGraph& graph) const
+{
+    if (graph.goal != LogicGraph::NO_NODE)
+    {
+        return isReachable(graph.goal);
+    }
+    for (size_t i = 0; i < LOCATION_WORDS; i++)
+    {
+        if (graph.allLocations[i] & ~locations[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LogicState::markReachable(const LogicGraph& graph, uint32_t node, std::vector<uint32_t>* inLogic)
+{
+    reachable[node / 64] |= uint64_t(1) << (node % 64);
+    const uint32_t location = graph.nodeLocations[node];
+    if (location != LogicGraph::NO_LOCATION)
+    {
+        locations[location / 64] |= uint64_t(1) << (location % 64);
+        if (inLogic != nullptr)
+        {
+            inLogic->push_back(location);
+        }
+    }
+}
+
+void LogicState::evaluateAll(const LogicGraph& graph, const uint8_t* itemCounts, std::vector<uint32_t>* inLogic)
+{
+    // one word more than needed, so even an empty graph counts as evaluated
+    reachable.assign(graph.nodeCount() / 64 + 1, 0);
+    memset(locations, 0, sizeof(locations));
+    memset(have, 0, sizeof(have));
+    for (uint32_t item = 0; item < MAX_ITEMS; item++)
+    {
+        have[item / 64] |= uint64_t(itemCounts[item] != 0) << (item % 64);
+    }
+    // sweep every unreached node until a sweep reaches nothing new
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (uint32_t node = 0; node < graph.nodeCount(); node++)
+        {
+            if (isReachable(node))
+            {
+                continue;
+            }
+            for (uint32_t i = graph.nodeClauseStart[node]; i < graph.nodeClauseStart[node + 1]; i++)
+            {
+                if (satisfied(graph, graph.clauses[i], itemCounts))
+                {
+                    markReachable(graph, node, inLogic);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void LogicState::addItem(const LogicGraph& graph, const uint8_t* itemCounts, uint32_t item, std::vector<uint32_t>& inLogic)
+{
+    have[item / 64] |= uint64_t(1) << (item % 64);
+    worklist.assign(graph.itemWatchers.begin() + graph.itemWatchStart[item],
+                    graph.itemWatchers.begin() + graph.itemWatchStart[item + 1]);
+    while (!worklist.empty())
+    {
+        const LogicGraph::Clause& clause = graph.clauses[worklist.back()];
+        worklist.pop_back();
+        if (isReachable(clause.node) || !satisfied(graph, clause, itemCounts))
+        {
+            continue;
+        }
+        markReachable(graph, clause.node, &inLogic);
+        worklist.insert(worklist.end(), graph.nodeWatchers.begin() + graph.nodeWatchStart[clause.node],
+                        graph.nodeWatchers.begin() + graph.nodeWatchStart[clause.node + 1]);
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "WorldState.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Item logic for the trackers: which of a world's locations it can reach with
+// the items it has received. Each requirement expression is compiled into
+// nodes (one per macro and per location), each an OR of clauses, each clause
+// an AND of items (a bitset over MAX_ITEMS), item counts and other nodes. A
+// nested OR inside an AND becomes a helper node of its own, so no expression
+// grows past its number of terms.
+//
+// Items are only ever gained, so reachability only grows: on a new item only
+// the clauses that mention it are re-evaluated, and a node that becomes
+// reachable queues the clauses that depend on it (LogicState::addItem). A
+// full evaluation is only needed to start a world.
+
+constexpr size_t ITEM_WORDS = MAX_ITEMS / 64;
+
+class LogicGraph
+{
+public:
+    // Loads a logic file:
+    //   {"items": {"GrapplingHook": 12, ...},
+    //    "macros": {"CanDefeatDarknuts": "requirement", ...},
+    //    "locations": [[location id, "requirement"], ...],
+    //    "goal": "requirement"}
+    // where a requirement is made of item and macro names, count(n, Item),
+    // Nothing, and, or and parentheses (and binds tighter than or). A macro
+    // may refer to macros defined after it. Without a goal, a world has won
+    // once every location is in logic.
+    bool loadFile(const std::string& path);
+
+    // the same from the file's text; source names it in errors
+    bool loadText(const std::string& text, const std::string& source);
+
+    bool empty() const { return nodeClauseStart.size() <= 1; }
+
+    size_t nodeCount() const { return nodeLocations.size(); }
+
+    size_t clauseCount() const { return clauses.size(); }
+
+    size_t locationCount() const { return locations; }
+
+    // every location the logic decides
+    const uint64_t* locationWords() const { return allLocations; }
+
+    // the locations in logic with no items at all
+    const uint64_t* startLocationWords() const { return startLocations; }
+
+    // how many of each item the logic ever asks for (MAX_ITEMS counts):
+    // the progression a seed has to place
+    const uint8_t* progressionCounts() const { return progression; }
+private:
+    friend class LogicState;
+
+    static constexpr uint32_t NO_LOCATION = UINT32_MAX;
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    struct CountAtom
+    {
+        uint8_t item;
+        uint8_t count;
+    };
+
+    struct Clause
+    {
+        // items needed at least once
+        uint64_t items[ITEM_WORDS];
+        uint32_t node;
+        uint32_t firstCount;
+        uint32_t countAtoms;
+        uint32_t firstNode;
+        uint32_t nodeAtoms;
+    };
+
+    // clauses are grouped by node, node n owning
+    // [nodeClauseStart[n], nodeClauseStart[n + 1])
+    std::vector<Clause> clauses;
+    std::vector<uint32_t> nodeClauseStart;
+    std::vector<CountAtom> countAtoms;
+    std::vector<uint32_t> nodeAtoms;
+    // the clauses to re-evaluate when an item count goes up or a node
+    // becomes reachable, in the same start-offset layout
+    std::vector<uint32_t> itemWatchStart;
+    std::vector<uint32_t> itemWatchers;
+    std::vector<uint32_t> nodeWatchStart;
+    std::vector<uint32_t> nodeWatchers;
+    // the location each node decides, or NO_LOCATION for macros and helpers
+    std::vector<uint32_t> nodeLocations;
+    size_t locations = 0;
+    uint32_t goal = NO_NODE;
+    uint64_t allLocations[LOCATION_WORDS] = {};
+    uint64_t startLocations[LOCATION_WORDS] = {};
+    uint8_t progression[MAX_ITEMS] = {};
+
+    void clear();
+};
+
+// One world's view of a LogicGraph: which nodes (and so locations) are
+// reachable with its item counts. Default constructed it is unevaluated.
+class LogicState
+{
+public:
+    bool evaluated() const { return !reachable.empty(); }
+
+    // Starts over and runs every node to a fixpoint with itemCounts
+    // (MAX_ITEMS counts); the locations in logic are appended to inLogic
+    // when given.
+    void evaluateAll(const LogicGraph& graph, const uint8_t* itemCounts, std::vector<uint32_t>* inLogic = nullptr);
+
+    // itemCounts[item] just went up: re-evaluates only what that can
+    // unlock and appends the locations that came into logic. The state
+    // must be evaluated.
+    void addItem(const LogicGraph& graph, const uint8_t* itemCounts, uint32_t item, std::vector<uint32_t>& inLogic);
+
+    bool inLogic(uint32_t location) const
+    {
+        return (locations[location / 64] >> (location % 64)) & 1;
+    }
+
+    const uint64_t* locationWords() const { return locations; }
+
+    // whether the graph's goal is in logic
+    bool reachesGoal(const LogicGraph& graph) const;
+private:
+    std::vector<uint64_t> reachable;
+    uint64_t have[ITEM_WORDS] = {};
+    uint64_t locations[LOCATION_WORDS] = {};
+    std::vector<uint32_t> worklist;
+
+    bool isReachable(uint32_t node) const
+    {
+        return (reachable[node / 64] >> (node % 64)) & 1;
+    }
+
+    bool satisfied(const LogicGraph& graph, const LogicGraph::Clause& clause, const uint8_t* itemCounts) const;
+
+    void markReachable(const LogicGraph& graph, uint32_t node, std::vector<uint32_t>* inLogic);
+};
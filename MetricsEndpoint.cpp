@@ -0,0 +1,199 @@
+
+#include "MetricsEndpoint.hpp"
+#include "utility/log.hpp"
+
+#ifndef PLATFORM_MSVC
+  #include <arpa/inet.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+#include <string.h>
+
+// a scraper is local and trusted, but there is still no reason to hold more
+// than a few of them or to buffer a large request
+constexpr size_t MAX_SCRAPE_CLIENTS = 4;
+constexpr size_t MAX_REQUEST_SIZE = 8 * 1024;
+// a client that has not asked and been answered by then is dropped, so a few
+// that connect and say nothing cannot keep the scraper out
+constexpr std::chrono::seconds SCRAPE_CLIENT_TIMEOUT(10);
+
+MetricsEndpoint::MetricsEndpoint(uint16_t port) : port(port)
+{
+    Metrics::Registry& registry = Metrics::registry();
+    scrapes = registry.counter("wwhd_metrics_scrapes_total", "Metrics pages served");
+    renderLatency = registry.histogram("wwhd_metrics_render_ns", "Time spent rendering one metrics page, in nanoseconds");
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    shutdown();
+}
+
+bool MetricsEndpoint::initialize()
+{
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (Utility::isSocketInvalid(listenSocket))
+    {
+        return false;
+    }
+    Utility::setSocketReuseAddress(listenSocket);
+    Utility::setSocketNonBlocking(listenSocket);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(listenSocket, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenSocket, 4) < 0)
+    {
+        SOCK_CLOSE(listenSocket);
+        listenSocket = INVALID_SOCKET;
+        return false;
+    }
+    PLATFORM_LOG_INFO(Net, "serving metrics on 127.0.0.1:%u\n", port);
+    return true;
+}
+
+void MetricsEndpoint::preparePoll(std::vector<pollfd>& pfds) const
+{
+    pollfd pfd{};
+    pfd.fd = listenSocket;
+    pfd.events = clients.size() < MAX_SCRAPE_CLIENTS ? POLLIN : 0;
+    pfds.push_back(pfd);
+    for (const Client& client : clients)
+    {
+        pfd.fd = client.socket;
+        pfd.events = client.response.empty() ? POLLIN : POLLOUT;
+        pfds.push_back(pfd);
+    }
+}
+
+void MetricsEndpoint::processPoll(const pollfd* pfds)
+{
+    // same layout as preparePoll: the listen socket, then each client
+    const size_t polledClients = clients.size();
+    const auto now = std::chrono::steady_clock::now();
+    for (size_t i = polledClients; i-- > 0;)
+    {
+        const short revents = pfds[i + 1].revents;
+        Client& client = clients[i];
+        if (revents == 0 && now < client.deadline)
+        {
+            continue;
+        }
+        bool keep = (revents & (POLLERR | POLLNVAL)) == 0 && now < client.deadline;
+        if (keep && client.response.empty() && (revents & (POLLIN | POLLHUP)))
+        {
+            keep = readRequest(client);
+        }
+        if (keep && !client.response.empty())
+        {
+            keep = writeResponse(client);
+        }
+        if (!keep)
+        {
+            SOCK_CLOSE(client.socket);
+            clients[i] = std::move(clients.back());
+            clients.pop_back();
+        }
+    }
+
+    if (pfds[0].revents & POLLIN)
+    {
+        acceptClient();
+    }
+}
+
+void MetricsEndpoint::shutdown()
+{
+    for (Client& client : clients)
+    {
+        SOCK_CLOSE(client.socket);
+    }
+    clients.clear();
+    if (!Utility::isSocketInvalid(listenSocket))
+    {
+        SOCK_CLOSE(listenSocket);
+    }
+    listenSocket = INVALID_SOCKET;
+}
+
+void MetricsEndpoint::acceptClient()
+{
+    SocketType socket = accept(listenSocket, nullptr, nullptr);
+    if (Utility::isSocketInvalid(socket))
+    {
+        return;
+    }
+    Utility::setSocketNonBlocking(socket);
+    Client client;
+    client.socket = socket;
+    client.deadline = std::chrono::steady_clock::now() + SCRAPE_CLIENT_TIMEOUT;
+    clients.push_back(std::move(client));
+}
+
+bool MetricsEndpoint::readRequest(Client& client)
+{
+    char buffer[1024];
+    const auto received = recv(client.socket, buffer, sizeof(buffer), 0);
+    if (received == 0)
+    {
+        return false;
+    }
+    if (received < 0)
+    {
+        return Utility::socketWouldBlock();
+    }
+    client.request.append(buffer, received);
+    if (client.request.size() > MAX_REQUEST_SIZE)
+    {
+        return false;
+    }
+    if (client.request.find("\r\n\r\n") != std::string::npos || client.request.find("\n\n") != std::string::npos)
+    {
+        buildResponse(client);
+    }
+    return true;
+}
+
+void MetricsEndpoint::buildResponse(Client& client)
+{
+    const bool isMetrics = client.request.compare(0, 13, "GET /metrics ") == 0 ||
+                           client.request.compare(0, 6, "GET / ") == 0;
+    if (!isMetrics)
+    {
+        client.response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        return;
+    }
+
+    const std::string* page;
+    {
+        Metrics::ScopedTimer timer(renderLatency);
+        page = &renderer.render();
+    }
+    scrapes.inc();
+
+    char header[160];
+    const int headerLength = snprintf(header, sizeof(header),
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        page->size());
+    client.response.reserve(headerLength + page->size());
+    client.response.assign(header, headerLength);
+    client.response += *page;
+}
+
+bool MetricsEndpoint::writeResponse(Client& client)
+{
+    while (client.responseOffset < client.response.size())
+    {
+        const auto sent = send(client.socket, client.response.data() + client.responseOffset,
+                               client.response.size() - client.responseOffset, SOCK_SEND_FLAGS);
+        if (sent < 0)
+        {
+            return Utility::socketWouldBlock();
+        }
+        client.responseOffset += sent;
+    }
+    // HTTP/1.0 with Connection: close, the page is done once it is sent
+    return false;
+}
@@ -0,0 +1,65 @@
+
+#pragma once
+
+#include "utility/platform_socket.hpp"
+#include "utility/metrics_exporter.hpp"
+
+#ifndef PLATFORM_MSVC
+  #include <poll.h>
+#endif
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Minimal HTTP/1.0 endpoint serving the metrics registry in Prometheus text
+// format on a loopback port. It has no thread of its own: the owner's poll
+// loop adds the endpoint's sockets to its poll set and hands back the results.
+class MetricsEndpoint
+{
+public:
+    MetricsEndpoint(uint16_t port);
+
+    ~MetricsEndpoint();
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    // binds 127.0.0.1:port
+    bool initialize();
+
+    // appends this endpoint's pollfds to pfds
+    void preparePoll(std::vector<pollfd>& pfds) const;
+
+    // pfds points at the entries preparePoll appended; call every poll
+    // round, even when nothing happened, so idle clients time out
+    void processPoll(const pollfd* pfds);
+
+    void shutdown();
+private:
+    struct Client
+    {
+        SocketType socket;
+        std::string request;
+        std::string response;
+        size_t responseOffset = 0;
+        // closed if the exchange is not over by then
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    uint16_t port;
+    SocketType listenSocket = INVALID_SOCKET;
+    std::vector<Client> clients;
+    Metrics::PrometheusRenderer renderer;
+    Metrics::Counter scrapes;
+    Metrics::Histogram renderLatency;
+
+    void acceptClient();
+
+    // false once the client should be closed
+    bool readRequest(Client& client);
+
+    bool writeResponse(Client& client);
+
+    void buildResponse(Client& client);
+};
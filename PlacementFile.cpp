@@ -0,0 +1,238 @@
+#include "PlacementFile.hpp"
+#include "WorldState.hpp"
+#include "utility/log.hpp"
+#include "utility/platform.hpp"
+#include "json.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string.h>
+
+constexpr uint32_t PlacementFile::NO_OWNER;
+
+namespace
+{
+    const uint8_t PLACEMENT_MAGIC[8] = { 'W', 'W', 'H', 'D', 'P', 'L', 'C', 2 };
+    constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+}
+
+bool PlacementFile::open(const std::string& path)
+{
+    file.close();
+    image.clear();
+    header = nullptr;
+
+    Utility::FileStamp source;
+    if (!Utility::stampFile(path.c_str(), source))
+    {
+        PLATFORM_LOG_ERROR(General, "could not open %s\n", path.c_str());
+        return false;
+    }
+    if (file.open(path + ".bin") && attach(file.data(), file.size(), source))
+    {
+        return true;
+    }
+    file.close();
+    // a change after the stamp was taken leaves the .bin stale, so it is
+    // rebuilt on the next open
+    return convert(path, source);
+}
+
+bool PlacementFile::section(const std::string& name, const char*& text, size_t& length) const
+{
+    for (uint64_t i = 0; header != nullptr && i < header->sectionCount; i++)
+    {
+        const Section& entry = sections[i];
+        if (entry.nameLength == name.size() && memcmp(base + entry.nameOffset, name.data(), name.size()) == 0)
+        {
+            text = reinterpret_cast<const char*>(base + entry.textOffset);
+            length = static_cast<size_t>(entry.textLength);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PlacementFile::attach(const uint8_t* data, size_t length, const Utility::FileStamp& source)
+{
+    const Header* candidate = reinterpret_cast<const Header*>(data);
+    if (length < sizeof(Header) || memcmp(candidate->magic, PLACEMENT_MAGIC, sizeof(PLACEMENT_MAGIC)) != 0 ||
+        candidate->byteOrder != BYTE_ORDER_MARK || candidate->sourceSize != source.size ||
+        candidate->sourceModifiedNs != source.modifiedNs || candidate->sourceInode != source.inode ||
+        candidate->fileSize != length ||
+        candidate->worldCount > MAX_PLAYERS || candidate->slotCount > uint64_t(MAX_PLAYERS) * MAX_LOCATIONS ||
+        candidate->sectionCount > length / sizeof(Section))
+    {
+        return false;
+    }
+    // everything else is only checked for fitting in the file
+    const size_t worldsOffset = sizeof(Header);
+    const size_t routesOffset = worldsOffset + candidate->worldCount * sizeof(WorldSlots);
+    const size_t sectionsOffset = routesOffset + static_cast<size_t>(candidate->slotCount) * sizeof(Route);
+    if (sectionsOffset + candidate->sectionCount * sizeof(Section) > length)
+    {
+        return false;
+    }
+    const WorldSlots* slots = reinterpret_cast<const WorldSlots*>(data + worldsOffset);
+    for (uint32_t world = 0; world < candidate->worldCount; world++)
+    {
+        if (slots[world].span > MAX_LOCATIONS || uint64_t(slots[world].first) + slots[world].span > candidate->slotCount)
+        {
+            return false;
+        }
+    }
+    const Section* entries = reinterpret_cast<const Section*>(data + sectionsOffset);
+    for (uint64_t i = 0; i < candidate->sectionCount; i++)
+    {
+        if (entries[i].nameOffset > length || entries[i].nameLength > length - entries[i].nameOffset ||
+            entries[i].textOffset > length || entries[i].textLength > length - entries[i].textOffset)
+        {
+            return false;
+        }
+    }
+    base = data;
+    header = candidate;
+    worlds = slots;
+    routes = reinterpret_cast<const Route*>(data + routesOffset);
+    sections = entries;
+    return true;
+}
+
+bool PlacementFile::convert(const std::string& path, const Utility::FileStamp& source)
+{
+    nlohmann::json json;
+    {
+        Utility::MappedFile text;
+        if (!text.open(path))
+        {
+            PLATFORM_LOG_ERROR(General, "could not open %s\n", path.c_str());
+            return false;
+        }
+        json = nlohmann::json::parse(text.data(), text.data() + text.size(), nullptr, false);
+    }
+    const auto placements = json.is_object() ? json.find("placements") : json.end();
+    if (!json.is_object() || placements == json.end() || !placements->is_array())
+    {
+        PLATFORM_LOG_ERROR(General, "%s is not a placement file\n", path.c_str());
+        return false;
+    }
+
+    std::vector<uint32_t> spans;
+    for (const nlohmann::json& placement : *placements)
+    {
+        if (!placement.is_array() || placement.size() != 4 ||
+            !placement[0].is_number_unsigned() || !placement[1].is_number_unsigned() ||
+            !placement[2].is_number_unsigned() || !placement[3].is_number_unsigned() ||
+            placement[0].get<uint64_t>() >= MAX_PLAYERS || placement[1].get<uint64_t>() >= MAX_LOCATIONS ||
+            placement[2].get<uint64_t>() >= NO_OWNER || placement[3].get<uint64_t>() > UINT32_MAX)
+        {
+            PLATFORM_LOG_ERROR(General, "%s: malformed placement %s\n", path.c_str(), placement.dump().c_str());
+            return false;
+        }
+        const uint32_t world = placement[0].get<uint32_t>();
+        if (world >= spans.size())
+        {
+            spans.resize(world + 1, 0);
+        }
+        spans[world] = std::max(spans[world], placement[1].get<uint32_t>() + 1);
+    }
+    std::vector<std::pair<std::string, std::string>> texts;
+    size_t textBytes = 0;
+    for (auto value = json.begin(); value != json.end(); ++value)
+    {
+        if (value.key() != "placements")
+        {
+            texts.emplace_back(value.key(), value->dump());
+            textBytes += value.key().size() + texts.back().second.size();
+        }
+    }
+
+    uint64_t slotCount = 0;
+    for (const uint32_t span : spans)
+    {
+        slotCount += span;
+    }
+    const size_t worldsOffset = sizeof(Header);
+    const size_t routesOffset = worldsOffset + spans.size() * sizeof(WorldSlots);
+    const size_t sectionsOffset = routesOffset + static_cast<size_t>(slotCount) * sizeof(Route);
+    const size_t textOffset = sectionsOffset + texts.size() * sizeof(Section);
+    const size_t fileSize = (textOffset + textBytes + 7) & ~size_t(7);
+    image.assign(fileSize / sizeof(uint64_t), 0);
+    uint8_t* out = reinterpret_cast<uint8_t*>(image.data());
+
+    Header& head = *reinterpret_cast<Header*>(out);
+    memcpy(head.magic, PLACEMENT_MAGIC, sizeof(PLACEMENT_MAGIC));
+    head.byteOrder = BYTE_ORDER_MARK;
+    head.worldCount = static_cast<uint32_t>(spans.size());
+    head.sourceSize = source.size;
+    head.sourceModifiedNs = source.modifiedNs;
+    head.sourceInode = source.inode;
+    head.routeCount = 0;
+    head.slotCount = slotCount;
+    head.sectionCount = texts.size();
+    head.fileSize = fileSize;
+
+    WorldSlots* slots = reinterpret_cast<WorldSlots*>(out + worldsOffset);
+    uint32_t first = 0;
+    for (size_t world = 0; world < spans.size(); world++)
+    {
+        slots[world] = WorldSlots{ first, spans[world] };
+        first += spans[world];
+    }
+    Route* slotRoutes = reinterpret_cast<Route*>(out + routesOffset);
+    for (uint64_t i = 0; i < slotCount; i++)
+    {
+        slotRoutes[i] = Route{ NO_OWNER, 0 };
+    }
+    // a later placement for the same location replaces the earlier one
+    for (const nlohmann::json& placement : *placements)
+    {
+        Route& route = slotRoutes[slots[placement[0].get<uint32_t>()].first + placement[1].get<uint32_t>()];
+        head.routeCount += route.owner == NO_OWNER;
+        route = Route{ placement[2].get<uint32_t>(), placement[3].get<uint32_t>() };
+    }
+    Section* entries = reinterpret_cast<Section*>(out + sectionsOffset);
+    size_t cursor = textOffset;
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        entries[i].nameOffset = cursor;
+        entries[i].nameLength = texts[i].first.size();
+        memcpy(out + cursor, texts[i].first.data(), texts[i].first.size());
+        cursor += texts[i].first.size();
+        entries[i].textOffset = cursor;
+        entries[i].textLength = texts[i].second.size();
+        memcpy(out + cursor, texts[i].second.data(), texts[i].second.size());
+        cursor += texts[i].second.size();
+    }
+
+    // written beside the source and renamed into place, so a reader never
+    // maps half of one
+    const std::string cachePath = path + ".bin";
+    const std::string temporary = cachePath + ".tmp";
+    std::FILE* cache = std::fopen(temporary.c_str(), "wb");
+    bool written = false;
+    if (cache != nullptr)
+    {
+        written = std::fwrite(out, 1, fileSize, cache) == fileSize && Utility::syncFile(cache);
+        std::fclose(cache);
+        written = written && Utility::replaceFile(temporary.c_str(), cachePath.c_str());
+        if (!written)
+        {
+            std::remove(temporary.c_str());
+        }
+    }
+    if (written && file.open(cachePath) && attach(file.data(), file.size(), source))
+    {
+        image.clear();
+        image.shrink_to_fit();
+    }
+    else
+    {
+        PLATFORM_LOG_WARN(General, "could not write %s; keeping %s converted in memory\n", cachePath.c_str(), path.c_str());
+        file.close();
+        attach(out, fileSize, source);
+    }
+    PLATFORM_LOG_INFO(General, "converted %s: %zu placements over %u worlds\n", path.c_str(),
+                      size(), worldCount());
+    return true;
+}
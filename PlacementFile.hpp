@@ -0,0 +1,108 @@
+#pragma once
+
+#include "RoutingTable.hpp"
+#include "utility/mapped_file.hpp"
+#include "utility/platform.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A placement (or full spoiler) file in a compact binary form that is read
+// straight out of a mapping. The JSON is parsed once, the first time the
+// file is opened, and the result kept next to it as <path>.bin; after that
+// opening it maps the .bin and checks its header, so the cost does not grow
+// with the seed. Pages are only read as lookups touch them.
+//
+// Routes are dense per world, indexed by location, so a lookup is two loads.
+// Every other top-level value of the JSON (the spoiler log, settings, ...)
+// is kept as its JSON text and only parsed by whoever asks for it.
+//
+// The .bin is in this machine's byte order and is stamped with the source's
+// size, nanosecond modification time and inode, so an edit within the same
+// second or a file renamed over the source is noticed; one that does not
+// match is rebuilt.
+class PlacementFile
+{
+public:
+    PlacementFile() = default;
+
+    PlacementFile(const PlacementFile&) = delete;
+    PlacementFile& operator=(const PlacementFile&) = delete;
+
+    // Opens path, a placement file in the RoutingTable::loadFile format,
+    // converting it first if its .bin is missing or stale. If the .bin
+    // cannot be written the converted form is kept in memory instead.
+    bool open(const std::string& path);
+
+    // nullptr if nothing is placed there; only after open() succeeded
+    const Route* find(uint32_t world, uint32_t location) const
+    {
+        if (world >= header->worldCount || location >= worlds[world].span)
+        {
+            return nullptr;
+        }
+        const Route* route = &routes[worlds[world].first + location];
+        return route->owner != NO_OWNER ? route : nullptr;
+    }
+
+    size_t size() const { return header != nullptr ? header->routeCount : 0; }
+
+    // one past the highest world anything is placed in
+    uint32_t worldCount() const { return header != nullptr ? header->worldCount : 0; }
+
+    // The JSON text of a top-level value other than "placements", to parse
+    // with nlohmann::json::parse(text, text + length); false if there is none.
+    bool section(const std::string& name, const char*& text, size_t& length) const;
+
+    // true if this came out of a mapped .bin rather than a fresh conversion
+    bool isMapped() const { return file.isMapped(); }
+private:
+    // marks an empty slot; a placement with this owner is refused
+    static constexpr uint32_t NO_OWNER = UINT32_MAX;
+
+    struct Header
+    {
+        uint8_t magic[8];
+        uint32_t byteOrder;
+        uint32_t worldCount;
+        uint64_t sourceSize;
+        int64_t sourceModifiedNs;
+        uint64_t sourceInode;
+        uint64_t routeCount;
+        uint64_t slotCount;
+        uint64_t sectionCount;
+        uint64_t fileSize;
+    };
+
+    struct WorldSlots
+    {
+        // index of the world's location 0 in the route slots
+        uint32_t first;
+        // one past its highest placed location
+        uint32_t span;
+    };
+
+    struct Section
+    {
+        uint64_t nameOffset;
+        uint64_t nameLength;
+        uint64_t textOffset;
+        uint64_t textLength;
+    };
+
+    Utility::MappedFile file;
+    // the converted form when it could not be written out
+    std::vector<uint64_t> image;
+    const uint8_t* base = nullptr;
+    const Header* header = nullptr;
+    const WorldSlots* worlds = nullptr;
+    const Route* routes = nullptr;
+    const Section* sections = nullptr;
+
+    // points the members into data, if it is a valid image for the source
+    bool attach(const uint8_t* data, size_t length, const Utility::FileStamp& source);
+
+    bool convert(const std::string& path, const Utility::FileStamp& source);
+};
@@ -0,0 +1,77 @@
+#include "Playthrough.hpp"
+#include "utility/bits.hpp"
+
+void computePlaythrough(const LogicGraph& logic, const RoutingTable& placement, uint32_t worlds, Playthrough& out)
+{
+    out.beatable = false;
+    out.sphereStart.assign(1, 0);
+    out.locations.clear();
+    out.failure.clear();
+
+    std::vector<uint8_t> counts(static_cast<size_t>(worlds) * MAX_ITEMS);
+    std::vector<uint64_t> collected(static_cast<size_t>(worlds) * LOCATION_WORDS);
+    std::vector<LogicState> states(worlds);
+    for (uint32_t world = 0; world < worlds; world++)
+    {
+        states[world].evaluateAll(logic, &counts[world * MAX_ITEMS]);
+    }
+
+    std::vector<Route> found;
+    std::vector<uint32_t> cameIntoLogic;
+    while (true)
+    {
+        uint32_t stuckWorld = UINT32_MAX;
+        for (uint32_t world = 0; world < worlds && stuckWorld == UINT32_MAX; world++)
+        {
+            if (!states[world].reachesGoal(logic))
+            {
+                stuckWorld = world;
+            }
+        }
+        if (stuckWorld == UINT32_MAX)
+        {
+            out.beatable = true;
+            return;
+        }
+
+        // in logic and not collected yet
+        found.clear();
+        for (uint32_t world = 0; world < worlds; world++)
+        {
+            const uint64_t* reachable = states[world].locationWords();
+            uint64_t* taken = &collected[world * LOCATION_WORDS];
+            for (size_t i = 0; i < LOCATION_WORDS; i++)
+            {
+                const uint64_t fresh = reachable[i] & ~taken[i];
+                taken[i] |= fresh;
+                for (uint64_t word = fresh; word != 0; word &= word - 1)
+                {
+                    const uint32_t location = static_cast<uint32_t>(i * 64 + Utility::countTrailingZeros(word));
+                    out.locations.push_back(SphereLocation{ world, location });
+                    const Route* route = placement.find(world, location);
+                    if (route != nullptr && route->owner < worlds && route->item < MAX_ITEMS)
+                    {
+                        found.push_back(*route);
+                    }
+                }
+            }
+        }
+        if (out.locations.size() == out.sphereStart.back())
+        {
+            out.failure = "world " + std::to_string(stuckWorld) + " cannot reach its goal; " +
+                          (out.sphereCount() == 0 ? std::string("nothing is in logic at the start") :
+                           "progress stops after sphere " + std::to_string(out.sphereCount() - 1));
+            return;
+        }
+        out.sphereStart.push_back(static_cast<uint32_t>(out.locations.size()));
+
+        // only usable from the next sphere on
+        for (const Route& route : found)
+        {
+            uint8_t& count = counts[route.owner * MAX_ITEMS + route.item];
+            count += count != UINT8_MAX;
+            states[route.owner].addItem(logic, &counts[route.owner * MAX_ITEMS], route.item, cameIntoLogic);
+        }
+        cameIntoLogic.clear();
+    }
+}
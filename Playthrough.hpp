@@ -0,0 +1,39 @@
+#pragma once
+
+#include "LogicGraph.hpp"
+#include "RoutingTable.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Playthrough spheres for a multiworld placement: sphere 0 is every location
+// in logic with no items, and sphere n + 1 every location that came into
+// logic once the items found up to sphere n reached their owners. What each
+// world has reached and collected is a bitset over its locations, so a
+// sphere is a few word operations per world, and the items it hands out
+// update their owners' logic incrementally (LogicState::addItem).
+
+struct SphereLocation
+{
+    uint32_t world;
+    uint32_t location;
+};
+
+struct Playthrough
+{
+    bool beatable = false;
+    // sphere n is locations [sphereStart[n], sphereStart[n + 1])
+    std::vector<uint32_t> sphereStart;
+    std::vector<SphereLocation> locations;
+    // why not, when not beatable
+    std::string failure;
+
+    size_t sphereCount() const { return sphereStart.empty() ? 0 : sphereStart.size() - 1; }
+};
+
+// Collects spheres over worlds copies of logic, with the item at each
+// location taken from placement, until every world reaches its goal
+// (beatable) or a sphere finds nothing new (not; this stops right there).
+void computePlaythrough(const LogicGraph& logic, const RoutingTable& placement, uint32_t worlds, Playthrough& out);
@@ -0,0 +1,68 @@
+
+#include "Protocol.hpp"
+#include "utility/byteswap.hpp"
+
+#include <string.h>
+
+namespace Protocol
+{
+    const char* messageTypeName(MessageType type)
+    {
+        switch (type)
+        {
+        #define PROTOCOL_MESSAGE_NAME(name, value, label) case MessageType::name: return label;
+            PROTOCOL_MESSAGE_TYPES(PROTOCOL_MESSAGE_NAME)
+        #undef PROTOCOL_MESSAGE_NAME
+        default:
+            return "unknown";
+        }
+    }
+
+    bool isKnownMessageType(MessageType type)
+    {
+        return static_cast<uint16_t>(type) < MESSAGE_TYPE_COUNT;
+    }
+
+    FrameHeader decodeHeader(const uint8_t* data)
+    {
+        uint32_t length;
+        uint16_t type;
+        uint16_t flags;
+        memcpy(&length, data, sizeof(length));
+        memcpy(&type, data + 4, sizeof(type));
+        memcpy(&flags, data + 6, sizeof(flags));
+
+        FrameHeader header;
+        header.length = Utility::fromBigEndian(length);
+        header.type = static_cast<MessageType>(Utility::fromBigEndian(type));
+        header.flags = Utility::fromBigEndian(flags);
+        return header;
+    }
+
+    void encodeHeader(const FrameHeader& header, uint8_t* out)
+    {
+        const uint32_t length = Utility::toBigEndian(header.length);
+        const uint16_t type = Utility::toBigEndian(static_cast<uint16_t>(header.type));
+        const uint16_t flags = Utility::toBigEndian(header.flags);
+        memcpy(out, &length, sizeof(length));
+        memcpy(out + 4, &type, sizeof(type));
+        memcpy(out + 6, &flags, sizeof(flags));
+    }
+
+    void encodeError(ErrorCode code, uint8_t* out)
+    {
+        const uint16_t value = Utility::toBigEndian(static_cast<uint16_t>(code));
+        memcpy(out, &value, sizeof(value));
+    }
+
+    void appendFrame(std::vector<uint8_t>& out, MessageType type, const uint8_t* payload, size_t length, uint16_t flags)
+    {
+        const size_t offset = out.size();
+        out.resize(offset + FRAME_HEADER_SIZE + length);
+        encodeHeader({ static_cast<uint32_t>(length), type, flags }, out.data() + offset);
+        if (length != 0)
+        {
+            memcpy(out.data() + offset + FRAME_HEADER_SIZE, payload, length);
+        }
+    }
+}
@@ -0,0 +1,190 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Wire format: every message is a frame of an 8 byte big-endian header
+// (payload length, message type, flags) followed by the payload.
+//
+// Every request gets exactly one reply, in order, on the same connection:
+//   Ping            any bytes               -> Pong with the same bytes
+//   ItemSend        {"world", "item"}       -> Ack
+//   LocationCheck   {"world", "location"}   -> Ack
+//                   Both: Error Unavailable while the event log cannot be
+//                   written, as nothing would survive a restart
+//   TrackerQuery    {"world"}               -> TrackerState {"world", "version", "items": [[id, count]...], "checked": [ids]},
+//                                              plus "in_logic": [ids] when the server has the seed's logic
+//   Join            {"world"}               -> Ack, and this connection now receives that world's items
+//   FlagSync        FLAG_SYNC_PAYLOAD_SIZE raw bytes: the sender's event flags
+//                   then stage flags, as in its save data -> Ack
+//   TrackerSubscribe {"world", "version"?, "rate_hz"?}
+//                                           -> Ack, and this connection now follows that world's
+//                                              tracker state, starting from version if given;
+//                                              with rate_hz (1 to MAX_TRACKER_RATE_HZ) changes are
+//                                              coalesced and sent at most that many times a second
+//   Subscribe       repeated u32 big-endian topic ids -> Ack, and this connection now
+//                   receives what is published to them
+//   Unsubscribe     repeated u32 big-endian topic ids -> Ack
+//   Publish         u32 big-endian topic id, then the message body -> Ack
+//   GenerateSeed    {"settings": {"worlds"?, "junk_item"?}, "seed"?}
+//                                           -> SeedQueued {"job", "settings_hash", "seed", "cached"},
+//                                              then SeedProgress and SeedResult pushes for that job
+//                                              (job 0: cached, the SeedResult follows at once);
+//                                              Error Unavailable if the server has no logic, or
+//                                              past MAX_QUEUED_SEED_JOBS uncached jobs waited on
+//                                              here or MAX_SEED_JOBS (SeedService.hpp) overall
+//   TransferRequest {"file": name} (from the server's transfer directory) or
+//                   {"seed", "settings_hash"} (a generated seed's placements
+//                   array, as in SeedResult), plus "offset"? and "digest"?
+//                                           -> TransferStart {"transfer", "size", "chunk_size", "offset", "digest"},
+//                                              then TransferChunk pushes from offset to the end;
+//                                              Error NotFound for a file or seed the server does
+//                                              not have, Unavailable past MAX_QUEUED_TRANSFERS
+//                   To resume after a reconnect, ask again with the offset
+//                   (a multiple of chunk_size) of the first chunk missing and
+//                   the digest from the earlier TransferStart; if the payload
+//                   changed since, it starts over from offset 0. A file that
+//                   changes mid-transfer drops the connection, to be resumed
+//                   the same way.
+// and anything unknown or malformed gets an Error frame instead. The one
+// exception is TrackerAck, which gets no reply:
+//   TrackerAck      u64 big-endian version: the newest tracker state applied
+//
+// The server also pushes frames that are not replies and can arrive between
+// them:
+//   ItemReceived    {"item", "from", "location"}   an item from another world's
+//                                                  check (or a queued one, right
+//                                                  after Join)
+//   FlagUpdate      repeated (u16 big-endian word index, the 8 raw bytes of
+//                   that word of the room's shared flags): every word a
+//                   FlagSync from another joined player changed
+//   TrackerState    as above, when a subscriber is new or too far behind for
+//                   a delta
+//   TrackerDelta    u64 big-endian from version, u64 big-endian to version,
+//                   then repeated (u8 kind, u8 value, u16 big-endian id): the
+//                   changes since the subscriber's last update, see
+//                   TrackerSync.hpp
+//   TopicMessage    u32 big-endian topic id, u32 big-endian world of the
+//                   publisher (UINT32_MAX if it has not joined), then the
+//                   body: a Publish from another connection to a subscribed
+//                   topic. A subscriber that falls megabytes behind on
+//                   reading misses messages until it catches up
+//   SeedProgress    {"job", "done", "total"}   progression items placed so far
+//   SeedResult      {"job", "settings_hash", "seed", "placements": [...]} in
+//                   the placement file format (RoutingTable::loadFile), or
+//                   {"job", "settings_hash", "seed", "size"} when the
+//                   placements do not fit in a frame (fetch them with
+//                   TransferRequest), or {"job", "settings_hash", "seed", "error"}
+//   TransferChunk   u32 big-endian transfer id, u64 big-endian offset, u32
+//                   big-endian CRC-32 of the data, then the data: chunk_size
+//                   bytes, fewer for the last chunk. Chunks only go out while
+//                   nothing else is waiting to, so replies are never stuck
+//                   behind a transfer, and transfers on one connection go one
+//                   after another
+//
+// Topic ids are below MAX_TOPICS (TopicBus.hpp) and are the clients' to
+// assign: a chat channel, a hint feed, a race's events. The server only
+// fans the bodies out.
+
+namespace Protocol
+{
+    // X(name, value, label) for every message type; label is what metrics and
+    // logs call it
+    #define PROTOCOL_MESSAGE_TYPES(X) \
+        X(Ping, 0, "ping") \
+        X(Pong, 1, "pong") \
+        X(Error, 2, "error") \
+        X(Ack, 3, "ack") \
+        X(ItemSend, 4, "item_send") \
+        X(LocationCheck, 5, "location_check") \
+        X(TrackerQuery, 6, "tracker_query") \
+        X(TrackerState, 7, "tracker_state") \
+        X(Join, 8, "join") \
+        X(ItemReceived, 9, "item_received") \
+        X(FlagSync, 10, "flag_sync") \
+        X(FlagUpdate, 11, "flag_update") \
+        X(TrackerSubscribe, 12, "tracker_subscribe") \
+        X(TrackerAck, 13, "tracker_ack") \
+        X(TrackerDelta, 14, "tracker_delta") \
+        X(Subscribe, 15, "subscribe") \
+        X(Unsubscribe, 16, "unsubscribe") \
+        X(Publish, 17, "publish") \
+        X(TopicMessage, 18, "topic_message") \
+        X(GenerateSeed, 19, "generate_seed") \
+        X(SeedQueued, 20, "seed_queued") \
+        X(SeedProgress, 21, "seed_progress") \
+        X(SeedResult, 22, "seed_result") \
+        X(TransferRequest, 23, "transfer_request") \
+        X(TransferStart, 24, "transfer_start") \
+        X(TransferChunk, 25, "transfer_chunk")
+
+    enum class MessageType : uint16_t
+    {
+    #define PROTOCOL_MESSAGE_ENUM(name, value, label) name = value,
+        PROTOCOL_MESSAGE_TYPES(PROTOCOL_MESSAGE_ENUM)
+    #undef PROTOCOL_MESSAGE_ENUM
+        Count
+    };
+
+    constexpr size_t MESSAGE_TYPE_COUNT = static_cast<size_t>(MessageType::Count);
+
+    constexpr size_t FRAME_HEADER_SIZE = 8;
+
+    // larger frames are a protocol error and drop the connection
+    constexpr uint32_t MAX_FRAME_PAYLOAD = 1 << 20;
+
+    struct FrameHeader
+    {
+        uint32_t length;
+        MessageType type;
+        uint16_t flags;
+    };
+
+    // Error frames carry the big-endian error code as their payload
+    enum class ErrorCode : uint16_t
+    {
+        UnknownMessageType = 1,
+        MalformedPayload = 2,
+        // the server is not set up for the request
+        Unavailable = 3,
+        // what the request names does not exist
+        NotFound = 4,
+    };
+
+    constexpr size_t ERROR_PAYLOAD_SIZE = 2;
+
+    constexpr size_t FLAG_SYNC_PAYLOAD_SIZE = 768;
+    constexpr size_t FLAG_UPDATE_ENTRY_SIZE = 10;
+
+    constexpr size_t TRACKER_ACK_PAYLOAD_SIZE = 8;
+    constexpr size_t TRACKER_DELTA_HEADER_SIZE = 16;
+    constexpr size_t TRACKER_DELTA_ENTRY_SIZE = 4;
+    constexpr uint32_t MAX_TRACKER_RATE_HZ = 60;
+
+    constexpr size_t TOPIC_ID_SIZE = 4;
+    constexpr size_t TOPIC_MESSAGE_HEADER_SIZE = 8;
+    // larger Publish bodies are malformed
+    constexpr size_t MAX_TOPIC_BODY = 4096;
+
+    constexpr size_t TRANSFER_CHUNK_HEADER_SIZE = 16;
+    // transfers started and not finished on one connection
+    constexpr size_t MAX_QUEUED_TRANSFERS = 8;
+    // GenerateSeed jobs one connection waits on
+    constexpr size_t MAX_QUEUED_SEED_JOBS = 4;
+
+    // "unknown" for anything outside the known range
+    const char* messageTypeName(MessageType type);
+
+    bool isKnownMessageType(MessageType type);
+
+    FrameHeader decodeHeader(const uint8_t* data);
+
+    void encodeHeader(const FrameHeader& header, uint8_t* out);
+
+    void encodeError(ErrorCode code, uint8_t* out);
+
+    // appends a complete frame to out
+    void appendFrame(std::vector<uint8_t>& out, MessageType type, const uint8_t* payload, size_t length, uint16_t flags = 0);
+}
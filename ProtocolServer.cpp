@@ -1,24 +1,251 @@
 
 #include "ProtocolServer.hpp"
+#include "Playthrough.hpp"
+#include "utility/log.hpp"
+#include "utility/platform.hpp"
+#include "utility/trace.hpp"
+#include "utility/bits.hpp"
+#include "utility/byteswap.hpp"
+#include "json.hpp"
 
 #ifndef PLATFORM_MSVC
   #include <arpa/inet.h>
-  #include <sys/types.h> 
+  #include <sys/types.h>
   #include <sys/socket.h>
   #include <poll.h>
   #include <unistd.h>
   #include <errno.h>
 #endif
 
+#include <algorithm>
 #include <string.h>
+#include <string>
 #include <thread>
 #include <chrono>
 
 constexpr long POLL_TIMEOUT_MSEC = 100; // 100 ms
+// while replies wait on an event log commit, poll often enough to notice it
+constexpr long HELD_POLL_TIMEOUT_MSEC = 1;
+constexpr size_t READ_CHUNK_SIZE = 16 * 1024;
+// stop reading from a client that is not draining its responses
+constexpr size_t MAX_PENDING_WRITE = 1024 * 1024;
+// a subscriber with this much still to send misses topic messages until it
+// catches up, so one that never reads cannot grow without bound
+constexpr size_t MAX_PUBLISHED_BACKLOG = 4 * MAX_PENDING_WRITE;
+// a subscriber this many versions short of acknowledging what it was sent is
+// not sent more until it catches up; by then it may need a full TrackerState
+constexpr uint64_t MAX_UNACKED_VERSIONS = ChangeLog::CAPACITY / 2;
+// transfer directory files kept open, with their checksums
+constexpr size_t MAX_TRANSFER_FILES = 16;
+// transfer data allowed to wait in a socket to go out; replies queued after
+// it wait on no more than this
+constexpr size_t TRANSFER_WINDOW = 2 * TRANSFER_CHUNK_SIZE;
+// one room per server for now, so one worker runs it
+constexpr unsigned ROOM_WORKERS = 1;
+// times settleRoom yields to the room's worker before sleeping on it
+constexpr unsigned SETTLE_SPINS = 64;
 
-ProtocolServer::ProtocolServer(uint16_t port) : port(port), acceptingClients(false)
+static uint32_t readBigEndian32(const uint8_t* data)
 {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return Utility::fromBigEndian(value);
+}
+
+static void writeBigEndian32(uint8_t* out, uint32_t value)
+{
+    value = Utility::toBigEndian(value);
+    memcpy(out, &value, sizeof(value));
+}
+
+static bool isUnsignedField(const nlohmann::json& object, const char* name)
+{
+    const auto found = object.find(name);
+    return found != object.end() && found->is_number_unsigned() && found->get<uint64_t>() <= UINT32_MAX;
+}
+
+ProtocolServer::ServerMetrics::ServerMetrics()
+{
+    Metrics::Registry& registry = Metrics::registry();
+    accepts = registry.counter("wwhd_accepts_total", "Client connections accepted");
+    acceptErrors = registry.counter("wwhd_accept_errors_total", "Failed accept calls");
+    protocolErrors = registry.counter("wwhd_protocol_errors_total", "Connections dropped for malformed frames");
+    activeConnections = registry.gauge("wwhd_active_connections", "Currently connected clients");
+    bytesReceived = registry.counter("wwhd_received_bytes_total", "Bytes read from clients");
+    bytesSent = registry.counter("wwhd_sent_bytes_total", "Bytes written to clients");
+    sendQueueBytes = registry.gauge("wwhd_send_queue_bytes", "Bytes queued for clients but not yet sent");
+
+    itemsRouted = registry.counter("wwhd_items_routed_total", "Checked locations that routed an item to its owner");
+    itemsDelivered = registry.counter("wwhd_items_delivered_total", "Routed items sent to their owner's connection");
+    flagWordsChanged = registry.counter("wwhd_flag_words_changed_total", "Shared flag words changed by FlagSync and broadcast");
+    trackerDeltaBytes = registry.counter("wwhd_tracker_sync_bytes_total", "Tracker state pushed to subscribers, in payload bytes", "kind=\"delta\"");
+    trackerSnapshotBytes = registry.counter("wwhd_tracker_sync_bytes_total", "Tracker state pushed to subscribers, in payload bytes", "kind=\"snapshot\"");
+    topicPublishes = registry.counter("wwhd_topic_publishes_total", "Publish requests fanned out to topic subscribers");
+    topicDeliveries = registry.counter("wwhd_topic_deliveries_total", "TopicMessages queued for subscribers");
+    topicDrops = registry.counter("wwhd_topic_drops_total", "TopicMessages a subscriber missed for being too far behind");
+    transferChunks = registry.counter("wwhd_transfer_chunks_total", "TransferChunks sent");
+    transferBytes = registry.counter("wwhd_transfer_bytes_total", "Payload bytes sent in TransferChunks");
+    transferResumes = registry.counter("wwhd_transfer_resumes_total", "Transfers started past offset 0");
+    deliveriesQueued = registry.gauge("wwhd_deliveries_queued", "Routed items waiting for their owner to join");
+
+    for (size_t i = 0; i <= Protocol::MESSAGE_TYPE_COUNT; i++)
+    {
+        const std::string labels = std::string("type=\"") +
+            Protocol::messageTypeName(static_cast<Protocol::MessageType>(i)) + "\"";
+        framesReceived[i] = registry.counter("wwhd_frames_received_total", "Frames received by message type", labels);
+        handlerLatency[i] = registry.histogram("wwhd_handler_latency_ns", "Time spent handling one frame, in nanoseconds", labels);
+        if (i < Protocol::MESSAGE_TYPE_COUNT)
+        {
+            framesSent[i] = registry.counter("wwhd_frames_sent_total", "Frames sent by message type", labels);
+        }
+    }
+}
+
+constexpr uint32_t ProtocolServer::NO_PLAYER;
+
+static_assert(Protocol::FLAG_SYNC_PAYLOAD_SIZE == SHARED_FLAG_BYTES, "FlagSync carries the room's whole shared flag block");
+
+ProtocolServer::ProtocolServer(uint16_t port, uint16_t metricsPort) :
+    port(port), metricsPort(metricsPort), acceptingClients(false),
+    roomHost(ROOM_WORKERS, &ProtocolServer::roomHandled, this), room(roomHost.addRoom()), playerConnections(MAX_PLAYERS, nullptr),
+    trackerSubscribers(MAX_PLAYERS), worldChanged(MAX_PLAYERS, 0)
+{
+    room.setLogic(logic);
+}
+
+bool ProtocolServer::openEventLog(const std::string& path, std::chrono::microseconds commitInterval)
+{
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t covered = 0;
+    if (!snapshotPath.empty() && loadRoomSnapshot(snapshotPath, room.state(), room.changeLogs(), covered))
+    {
+        PLATFORM_LOG_INFO(General, "restored %u players from %s, covering %llu logged events\n",
+                          room.state().playerCount(), snapshotPath.c_str(), static_cast<unsigned long long>(covered));
+        room.evaluateLogic();
+    }
+    std::vector<LogRecord> records;
+    if (!eventLog.open(path, commitInterval, &records, covered))
+    {
+        if (covered == 0)
+        {
+            return false;
+        }
+        // the log was replaced or cut short behind the snapshot's back; it
+        // is what acknowledged events were promised on, so it wins
+        PLATFORM_LOG_WARN(General, "snapshot is ahead of the event log, replaying the whole log\n");
+        room.reset();
+        if (!eventLog.open(path, commitInterval, &records))
+        {
+            return false;
+        }
+    }
+    // Items routed before the restart are not queued for delivery again:
+    // some were delivered already. Reconnecting consoles resync from their
+    // TrackerState instead.
+    RoomMessage message;
+    message.recovered = true;
+    for (const LogRecord& record : records)
+    {
+        if (record.world >= MAX_PLAYERS)
+        {
+            continue;
+        }
+        if (record.event == LoggedEvent::ItemSend && record.id < MAX_ITEMS)
+        {
+            message.request = RoomRequest::ItemSend;
+        }
+        else if (record.event == LoggedEvent::LocationCheck && record.id < MAX_LOCATIONS)
+        {
+            message.request = RoomRequest::LocationCheck;
+        }
+        else
+        {
+            continue;
+        }
+        message.world = record.world;
+        message.id = record.id;
+        room.handle(message);
+    }
+    // nobody is subscribed yet
+    room.takeChangedWorlds(roomChanged);
+    PLATFORM_LOG_INFO(General, "replayed %zu logged events, room ready in %.1f ms\n", records.size(),
+                      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return true;
+}
+
+void ProtocolServer::setSnapshots(const std::string& path, std::chrono::seconds interval)
+{
+    snapshotPath = path;
+    snapshotInterval = interval;
+}
+
+bool ProtocolServer::saveSnapshot()
+{
+    if (snapshotPath.empty())
+    {
+        return false;
+    }
+    encodeRoomSnapshot(room.state(), room.changeLogs(), eventLog.recordCount(), snapshotImage);
+    return writeRoomSnapshot(snapshotPath, snapshotImage);
+}
+
+void ProtocolServer::snapshotIfDue()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (snapshotPath.empty() || !eventLog.isOpen() || now < nextSnapshot || snapshotWriter.busy())
+    {
+        return;
+    }
+    // the copy is the only part on this thread
+    encodeRoomSnapshot(room.state(), room.changeLogs(), eventLog.recordCount(), snapshotImage);
+    snapshotWriter.submit(snapshotImage, &eventLog, eventLog.lastBatch());
+    nextSnapshot = now + snapshotInterval;
+}
+
+bool ProtocolServer::loadPlacement(const std::string& path)
+{
+    return room.routing().loadFile(path);
+}
+
+bool ProtocolServer::loadLogic(const std::string& path)
+{
+    return logic.loadFile(path);
+}
+
+bool ProtocolServer::validatePlacement()
+{
+    const RoutingTable& routing = room.routing();
+    if (logic.empty() || routing.size() == 0)
+    {
+        return true;
+    }
+    if (routing.worldCount() > MAX_PLAYERS)
+    {
+        PLATFORM_LOG_ERROR(General, "placement has worlds past %u\n", MAX_PLAYERS);
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    Playthrough playthrough;
+    computePlaythrough(logic, routing, routing.worldCount(), playthrough);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!playthrough.beatable)
+    {
+        PLATFORM_LOG_ERROR(General, "placement is not beatable: %s\n", playthrough.failure.c_str());
+        return false;
+    }
+    PLATFORM_LOG_INFO(General, "placement for %u worlds is beatable in %zu spheres (checked in %.1f ms)\n",
+                      routing.worldCount(), playthrough.sphereCount(), ms);
+    return true;
+}
+
+void ProtocolServer::setSeedWorkers(unsigned workers)
+{
+    seedWorkers = workers;
+}
 
+void ProtocolServer::setTransferDirectory(const std::string& directory)
+{
+    transferDirectory = directory;
 }
 
 bool ProtocolServer::initialize()
@@ -28,6 +255,7 @@ bool ProtocolServer::initialize()
     {
         return false;
     }
+    Utility::setSocketReuseAddress(acceptSocket);
     memset(reinterpret_cast<char*>(&serverAddr), '\0', sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
@@ -36,66 +264,1397 @@ bool ProtocolServer::initialize()
     {
         return false;
     }
-    listen(acceptSocket, 5);
+    listen(acceptSocket, SOMAXCONN);
+
+    if (metricsPort != 0)
+    {
+        metricsEndpoint.reset(new MetricsEndpoint(metricsPort));
+        if (!metricsEndpoint->initialize())
+        {
+            PLATFORM_LOG_ERROR(Net, "could not listen for metrics on port %u\n", metricsPort);
+            metricsEndpoint.reset();
+            return false;
+        }
+    }
     return true;
 }
 
-void ProtocolServer::acceptCallback()
+void ProtocolServer::pollCallback()
 {
-    SocketType clientSocket = INVALID_SOCKET;
     int haveData;
-    socklen_t clientLen;
-    char clientIP[64];
-    sockaddr_in clientAddr{};
-    pollfd pfds[1]; // only need to hold one, but treat as an array for formality
+    std::vector<pollfd> pfds;
 
-    memset(clientIP, '\0', sizeof(clientIP));
-    pfds[0].fd = acceptSocket;
-    pfds[0].events = POLLIN;
-    clientLen = sizeof(clientAddr);
-
-    Utility::platformLog("starting accept loop\n");
+    PLATFORM_LOG_INFO(Net, "starting accept loop\n");
 
     while(acceptingClients)
     {
-        haveData = SOCK_POLL(pfds, 1, POLL_TIMEOUT_MSEC);
+        // slot 0 is the accept socket, slot i + 1 is connections[i]
+        const size_t polledConnections = connections.size();
+        bool holding = false;
+        pfds.resize(polledConnections + 1);
+        pfds[0].fd = acceptSocket;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        for (size_t i = 0; i < polledConnections; i++)
+        {
+            const Connection& connection = *connections[i];
+            pfds[i + 1].fd = connection.socket;
+            pfds[i + 1].events = 0;
+            pfds[i + 1].revents = 0;
+            if (connection.pendingWrite() < MAX_PENDING_WRITE)
+            {
+                pfds[i + 1].events |= POLLIN;
+            }
+            if (connection.sendableWrite() != 0 || !connection.transfers.empty())
+            {
+                pfds[i + 1].events |= POLLOUT;
+            }
+            holding |= !connection.held.empty();
+        }
+
+        const size_t metricsFirst = pfds.size();
+        if (metricsEndpoint)
+        {
+            metricsEndpoint->preparePoll(pfds);
+        }
+
+        // seed jobs are checked on for progress the same way as held replies
+        const bool generating = seeds && seeds->busy();
+        long timeout = holding || generating ? HELD_POLL_TIMEOUT_MSEC : POLL_TIMEOUT_MSEC;
+        if (!tickedSubscribers.empty())
+        {
+            // rounded up so the poll does not wake just short of the tick
+            const auto untilTick = nextTrackerTick - std::chrono::steady_clock::now();
+            timeout = std::min<long>(timeout, std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(untilTick).count() + 1));
+        }
+        haveData = SOCK_POLL(pfds.data(), pfds.size(), timeout);
+        if (haveData < 0)
+        {
+            PLATFORM_LOG_WARN(Net, "exited poll with errno %d\n", Utility::lastSocketError());
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        if (holding)
+        {
+            releaseDurableReplies();
+        }
+        syncTrackerTicks();
+        if (generating)
+        {
+            pollSeeds();
+        }
         if (haveData == 0)
         {
-            if(haveData < 0)
+            // still called, so idle scrape clients time out
+            if (metricsEndpoint)
             {
-                Utility::platformLog("exited poll with errno %d\n", errno);
-                std::this_thread::sleep_for(std::chrono::seconds(1));
+                metricsEndpoint->processPoll(&pfds[metricsFirst]);
             }
             continue;
         }
         if(pfds[0].revents & POLLIN)
         {
-            clientSocket = accept(acceptSocket, (struct sockaddr*)&clientAddr, &clientLen);
+            acceptClient();
         }
-        if(Utility::isSocketInvalid(clientSocket))
+
+        // backwards so closing (which swaps the last connection into place)
+        // never skips one; connections accepted above are not in pfds yet
+        for (size_t i = polledConnections; i-- > 0;)
         {
-            Utility::platformLog("client socket errno: %d\n", clientSocket);
-            continue;
+            const short revents = pfds[i + 1].revents;
+            if (revents == 0)
+            {
+                continue;
+            }
+            Connection& connection = *connections[i];
+            bool keep = true;
+            if (revents & (POLLERR | POLLNVAL))
+            {
+                keep = false;
+            }
+            if (keep && (revents & (POLLIN | POLLHUP)))
+            {
+                keep = readFromClient(connection) && processFrames(connection);
+            }
+            if (keep && (connection.pendingWrite() != 0 || !connection.transfers.empty()))
+            {
+                keep = flushClient(connection);
+            }
+            if (!keep)
+            {
+                closeClient(i);
+            }
         }
+
+        settleRoom();
+        deliverPending();
+        syncTrackers();
+        snapshotIfDue();
+
+        // scrapes are served last so protocol traffic in the same poll goes first
+        if (metricsEndpoint)
+        {
+            metricsEndpoint->processPoll(&pfds[metricsFirst]);
+        }
+    }
+}
+
+void ProtocolServer::acceptClient()
+{
+    TRACE_SAMPLE();
+    TRACE_SPAN(Accept, nextConnectionId, 0);
+    char clientIP[64];
+    sockaddr_in clientAddr{};
+    socklen_t clientLen = sizeof(clientAddr);
+
+    SocketType clientSocket = accept(acceptSocket, (struct sockaddr*)&clientAddr, &clientLen);
+    if(Utility::isSocketInvalid(clientSocket))
+    {
+        metrics.acceptErrors.inc();
+        PLATFORM_LOG_WARN(Net, "client socket errno: %d\n", Utility::lastSocketError());
+        return;
+    }
+    Utility::setSocketNonBlocking(clientSocket);
+    Utility::setSocketNoDelay(clientSocket);
+
+    std::unique_ptr<Connection> connection(new Connection());
+    connection->socket = clientSocket;
+    connection->id = nextConnectionId++;
+    assignSlot(*connection);
+    connections.push_back(std::move(connection));
+    if (capture != nullptr)
+    {
+        capture->recordOpen(connections.back()->id);
+    }
+    metrics.accepts.inc();
+    metrics.activeConnections.add();
+
+    // the address is only needed for the log line, so skip formatting it
+    // entirely when connection logging is off
+    if (PLATFORM_LOG_DEBUG_ENABLED(Net))
+    {
+        memset(clientIP, '\0', sizeof(clientIP));
         inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, sizeof(clientIP));
-        Utility::platformLog("client connected from addr %s\n", clientIP);
+        PLATFORM_LOG_DEBUG(Net, "client %u connected from addr %s\n", connections.back()->id, clientIP);
     }
 }
 
-bool ProtocolServer::start()
+bool ProtocolServer::readFromClient(Connection& connection)
 {
-    // TODO: check we are initialized
-    acceptingClients = true;
-    acceptThread = std::thread(&ProtocolServer::acceptCallback, this);
+    TRACE_SAMPLE();
+    TRACE_SPAN(Read, connection.id, static_cast<uint32_t>(connection.readLength));
+    if (connection.readBuffer.size() < connection.readLength + READ_CHUNK_SIZE)
+    {
+        connection.readBuffer.resize(connection.readLength + READ_CHUNK_SIZE);
+    }
+    const auto received = recv(connection.socket,
+                               reinterpret_cast<char*>(connection.readBuffer.data() + connection.readLength),
+                               READ_CHUNK_SIZE, 0);
+    if (received == 0)
+    {
+        return false;
+    }
+    if (received < 0)
+    {
+        return Utility::socketWouldBlock();
+    }
+    connection.readLength += received;
+    metrics.bytesReceived.inc(received);
     return true;
 }
 
-bool ProtocolServer::stop()
+bool ProtocolServer::processFrames(Connection& connection)
 {
-    acceptingClients = false;
-    if(acceptThread.joinable())
+    size_t offset = 0;
+    while (connection.readLength - offset >= Protocol::FRAME_HEADER_SIZE)
+    {
+        // one sampling decision covers the frame from decode to enqueue
+        TRACE_SAMPLE();
+        Protocol::FrameHeader header;
+        {
+            TRACE_SPAN(Decode, connection.id, 0);
+            header = Protocol::decodeHeader(connection.readBuffer.data() + offset);
+        }
+        if (header.length > Protocol::MAX_FRAME_PAYLOAD)
+        {
+            metrics.protocolErrors.inc();
+            PLATFORM_LOG_WARN(Net, "client %u sent a %u byte frame, dropping it\n", connection.id, header.length);
+            return false;
+        }
+        if (connection.readLength - offset - Protocol::FRAME_HEADER_SIZE < header.length)
+        {
+            break;
+        }
+        if (capture != nullptr)
+        {
+            capture->recordFrame(connection.id, connection.readBuffer.data() + offset,
+                                 Protocol::FRAME_HEADER_SIZE + header.length);
+        }
+        handleFrame(connection, header, connection.readBuffer.data() + offset + Protocol::FRAME_HEADER_SIZE);
+        offset += Protocol::FRAME_HEADER_SIZE + header.length;
+    }
+
+    // keep the partial frame at the front of the buffer
+    if (offset != 0)
+    {
+        memmove(connection.readBuffer.data(), connection.readBuffer.data() + offset, connection.readLength - offset);
+        connection.readLength -= offset;
+    }
+    return true;
+}
+
+void ProtocolServer::handleFrame(Connection& connection, const Protocol::FrameHeader& header, const uint8_t* payload)
+{
+    const size_t typeIndex = Protocol::isKnownMessageType(header.type) ?
+        static_cast<size_t>(header.type) : Protocol::MESSAGE_TYPE_COUNT;
+    metrics.framesReceived[typeIndex].inc();
+    Metrics::ScopedTimer timer(metrics.handlerLatency[typeIndex]);
+    TRACE_SPAN(Handle, connection.id, static_cast<uint32_t>(header.type));
+
+    switch (header.type)
+    {
+    case Protocol::MessageType::ItemSend:
+    case Protocol::MessageType::LocationCheck:
+    case Protocol::MessageType::Ping:
+    case Protocol::MessageType::Subscribe:
+    case Protocol::MessageType::Unsubscribe:
+    case Protocol::MessageType::Publish:
+    case Protocol::MessageType::GenerateSeed:
+    case Protocol::MessageType::TransferRequest:
+        break;
+    default:
+        // reads the room, so it waits for the sends and checks before it
+        settleRoom();
+        break;
+    }
+
+    switch (header.type)
+    {
+    case Protocol::MessageType::Ping:
+        queueFrame(connection, Protocol::MessageType::Pong, payload, header.length);
+        return;
+    case Protocol::MessageType::FlagSync:
+        if (header.length != Protocol::FLAG_SYNC_PAYLOAD_SIZE)
+        {
+            queueError(connection, Protocol::ErrorCode::MalformedPayload);
+            return;
+        }
+        handleFlagSync(connection, payload);
+        return;
+    case Protocol::MessageType::TrackerAck:
+        if (header.length != Protocol::TRACKER_ACK_PAYLOAD_SIZE)
+        {
+            queueError(connection, Protocol::ErrorCode::MalformedPayload);
+            return;
+        }
+        handleTrackerAck(connection, payload);
+        return;
+    case Protocol::MessageType::Subscribe:
+    case Protocol::MessageType::Unsubscribe:
+        if (header.length == 0 || header.length % Protocol::TOPIC_ID_SIZE != 0)
+        {
+            queueError(connection, Protocol::ErrorCode::MalformedPayload);
+            return;
+        }
+        handleSubscribe(connection, payload, header.length, header.type == Protocol::MessageType::Subscribe);
+        return;
+    case Protocol::MessageType::Publish:
+        if (header.length < Protocol::TOPIC_ID_SIZE || header.length - Protocol::TOPIC_ID_SIZE > Protocol::MAX_TOPIC_BODY)
+        {
+            queueError(connection, Protocol::ErrorCode::MalformedPayload);
+            return;
+        }
+        handlePublish(connection, payload, header.length);
+        return;
+    case Protocol::MessageType::GenerateSeed:
+        handleGenerateSeed(connection, payload, header.length);
+        return;
+    case Protocol::MessageType::TransferRequest:
+        handleTransferRequest(connection, payload, header.length);
+        return;
+    case Protocol::MessageType::ItemSend:
+    case Protocol::MessageType::LocationCheck:
+    case Protocol::MessageType::TrackerQuery:
+    case Protocol::MessageType::Join:
+    case Protocol::MessageType::TrackerSubscribe:
+        break;
+    default:
+        queueError(connection, Protocol::ErrorCode::UnknownMessageType);
+        return;
+    }
+
+    // the rest carry a JSON object with a world id and, for sends and checks,
+    // the item or location
+    const nlohmann::json request = nlohmann::json::parse(payload, payload + header.length, nullptr, false);
+    const char* idField = header.type == Protocol::MessageType::ItemSend ? "item" :
+                          header.type == Protocol::MessageType::LocationCheck ? "location" : nullptr;
+    if (!request.is_object() || !isUnsignedField(request, "world") || (idField != nullptr && !isUnsignedField(request, idField)))
+    {
+        queueError(connection, Protocol::ErrorCode::MalformedPayload);
+        return;
+    }
+    const uint32_t world = request["world"].get<uint32_t>();
+    const uint32_t id = idField != nullptr ? request[idField].get<uint32_t>() : 0;
+    const uint32_t idLimit = header.type == Protocol::MessageType::ItemSend ? MAX_ITEMS : MAX_LOCATIONS;
+    if (world >= MAX_PLAYERS || id >= idLimit)
+    {
+        queueError(connection, Protocol::ErrorCode::MalformedPayload);
+        return;
+    }
+    switch (header.type)
+    {
+    case Protocol::MessageType::ItemSend:
+        handleItemSend(connection, world, id);
+        break;
+    case Protocol::MessageType::LocationCheck:
+        handleLocationCheck(connection, world, id);
+        break;
+    case Protocol::MessageType::Join:
+        handleJoin(connection, world);
+        break;
+    case Protocol::MessageType::TrackerSubscribe:
+    {
+        // without a version (or with one this server never had) the
+        // subscriber starts from a full TrackerState
+        const auto version = request.find("version");
+        const auto rate = request.find("rate_hz");
+        std::chrono::steady_clock::duration tick{ 0 };
+        if (rate != request.end())
+        {
+            if (!rate->is_number_unsigned() || rate->get<uint64_t>() == 0 || rate->get<uint64_t>() > Protocol::MAX_TRACKER_RATE_HZ)
+            {
+                queueError(connection, Protocol::ErrorCode::MalformedPayload);
+                return;
+            }
+            tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / rate->get<uint32_t>();
+        }
+        handleTrackerSubscribe(connection, world, version != request.end() && version->is_number_unsigned() ?
+                               version->get<uint64_t>() : UINT64_MAX, tick);
+        break;
+    }
+    default:
+        handleTrackerQuery(connection, world);
+        break;
+    }
+}
+
+void ProtocolServer::postToRoom(RoomRequest request, uint32_t world, uint32_t id)
+{
+    if (roomMessagesPosted == roomMessages.size())
+    {
+        roomMessages.emplace_back();
+    }
+    RoomMessage& message = roomMessages[roomMessagesPosted++];
+    message.request = request;
+    message.world = world;
+    message.id = id;
+    message.batch = eventLog.lastBatch();
+    if (!roomRunning)
+    {
+        room.handle(message);
+        return;
+    }
+    roomInFlight.fetch_add(1, std::memory_order_relaxed);
+    roomHost.post(room.id(), &message);
+}
+
+void ProtocolServer::settleRoom()
+{
+    if (roomMessagesPosted == 0)
+    {
+        return;
+    }
+    // the room's changes are visible once the count it drops reads 0
+    uint32_t left;
+    for (unsigned spins = 0; (left = roomInFlight.load(std::memory_order_acquire)) != 0; spins++)
+    {
+        if (spins < SETTLE_SPINS)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            Utility::waitOnWord(roomInFlight, left);
+        }
+    }
+    for (size_t i = 0; i < roomMessagesPosted; i++)
+    {
+        if (roomMessages[i].routed)
+        {
+            metrics.itemsRouted.inc();
+            metrics.deliveriesQueued.add();
+        }
+    }
+    roomMessagesPosted = 0;
+    room.takeChangedWorlds(roomChanged);
+    for (uint32_t world : roomChanged)
+    {
+        if (!worldChanged[world] && !trackerSubscribers[world].empty())
+        {
+            worldChanged[world] = 1;
+            changedWorlds.push_back(world);
+        }
+    }
+}
+
+void ProtocolServer::roomHandled(RoomMessage*, void* context)
+{
+    ProtocolServer& server = *static_cast<ProtocolServer*>(context);
+    if (server.roomInFlight.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        Utility::wakeWord(server.roomInFlight);
+    }
+}
+
+bool ProtocolServer::logEvent(Connection& connection, const LogRecord& record)
+{
+    if (!eventLog.isOpen())
+    {
+        return true;
+    }
+    if (eventLog.failing())
+    {
+        return false;
+    }
+    holdReplies(connection, eventLog.append(record));
+    return true;
+}
+
+void ProtocolServer::holdReplies(Connection& connection, uint64_t batch)
+{
+    // replies already held behind this batch or a later one wait long enough
+    if (batch <= eventLog.durableBatch() || (!connection.held.empty() && connection.held.back().batch >= batch))
+    {
+        return;
+    }
+    connection.held.push_back(Connection::HeldReplies{ batch, connection.writeBuffer.size() });
+}
+
+void ProtocolServer::releaseDurableReplies()
+{
+    const uint64_t durable = eventLog.durableBatch();
+    for (const std::unique_ptr<Connection>& connection : connections)
+    {
+        if (!connection->held.empty() && connection->held.front().batch <= durable)
+        {
+            // errors are picked up by the next poll
+            flushClient(*connection);
+        }
+    }
+}
+
+void ProtocolServer::handleItemSend(Connection& connection, uint32_t world, uint32_t item)
+{
+    // logged first, so the changes it makes are tagged with its batch
+    if (!logEvent(connection, LogRecord{ LoggedEvent::ItemSend, world, item }))
+    {
+        queueError(connection, Protocol::ErrorCode::Unavailable);
+        return;
+    }
+    postToRoom(RoomRequest::ItemSend, world, item);
+    queueFrame(connection, Protocol::MessageType::Ack, nullptr, 0);
+}
+
+void ProtocolServer::handleLocationCheck(Connection& connection, uint32_t world, uint32_t location)
+{
+    if (!logEvent(connection, LogRecord{ LoggedEvent::LocationCheck, world, location }))
+    {
+        queueError(connection, Protocol::ErrorCode::Unavailable);
+        return;
+    }
+    postToRoom(RoomRequest::LocationCheck, world, location);
+    queueFrame(connection, Protocol::MessageType::Ack, nullptr, 0);
+}
+
+void ProtocolServer::handleJoin(Connection& connection, uint32_t world)
+{
+    if (connection.player != NO_PLAYER && playerConnections[connection.player] == &connection)
+    {
+        playerConnections[connection.player] = nullptr;
+    }
+    // a console reconnecting takes over from its old connection
+    if (playerConnections[world] != nullptr)
+    {
+        playerConnections[world]->player = NO_PLAYER;
+    }
+    connection.player = world;
+    playerConnections[world] = &connection;
+    queueFrame(connection, Protocol::MessageType::Ack, nullptr, 0);
+    // anything routed while it was away goes out right behind the Ack
+    room.deliveries().markReady(world);
+}
+
+void ProtocolServer::handleFlagSync(Connection& connection, const uint8_t* block)
+{
+    uint16_t changed[SHARED_FLAG_WORDS];
+    const size_t changedCount = room.state().mergeSharedFlags(block, changed);
+    queueFrame(connection, Protocol::MessageType::Ack, nullptr, 0);
+    if (changedCount == 0)
+    {
+        return;
+    }
+    metrics.flagWordsChanged.inc(changedCount);
+
+    // encoded once, then copied to every other joined player
+    flagUpdate.resize(changedCount * Protocol::FLAG_UPDATE_ENTRY_SIZE);
+    const uint64_t* words = room.state().sharedFlagWords();
+    for (size_t i = 0; i < changedCount; i++)
+    {
+        uint8_t* entry = flagUpdate.data() + i * Protocol::FLAG_UPDATE_ENTRY_SIZE;
+        const uint16_t index = Utility::toBigEndian(changed[i]);
+        memcpy(entry, &index, sizeof(index));
+        memcpy(entry + sizeof(index), &words[changed[i]], sizeof(uint64_t));
+    }
+    for (Connection* player : playerConnections)
+    {
+        if (player != nullptr && player != &connection)
+        {
+            queueFrame(*player, Protocol::MessageType::FlagUpdate, flagUpdate.data(), flagUpdate.size());
+        }
+    }
+}
+
+void ProtocolServer::handleSubscribe(Connection& connection, const uint8_t* payload, size_t length, bool subscribe)
+{
+    // checked up front so a bad id leaves the subscriptions as they were
+    for (size_t offset = 0; offset < length; offset += Protocol::TOPIC_ID_SIZE)
+    {
+        if (readBigEndian32(payload + offset) >= MAX_TOPICS)
+        {
+            queueError(connection, Protocol::ErrorCode::MalformedPayload);
+            return;
+        }
+    }
+    for (size_t offset = 0; offset < length; offset += Protocol::TOPIC_ID_SIZE)
+    {
+        const uint32_t topic = readBigEndian32(payload + offset);
+        if (subscribe)
+        {
+            topics.subscribe(topic, connection.slot);
+        }
+        else
+        {
+            topics.unsubscribe(topic, connection.slot);
+        }
+    }
+    queueFrame(connection, Protocol::MessageType::Ack, nullptr, 0);
+}
+
+void ProtocolServer::handlePublish(Connection& connection, const uint8_t* payload, size_t length)
+{
+    const uint32_t topic = readBigEndian32(payload);
+    if (topic >= MAX_TOPICS)
+    {
+        queueError(connection, Protocol::ErrorCode::MalformedPayload);
+        return;
+    }
+    queueFrame(connection, Protocol::MessageType::Ack, nullptr, 0);
+    metrics.topicPublishes.inc();
+    if (topics.subscriberCount(topic) == 0)
+    {
+        return;
+    }
+
+    // built once, then queued by reference on every other subscriber
+    const size_t bodyLength = length - Protocol::TOPIC_ID_SIZE;
+    std::vector<uint8_t> bytes(Protocol::FRAME_HEADER_SIZE + Protocol::TOPIC_MESSAGE_HEADER_SIZE + bodyLength);
+    Protocol::encodeHeader({ static_cast<uint32_t>(Protocol::TOPIC_MESSAGE_HEADER_SIZE + bodyLength), Protocol::MessageType::TopicMessage, 0 }, bytes.data());
+    uint8_t* message = bytes.data() + Protocol::FRAME_HEADER_SIZE;
+    writeBigEndian32(message, topic);
+    writeBigEndian32(message + 4, connection.player);
+    memcpy(message + Protocol::TOPIC_MESSAGE_HEADER_SIZE, payload + Protocol::TOPIC_ID_SIZE, bodyLength);
+    SharedFrame* frame = SharedFrame::create(std::move(bytes));
+
+    size_t delivered = 0;
+    size_t dropped = 0;
+    topics.forEachSubscriber(topic, [&](uint32_t slot)
+    {
+        // replay connections have no socket to ever drain a queue
+        Connection* subscriber = slotConnections[slot];
+        if (subscriber == &connection || Utility::isSocketInvalid(subscriber->socket))
+        {
+            return;
+        }
+        if (subscriber->pendingWrite() >= MAX_PUBLISHED_BACKLOG)
+        {
+            dropped++;
+            return;
+        }
+        subscriber->published.push(frame);
+        delivered++;
+    });
+    metrics.topicDeliveries.inc(delivered);
+    metrics.topicDrops.inc(dropped);
+    metrics.framesSent[static_cast<size_t>(Protocol::MessageType::TopicMessage)].inc(delivered);
+    metrics.sendQueueBytes.add(delivered * frame->size());
+    frame->release();
+}
+
+void ProtocolServer::handleGenerateSeed(Connection& connection, const uint8_t* payload, size_t length)
+{
+    if (!seeds)
+    {
+        queueError(connection, Protocol::ErrorCode::Unavailable);
+        return;
+    }
+    const nlohmann::json request = nlohmann::json::parse(payload, payload + length, nullptr, false);
+    const auto settingsField = request.is_object() ? request.find("settings") : request.end();
+    const auto seedField = request.is_object() ? request.find("seed") : request.end();
+    if (!request.is_object() || settingsField == request.end() || !settingsField->is_object() ||
+        (seedField != request.end() && !seedField->is_number_unsigned()))
+    {
+        queueError(connection, Protocol::ErrorCode::MalformedPayload);
+        return;
+    }
+    SeedSettings settings;
+    if (settingsField->count("worlds") != 0)
+    {
+        settings.worlds = isUnsignedField(*settingsField, "worlds") ? (*settingsField)["worlds"].get<uint32_t>() : 0;
+    }
+    if (settingsField->count("junk_item") != 0)
+    {
+        settings.junkItem = isUnsignedField(*settingsField, "junk_item") ? (*settingsField)["junk_item"].get<uint32_t>() : MAX_ITEMS;
+    }
+    if (settings.worlds == 0 || settings.worlds > MAX_SEED_WORLDS || settings.junkItem >= MAX_ITEMS)
+    {
+        queueError(connection, Protocol::ErrorCode::MalformedPayload);
+        return;
+    }
+    // no seed asks for a fresh one
+    const uint64_t seed = seedField != request.end() ? seedField->get<uint64_t>() :
+        static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) * 0x9E3779B97F4A7C15ULL;
+
+    const std::shared_ptr<const SeedResult> cached = seeds->cached(settings, seed);
+    // job 0 is a cached seed, whose result follows at once
+    const uint32_t job = cached || connection.seedJobs >= Protocol::MAX_QUEUED_SEED_JOBS ? 0 : seeds->submit(settings, seed);
+    if (!cached && job == 0)
+    {
+        queueError(connection, Protocol::ErrorCode::Unavailable);
+        return;
+    }
+    const nlohmann::json queued = { { "job", job }, { "settings_hash", settings.hash() }, { "seed", seed }, { "cached", cached != nullptr } };
+    const std::string encoded = queued.dump();
+    queueFrame(connection, Protocol::MessageType::SeedQueued, reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+    if (cached)
+    {
+        sendSeedResult(connection, job, *cached);
+        return;
+    }
+    seedWaiters[job].push_back(SeedWaiter{ connection.slot, connection.id });
+    connection.seedJobs++;
+}
+
+void ProtocolServer::pollSeeds()
+{
+    seeds->poll([this](uint32_t job, uint32_t done, uint32_t total)
+    {
+        const auto waiters = seedWaiters.find(job);
+        if (waiters == seedWaiters.end())
+        {
+            return;
+        }
+        const nlohmann::json progress = { { "job", job }, { "done", done }, { "total", total } };
+        const std::string encoded = progress.dump();
+        for (const SeedWaiter& waiter : waiters->second)
+        {
+            Connection* connection = seedWaiter(waiter);
+            if (connection != nullptr)
+            {
+                queueFrame(*connection, Protocol::MessageType::SeedProgress,
+                           reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+            }
+        }
+    },
+    [this](uint32_t job, const std::shared_ptr<const SeedResult>& result)
+    {
+        const auto waiters = seedWaiters.find(job);
+        if (waiters == seedWaiters.end())
+        {
+            return;
+        }
+        for (const SeedWaiter& waiter : waiters->second)
+        {
+            Connection* connection = seedWaiter(waiter);
+            if (connection != nullptr)
+            {
+                connection->seedJobs--;
+                sendSeedResult(*connection, job, *result);
+            }
+        }
+        seedWaiters.erase(waiters);
+    });
+    for (const std::unique_ptr<Connection>& connection : connections)
+    {
+        // errors are picked up by the next poll
+        if (connection->pendingWrite() != 0)
+        {
+            flushClient(*connection);
+        }
+    }
+}
+
+void ProtocolServer::sendSeedResult(Connection& connection, uint32_t job, const SeedResult& result)
+{
+    // the placements are spliced in as they are, already encoded
+    nlohmann::json header = { { "job", job }, { "settings_hash", result.settingsHash }, { "seed", result.seed } };
+    std::string encoded;
+    if (result.error.empty())
+    {
+        encoded = header.dump();
+        encoded.pop_back();
+        encoded += ",\"placements\":";
+        encoded += result.placements;
+        encoded += '}';
+    }
+    if (encoded.empty() || encoded.size() > Protocol::MAX_FRAME_PAYLOAD)
+    {
+        // too big for a frame: the size says to fetch it with a transfer
+        if (result.error.empty())
+        {
+            header["size"] = result.placements.size();
+        }
+        else
+        {
+            header["error"] = result.error;
+        }
+        encoded = header.dump();
+    }
+    queueFrame(connection, Protocol::MessageType::SeedResult, reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+}
+
+void ProtocolServer::handleTransferRequest(Connection& connection, const uint8_t* payload, size_t length)
+{
+    const nlohmann::json request = nlohmann::json::parse(payload, payload + length, nullptr, false);
+    const auto file = request.is_object() ? request.find("file") : request.end();
+    const auto offsetField = request.is_object() ? request.find("offset") : request.end();
+    const auto digestField = request.is_object() ? request.find("digest") : request.end();
+    if (!request.is_object() || (file != request.end() && !file->is_string()) ||
+        (file == request.end() && (!request.count("seed") || !request["seed"].is_number_unsigned() ||
+                                   !request.count("settings_hash") || !request["settings_hash"].is_number_unsigned())) ||
+        (offsetField != request.end() && !offsetField->is_number_unsigned()) ||
+        (digestField != request.end() && !isUnsignedField(request, "digest")))
+    {
+        queueError(connection, Protocol::ErrorCode::MalformedPayload);
+        return;
+    }
+    std::shared_ptr<const TransferSource> source;
+    if (file != request.end())
+    {
+        source = transferFile(file->get<std::string>());
+    }
+    else if (seeds)
+    {
+        const std::shared_ptr<const SeedResult> result = seeds->cached(request["settings_hash"].get<uint64_t>(),
+                                                                       request["seed"].get<uint64_t>());
+        if (result && result->error.empty())
+        {
+            source = TransferSource::fromMemory(result, reinterpret_cast<const uint8_t*>(result->placements.data()),
+                                                result->placements.size());
+        }
+    }
+    if (!source)
+    {
+        queueError(connection, Protocol::ErrorCode::NotFound);
+        return;
+    }
+    uint64_t offset = offsetField != request.end() ? offsetField->get<uint64_t>() : 0;
+    if (offset % TRANSFER_CHUNK_SIZE != 0 || offset > source->size())
+    {
+        queueError(connection, Protocol::ErrorCode::MalformedPayload);
+        return;
+    }
+    if (connection.transfers.size() >= Protocol::MAX_QUEUED_TRANSFERS)
+    {
+        queueError(connection, Protocol::ErrorCode::Unavailable);
+        return;
+    }
+    // what the client has is of another version of the payload
+    if (digestField != request.end() && digestField->get<uint32_t>() != source->digest())
+    {
+        offset = 0;
+    }
+    if (offset != 0)
+    {
+        metrics.transferResumes.inc();
+    }
+    // so a full window wakes poll only once it has room again
+    Utility::setSocketSendLowWater(connection.socket, static_cast<int>(TRANSFER_WINDOW));
+    const uint32_t id = connection.nextTransfer++;
+    const nlohmann::json start = { { "transfer", id }, { "size", source->size() }, { "chunk_size", TRANSFER_CHUNK_SIZE },
+                                   { "offset", offset }, { "digest", source->digest() } };
+    const std::string encoded = start.dump();
+    queueFrame(connection, Protocol::MessageType::TransferStart, reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+    Connection::OutgoingTransfer transfer{};
+    transfer.id = id;
+    transfer.source = std::move(source);
+    transfer.next = offset;
+    connection.transfers.push_back(std::move(transfer));
+}
+
+std::shared_ptr<const TransferSource> ProtocolServer::transferFile(const std::string& name)
+{
+    // only plain names, nothing outside the directory or hidden in it
+    if (transferDirectory.empty() || name.empty() || name[0] == '.' || name.find_first_of("/\\") != std::string::npos)
+    {
+        return nullptr;
+    }
+    const std::string path = transferDirectory + "/" + name;
+    const auto found = transferFiles.find(name);
+    if (found != transferFiles.end())
+    {
+        if (found->second->matchesFile(path))
+        {
+            return found->second;
+        }
+        // transfers already going keep the version they started with
+        transferFiles.erase(found);
+    }
+    std::shared_ptr<const TransferSource> source = TransferSource::openFile(path);
+    if (!source)
+    {
+        return nullptr;
+    }
+    if (transferFiles.size() >= MAX_TRANSFER_FILES)
+    {
+        transferFiles.erase(transferFiles.begin());
+    }
+    transferFiles[name] = source;
+    return source;
+}
+
+bool ProtocolServer::sendTransfers(Connection& connection)
+{
+    constexpr size_t HEADERS_SIZE = Protocol::FRAME_HEADER_SIZE + Protocol::TRANSFER_CHUNK_HEADER_SIZE;
+    while (!connection.transfers.empty())
+    {
+        Connection::OutgoingTransfer& transfer = connection.transfers.front();
+        if (transfer.chunkSent == transfer.chunkLength)
+        {
+            if (transfer.next >= transfer.source->size())
+            {
+                connection.transfers.pop_front();
+                continue;
+            }
+            // a chunk is only started on an otherwise empty queue and a
+            // socket with no more than the window still to send, so
+            // anything else never waits long behind a transfer
+            if (connection.sendableWrite() != 0 || Utility::socketUnsentBytes(connection.socket) >= TRANSFER_WINDOW)
+            {
+                return true;
+            }
+            uint32_t checksum;
+            if (!transfer.source->chunkChecksum(transfer.next, checksum))
+            {
+                // the client asks again with the digest and starts over on
+                // the new version
+                PLATFORM_LOG_WARN(Net, "transfer %u to client %u: the file changed, dropping the client\n", transfer.id, connection.id);
+                return false;
+            }
+            const uint32_t data = static_cast<uint32_t>(std::min<uint64_t>(TRANSFER_CHUNK_SIZE, transfer.source->size() - transfer.next));
+            uint8_t* header = transfer.chunkHeader;
+            Protocol::encodeHeader({ static_cast<uint32_t>(Protocol::TRANSFER_CHUNK_HEADER_SIZE + data),
+                                     Protocol::MessageType::TransferChunk, 0 }, header);
+            header += Protocol::FRAME_HEADER_SIZE;
+            writeBigEndian32(header, transfer.id);
+            writeBigEndian32(header + 4, static_cast<uint32_t>(transfer.next >> 32));
+            writeBigEndian32(header + 8, static_cast<uint32_t>(transfer.next));
+            writeBigEndian32(header + 12, checksum);
+            transfer.chunkLength = HEADERS_SIZE + data;
+            transfer.chunkSent = 0;
+        }
+        const bool inData = transfer.chunkSent >= HEADERS_SIZE;
+        const long sent = inData ?
+            transfer.source->sendTo(connection.socket, transfer.next + (transfer.chunkSent - HEADERS_SIZE), transfer.chunkLength - transfer.chunkSent) :
+            static_cast<long>(send(connection.socket, reinterpret_cast<const char*>(transfer.chunkHeader + transfer.chunkSent),
+                                   HEADERS_SIZE - transfer.chunkSent, SOCK_SEND_FLAGS));
+        if (sent == 0)
+        {
+            // the chunk cannot be finished, and the stream is mid-frame
+            PLATFORM_LOG_WARN(Net, "transfer %u to client %u: the file shrank\n", transfer.id, connection.id);
+            return false;
+        }
+        if (sent < 0)
+        {
+            return Utility::socketWouldBlock();
+        }
+        transfer.chunkSent += sent;
+        metrics.bytesSent.inc(sent);
+        if (inData)
+        {
+            metrics.transferBytes.inc(sent);
+        }
+        if (transfer.chunkSent == transfer.chunkLength)
+        {
+            transfer.next += transfer.chunkLength - HEADERS_SIZE;
+            metrics.transferChunks.inc();
+            metrics.framesSent[static_cast<size_t>(Protocol::MessageType::TransferChunk)].inc();
+        }
+    }
+    return true;
+}
+
+ProtocolServer::Connection* ProtocolServer::seedWaiter(const SeedWaiter& waiter) const
+{
+    Connection* connection = waiter.slot < slotConnections.size() ? slotConnections[waiter.slot] : nullptr;
+    return connection != nullptr && connection->id == waiter.connectionId ? connection : nullptr;
+}
+
+void ProtocolServer::assignSlot(Connection& connection)
+{
+    if (freeSlots.empty())
+    {
+        connection.slot = static_cast<uint32_t>(slotConnections.size());
+        slotConnections.push_back(&connection);
+        return;
+    }
+    connection.slot = freeSlots.back();
+    freeSlots.pop_back();
+    slotConnections[connection.slot] = &connection;
+}
+
+void ProtocolServer::releaseSlot(Connection& connection)
+{
+    topics.removeSlot(connection.slot);
+    slotConnections[connection.slot] = nullptr;
+    freeSlots.push_back(connection.slot);
+}
+
+void ProtocolServer::deliverPending()
+{
+    DeliveryQueues& deliveries = room.deliveries();
+    if (deliveries.pending() == 0)
+    {
+        return;
+    }
+    deliveries.takeReady(readyRecipients);
+    char payload[96];
+    for (uint32_t recipient : readyRecipients)
+    {
+        Connection* connection = recipient < playerConnections.size() ? playerConnections[recipient] : nullptr;
+        if (connection == nullptr)
+        {
+            // stays queued until the recipient joins
+            continue;
+        }
+        std::deque<Delivery>& queue = deliveries.queue(recipient);
+        while (!queue.empty())
+        {
+            const Delivery& delivery = queue.front();
+            const int length = snprintf(payload, sizeof(payload), "{\"item\":%u,\"from\":%u,\"location\":%u}",
+                                        delivery.item, delivery.fromWorld, delivery.location);
+            // a check lost in a crash would be resent, and the item with it
+            holdReplies(*connection, delivery.batch);
+            queueFrame(*connection, Protocol::MessageType::ItemReceived, reinterpret_cast<const uint8_t*>(payload), length);
+            deliveries.popFront(recipient);
+            metrics.itemsDelivered.inc();
+            metrics.deliveriesQueued.sub();
+        }
+        // errors are picked up by the next poll
+        if (!Utility::isSocketInvalid(connection->socket))
+        {
+            flushClient(*connection);
+        }
+    }
+}
+
+void ProtocolServer::handleTrackerQuery(Connection& connection, uint32_t world)
+{
+    const ChangeLog& log = room.changeLogs()[world];
+    const std::string encoded = encodeTrackerState(room.state(), world, log.version(), room.inLogicWords(world));
+    holdReplies(connection, log.batch());
+    queueFrame(connection, Protocol::MessageType::TrackerState,
+               reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+}
+
+void ProtocolServer::handleTrackerSubscribe(Connection& connection, uint32_t world, uint64_t version, std::chrono::steady_clock::duration tick)
+{
+    unsubscribeTracker(connection);
+    connection.trackedWorld = world;
+    connection.sentVersion = version;
+    connection.ackedVersion = version;
+    connection.trackerTick = tick;
+    trackerSubscribers[world].push_back(&connection);
+    queueFrame(connection, Protocol::MessageType::Ack, nullptr, 0);
+    sendTrackerUpdate(connection);
+}
+
+void ProtocolServer::handleTrackerAck(Connection& connection, const uint8_t* payload)
+{
+    if (connection.trackedWorld == NO_PLAYER)
+    {
+        return;
+    }
+    uint64_t version;
+    memcpy(&version, payload, sizeof(version));
+    version = Utility::fromBigEndian(version);
+    const bool wasHeld = connection.sentVersion - connection.ackedVersion >= MAX_UNACKED_VERSIONS;
+    // a version it was never sent acknowledges nothing
+    if (version <= connection.sentVersion && version > connection.ackedVersion)
+    {
+        connection.ackedVersion = version;
+    }
+    if (wasHeld)
+    {
+        sendTrackerUpdate(connection);
+    }
+}
+
+void ProtocolServer::syncTrackers()
+{
+    // one update per subscriber per poll round, however many changes the
+    // round made
+    for (uint32_t world : changedWorlds)
+    {
+        worldChanged[world] = 0;
+        for (Connection* subscriber : trackerSubscribers[world])
+        {
+            if (subscriber->trackerTick.count() != 0)
+            {
+                if (!subscriber->trackerDirty)
+                {
+                    // ticks fall on a grid shared by every subscriber with
+                    // the same rate, so the poll wakes once per tick rather
+                    // than once per subscriber
+                    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+                    subscriber->nextTrackerTick = std::chrono::steady_clock::time_point((now / subscriber->trackerTick + 1) * subscriber->trackerTick);
+                    subscriber->trackerDirty = true;
+                    tickedSubscribers.push_back(subscriber);
+                    nextTrackerTick = tickedSubscribers.size() == 1 ? subscriber->nextTrackerTick :
+                                      std::min(nextTrackerTick, subscriber->nextTrackerTick);
+                }
+                continue;
+            }
+            sendTrackerUpdate(*subscriber);
+            // errors are picked up by the next poll
+            if (!Utility::isSocketInvalid(subscriber->socket))
+            {
+                flushClient(*subscriber);
+            }
+        }
+    }
+    changedWorlds.clear();
+}
+
+void ProtocolServer::syncTrackerTicks()
+{
+    if (tickedSubscribers.empty())
+    {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now < nextTrackerTick)
+    {
+        return;
+    }
+    nextTrackerTick = std::chrono::steady_clock::time_point::max();
+    for (size_t i = tickedSubscribers.size(); i-- > 0;)
+    {
+        Connection& subscriber = *tickedSubscribers[i];
+        if (subscriber.nextTrackerTick > now)
+        {
+            nextTrackerTick = std::min(nextTrackerTick, subscriber.nextTrackerTick);
+            continue;
+        }
+        // however many changes the tick covers, one collapsed delta
+        sendTrackerUpdate(subscriber);
+        if (!Utility::isSocketInvalid(subscriber.socket))
+        {
+            flushClient(subscriber);
+        }
+        subscriber.trackerDirty = false;
+        tickedSubscribers[i] = tickedSubscribers.back();
+        tickedSubscribers.pop_back();
+    }
+}
+
+void ProtocolServer::sendTrackerUpdate(Connection& connection)
+{
+    const ChangeLog& log = room.changeLogs()[connection.trackedWorld];
+    if (connection.sentVersion == log.version() ||
+        connection.sentVersion - connection.ackedVersion >= MAX_UNACKED_VERSIONS)
+    {
+        return;
+    }
+    // a version is only published once a restart would come back to it
+    holdReplies(connection, log.batch());
+    if (log.covers(connection.sentVersion))
+    {
+        trackerDelta.clear();
+        log.encodeDelta(connection.sentVersion, trackerDelta, connection.trackerTick.count() != 0);
+        queueFrame(connection, Protocol::MessageType::TrackerDelta, trackerDelta.data(), trackerDelta.size());
+        metrics.trackerDeltaBytes.inc(trackerDelta.size());
+    }
+    else
+    {
+        const std::string encoded = encodeTrackerState(room.state(), connection.trackedWorld, log.version(),
+                                                       room.inLogicWords(connection.trackedWorld));
+        queueFrame(connection, Protocol::MessageType::TrackerState,
+                   reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+        metrics.trackerSnapshotBytes.inc(encoded.size());
+        // a full state needs nothing acknowledged before it
+        connection.ackedVersion = log.version();
+    }
+    connection.sentVersion = log.version();
+}
+
+void ProtocolServer::unsubscribeTracker(Connection& connection)
+{
+    if (connection.trackedWorld == NO_PLAYER)
+    {
+        return;
+    }
+    std::vector<Connection*>& subscribers = trackerSubscribers[connection.trackedWorld];
+    for (size_t i = 0; i < subscribers.size(); i++)
+    {
+        if (subscribers[i] == &connection)
+        {
+            subscribers[i] = subscribers.back();
+            subscribers.pop_back();
+            break;
+        }
+    }
+    if (connection.trackerDirty)
+    {
+        tickedSubscribers.erase(std::find(tickedSubscribers.begin(), tickedSubscribers.end(), &connection));
+        connection.trackerDirty = false;
+    }
+    connection.trackedWorld = NO_PLAYER;
+}
+
+void ProtocolServer::queueError(Connection& connection, Protocol::ErrorCode code)
+{
+    uint8_t error[Protocol::ERROR_PAYLOAD_SIZE];
+    Protocol::encodeError(code, error);
+    queueFrame(connection, Protocol::MessageType::Error, error, sizeof(error));
+}
+
+void ProtocolServer::queueFrame(Connection& connection, Protocol::MessageType type, const uint8_t* payload, size_t length)
+{
+    {
+        TRACE_SPAN(Encode, connection.id, static_cast<uint32_t>(type));
+        Protocol::appendFrame(connection.writeBuffer, type, payload, length);
+    }
+    TRACE_SPAN(Enqueue, connection.id, static_cast<uint32_t>(type));
+    metrics.framesSent[static_cast<size_t>(type)].inc();
+    metrics.sendQueueBytes.add(Protocol::FRAME_HEADER_SIZE + length);
+}
+
+bool ProtocolServer::flushClient(Connection& connection)
+{
+    TRACE_SAMPLE();
+    TRACE_SPAN(Flush, connection.id, static_cast<uint32_t>(connection.pendingWrite()));
+    const uint64_t durable = eventLog.durableBatch();
+    while (!connection.held.empty() && connection.held.front().batch <= durable)
+    {
+        connection.held.pop_front();
+    }
+    // a frame is never interleaved with another: a part-sent topic message
+    // or transfer chunk goes first, then the replies, then the other topic
+    // messages, then more chunks
+    if (connection.published.midFrame() && !sendPublished(connection, true))
+    {
+        return Utility::socketWouldBlock();
+    }
+    if (connection.midChunk())
+    {
+        if (!sendTransfers(connection))
+        {
+            return false;
+        }
+        if (connection.midChunk())
+        {
+            return true;
+        }
+    }
+    while (connection.sendableReplies() != 0)
+    {
+        const auto sent = send(connection.socket,
+                               reinterpret_cast<const char*>(connection.writeBuffer.data() + connection.writeOffset),
+                               connection.sendableReplies(), SOCK_SEND_FLAGS);
+        if (sent < 0)
+        {
+            return Utility::socketWouldBlock();
+        }
+        connection.writeOffset += sent;
+        metrics.bytesSent.inc(sent);
+        metrics.sendQueueBytes.sub(sent);
+    }
+    if (!sendPublished(connection))
+    {
+        return Utility::socketWouldBlock();
+    }
+    if (connection.held.empty())
+    {
+        connection.writeBuffer.clear();
+        connection.writeOffset = 0;
+    }
+    else if (connection.writeOffset != 0)
+    {
+        // the buffer may never empty while commits keep holding its tail,
+        // so drop what was sent now
+        connection.writeBuffer.erase(connection.writeBuffer.begin(), connection.writeBuffer.begin() + connection.writeOffset);
+        for (Connection::HeldReplies& held : connection.held)
+        {
+            held.offset -= connection.writeOffset;
+        }
+        connection.writeOffset = 0;
+    }
+    return sendTransfers(connection);
+}
+
+bool ProtocolServer::sendPublished(Connection& connection, bool frameOnly)
+{
+    while (frameOnly ? connection.published.midFrame() : !connection.published.empty())
+    {
+        const auto sent = send(connection.socket,
+                               reinterpret_cast<const char*>(connection.published.frontData()),
+                               connection.published.frontRemaining(), SOCK_SEND_FLAGS);
+        if (sent < 0)
+        {
+            return false;
+        }
+        connection.published.consume(sent);
+        metrics.bytesSent.inc(sent);
+        metrics.sendQueueBytes.sub(sent);
+    }
+    return true;
+}
+
+void ProtocolServer::closeClient(size_t index)
+{
+    Connection& connection = *connections[index];
+    PLATFORM_LOG_DEBUG(Net, "client %u disconnected\n", connection.id);
+    if (capture != nullptr)
+    {
+        capture->recordClose(connection.id);
+    }
+    if (connection.player != NO_PLAYER && playerConnections[connection.player] == &connection)
+    {
+        playerConnections[connection.player] = nullptr;
+    }
+    unsubscribeTracker(connection);
+    releaseSlot(connection);
+    SOCK_CLOSE(connection.socket);
+    metrics.sendQueueBytes.sub(connection.pendingWrite());
+    metrics.activeConnections.sub();
+
+    connections[index] = std::move(connections.back());
+    connections.pop_back();
+}
+
+void ProtocolServer::setCapture(TrafficCapture* trafficCapture)
+{
+    capture = trafficCapture;
+}
+
+size_t ProtocolServer::replayFrame(uint32_t connectionId, const uint8_t* frame, size_t length)
+{
+    std::unique_ptr<Connection>& slot = replayConnections[connectionId];
+    if (!slot)
+    {
+        slot.reset(new Connection());
+        slot->socket = INVALID_SOCKET;
+        slot->id = connectionId;
+        assignSlot(*slot);
+    }
+    Connection& connection = *slot;
+    if (connection.readBuffer.size() < connection.readLength + length)
+    {
+        connection.readBuffer.resize(connection.readLength + length);
+    }
+    memcpy(connection.readBuffer.data() + connection.readLength, frame, length);
+    connection.readLength += length;
+    metrics.bytesReceived.inc(length);
+    if (!processFrames(connection))
+    {
+        // the live server would have dropped the connection here
+        connection.readLength = 0;
+    }
+    settleRoom();
+    deliverPending();
+    syncTrackers();
+
+    const size_t replied = connection.pendingWrite();
+    metrics.sendQueueBytes.sub(replied);
+    connection.writeBuffer.clear();
+    connection.writeOffset = 0;
+    connection.held.clear();
+    connection.transfers.clear();
+    return replied;
+}
+
+void ProtocolServer::replayClose(uint32_t connectionId)
+{
+    const auto found = replayConnections.find(connectionId);
+    if (found == replayConnections.end())
+    {
+        return;
+    }
+    const uint32_t player = found->second->player;
+    if (player != NO_PLAYER && playerConnections[player] == found->second.get())
+    {
+        playerConnections[player] = nullptr;
+    }
+    unsubscribeTracker(*found->second);
+    releaseSlot(*found->second);
+    replayConnections.erase(found);
+}
+
+bool ProtocolServer::start()
+{
+    // TODO: check we are initialized
+    if (!snapshotPath.empty() && eventLog.isOpen())
+    {
+        snapshotWriter.start(snapshotPath);
+        nextSnapshot = std::chrono::steady_clock::now() + snapshotInterval;
+    }
+    if (!logic.empty())
+    {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        seeds.reset(new SeedService(logic, seedWorkers != 0 ? seedWorkers : cores));
+        seeds->start();
+    }
+    roomHost.start();
+    roomRunning = true;
+    acceptingClients = true;
+    pollThread = std::thread(&ProtocolServer::pollCallback, this);
+    return true;
+}
+
+bool ProtocolServer::stop()
+{
+    acceptingClients = false;
+    if(pollThread.joinable())
+    {
+        pollThread.join();
+    }
+    while (!connections.empty())
+    {
+        closeClient(connections.size() - 1);
+    }
+    // the poll loop settles the room before it ends
+    if (roomRunning)
+    {
+        roomHost.stop();
+        roomRunning = false;
+    }
+    capture = nullptr;
+    if (seeds)
+    {
+        seeds->stop();
+        seeds.reset();
+        seedWaiters.clear();
+    }
+    // the writer may be waiting on a commit, so it stops before the log
+    snapshotWriter.stop();
+    if (eventLog.isOpen())
+    {
+        eventLog.close();
+        saveSnapshot();
+    }
+    if (metricsEndpoint)
     {
-        acceptThread.join();
+        metricsEndpoint->shutdown();
     }
     if (acceptSocket != -1)
     {
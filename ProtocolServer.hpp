@@ -2,24 +2,355 @@
 #pragma once
 
 #include "utility/platform_socket.hpp"
+#include "utility/metrics.hpp"
+#include "EventLog.hpp"
+#include "LogicGraph.hpp"
+#include "MetricsEndpoint.hpp"
+#include "Protocol.hpp"
+#include "TrafficCapture.hpp"
+#include "WorldState.hpp"
+#include "RoomHost.hpp"
+#include "RoomSnapshot.hpp"
+#include "RoutingTable.hpp"
+#include "SeedService.hpp"
+#include "TopicBus.hpp"
+#include "TrackerSync.hpp"
+#include "Transfer.hpp"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
 #include <thread>
+#include <vector>
 
 class ProtocolServer
 {
 public:
-    ProtocolServer(uint16_t port);
+    // a non-zero metricsPort also serves Prometheus metrics on 127.0.0.1:metricsPort
+    ProtocolServer(uint16_t port, uint16_t metricsPort = 0);
 
     bool initialize();
 
     bool start();
 
     bool stop();
+
+    // the seed's item placement, which location checks are routed by; see
+    // RoutingTable::loadFile for the format. Load before start().
+    bool loadPlacement(const std::string& path);
+
+    // the seed's item logic, so trackers also hear which locations each
+    // world has in logic; see LogicGraph::loadFile for the format. Load
+    // before openEventLog().
+    bool loadLogic(const std::string& path);
+
+    // With logic and a placement loaded, checks that every world can reach
+    // its goal (Playthrough.hpp) and logs the outcome; true without either.
+    // Call before start(), so nobody plays an unbeatable seed.
+    bool validatePlacement();
+
+    // threads generating seeds for GenerateSeed (with logic loaded), 0 for
+    // one per core; set before start()
+    void setSeedWorkers(unsigned workers);
+
+    // the directory whose files TransferRequest can fetch (patches, say);
+    // without one only seeds can be fetched. Set before start().
+    void setTransferDirectory(const std::string& directory);
+
+    // Rebuilds the room from the event log at path, then keeps appending to
+    // it: every item send and location check is committed in a batch at
+    // most commitInterval (plus a sync) old before its Ack, the item it
+    // routes or a tracker version including it goes out. Call after
+    // loadPlacement() and before start().
+    bool openEventLog(const std::string& path, std::chrono::microseconds commitInterval);
+
+    // With an event log, snapshots the room to path every interval (on a
+    // background thread) and on stop(), so openEventLog() restores the
+    // snapshot and only replays the records after it. Call before
+    // openEventLog().
+    void setSnapshots(const std::string& path, std::chrono::seconds interval);
+
+    // snapshots the room now, on the calling thread; only while the server
+    // is not running
+    bool saveSnapshot();
+
+    // every inbound frame (and connect/disconnect) is recorded to capture
+    // until stop(); set before start()
+    void setCapture(TrafficCapture* capture);
+
+    // Offline replay: feeds one captured frame through the same decode and
+    // handler path a socket read would, for a connection that only exists in
+    // memory. Only for servers that were never started. Returns the bytes of
+    // replies the frame produced, which are then discarded.
+    size_t replayFrame(uint32_t connectionId, const uint8_t* frame, size_t length);
+
+    void replayClose(uint32_t connectionId);
 private:
+    struct Connection
+    {
+        SocketType socket;
+        uint32_t id;
+        // index into slotConnections, and this connection's bit in topic bitmaps
+        uint32_t slot = 0;
+        // the world this connection joined, NO_PLAYER until it does
+        uint32_t player = NO_PLAYER;
+        // the world whose tracker state this connection follows, NO_PLAYER
+        // if none, and the newest version of it sent and acknowledged
+        uint32_t trackedWorld = NO_PLAYER;
+        uint64_t sentVersion = 0;
+        uint64_t ackedVersion = 0;
+        // zero sends every change as it happens; otherwise changes are
+        // coalesced and sent at the next multiple of trackerTick
+        std::chrono::steady_clock::duration trackerTick{ 0 };
+        // while listed in tickedSubscribers, when its changes go out
+        std::chrono::steady_clock::time_point nextTrackerTick;
+        bool trackerDirty = false;
+        std::vector<uint8_t> readBuffer;
+        size_t readLength = 0;
+        std::vector<uint8_t> writeBuffer;
+        size_t writeOffset = 0;
+        // replies from offset on wait for an event log batch to be durable,
+        // oldest first
+        struct HeldReplies
+        {
+            uint64_t batch;
+            size_t offset;
+        };
+        std::deque<HeldReplies> held;
+        // published topic messages; never held, and sent between whole
+        // frames of writeBuffer
+        SharedFrameQueue published;
+        // started transfers, streamed one after another once nothing else is
+        // waiting to go out; never counted in pendingWrite()
+        struct OutgoingTransfer
+        {
+            uint32_t id;
+            std::shared_ptr<const TransferSource> source;
+            // where the next chunk starts
+            uint64_t next;
+            // the chunk going out: its frame and chunk headers, and how much
+            // of headers plus data is sent; equal when none is
+            uint8_t chunkHeader[Protocol::FRAME_HEADER_SIZE + Protocol::TRANSFER_CHUNK_HEADER_SIZE];
+            size_t chunkLength;
+            size_t chunkSent;
+        };
+        std::deque<OutgoingTransfer> transfers;
+        uint32_t nextTransfer = 1;
+        // seed jobs this connection waits on the result of
+        uint32_t seedJobs = 0;
+
+        // true if a chunk went out in part
+        bool midChunk() const { return !transfers.empty() && transfers.front().chunkSent != transfers.front().chunkLength; }
+
+        size_t pendingWrite() const { return writeBuffer.size() - writeOffset + published.pendingBytes(); }
+
+        // what can go out before the first held reply
+        size_t sendableReplies() const { return (held.empty() ? writeBuffer.size() : held.front().offset) - writeOffset; }
+
+        size_t sendableWrite() const { return sendableReplies() + published.pendingBytes(); }
+    };
+
+    static constexpr uint32_t NO_PLAYER = UINT32_MAX;
+
+    struct ServerMetrics
+    {
+        Metrics::Counter accepts;
+        Metrics::Counter acceptErrors;
+        Metrics::Counter protocolErrors;
+        Metrics::Gauge activeConnections;
+        Metrics::Counter bytesReceived;
+        Metrics::Counter bytesSent;
+        Metrics::Gauge sendQueueBytes;
+        // indexed by message type, the extra entry counts unknown types
+        Metrics::Counter framesReceived[Protocol::MESSAGE_TYPE_COUNT + 1];
+        Metrics::Counter framesSent[Protocol::MESSAGE_TYPE_COUNT];
+        Metrics::Histogram handlerLatency[Protocol::MESSAGE_TYPE_COUNT + 1];
+        Metrics::Counter itemsRouted;
+        Metrics::Counter itemsDelivered;
+        Metrics::Gauge deliveriesQueued;
+        Metrics::Counter flagWordsChanged;
+        Metrics::Counter trackerDeltaBytes;
+        Metrics::Counter trackerSnapshotBytes;
+        Metrics::Counter topicPublishes;
+        Metrics::Counter topicDeliveries;
+        Metrics::Counter topicDrops;
+        Metrics::Counter transferChunks;
+        Metrics::Counter transferBytes;
+        Metrics::Counter transferResumes;
+
+        ServerMetrics();
+    };
+
     uint16_t port;
+    uint16_t metricsPort;
     SocketType acceptSocket = -1;
     sockaddr_in serverAddr{};
-    bool acceptingClients;
-    std::thread acceptThread;
+    std::atomic<bool> acceptingClients;
+    std::thread pollThread;
+    // only touched by pollThread while it runs
+    std::vector<std::unique_ptr<Connection>> connections;
+    uint32_t nextConnectionId = 1;
+    LogicGraph logic;
+    // Every world (player) the clients have reported on, the placement and
+    // the tracker changes: one room, run by roomHost on its worker. Sends
+    // and checks are posted to it as they are decoded; pollThread only
+    // touches it once settleRoom() has waited for them.
+    RoomHost roomHost;
+    Room& room;
+    bool roomRunning = false;
+    // messages posted since the last settleRoom(), reused after it, and
+    // how many of them the room has not handled yet
+    std::deque<RoomMessage> roomMessages;
+    size_t roomMessagesPosted = 0;
+    std::atomic<uint32_t> roomInFlight{ 0 };
+    unsigned seedWorkers = 0;
+    std::unique_ptr<SeedService> seeds;
+    // who is waiting on each seed job
+    struct SeedWaiter
+    {
+        uint32_t slot;
+        uint32_t connectionId;
+    };
+    std::map<uint32_t, std::vector<SeedWaiter>> seedWaiters;
+    std::string transferDirectory;
+    // files opened for transfers, with their checksums, by name
+    std::map<std::string, std::shared_ptr<const TransferSource>> transferFiles;
+    // the joined connection for each world, indexed by world
+    std::vector<Connection*> playerConnections;
+    std::vector<uint32_t> readyRecipients;
+    std::vector<uint8_t> flagUpdate;
+    // tracker subscribers, indexed by world
+    std::vector<std::vector<Connection*>> trackerSubscribers;
+    // fixed-rate subscribers with changes waiting, each listed once, and
+    // the soonest of their ticks
+    std::vector<Connection*> tickedSubscribers;
+    std::chrono::steady_clock::time_point nextTrackerTick;
+    // subscribed worlds changed since the last syncTrackers, each listed
+    // once, and what the room reported changed
+    std::vector<uint32_t> changedWorlds;
+    std::vector<uint8_t> worldChanged;
+    std::vector<uint32_t> roomChanged;
+    std::vector<uint8_t> trackerDelta;
+    // every live connection by slot (nullptr for a free one), the free
+    // slots, and the topics each slot is subscribed to
+    std::vector<Connection*> slotConnections;
+    std::vector<uint32_t> freeSlots;
+    TopicBus topics;
+    ServerMetrics metrics;
+    // polled by pollThread after the protocol sockets
+    std::unique_ptr<MetricsEndpoint> metricsEndpoint;
+    TrafficCapture* capture = nullptr;
+    EventLog eventLog;
+    std::string snapshotPath;
+    std::chrono::seconds snapshotInterval{ 0 };
+    std::chrono::steady_clock::time_point nextSnapshot;
+    SnapshotWriter snapshotWriter;
+    std::vector<uint8_t> snapshotImage;
+    // connections created by replayFrame, by captured id
+    std::map<uint32_t, std::unique_ptr<Connection>> replayConnections;
+
+    void pollCallback();
+
+    void acceptClient();
+
+    bool readFromClient(Connection& connection);
+
+    bool processFrames(Connection& connection);
+
+    void handleFrame(Connection& connection, const Protocol::FrameHeader& header, const uint8_t* payload);
+
+    // posts a send or check logged in the newest batch to the room; before
+    // start() it is handled on the spot
+    void postToRoom(RoomRequest request, uint32_t world, uint32_t id);
+
+    // waits until the room has handled everything posted, then lists the
+    // changed worlds that have tracker subscribers for syncTrackers
+    void settleRoom();
+
+    // RoomHost's completion hook, on the room's worker
+    static void roomHandled(RoomMessage* message, void* context);
+
+    // appends to the event log (if open) and holds the connection's replies
+    // from here on until the record is durable; false, and nothing appended,
+    // while the log is failing
+    bool logEvent(Connection& connection, const LogRecord& record);
+
+    // holds the connection's replies from here on until batch is durable
+    void holdReplies(Connection& connection, uint64_t batch);
+
+    // hands the writer a snapshot when one is due
+    void snapshotIfDue();
+
+    // sends whatever durable commits have released
+    void releaseDurableReplies();
+
+    void handleItemSend(Connection& connection, uint32_t world, uint32_t item);
+
+    void handleLocationCheck(Connection& connection, uint32_t world, uint32_t location);
+
+    void handleTrackerQuery(Connection& connection, uint32_t world);
+
+    void handleJoin(Connection& connection, uint32_t world);
+
+    void handleFlagSync(Connection& connection, const uint8_t* block);
+
+    // a zero tick sends every change as it happens
+    void handleTrackerSubscribe(Connection& connection, uint32_t world, uint64_t version, std::chrono::steady_clock::duration tick);
+
+    void handleTrackerAck(Connection& connection, const uint8_t* payload);
+
+    // brings every subscriber of a changed world up to date, or marks it
+    // for its next tick
+    void syncTrackers();
+
+    // sends the fixed-rate subscribers whose tick has come
+    void syncTrackerTicks();
+
+    void sendTrackerUpdate(Connection& connection);
+
+    void unsubscribeTracker(Connection& connection);
+
+    void handleSubscribe(Connection& connection, const uint8_t* payload, size_t length, bool subscribe);
+
+    void handlePublish(Connection& connection, const uint8_t* payload, size_t length);
+
+    void handleGenerateSeed(Connection& connection, const uint8_t* payload, size_t length);
+
+    // pushes seed job progress and results to whoever asked for them
+    void pollSeeds();
+
+    void sendSeedResult(Connection& connection, uint32_t job, const SeedResult& result);
+
+    // the connection a waiter is, unless it closed since
+    Connection* seedWaiter(const SeedWaiter& waiter) const;
+
+    void handleTransferRequest(Connection& connection, const uint8_t* payload, size_t length);
+
+    // the named file in the transfer directory, reopened if it changed; nullptr if
+    // there is none
+    std::shared_ptr<const TransferSource> transferFile(const std::string& name);
+
+    // sends transfer chunks until they are all sent, the socket is full or
+    // something else is waiting to go out; false if the connection failed
+    bool sendTransfers(Connection& connection);
+
+    void assignSlot(Connection& connection);
+
+    void releaseSlot(Connection& connection);
+
+    // moves queued deliveries to their recipients' connections, if joined
+    void deliverPending();
+
+    void queueFrame(Connection& connection, Protocol::MessageType type, const uint8_t* payload, size_t length);
+
+    void queueError(Connection& connection, Protocol::ErrorCode code);
+
+    bool flushClient(Connection& connection);
+
+    // sends queued topic messages until done (true) or the socket is full;
+    // with frameOnly, only the rest of a part-sent one
+    bool sendPublished(Connection& connection, bool frameOnly = false);
 
-    void acceptCallback();
+    void closeClient(size_t index);
 };
@@ -0,0 +1,112 @@
+#include "Room.hpp"
+
+Room::Room(uint32_t id) :
+    roomId(id), changes(MAX_PLAYERS), logicStates(MAX_PLAYERS), worldChanged(MAX_PLAYERS, 0)
+{
+
+}
+
+void Room::handle(RoomMessage& message)
+{
+    message.routed = false;
+    worldState.ensurePlayers(message.world + 1);
+    if (message.request == RoomRequest::ItemSend)
+    {
+        receiveItem(message.world, message.id, message.batch);
+        message.changed = true;
+        return;
+    }
+    // only the first check of a location hands out its item
+    message.changed = worldState.checkLocation(message.world, message.id);
+    if (!message.changed)
+    {
+        return;
+    }
+    recordChange(message.world, ChangeKind::LocationChecked, message.id, 0, message.batch);
+    const Route* route = placement.find(message.world, message.id);
+    if (route == nullptr || route->owner >= MAX_PLAYERS || route->item >= MAX_ITEMS)
+    {
+        return;
+    }
+    worldState.ensurePlayers(route->owner + 1);
+    receiveItem(route->owner, route->item, message.batch);
+    if (!message.recovered)
+    {
+        pending.push(route->owner, Delivery{ route->item, message.world, message.id, message.batch });
+        message.routed = true;
+    }
+}
+
+void Room::reset()
+{
+    worldState = WorldState();
+    changes.assign(MAX_PLAYERS, ChangeLog());
+    logicStates.assign(MAX_PLAYERS, LogicState());
+    changedWorlds.clear();
+    worldChanged.assign(MAX_PLAYERS, 0);
+}
+
+void Room::evaluateLogic()
+{
+    // derived, so not in a snapshot; nothing is recorded, as the change
+    // logs restart after the restored versions
+    for (uint32_t world = 0; logic != nullptr && !logic->empty() && world < worldState.playerCount(); world++)
+    {
+        logicStates[world].evaluateAll(*logic, worldState.itemCountBytes(world));
+    }
+}
+
+const uint64_t* Room::inLogicWords(uint32_t world) const
+{
+    if (logic == nullptr || logic->empty())
+    {
+        return nullptr;
+    }
+    return logicStates[world].evaluated() ? logicStates[world].locationWords() : logic->startLocationWords();
+}
+
+void Room::takeChangedWorlds(std::vector<uint32_t>& out)
+{
+    out.clear();
+    out.swap(changedWorlds);
+    for (uint32_t world : out)
+    {
+        worldChanged[world] = 0;
+    }
+}
+
+void Room::receiveItem(uint32_t world, uint32_t item, uint64_t batch)
+{
+    worldState.addItem(world, item);
+    recordChange(world, ChangeKind::ItemCount, item, worldState.itemCount(world, item), batch);
+    if (logic == nullptr || logic->empty())
+    {
+        return;
+    }
+    LogicState& state = logicStates[world];
+    if (state.evaluated())
+    {
+        state.addItem(*logic, worldState.itemCountBytes(world), item, cameIntoLogic);
+    }
+    else
+    {
+        // everything in logic is news to a delta subscriber, the locations
+        // needing no items included
+        state.evaluateAll(*logic, worldState.itemCountBytes(world), &cameIntoLogic);
+    }
+    for (const uint32_t location : cameIntoLogic)
+    {
+        recordChange(world, ChangeKind::InLogic, location, 0, batch);
+    }
+    cameIntoLogic.clear();
+}
+
+void Room::recordChange(uint32_t world, ChangeKind kind, uint32_t id, uint8_t value, uint64_t batch)
+{
+    changes[world].append(StateChange{ kind, value, static_cast<uint16_t>(id) }, batch);
+    if (!worldChanged[world])
+    {
+        worldChanged[world] = 1;
+        changedWorlds.push_back(world);
+    }
+}
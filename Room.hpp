@@ -0,0 +1,102 @@
+#pragma once
+
+#include "LogicGraph.hpp"
+#include "RoutingTable.hpp"
+#include "TrackerSync.hpp"
+#include "WorldState.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// One multiworld room as an actor: it owns its state, and only ever runs on
+// one thread at a time (see RoomHost), so nothing in it takes a lock.
+// Everything it does arrives as a RoomMessage in its mailbox.
+//
+// handle() is the only code that applies item sends and location checks:
+// ProtocolServer's requests, event log recovery and the benchmarks all go
+// through it.
+
+enum class RoomRequest : uint8_t
+{
+    ItemSend,
+    LocationCheck,
+};
+
+struct RoomMessage
+{
+    // mailbox link, owned by Utility::MpscQueue
+    std::atomic<RoomMessage*> queueNext{ nullptr };
+    RoomRequest request = RoomRequest::ItemSend;
+    uint32_t world = 0;
+    // the item or location
+    uint32_t id = 0;
+    // the event log batch the request is committed in, 0 for none; what it
+    // changes and routes is tagged with it
+    uint64_t batch = 0;
+    // replayed from the event log: the state changes, but an item routed
+    // before the restart is not queued for delivery again
+    bool recovered = false;
+    // set by the room: whether the request changed its state, and whether a
+    // check queued an item for its owner
+    bool changed = false;
+    bool routed = false;
+    // whoever posted the message, for the completion hook to hand it back
+    void* sender = nullptr;
+};
+
+class Room
+{
+public:
+    explicit Room(uint32_t id);
+
+    uint32_t id() const { return roomId; }
+
+    // the seed's logic, so changes include the locations coming into logic;
+    // kept by reference. Set before the first message.
+    void setLogic(const LogicGraph& graph) { logic = &graph; }
+
+    // only from the room's own thread (or before the host starts); ids are
+    // checked by whoever decoded the request
+    void handle(RoomMessage& message);
+
+    // Back to no players and no changes; the placement and logic stay.
+    void reset();
+
+    // evaluates the logic of every world from scratch, after a restore
+    void evaluateLogic();
+
+    WorldState& state() { return worldState; }
+
+    RoutingTable& routing() { return placement; }
+
+    DeliveryQueues& deliveries() { return pending; }
+
+    // tracker changes, indexed by world
+    std::vector<ChangeLog>& changeLogs() { return changes; }
+
+    // what a world has in logic, for its TrackerState; nullptr without logic
+    const uint64_t* inLogicWords(uint32_t world) const;
+
+    // swaps the worlds whose change log grew since the last call (each
+    // listed once) into out
+    void takeChangedWorlds(std::vector<uint32_t>& out);
+private:
+    uint32_t roomId;
+    WorldState worldState;
+    RoutingTable placement;
+    DeliveryQueues pending;
+    std::vector<ChangeLog> changes;
+    const LogicGraph* logic = nullptr;
+    // indexed by world; unevaluated until the world's first item
+    std::vector<LogicState> logicStates;
+    std::vector<uint32_t> cameIntoLogic;
+    std::vector<uint32_t> changedWorlds;
+    std::vector<uint8_t> worldChanged;
+
+    // adds the item and records the changes, locations coming into logic
+    // included
+    void receiveItem(uint32_t world, uint32_t item, uint64_t batch);
+
+    void recordChange(uint32_t world, ChangeKind kind, uint32_t id, uint8_t value, uint64_t batch);
+};
@@ -0,0 +1,83 @@
+#include "RoomHost.hpp"
+
+constexpr unsigned RoomHost::MAX_BATCH;
+constexpr unsigned RoomHost::SHARE_INTERVAL;
+
+RoomHost::RoomHost(unsigned workerCount, Completion complete, void* context, bool stealing) :
+    complete(complete), context(context), pool(workerCount, stealing)
+{
+    Metrics::Registry& registry = Metrics::registry();
+    messagesHandled = registry.counter("wwhd_room_messages_total", "Messages handled by room actors");
+    roomRuns = registry.counter("wwhd_room_runs_total", "Times a room with mail was run by a worker");
+}
+
+RoomHost::~RoomHost()
+{
+    stop();
+}
+
+Room& RoomHost::addRoom()
+{
+    const uint32_t id = static_cast<uint32_t>(rooms.size());
+    rooms.emplace_back(new RoomSlot(*this, id));
+    RoomSlot& slot = *rooms.back();
+    slot.run = &RoomHost::runRoom;
+    slot.home = id % pool.workerCount();
+    return slot.room;
+}
+
+void RoomHost::start()
+{
+    pool.start();
+}
+
+void RoomHost::stop()
+{
+    pool.stop();
+}
+
+void RoomHost::post(uint32_t roomId, RoomMessage* message)
+{
+    RoomSlot& slot = *rooms[roomId];
+    slot.mailbox.push(message);
+    if (!slot.scheduled.exchange(true, std::memory_order_acq_rel))
+    {
+        pool.post(&slot, slot.home);
+    }
+}
+
+void RoomHost::runRoom(Task& task, unsigned worker)
+{
+    RoomSlot& slot = static_cast<RoomSlot&>(task);
+    RoomHost& host = slot.host;
+    host.roomRuns.inc();
+    unsigned handled = 0;
+    while (handled < MAX_BATCH)
+    {
+        RoomMessage* message = slot.mailbox.pop();
+        if (message == nullptr)
+        {
+            break;
+        }
+        slot.room.handle(*message);
+        host.complete(message, host.context);
+        if (++handled % SHARE_INTERVAL == 0)
+        {
+            host.pool.share(worker);
+        }
+    }
+    host.messagesHandled.inc(handled);
+    if (handled == MAX_BATCH)
+    {
+        // more mail, maybe: back of this worker's line so other rooms get a
+        // turn (it is warm here, so it stays until it next goes idle)
+        host.pool.post(&slot, worker);
+        return;
+    }
+    slot.scheduled.store(false, std::memory_order_seq_cst);
+    // a post that saw scheduled still set left its message for us
+    if (!slot.mailbox.empty() && !slot.scheduled.exchange(true, std::memory_order_acq_rel))
+    {
+        host.pool.post(&slot, worker);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Executor.hpp"
+#include "Room.hpp"
+#include "utility/metrics.hpp"
+#include "utility/mpsc_queue.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Runs many rooms on an Executor. Each room has a lock-free mailbox that any
+// thread posts to; a room with mail is posted to the executor as a task once
+// (the scheduled flag), and whichever worker picks it up drains up to
+// MAX_BATCH messages before letting other tasks run. A room only ever runs
+// on one worker at a time, so its handlers need no locks.
+//
+// A room is always posted to its home worker (room id modulo the worker
+// count) so its state stays in one core's cache, but when that worker is
+// busy with a big room the executor lets idle workers steal it.
+class RoomHost
+{
+public:
+    // called on the room's worker once a message is handled; hands the
+    // message back to its sender
+    using Completion = void (*)(RoomMessage* message, void* context);
+
+    RoomHost(unsigned workerCount, Completion complete, void* context, bool stealing = true);
+
+    ~RoomHost();
+
+    RoomHost(const RoomHost&) = delete;
+    RoomHost& operator=(const RoomHost&) = delete;
+
+    // rooms are added before start()
+    Room& addRoom();
+
+    size_t roomCount() const { return rooms.size(); }
+
+    Room& room(uint32_t id) { return rooms[id]->room; }
+
+    // for request handling and other work that should share the room workers
+    Executor& executor() { return pool; }
+
+    void start();
+
+    // handles everything already posted, then joins the workers
+    void stop();
+
+    // any thread, any time between start() and stop()
+    void post(uint32_t roomId, RoomMessage* message);
+private:
+    static constexpr unsigned MAX_BATCH = 64;
+    // messages between offers of the worker's other tasks to thieves
+    static constexpr unsigned SHARE_INTERVAL = 8;
+
+    struct RoomSlot : Task
+    {
+        RoomSlot(RoomHost& host, uint32_t id) : host(host), room(id) {}
+
+        RoomHost& host;
+        Room room;
+        Utility::MpscQueue<RoomMessage> mailbox;
+        // true while the room is posted or running
+        std::atomic<bool> scheduled{ false };
+        unsigned home = 0;
+    };
+
+    Completion complete;
+    void* context;
+    Executor pool;
+    std::vector<std::unique_ptr<RoomSlot>> rooms;
+    Metrics::Counter messagesHandled;
+    Metrics::Counter roomRuns;
+
+    static void runRoom(Task& task, unsigned worker);
+};
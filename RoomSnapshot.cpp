@@ -0,0 +1,205 @@
+#include "RoomSnapshot.hpp"
+#include "utility/byteswap.hpp"
+#include "utility/log.hpp"
+#include "utility/mapped_file.hpp"
+#include "utility/platform.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string.h>
+
+namespace
+{
+    const uint8_t SNAPSHOT_MAGIC[8] = { 'W', 'W', 'H', 'D', 'S', 'N', 'P', 1 };
+    constexpr size_t SNAPSHOT_HEADER_SIZE = sizeof(SNAPSHOT_MAGIC) + 4 + 8 + MAX_PLAYERS * 8;
+    constexpr size_t SNAPSHOT_CHECK_SIZE = 4;
+
+    uint32_t fnv1a(const uint8_t* data, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    void putBigEndian(uint8_t*& out, T value)
+    {
+        value = Utility::toBigEndian(value);
+        memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+    }
+
+    template<typename T>
+    T getBigEndian(const uint8_t*& in)
+    {
+        T value;
+        memcpy(&value, in, sizeof(value));
+        in += sizeof(value);
+        return Utility::fromBigEndian(value);
+    }
+}
+
+void encodeRoomSnapshot(const WorldState& state, const std::vector<ChangeLog>& changeLogs,
+                        uint64_t logRecords, std::vector<uint8_t>& out)
+{
+    out.resize(SNAPSHOT_HEADER_SIZE + state.roomSnapshotSize() + SNAPSHOT_CHECK_SIZE);
+    uint8_t* cursor = out.data();
+    memcpy(cursor, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    cursor += sizeof(SNAPSHOT_MAGIC);
+    putBigEndian(cursor, state.playerCount());
+    putBigEndian(cursor, logRecords);
+    for (uint32_t world = 0; world < MAX_PLAYERS; world++)
+    {
+        putBigEndian(cursor, world < changeLogs.size() ? changeLogs[world].version() : uint64_t(0));
+    }
+    state.snapshotRoom(cursor);
+}
+
+bool writeRoomSnapshot(const std::string& path, std::vector<uint8_t>& image)
+{
+    uint8_t* check = image.data() + image.size() - SNAPSHOT_CHECK_SIZE;
+    putBigEndian(check, fnv1a(image.data(), image.size() - SNAPSHOT_CHECK_SIZE));
+
+    const std::string temporary = path + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        PLATFORM_LOG_ERROR(General, "could not create snapshot %s\n", temporary.c_str());
+        return false;
+    }
+    const bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size() && Utility::syncFile(file);
+    std::fclose(file);
+    if (!written || !Utility::replaceFile(temporary.c_str(), path.c_str()))
+    {
+        PLATFORM_LOG_ERROR(General, "could not write snapshot %s\n", path.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadRoomSnapshot(const std::string& path, WorldState& state, std::vector<ChangeLog>& changeLogs,
+                      uint64_t& logRecords)
+{
+    Utility::MappedFile file;
+    if (!file.open(path))
+    {
+        return false;
+    }
+    const uint8_t* in = file.data();
+    if (file.size() < SNAPSHOT_HEADER_SIZE + SNAPSHOT_CHECK_SIZE || memcmp(in, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+    {
+        PLATFORM_LOG_WARN(General, "%s is not a room snapshot\n", path.c_str());
+        return false;
+    }
+    in += sizeof(SNAPSHOT_MAGIC);
+    const uint32_t players = getBigEndian<uint32_t>(in);
+    const uint64_t records = getBigEndian<uint64_t>(in);
+    const size_t roomSize = players * sizeof(PlayerSnapshot) + SHARED_FLAG_BYTES;
+    const uint8_t* check = file.data() + SNAPSHOT_HEADER_SIZE + roomSize;
+    if (players > MAX_PLAYERS || file.size() != SNAPSHOT_HEADER_SIZE + roomSize + SNAPSHOT_CHECK_SIZE ||
+        getBigEndian<uint32_t>(check) != fnv1a(file.data(), SNAPSHOT_HEADER_SIZE + roomSize))
+    {
+        PLATFORM_LOG_WARN(General, "snapshot %s is damaged\n", path.c_str());
+        return false;
+    }
+    changeLogs.resize(MAX_PLAYERS);
+    for (uint32_t world = 0; world < MAX_PLAYERS; world++)
+    {
+        changeLogs[world].restart(getBigEndian<uint64_t>(in));
+    }
+    state.restoreRoom(players, in);
+    logRecords = records;
+    return true;
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    stop();
+}
+
+void SnapshotWriter::start(const std::string& snapshotPath)
+{
+    stop();
+    path = snapshotPath;
+    running = true;
+    writerThread = std::thread(&SnapshotWriter::writerCallback, this);
+}
+
+void SnapshotWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+        {
+            return;
+        }
+        running = false;
+    }
+    condition.notify_one();
+    writerThread.join();
+}
+
+bool SnapshotWriter::busy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+}
+
+bool SnapshotWriter::submit(std::vector<uint8_t>& image, const EventLog* log, uint64_t durableBatch)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending || !running)
+        {
+            return false;
+        }
+        submitted.swap(image);
+        eventLog = log;
+        waitBatch = durableBatch;
+        pending = true;
+    }
+    condition.notify_one();
+    return true;
+}
+
+void SnapshotWriter::writerCallback()
+{
+    std::vector<uint8_t> writing;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        condition.wait(lock, [this] { return !running || pending; });
+        if (!pending)
+        {
+            return;
+        }
+        writing.swap(submitted);
+        const EventLog* log = eventLog;
+        const uint64_t batch = waitBatch;
+        const bool stopping = !running;
+        lock.unlock();
+
+        // commits are milliseconds apart; a snapshot can wait for one
+        while (log != nullptr && log->durableBatch() < batch)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const auto start = std::chrono::steady_clock::now();
+        if (writeRoomSnapshot(path, writing))
+        {
+            PLATFORM_LOG_DEBUG(General, "wrote %zu byte snapshot in %.1f ms\n", writing.size(),
+                               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        lock.lock();
+        pending = false;
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "EventLog.hpp"
+#include "TrackerSync.hpp"
+#include "WorldState.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A point-in-time image of the whole room, so a restart only replays the
+// event log records after it instead of the whole race.
+//
+// File layout: the 8 byte magic "WWHDSNP" followed by the version byte, then
+// big-endian u32 player count, u64 event log records covered and
+// MAX_PLAYERS u64 tracker versions, then the room as
+// WorldState::snapshotRoom copies it (host byte order: a snapshot is read
+// back by the machine that wrote it), then a big-endian u32 FNV-1a of
+// everything before it.
+
+// builds the image on the calling thread: a plain copy of the room, with the
+// checksum left for writeRoomSnapshot
+void encodeRoomSnapshot(const WorldState& state, const std::vector<ChangeLog>& changeLogs,
+                        uint64_t logRecords, std::vector<uint8_t>& out);
+
+// fills in image's checksum, writes it next to path, syncs it and renames it
+// over path, so a crash leaves either the old snapshot or the new one
+bool writeRoomSnapshot(const std::string& path, std::vector<uint8_t>& image);
+
+// Restores the room (and the tracker versions) from the snapshot at path,
+// mapped rather than read. False, leaving everything untouched, if there
+// is none or it is damaged.
+bool loadRoomSnapshot(const std::string& path, WorldState& state, std::vector<ChangeLog>& changeLogs,
+                      uint64_t& logRecords);
+
+// Writes snapshots on its own thread. The poll thread encodes an image and
+// submits it; the writer waits until the event log has made every record
+// the image covers durable, so a snapshot never runs ahead of the log.
+class SnapshotWriter
+{
+public:
+    ~SnapshotWriter();
+
+    void start(const std::string& path);
+
+    // writes the last submitted image, if any, then stops the thread
+    void stop();
+
+    // true while a submitted image has not been written yet
+    bool busy();
+
+    // Takes image (swapping in a spare buffer) unless the previous one is
+    // still being written. It is written once log (if not null) has made
+    // durableBatch durable; log must stay open until then or stop().
+    bool submit(std::vector<uint8_t>& image, const EventLog* log, uint64_t durableBatch);
+private:
+    std::string path;
+    std::thread writerThread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<uint8_t> submitted;
+    const EventLog* eventLog = nullptr;
+    uint64_t waitBatch = 0;
+    bool pending = false;
+    bool running = false;
+
+    void writerCallback();
+};
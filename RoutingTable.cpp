@@ -0,0 +1,178 @@
+#include "RoutingTable.hpp"
+#include "PlacementFile.hpp"
+#include "utility/log.hpp"
+
+#include <algorithm>
+
+constexpr uint64_t RoutingTable::EMPTY_KEY;
+
+namespace
+{
+    constexpr size_t MIN_SLOTS = 16;
+}
+
+RoutingTable::RoutingTable()
+{
+    rehash(MIN_SLOTS);
+}
+
+void RoutingTable::reserve(size_t wanted)
+{
+    size_t slots = MIN_SLOTS;
+    while (slots < wanted * 2)
+    {
+        slots *= 2;
+    }
+    if (slots > entries.size())
+    {
+        rehash(slots);
+    }
+}
+
+void RoutingTable::insert(uint32_t world, uint32_t location, Route route)
+{
+    if ((count + 1) * 2 > entries.size())
+    {
+        rehash(entries.size() * 2);
+    }
+    if (world >= worlds && world != UINT32_MAX)
+    {
+        worlds = world + 1;
+    }
+    const uint64_t key = makeKey(world, location);
+    for (size_t index = slot(key);; index = (index + 1) & mask)
+    {
+        Entry& entry = entries[index];
+        if (entry.key == EMPTY_KEY)
+        {
+            entry.key = key;
+            entry.route = route;
+            count++;
+            shadowed += backing && backing->find(world, location) != nullptr;
+            return;
+        }
+        if (entry.key == key)
+        {
+            entry.route = route;
+            return;
+        }
+    }
+}
+
+void RoutingTable::rehash(size_t slots)
+{
+    std::vector<Entry> old;
+    old.swap(entries);
+    entries.assign(slots, Entry{ EMPTY_KEY, Route{ 0, 0 } });
+    mask = slots - 1;
+    shift = 64;
+    for (size_t size = slots; size > 1; size >>= 1)
+    {
+        shift--;
+    }
+    count = 0;
+    shadowed = 0;
+    for (const Entry& entry : old)
+    {
+        if (entry.key != EMPTY_KEY)
+        {
+            insert(static_cast<uint32_t>(entry.key >> 32), static_cast<uint32_t>(entry.key), entry.route);
+        }
+    }
+}
+
+double RoutingTable::averageProbeLength() const
+{
+    if (count == 0)
+    {
+        return 0.0;
+    }
+    uint64_t probes = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].key != EMPTY_KEY)
+        {
+            probes += ((i - slot(entries[i].key)) & mask) + 1;
+        }
+    }
+    return static_cast<double>(probes) / count;
+}
+
+size_t RoutingTable::size() const
+{
+    return count + (backing ? backing->size() - shadowed : 0);
+}
+
+uint32_t RoutingTable::worldCount() const
+{
+    return backing ? std::max(worlds, backing->worldCount()) : worlds;
+}
+
+const Route* RoutingTable::findBacked(uint32_t world, uint32_t location) const
+{
+    return backing->find(world, location);
+}
+
+void RoutingTable::clear()
+{
+    backing.reset();
+    entries.clear();
+    rehash(MIN_SLOTS);
+    worlds = 0;
+}
+
+void RoutingTable::attach(std::shared_ptr<const PlacementFile> file)
+{
+    clear();
+    backing = std::move(file);
+}
+
+bool RoutingTable::loadFile(const std::string& path)
+{
+    clear();
+    std::shared_ptr<PlacementFile> file = std::make_shared<PlacementFile>();
+    if (!file->open(path))
+    {
+        return false;
+    }
+    attach(std::move(file));
+    PLATFORM_LOG_INFO(General, "loaded %zu placements from %s\n", size(), path.c_str());
+    return true;
+}
+
+void DeliveryQueues::ensureRecipient(uint32_t recipient)
+{
+    if (recipient >= queues.size())
+    {
+        queues.resize(recipient + 1);
+        listed.resize(recipient + 1, 0);
+    }
+}
+
+void DeliveryQueues::push(uint32_t recipient, const Delivery& delivery)
+{
+    ensureRecipient(recipient);
+    queues[recipient].push_back(delivery);
+    queued++;
+    markReady(recipient);
+}
+
+void DeliveryQueues::markReady(uint32_t recipient)
+{
+    ensureRecipient(recipient);
+    if (!listed[recipient] && !queues[recipient].empty())
+    {
+        listed[recipient] = 1;
+        readyRecipients.push_back(recipient);
+    }
+}
+
+void DeliveryQueues::takeReady(std::vector<uint32_t>& out)
+{
+    out.clear();
+    out.swap(readyRecipients);
+    for (uint32_t recipient : out)
+    {
+        listed[recipient] = 0;
+    }
+}
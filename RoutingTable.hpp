@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where every item in a multiworld seed lives: (world, location) -> the
+// player the item belongs to and the item itself.
+//
+// A flat open-addressing table with linear probing, kept at most half full.
+// Entries are 16 bytes, four to a cache line, so a lookup is almost always
+// one hashed load that finds the entry or an empty slot straight away.
+//
+// A table can also sit on top of a PlacementFile; that is how a loaded
+// placement is read without building the table. The hash table is then
+// only an overlay for routes insert() adds or replaces, which the server
+// never calls, so while it is empty a lookup goes straight to the file.
+
+struct Route
+{
+    uint32_t owner;
+    uint32_t item;
+};
+
+class PlacementFile;
+
+class RoutingTable
+{
+public:
+    RoutingTable();
+
+    // sized so count entries fit without growing
+    void reserve(size_t count);
+
+    // replaces any existing route for (world, location)
+    void insert(uint32_t world, uint32_t location, Route route);
+
+    // nullptr if nothing is placed there
+    const Route* find(uint32_t world, uint32_t location) const
+    {
+        if (backing && count == 0)
+        {
+            return findBacked(world, location);
+        }
+        const uint64_t key = makeKey(world, location);
+        for (size_t index = slot(key);; index = (index + 1) & mask)
+        {
+            const Entry& entry = entries[index];
+            if (entry.key == key)
+            {
+                return &entry.route;
+            }
+            if (entry.key == EMPTY_KEY)
+            {
+                return backing ? findBacked(world, location) : nullptr;
+            }
+        }
+    }
+
+    size_t size() const;
+
+    // one past the highest world anything is placed in
+    uint32_t worldCount() const;
+
+    size_t capacity() const { return entries.size(); }
+
+    // mean number of slots a successful lookup touches
+    double averageProbeLength() const;
+
+    // Reads a placement file: {"placements": [[world, location, owner, item], ...]},
+    // through its PlacementFile cache. Replaces the current contents; false
+    // (and empty) on a malformed file.
+    bool loadFile(const std::string& path);
+
+    // Replaces the current contents with file's placements, which stay in
+    // file; rooms on the same seed can share one.
+    void attach(std::shared_ptr<const PlacementFile> file);
+private:
+    struct Entry
+    {
+        uint64_t key;
+        Route route;
+    };
+
+    static constexpr uint64_t EMPTY_KEY = UINT64_MAX;
+
+    std::vector<Entry> entries;
+    size_t mask = 0;
+    unsigned shift = 64;
+    size_t count = 0;
+    uint32_t worlds = 0;
+    std::shared_ptr<const PlacementFile> backing;
+    // entries that replace a route in backing
+    size_t shadowed = 0;
+
+    static uint64_t makeKey(uint32_t world, uint32_t location)
+    {
+        return (static_cast<uint64_t>(world) << 32) | location;
+    }
+
+    // Fibonacci hashing: the multiply mixes world and location into the top
+    // bits, which pick the slot
+    size_t slot(uint64_t key) const
+    {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    void rehash(size_t slots);
+
+    const Route* findBacked(uint32_t world, uint32_t location) const;
+
+    void clear();
+};
+
+// an item on its way to the player who owns it
+struct Delivery
+{
+    uint32_t item;
+    uint32_t fromWorld;
+    uint32_t location;
+    // the event log batch the check that routed it is committed in; it is
+    // not sent before that is durable
+    uint64_t batch;
+};
+
+// Items waiting for their recipient, one FIFO per player. Recipients with
+// something queued are listed in ready() until the owner takes the list, so
+// handing out deliveries never scans idle players.
+class DeliveryQueues
+{
+public:
+    void push(uint32_t recipient, const Delivery& delivery);
+
+    // lists recipient in ready() again if it still has deliveries queued
+    void markReady(uint32_t recipient);
+
+    // swaps the ready list into out and starts a new one
+    void takeReady(std::vector<uint32_t>& out);
+
+    std::deque<Delivery>& queue(uint32_t recipient) { return queues[recipient]; }
+
+    // deliveries queued over every recipient
+    size_t pending() const { return queued; }
+
+    void popFront(uint32_t recipient)
+    {
+        queues[recipient].pop_front();
+        queued--;
+    }
+private:
+    std::vector<std::deque<Delivery>> queues;
+    std::vector<uint8_t> listed;
+    std::vector<uint32_t> readyRecipients;
+    size_t queued = 0;
+
+    void ensureRecipient(uint32_t recipient);
+};
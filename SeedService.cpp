@@ -0,0 +1,315 @@
+#include "SeedService.hpp"
+#include "utility/bits.hpp"
+#include "json.hpp"
+
+#include <chrono>
+#include <string.h>
+
+namespace
+{
+    constexpr uint32_t MAX_FILL_ATTEMPTS = 16;
+
+    // splitmix64, to spread a seed over the generator's state
+    uint64_t mix(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    // xorshift64*: defined here rather than taken from <random> so a seed
+    // places the same items with every standard library
+    class Random
+    {
+    public:
+        explicit Random(uint64_t seed) : state(mix(seed) | 1) {}
+
+        uint64_t next()
+        {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 0x2545F4914F6CDD1DULL;
+        }
+
+        // [0, bound)
+        uint64_t below(uint64_t bound)
+        {
+            return next() % bound;
+        }
+    private:
+        uint64_t state;
+    };
+
+    // takes the pick-th location that is both reachable and open out of
+    // open, or if there are not that many, lowers pick by how many there are
+    bool takeNth(const uint64_t* reachable, uint64_t* open, uint64_t& pick, uint32_t& location)
+    {
+        for (size_t i = 0; i < LOCATION_WORDS; i++)
+        {
+            uint64_t word = reachable[i] & open[i];
+            const unsigned bits = Utility::popCount(word);
+            if (pick >= bits)
+            {
+                pick -= bits;
+                continue;
+            }
+            for (; pick > 0; pick--)
+            {
+                word &= word - 1;
+            }
+            const unsigned bit = Utility::countTrailingZeros(word);
+            open[i] &= ~(uint64_t(1) << bit);
+            location = static_cast<uint32_t>(i * 64 + bit);
+            return true;
+        }
+        return false;
+    }
+}
+
+uint64_t SeedSettings::hash() const
+{
+    // FNV-1a over the fields, in order
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    const uint32_t fields[] = { worlds, junkItem };
+    for (const uint32_t field : fields)
+    {
+        for (unsigned shift = 0; shift < 32; shift += 8)
+        {
+            hash = (hash ^ ((field >> shift) & 0xFF)) * 0x100000001B3ULL;
+        }
+    }
+    return hash;
+}
+
+bool generateSeed(const LogicGraph& logic, const SeedSettings& settings, uint64_t seed,
+                  std::vector<SeedPlacement>& out, std::string& error,
+                  const std::function<bool(uint32_t done, uint32_t total)>& progress)
+{
+    const uint32_t worlds = settings.worlds;
+    const uint8_t* progression = logic.progressionCounts();
+    std::vector<std::pair<uint32_t, uint32_t>> pool;
+    for (uint32_t world = 0; world < worlds; world++)
+    {
+        for (uint32_t item = 0; item < MAX_ITEMS; item++)
+        {
+            pool.insert(pool.end(), progression[item], std::make_pair(world, item));
+        }
+    }
+    if (pool.size() > logic.locationCount() * worlds)
+    {
+        error = "more progression items than locations";
+        return false;
+    }
+
+    std::vector<uint8_t> counts(static_cast<size_t>(worlds) * MAX_ITEMS);
+    std::vector<uint64_t> open(static_cast<size_t>(worlds) * LOCATION_WORDS);
+    std::vector<LogicState> states(worlds);
+    const uint32_t total = static_cast<uint32_t>(pool.size());
+    out.reserve(logic.locationCount() * worlds);
+    // a tight logic can paint the fill into a corner; another order usually
+    // gets through
+    for (uint32_t attempt = 0; attempt < MAX_FILL_ATTEMPTS; attempt++)
+    {
+        Random random(mix(seed ^ settings.hash()) + attempt);
+        for (size_t i = pool.size(); i > 1; i--)
+        {
+            std::swap(pool[i - 1], pool[random.below(i)]);
+        }
+        // every world starts out assuming it has all of its progression
+        out.clear();
+        for (uint32_t world = 0; world < worlds; world++)
+        {
+            memcpy(&counts[world * MAX_ITEMS], progression, MAX_ITEMS);
+            memcpy(&open[world * LOCATION_WORDS], logic.locationWords(), LOCATION_WORDS * sizeof(uint64_t));
+            states[world].evaluateAll(logic, &counts[world * MAX_ITEMS]);
+        }
+
+        uint32_t placed = 0;
+        for (; placed < total; placed++)
+        {
+            const uint32_t owner = pool[placed].first;
+            const uint32_t item = pool[placed].second;
+            // the item goes somewhere reachable without it; only its
+            // owner's logic changes
+            counts[owner * MAX_ITEMS + item]--;
+            states[owner].evaluateAll(logic, &counts[owner * MAX_ITEMS]);
+
+            uint64_t candidates = 0;
+            for (uint32_t world = 0; world < worlds; world++)
+            {
+                const uint64_t* reachable = states[world].locationWords();
+                for (size_t i = 0; i < LOCATION_WORDS; i++)
+                {
+                    candidates += Utility::popCount(reachable[i] & open[world * LOCATION_WORDS + i]);
+                }
+            }
+            if (candidates == 0)
+            {
+                error = "no location in logic left for item " + std::to_string(item) + " of world " + std::to_string(owner);
+                break;
+            }
+            uint64_t pick = random.below(candidates);
+            for (uint32_t world = 0;; world++)
+            {
+                uint32_t location;
+                if (takeNth(states[world].locationWords(), &open[world * LOCATION_WORDS], pick, location))
+                {
+                    out.push_back(SeedPlacement{ world, location, owner, item });
+                    break;
+                }
+            }
+            if (progress && !progress(placed + 1, total))
+            {
+                error = "cancelled";
+                return false;
+            }
+        }
+        if (placed < total)
+        {
+            continue;
+        }
+
+        for (uint32_t world = 0; world < worlds; world++)
+        {
+            for (size_t i = 0; i < LOCATION_WORDS; i++)
+            {
+                for (uint64_t word = open[world * LOCATION_WORDS + i]; word != 0; word &= word - 1)
+                {
+                    out.push_back(SeedPlacement{ world, static_cast<uint32_t>(i * 64 + Utility::countTrailingZeros(word)),
+                                                 world, settings.junkItem });
+                }
+            }
+        }
+        error.clear();
+        return true;
+    }
+    out.clear();
+    error += " after " + std::to_string(MAX_FILL_ATTEMPTS) + " attempts";
+    return false;
+}
+
+SeedService::SeedService(const LogicGraph& logic, unsigned workers) :
+    logic(logic), executor(workers)
+{
+    Metrics::Registry& registry = Metrics::registry();
+    jobsRun = registry.counter("wwhd_seed_jobs_total", "Seeds generated, or failed to generate");
+    cacheHits = registry.counter("wwhd_seed_cache_hits_total", "Seed requests answered from the cache");
+    generationTime = registry.histogram("wwhd_seed_generation_ns", "Time to generate one seed, in nanoseconds");
+}
+
+SeedService::~SeedService()
+{
+    stop();
+}
+
+void SeedService::start()
+{
+    stopping = false;
+    executor.start();
+}
+
+void SeedService::stop()
+{
+    stopping = true;
+    // runs what is queued, which gives up at once
+    executor.stop();
+    jobs.clear();
+}
+
+std::shared_ptr<const SeedResult> SeedService::cached(const SeedSettings& settings, uint64_t seed)
+{
+    return cached(settings.hash(), seed);
+}
+
+std::shared_ptr<const SeedResult> SeedService::cached(uint64_t settingsHash, uint64_t seed)
+{
+    const auto entry = cache.find(Key(settingsHash, seed));
+    if (entry == cache.end())
+    {
+        return nullptr;
+    }
+    recent.splice(recent.begin(), recent, entry->second.use);
+    cacheHits.inc();
+    return entry->second.result;
+}
+
+uint32_t SeedService::submit(const SeedSettings& settings, uint64_t seed)
+{
+    const Key key(settings.hash(), seed);
+    for (const std::unique_ptr<Job>& running : jobs)
+    {
+        if (running->key == key)
+        {
+            return running->id;
+        }
+    }
+    if (jobs.size() >= MAX_SEED_JOBS)
+    {
+        return 0;
+    }
+    std::unique_ptr<Job> job(new Job());
+    job->run = &SeedService::runJob;
+    job->service = this;
+    job->id = nextJob++;
+    job->key = key;
+    job->settings = settings;
+    job->result.settingsHash = key.first;
+    job->result.seed = seed;
+    // spread over the workers; stealing evens out the rest
+    executor.post(job.get(), nextWorker++);
+    jobs.push_back(std::move(job));
+    return jobs.back()->id;
+}
+
+void SeedService::runJob(Task& task, unsigned)
+{
+    Job& job = static_cast<Job&>(task);
+    SeedService& service = *job.service;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<SeedPlacement> placements;
+    const bool generated = !service.stopping.load(std::memory_order_relaxed) &&
+        generateSeed(service.logic, job.settings, job.result.seed, placements, job.result.error,
+                     [&](uint32_t done, uint32_t total)
+    {
+        job.total.store(total, std::memory_order_relaxed);
+        job.done.store(done, std::memory_order_relaxed);
+        return !service.stopping.load(std::memory_order_relaxed);
+    });
+    if (generated)
+    {
+        nlohmann::json encoded = nlohmann::json::array();
+        for (const SeedPlacement& placement : placements)
+        {
+            encoded.push_back({ placement.world, placement.location, placement.owner, placement.item });
+        }
+        job.result.placements = encoded.dump();
+    }
+    else if (job.result.error.empty())
+    {
+        job.result.error = "cancelled";
+    }
+    service.jobsRun.inc();
+    service.generationTime.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count()));
+    job.finished.store(true, std::memory_order_release);
+}
+
+std::shared_ptr<const SeedResult> SeedService::finish(Job& job)
+{
+    std::shared_ptr<const SeedResult> result = std::make_shared<SeedResult>(std::move(job.result));
+    // failures are not kept: a cancelled job would stay cancelled
+    if (!result->error.empty() || cache.count(job.key) != 0)
+    {
+        return result;
+    }
+    if (cache.size() >= MAX_CACHED_SEEDS)
+    {
+        cache.erase(recent.back());
+        recent.pop_back();
+    }
+    recent.push_front(job.key);
+    cache[job.key] = CacheEntry{ result, recent.begin() };
+    return result;
+}
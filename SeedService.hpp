@@ -0,0 +1,157 @@
+#pragma once
+
+#include "utility/metrics.hpp"
+#include "Executor.hpp"
+#include "LogicGraph.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Seed generation off the protocol loop: jobs run on their own Executor, the
+// poll thread collects their progress and results with poll(), and finished
+// seeds are cached by (settings hash, seed) so asking for the same seed again
+// costs nothing. A request for a seed that is already being generated joins
+// that job.
+
+// results too big for one SeedResult frame are fetched with a transfer
+constexpr uint32_t MAX_SEED_WORLDS = MAX_PLAYERS;
+constexpr size_t MAX_CACHED_SEEDS = 64;
+// jobs queued or running at once, across every connection
+constexpr size_t MAX_SEED_JOBS = 32;
+
+struct SeedSettings
+{
+    uint32_t worlds = 1;
+    // fills every location progression does not need
+    uint32_t junkItem = 0;
+
+    uint64_t hash() const;
+};
+
+struct SeedPlacement
+{
+    uint32_t world;
+    uint32_t location;
+    uint32_t owner;
+    uint32_t item;
+};
+
+// Assumed fill over settings.worlds copies of logic: every progression item
+// (LogicGraph::progressionCounts) is placed, in a random order, at a random
+// open location that is in logic with all the items not yet placed. The rest
+// get the junk item; a fill that gets stuck starts over in another order, a
+// few times. The same settings and seed always give the same placement.
+// progress(done, total) is called after each progression item placed and
+// stops the fill by returning false.
+bool generateSeed(const LogicGraph& logic, const SeedSettings& settings, uint64_t seed,
+                  std::vector<SeedPlacement>& out, std::string& error,
+                  const std::function<bool(uint32_t done, uint32_t total)>& progress = nullptr);
+
+struct SeedResult
+{
+    uint64_t settingsHash;
+    uint64_t seed;
+    // the placements as a JSON array in the RoutingTable::loadFile format;
+    // empty on error
+    std::string placements;
+    std::string error;
+};
+
+class SeedService
+{
+public:
+    SeedService(const LogicGraph& logic, unsigned workers);
+
+    ~SeedService();
+
+    void start();
+
+    // abandons queued and running jobs
+    void stop();
+
+    // the rest is for one thread, the protocol's poll thread
+
+    // the cached result for settings and seed, or nullptr
+    std::shared_ptr<const SeedResult> cached(const SeedSettings& settings, uint64_t seed);
+
+    std::shared_ptr<const SeedResult> cached(uint64_t settingsHash, uint64_t seed);
+
+    // queues a job, or returns the id of the one already running for the
+    // same settings and seed; 0 if that would be more than MAX_SEED_JOBS
+    uint32_t submit(const SeedSettings& settings, uint64_t seed);
+
+    bool busy() const { return !jobs.empty(); }
+
+    // Calls onProgress(job id, done, total) for every job that got further
+    // since the last poll, and onDone(job id, result) once a job is
+    // finished; the result is cached by then.
+    template<typename Progress, typename Done>
+    void poll(Progress onProgress, Done onDone)
+    {
+        for (size_t i = jobs.size(); i-- > 0;)
+        {
+            Job& job = *jobs[i];
+            if (job.finished.load(std::memory_order_acquire))
+            {
+                std::shared_ptr<const SeedResult> result = finish(job);
+                const uint32_t id = job.id;
+                jobs[i] = std::move(jobs.back());
+                jobs.pop_back();
+                onDone(id, result);
+                continue;
+            }
+            const uint32_t done = job.done.load(std::memory_order_relaxed);
+            if (done != job.reportedDone)
+            {
+                job.reportedDone = done;
+                onProgress(job.id, done, job.total.load(std::memory_order_relaxed));
+            }
+        }
+    }
+private:
+    using Key = std::pair<uint64_t, uint64_t>;
+
+    struct Job : Task
+    {
+        SeedService* service;
+        uint32_t id;
+        Key key;
+        SeedSettings settings;
+        std::atomic<uint32_t> done{ 0 };
+        std::atomic<uint32_t> total{ 0 };
+        std::atomic<bool> finished{ false };
+        SeedResult result;
+        // what poll() last reported
+        uint32_t reportedDone = 0;
+    };
+
+    struct CacheEntry
+    {
+        std::shared_ptr<const SeedResult> result;
+        // position in recent, most recently used first
+        std::list<Key>::iterator use;
+    };
+
+    const LogicGraph& logic;
+    Executor executor;
+    std::atomic<bool> stopping{ false };
+    std::vector<std::unique_ptr<Job>> jobs;
+    uint32_t nextJob = 1;
+    unsigned nextWorker = 0;
+    std::map<Key, CacheEntry> cache;
+    std::list<Key> recent;
+    Metrics::Counter jobsRun;
+    Metrics::Counter cacheHits;
+    Metrics::Histogram generationTime;
+
+    static void runJob(Task& task, unsigned worker);
+
+    // caches a finished job's result and hands it out
+    std::shared_ptr<const SeedResult> finish(Job& job);
+};
@@ -0,0 +1,103 @@
+#include "TopicBus.hpp"
+
+#include <algorithm>
+
+SharedFrame* SharedFrame::create(std::vector<uint8_t>&& bytes)
+{
+    return new SharedFrame(std::move(bytes));
+}
+
+void SharedFrameQueue::consume(size_t count)
+{
+    frontOffset += count;
+    if (frontOffset == frames[front]->size())
+    {
+        queuedBytes -= frontOffset;
+        frontOffset = 0;
+        frames[front++]->release();
+        if (front == frames.size())
+        {
+            frames.clear();
+            front = 0;
+        }
+        else if (front >= 64 && front * 2 >= frames.size())
+        {
+            // a connection that never quite catches up
+            frames.erase(frames.begin(), frames.begin() + front);
+            front = 0;
+        }
+    }
+}
+
+void SharedFrameQueue::clear()
+{
+    for (size_t i = front; i < frames.size(); i++)
+    {
+        frames[i]->release();
+    }
+    frames.clear();
+    front = 0;
+    queuedBytes = 0;
+    frontOffset = 0;
+}
+
+bool TopicBus::subscribe(uint32_t topic, uint32_t slot)
+{
+    if (topic >= bitmaps.size())
+    {
+        bitmaps.resize(topic + 1);
+        counts.resize(topic + 1, 0);
+    }
+    std::vector<uint64_t>& words = bitmaps[topic];
+    if (slot / 64 >= words.size())
+    {
+        words.resize(slot / 64 + 1, 0);
+    }
+    const uint64_t mask = uint64_t(1) << (slot % 64);
+    if (words[slot / 64] & mask)
+    {
+        return false;
+    }
+    words[slot / 64] |= mask;
+    counts[topic]++;
+    if (slot >= slotTopics.size())
+    {
+        slotTopics.resize(slot + 1);
+    }
+    slotTopics[slot].push_back(topic);
+    return true;
+}
+
+bool TopicBus::unsubscribe(uint32_t topic, uint32_t slot)
+{
+    if (topic >= bitmaps.size() || slot / 64 >= bitmaps[topic].size())
+    {
+        return false;
+    }
+    const uint64_t mask = uint64_t(1) << (slot % 64);
+    uint64_t& word = bitmaps[topic][slot / 64];
+    if (!(word & mask))
+    {
+        return false;
+    }
+    word &= ~mask;
+    counts[topic]--;
+    std::vector<uint32_t>& topics = slotTopics[slot];
+    topics.erase(std::find(topics.begin(), topics.end(), topic));
+    return true;
+}
+
+void TopicBus::removeSlot(uint32_t slot)
+{
+    if (slot >= slotTopics.size())
+    {
+        return;
+    }
+    const uint64_t mask = uint64_t(1) << (slot % 64);
+    for (uint32_t topic : slotTopics[slot])
+    {
+        bitmaps[topic][slot / 64] &= ~mask;
+        counts[topic]--;
+    }
+    slotTopics[slot].clear();
+}
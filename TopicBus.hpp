@@ -0,0 +1,129 @@
+#pragma once
+
+#include "utility/bits.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Topic publish/subscribe for the poll thread. Connections are known by a
+// dense slot index; each topic keeps a bitmap over slots, so a publish walks
+// one topic's words and visits each set bit, and a connection's topics are
+// also kept per slot so dropping it only touches those topics.
+//
+// A published frame is built once as a SharedFrame and every subscriber
+// queues a reference to it rather than a copy. The reference count is not
+// atomic: frames never leave the poll thread.
+
+constexpr uint32_t MAX_TOPICS = 4096;
+
+class SharedFrame
+{
+public:
+    // a complete frame (header included) with one reference, the caller's
+    static SharedFrame* create(std::vector<uint8_t>&& bytes);
+
+    const uint8_t* data() const { return bytes.data(); }
+
+    size_t size() const { return bytes.size(); }
+
+    void retain() { references++; }
+
+    void release()
+    {
+        if (--references == 0)
+        {
+            delete this;
+        }
+    }
+private:
+    explicit SharedFrame(std::vector<uint8_t>&& bytes) : bytes(std::move(bytes)) {}
+
+    uint32_t references = 1;
+    std::vector<uint8_t> bytes;
+};
+
+// shared frames waiting to go out on one connection, oldest first
+class SharedFrameQueue
+{
+public:
+    SharedFrameQueue() = default;
+
+    ~SharedFrameQueue() { clear(); }
+
+    SharedFrameQueue(const SharedFrameQueue&) = delete;
+    SharedFrameQueue& operator=(const SharedFrameQueue&) = delete;
+
+    void push(SharedFrame* frame)
+    {
+        frame->retain();
+        frames.push_back(frame);
+        queuedBytes += frame->size();
+    }
+
+    bool empty() const { return front == frames.size(); }
+
+    // bytes not yet sent, counting the part of the front frame already sent
+    size_t pendingBytes() const { return queuedBytes - frontOffset; }
+
+    // true if the front frame went out in part
+    bool midFrame() const { return frontOffset != 0; }
+
+    // the unsent rest of the front frame; the queue must not be empty
+    const uint8_t* frontData() const { return frames[front]->data() + frontOffset; }
+
+    size_t frontRemaining() const { return frames[front]->size() - frontOffset; }
+
+    // marks count bytes of the front frame sent, popping it once it all is
+    void consume(size_t count);
+
+    void clear();
+private:
+    // sent frames before front are dropped in bulk once the queue empties
+    // (or is half sent), which keeps a push to one plain vector append
+    std::vector<SharedFrame*> frames;
+    size_t front = 0;
+    size_t queuedBytes = 0;
+    size_t frontOffset = 0;
+};
+
+class TopicBus
+{
+public:
+    // false if already subscribed; topic must be below MAX_TOPICS
+    bool subscribe(uint32_t topic, uint32_t slot);
+
+    // false if not subscribed
+    bool unsubscribe(uint32_t topic, uint32_t slot);
+
+    // drops every subscription of slot, for a closing connection
+    void removeSlot(uint32_t slot);
+
+    size_t subscriberCount(uint32_t topic) const { return topic < counts.size() ? counts[topic] : 0; }
+
+    // calls visit(slot) for every subscriber of topic, in slot order
+    template<typename Visit>
+    void forEachSubscriber(uint32_t topic, Visit visit) const
+    {
+        if (subscriberCount(topic) == 0)
+        {
+            return;
+        }
+        const std::vector<uint64_t>& words = bitmaps[topic];
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            uint64_t word = words[i];
+            while (word != 0)
+            {
+                visit(static_cast<uint32_t>(i * 64 + Utility::countTrailingZeros(word)));
+                word &= word - 1;
+            }
+        }
+    }
+private:
+    // by topic, each sized to cover its highest subscribed slot
+    std::vector<std::vector<uint64_t>> bitmaps;
+    std::vector<uint32_t> counts;
+    // by slot
+    std::vector<std::vector<uint32_t>> slotTopics;
+};
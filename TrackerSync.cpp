@@ -0,0 +1,108 @@
+#include "TrackerSync.hpp"
+#include "Protocol.hpp"
+#include "utility/bits.hpp"
+#include "utility/byteswap.hpp"
+#include "json.hpp"
+
+#include <string.h>
+
+constexpr size_t ChangeLog::CAPACITY;
+
+namespace
+{
+    // ids of every kind fit below this (event flags have the most)
+    constexpr size_t COLLAPSE_IDS = MAX_EVENT_FLAGS;
+    constexpr size_t COLLAPSE_KINDS = 4;
+
+    void encodeChange(const StateChange& change, uint8_t* out)
+    {
+        const uint16_t id = Utility::toBigEndian(change.id);
+        out[0] = static_cast<uint8_t>(change.kind);
+        out[1] = change.value;
+        memcpy(out + 2, &id, sizeof(id));
+    }
+
+    // the index of every set bit, walking only those
+    void appendSetBits(const uint64_t* words, size_t count, nlohmann::json& out)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            for (uint64_t word = words[i]; word != 0; word &= word - 1)
+            {
+                out.push_back(static_cast<uint32_t>(i * 64 + Utility::countTrailingZeros(word)));
+            }
+        }
+    }
+}
+
+void ChangeLog::encodeDelta(uint64_t since, std::vector<uint8_t>& out, bool collapse) const
+{
+    const size_t start = out.size();
+    out.resize(start + Protocol::TRACKER_DELTA_HEADER_SIZE + (head - since) * Protocol::TRACKER_DELTA_ENTRY_SIZE);
+    uint8_t* cursor = out.data() + start;
+
+    const uint64_t from = Utility::toBigEndian(since);
+    const uint64_t to = Utility::toBigEndian(head);
+    memcpy(cursor, &from, sizeof(from));
+    memcpy(cursor + sizeof(from), &to, sizeof(to));
+    cursor += Protocol::TRACKER_DELTA_HEADER_SIZE;
+
+    if (!collapse)
+    {
+        for (uint64_t version = since; version < head; version++)
+        {
+            encodeChange(ring[version & (CAPACITY - 1)], cursor);
+            cursor += Protocol::TRACKER_DELTA_ENTRY_SIZE;
+        }
+        return;
+    }
+
+    // newest first, skipping anything already seen, written from the back
+    // of the space so the kept entries end up oldest first
+    uint64_t seen[COLLAPSE_KINDS * COLLAPSE_IDS / 64] = {};
+    uint8_t* back = cursor + (head - since) * Protocol::TRACKER_DELTA_ENTRY_SIZE;
+    for (uint64_t version = head; version-- > since;)
+    {
+        const StateChange& change = ring[version & (CAPACITY - 1)];
+        const size_t key = static_cast<size_t>(change.kind) * COLLAPSE_IDS + change.id;
+        if (static_cast<size_t>(change.kind) < COLLAPSE_KINDS && change.id < COLLAPSE_IDS)
+        {
+            uint64_t& word = seen[key / 64];
+            const uint64_t mask = uint64_t(1) << (key % 64);
+            if (word & mask)
+            {
+                continue;
+            }
+            word |= mask;
+        }
+        back -= Protocol::TRACKER_DELTA_ENTRY_SIZE;
+        encodeChange(change, back);
+    }
+    const size_t kept = cursor + (head - since) * Protocol::TRACKER_DELTA_ENTRY_SIZE - back;
+    memmove(cursor, back, kept);
+    out.resize(start + Protocol::TRACKER_DELTA_HEADER_SIZE + kept);
+}
+
+std::string encodeTrackerState(const WorldState& state, uint32_t world, uint64_t version, const uint64_t* inLogic)
+{
+    nlohmann::json tracker = { { "world", world }, { "version", version },
+                               { "items", nlohmann::json::array() }, { "checked", nlohmann::json::array() } };
+    if (world < state.playerCount())
+    {
+        nlohmann::json& items = tracker["items"];
+        const uint8_t* counts = state.itemCountBytes(world);
+        for (uint32_t item = 0; item < MAX_ITEMS; item++)
+        {
+            if (counts[item] != 0)
+            {
+                items.push_back({ item, counts[item] });
+            }
+        }
+        appendSetBits(state.locationWords(world), LOCATION_WORDS, tracker["checked"]);
+    }
+    if (inLogic != nullptr)
+    {
+        appendSetBits(inLogic, LOCATION_WORDS, tracker["in_logic"] = nlohmann::json::array());
+    }
+    return tracker.dump();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "WorldState.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Versioned tracker state. Every change to a world's tracked state (a checked
+// location, a new item count) is appended to that world's ChangeLog and bumps
+// its version, so a subscriber that has seen version v only needs the
+// changes after v. The log keeps the last CAPACITY changes; anyone further
+// behind than that gets a full TrackerState instead.
+
+enum class ChangeKind : uint8_t
+{
+    LocationChecked = 0,
+    ItemCount = 1,
+    EventFlag = 2,
+    // a location came into logic (LogicGraph.hpp); id is the location
+    InLogic = 3,
+};
+
+// one change as it goes on the wire: kind, value (the new count for
+// ItemCount, otherwise 0), big-endian id
+struct StateChange
+{
+    ChangeKind kind;
+    uint8_t value;
+    uint16_t id;
+};
+
+class ChangeLog
+{
+public:
+    static constexpr size_t CAPACITY = 1024; // power of two
+
+    // the number of changes ever appended
+    uint64_t version() const { return head; }
+
+    // batch is the event log batch the change waits on to be durable (0 for
+    // none); see ProtocolServer::holdReplies
+    void append(StateChange change, uint64_t batch = 0)
+    {
+        if (ring.empty())
+        {
+            // most worlds in a room are never subscribed to; only pay for
+            // the ones that change
+            ring.resize(CAPACITY);
+        }
+        ring[head & (CAPACITY - 1)] = change;
+        head++;
+        newestBatch = batch;
+    }
+
+    // the batch of the newest change; batches only grow, so once it is
+    // durable every change up to version() is
+    uint64_t batch() const { return newestBatch; }
+
+    // true if every change after since is still held
+    bool covers(uint64_t since) const
+    {
+        return since >= base && since <= head && head - since <= CAPACITY;
+    }
+
+    // continues from version with nothing held, as after a restore
+    void restart(uint64_t version)
+    {
+        base = version;
+        head = version;
+        newestBatch = 0;
+    }
+
+    // Appends a TrackerDelta payload taking a subscriber from since to
+    // version(); since must be covered. With collapse, a change superseded
+    // by a later one for the same kind and id is left out, so the delta
+    // holds each id once, at its newest value (in the order of those newest
+    // changes).
+    void encodeDelta(uint64_t since, std::vector<uint8_t>& out, bool collapse = false) const;
+private:
+    std::vector<StateChange> ring;
+    // changes before base were never appended here
+    uint64_t base = 0;
+    uint64_t head = 0;
+    uint64_t newestBatch = 0;
+};
+
+// {"world", "version", "items": [[id, count]...], "checked": [ids]}, plus
+// "in_logic": [ids] when inLogic (LOCATION_WORDS words) is given
+std::string encodeTrackerState(const WorldState& state, uint32_t world, uint64_t version, const uint64_t* inLogic = nullptr);
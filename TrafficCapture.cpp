@@ -0,0 +1,204 @@
+#include "TrafficCapture.hpp"
+#include "utility/byteswap.hpp"
+#include "utility/log.hpp"
+
+#include <string.h>
+
+namespace
+{
+    const uint8_t CAPTURE_MAGIC[CAPTURE_HEADER_SIZE] = { 'W', 'W', 'H', 'D', 'C', 'A', 'P', 1 };
+    // the writer is woken once this much is pending, and otherwise every
+    // WRITE_INTERVAL, so the poll thread rarely has to signal it
+    constexpr size_t WAKE_THRESHOLD = 64 * 1024;
+    constexpr std::chrono::milliseconds WRITE_INTERVAL(100);
+    // past this the disk is not keeping up and new records are dropped
+    constexpr size_t MAX_PENDING = 16 * 1024 * 1024;
+
+    template<typename T>
+    void putBigEndian(uint8_t*& out, T value)
+    {
+        value = Utility::toBigEndian(value);
+        memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+    }
+
+    template<typename T>
+    T getBigEndian(const uint8_t*& in)
+    {
+        T value;
+        memcpy(&value, in, sizeof(value));
+        in += sizeof(value);
+        return Utility::fromBigEndian(value);
+    }
+}
+
+TrafficCapture::TrafficCapture()
+{
+    Metrics::Registry& registry = Metrics::registry();
+    recorded = registry.counter("wwhd_capture_records_total", "Records added to the traffic capture");
+    dropped = registry.counter("wwhd_capture_dropped_total", "Records dropped because the capture writer fell behind");
+    bytesWritten = registry.counter("wwhd_capture_written_bytes_total", "Bytes written to the traffic capture file");
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    close();
+}
+
+bool TrafficCapture::open(const std::string& path)
+{
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        PLATFORM_LOG_ERROR(General, "could not open capture file %s\n", path.c_str());
+        return false;
+    }
+    std::fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), file);
+    epoch = std::chrono::steady_clock::now();
+    pending.reserve(WAKE_THRESHOLD * 2);
+    running = true;
+    writerThread = std::thread(&TrafficCapture::writerCallback, this);
+    PLATFORM_LOG_INFO(General, "capturing traffic to %s\n", path.c_str());
+    return true;
+}
+
+void TrafficCapture::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        running = false;
+    }
+    pendingCondition.notify_one();
+    if (writerThread.joinable())
+    {
+        writerThread.join();
+    }
+    if (file != nullptr)
+    {
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+void TrafficCapture::recordOpen(uint32_t connection)
+{
+    record(CaptureEvent::Open, connection, nullptr, 0);
+}
+
+void TrafficCapture::recordFrame(uint32_t connection, const uint8_t* frame, size_t length)
+{
+    record(CaptureEvent::Frame, connection, frame, length);
+}
+
+void TrafficCapture::recordClose(uint32_t connection)
+{
+    record(CaptureEvent::Close, connection, nullptr, 0);
+}
+
+void TrafficCapture::record(CaptureEvent event, uint32_t connection, const uint8_t* data, size_t length)
+{
+    const uint64_t timeNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count());
+    uint8_t header[CAPTURE_RECORD_HEADER_SIZE];
+    uint8_t* out = header;
+    *out++ = static_cast<uint8_t>(event);
+    putBigEndian(out, connection);
+    putBigEndian(out, timeNs);
+    putBigEndian(out, static_cast<uint32_t>(length));
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        const size_t before = pending.size();
+        if (before + sizeof(header) + length > MAX_PENDING)
+        {
+            dropped.inc();
+            return;
+        }
+        pending.insert(pending.end(), header, header + sizeof(header));
+        pending.insert(pending.end(), data, data + length);
+        wake = before < WAKE_THRESHOLD && pending.size() >= WAKE_THRESHOLD;
+    }
+    recorded.inc();
+    if (wake)
+    {
+        pendingCondition.notify_one();
+    }
+}
+
+void TrafficCapture::writerCallback()
+{
+    std::vector<uint8_t> writing;
+    writing.reserve(WAKE_THRESHOLD * 2);
+    std::unique_lock<std::mutex> lock(pendingMutex);
+    while (true)
+    {
+        pendingCondition.wait_for(lock, WRITE_INTERVAL, [this] { return !running || pending.size() >= WAKE_THRESHOLD; });
+        const bool stopping = !running;
+        writing.swap(pending);
+        lock.unlock();
+
+        if (!writing.empty())
+        {
+            if (std::fwrite(writing.data(), 1, writing.size(), file) != writing.size())
+            {
+                PLATFORM_LOG_ERROR(General, "capture write failed, %zu bytes lost\n", writing.size());
+            }
+            std::fflush(file);
+            bytesWritten.inc(writing.size());
+            writing.clear();
+        }
+
+        if (stopping)
+        {
+            return;
+        }
+        lock.lock();
+    }
+}
+
+CaptureReader::~CaptureReader()
+{
+    if (file != nullptr)
+    {
+        std::fclose(file);
+    }
+}
+
+bool CaptureReader::open(const std::string& path)
+{
+    if (file != nullptr)
+    {
+        std::fclose(file);
+    }
+    file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    uint8_t magic[CAPTURE_HEADER_SIZE];
+    if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0)
+    {
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+    uint8_t header[CAPTURE_RECORD_HEADER_SIZE];
+    if (file == nullptr || std::fread(header, 1, sizeof(header), file) != sizeof(header))
+    {
+        return false;
+    }
+    const uint8_t* in = header;
+    record.event = static_cast<CaptureEvent>(*in++);
+    record.connection = getBigEndian<uint32_t>(in);
+    record.timeNs = getBigEndian<uint64_t>(in);
+    const uint32_t length = getBigEndian<uint32_t>(in);
+    record.data.resize(length);
+    return length == 0 || std::fread(record.data.data(), 1, length, file) == length;
+}
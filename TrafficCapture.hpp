@@ -0,0 +1,95 @@
+#pragma once
+
+#include "utility/metrics.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records inbound protocol traffic to a file for offline replay.
+//
+// File layout (all integers big-endian, like the wire format): the 8 byte
+// magic "WWHDCAP" followed by the version byte, then one record per event:
+//   u8 event, u32 connection, u64 nanoseconds since the capture opened,
+//   u32 length, then length bytes (a whole frame, header included, for Frame
+//   events; nothing for Open and Close)
+//
+// The poll thread only copies the record into a pending buffer; a writer
+// thread swaps it out and writes it. If the disk falls far enough behind,
+// records are dropped and counted rather than stalling the poll loop.
+
+enum class CaptureEvent : uint8_t
+{
+    Open = 0,
+    Frame = 1,
+    Close = 2,
+};
+
+constexpr size_t CAPTURE_HEADER_SIZE = 8;
+constexpr size_t CAPTURE_RECORD_HEADER_SIZE = 17;
+
+class TrafficCapture
+{
+public:
+    TrafficCapture();
+
+    ~TrafficCapture();
+
+    TrafficCapture(const TrafficCapture&) = delete;
+    TrafficCapture& operator=(const TrafficCapture&) = delete;
+
+    // truncates path and starts the writer thread
+    bool open(const std::string& path);
+
+    // writes everything still pending and closes the file
+    void close();
+
+    void recordOpen(uint32_t connection);
+
+    void recordFrame(uint32_t connection, const uint8_t* frame, size_t length);
+
+    void recordClose(uint32_t connection);
+private:
+    std::FILE* file = nullptr;
+    std::chrono::steady_clock::time_point epoch;
+    std::thread writerThread;
+    std::mutex pendingMutex;
+    std::condition_variable pendingCondition;
+    std::vector<uint8_t> pending;
+    bool running = false;
+    Metrics::Counter recorded;
+    Metrics::Counter dropped;
+    Metrics::Counter bytesWritten;
+
+    void record(CaptureEvent event, uint32_t connection, const uint8_t* data, size_t length);
+
+    void writerCallback();
+};
+
+struct CaptureRecord
+{
+    CaptureEvent event;
+    uint32_t connection;
+    uint64_t timeNs;
+    std::vector<uint8_t> data;
+};
+
+// Reads a capture back one record at a time.
+class CaptureReader
+{
+public:
+    ~CaptureReader();
+
+    // false if path is missing or not a capture
+    bool open(const std::string& path);
+
+    // false at the end of the file or at a truncated record
+    bool next(CaptureRecord& record);
+private:
+    std::FILE* file = nullptr;
+};
@@ -0,0 +1,321 @@
+#include "Transfer.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+#include <sys/types.h>
+#ifndef PLATFORM_MSVC
+  #include <sys/socket.h>
+#endif
+#ifdef __linux__
+  #include <fcntl.h>
+  #include <sys/sendfile.h>
+  #include <unistd.h>
+  #define TRANSFER_SENDFILE
+#endif
+
+namespace
+{
+    // slicing-by-8: table[k][b] is the CRC of byte b followed by k zero
+    // bytes, so eight bytes are folded in with eight lookups at once
+    struct CrcTables
+    {
+        uint32_t entries[8][256];
+
+        CrcTables()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    value = (value >> 1) ^ (value & 1 ? 0xEDB88320u : 0);
+                }
+                entries[0][i] = value;
+            }
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                for (int k = 1; k < 8; k++)
+                {
+                    entries[k][i] = (entries[k - 1][i] >> 8) ^ entries[0][entries[k - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    const CrcTables CRC_TABLES;
+
+    // FNV-1a over the low bytes bytes of value, continuing from hash
+    uint32_t mixHash(uint32_t hash, uint64_t value, unsigned bytes)
+    {
+        for (unsigned i = 0; i < bytes; i++)
+        {
+            hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 16777619u;
+        }
+        return hash;
+    }
+
+    constexpr uint32_t FNV_OFFSET_BASIS = 2166136261u;
+
+    // <path>.crc: this header, then every chunk's checksum, in this
+    // machine's byte order
+    const uint8_t CHECKSUM_CACHE_MAGIC[8] = { 'W', 'W', 'H', 'D', 'C', 'R', 'C', 1 };
+
+    struct ChecksumCacheHeader
+    {
+        uint8_t magic[8];
+        uint64_t sourceSize;
+        int64_t sourceModifiedNs;
+        uint64_t sourceInode;
+        uint32_t chunkSize;
+        // FNV-1a over the checksums
+        uint32_t check;
+    };
+
+    uint32_t hashChecksums(const std::vector<uint32_t>& checksums)
+    {
+        uint32_t hash = FNV_OFFSET_BASIS;
+        for (const uint32_t checksum : checksums)
+        {
+            hash = mixHash(hash, checksum, 4);
+        }
+        return hash;
+    }
+}
+
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc)
+{
+    const uint32_t (&table)[8][256] = CRC_TABLES.entries;
+    crc = ~crc;
+    for (; length >= 8; length -= 8, data += 8)
+    {
+        const uint32_t low = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    for (; length > 0; length--, data++)
+    {
+        crc = table[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+TransferSource::~TransferSource()
+{
+#ifdef TRANSFER_SENDFILE
+    if (descriptor >= 0)
+    {
+        ::close(descriptor);
+    }
+#endif
+    if (stream != nullptr)
+    {
+        std::fclose(stream);
+    }
+}
+
+std::shared_ptr<TransferSource> TransferSource::openFile(const std::string& path)
+{
+    std::shared_ptr<TransferSource> source(new TransferSource());
+#ifdef TRANSFER_SENDFILE
+    // the one descriptor both checksums and sends, so they see the same file
+    source->descriptor = ::open(path.c_str(), O_RDONLY);
+    if (source->descriptor < 0 || !Utility::stampFile(source->descriptor, source->stamp))
+    {
+        return nullptr;
+    }
+#else
+    if (!Utility::stampFile(path.c_str(), source->stamp))
+    {
+        return nullptr;
+    }
+    source->stream = std::fopen(path.c_str(), "rb");
+    if (source->stream == nullptr)
+    {
+        return nullptr;
+    }
+#endif
+    source->path = path;
+    source->length = source->stamp.size;
+    source->checksums.resize(static_cast<size_t>((source->length + TRANSFER_CHUNK_SIZE - 1) / TRANSFER_CHUNK_SIZE));
+    source->checksummed.resize(source->checksums.size(), 0);
+    source->unchecksummed = source->checksums.size();
+    source->loadChecksums();
+    uint32_t hash = mixHash(FNV_OFFSET_BASIS, source->stamp.size, 8);
+    hash = mixHash(hash, static_cast<uint64_t>(source->stamp.modifiedNs), 8);
+    source->contentDigest = mixHash(hash, source->stamp.inode, 8);
+    return source;
+}
+
+bool TransferSource::matchesFile(const std::string& path) const
+{
+    Utility::FileStamp now;
+    return Utility::stampFile(path.c_str(), now) && now == stamp;
+}
+
+std::shared_ptr<TransferSource> TransferSource::fromMemory(std::shared_ptr<const void> owner, const uint8_t* data, size_t length)
+{
+    std::shared_ptr<TransferSource> source(new TransferSource());
+    source->owner = std::move(owner);
+    source->bytes = data;
+    source->length = length;
+    // FNV-1a over the size, then the checksums
+    uint32_t hash = mixHash(FNV_OFFSET_BASIS, length, 8);
+    for (uint64_t offset = 0; offset < length; offset += TRANSFER_CHUNK_SIZE)
+    {
+        source->checksums.push_back(source->computeChecksum(offset));
+        hash = mixHash(hash, source->checksums.back(), 4);
+    }
+    source->checksummed.assign(source->checksums.size(), 1);
+    source->contentDigest = hash;
+    return source;
+}
+
+bool TransferSource::chunkChecksum(uint64_t offset, uint32_t& checksum) const
+{
+#ifdef TRANSFER_SENDFILE
+    Utility::FileStamp now;
+    if (descriptor >= 0 && (!Utility::stampFile(descriptor, now) || now != stamp))
+    {
+        return false;
+    }
+#endif
+    const size_t chunk = static_cast<size_t>(offset / TRANSFER_CHUNK_SIZE);
+    if (!checksummed[chunk])
+    {
+        checksums[chunk] = computeChecksum(offset);
+        checksummed[chunk] = 1;
+        unchecksummed--;
+        if (unchecksummed == 0 && !path.empty())
+        {
+            saveChecksums();
+        }
+    }
+    checksum = checksums[chunk];
+    return true;
+}
+
+uint32_t TransferSource::computeChecksum(uint64_t offset) const
+{
+    if (bytes == nullptr)
+    {
+        readChunk(offset);
+        return crc32(chunkBuffer.data(), bufferedLength);
+    }
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(TRANSFER_CHUNK_SIZE, length - offset));
+    return crc32(bytes + offset, count);
+}
+
+void TransferSource::readChunk(uint64_t offset) const
+{
+    if (offset == bufferedOffset)
+    {
+        return;
+    }
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(TRANSFER_CHUNK_SIZE, length - offset));
+    chunkBuffer.resize(TRANSFER_CHUNK_SIZE);
+    size_t got = 0;
+#ifdef TRANSFER_SENDFILE
+    while (got < count)
+    {
+        const ssize_t read = pread(descriptor, chunkBuffer.data() + got, count - got, static_cast<off_t>(offset + got));
+        if (read <= 0)
+        {
+            // shrunk or unreadable: sendTo will not get the chunk out either
+            break;
+        }
+        got += static_cast<size_t>(read);
+    }
+#else
+#ifdef PLATFORM_MSVC
+    const bool seeked = _fseeki64(stream, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+    const bool seeked = std::fseek(stream, static_cast<long>(offset), SEEK_SET) == 0;
+#endif
+    got = seeked ? std::fread(chunkBuffer.data(), 1, count, stream) : 0;
+#endif
+    bufferedOffset = offset;
+    bufferedLength = got;
+}
+
+void TransferSource::loadChecksums()
+{
+    std::FILE* in = std::fopen((path + ".crc").c_str(), "rb");
+    if (in == nullptr)
+    {
+        return;
+    }
+    ChecksumCacheHeader header;
+    std::vector<uint32_t> cached(checksums.size());
+    const bool read = std::fread(&header, sizeof(header), 1, in) == 1 &&
+                      (cached.empty() || std::fread(cached.data(), sizeof(uint32_t), cached.size(), in) == cached.size()) &&
+                      std::fgetc(in) == EOF;
+    std::fclose(in);
+    if (!read || memcmp(header.magic, CHECKSUM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.sourceSize != stamp.size || header.sourceModifiedNs != stamp.modifiedNs || header.sourceInode != stamp.inode ||
+        header.chunkSize != TRANSFER_CHUNK_SIZE || header.check != hashChecksums(cached))
+    {
+        return;
+    }
+    checksums.swap(cached);
+    checksummed.assign(checksums.size(), 1);
+    unchecksummed = 0;
+}
+
+void TransferSource::saveChecksums() const
+{
+    if (!matchesFile(path))
+    {
+        return;
+    }
+    ChecksumCacheHeader header;
+    memcpy(header.magic, CHECKSUM_CACHE_MAGIC, sizeof(header.magic));
+    header.sourceSize = stamp.size;
+    header.sourceModifiedNs = stamp.modifiedNs;
+    header.sourceInode = stamp.inode;
+    header.chunkSize = TRANSFER_CHUNK_SIZE;
+    header.check = hashChecksums(checksums);
+
+    // renamed into place, so a reader never sees half of one; a directory
+    // that cannot be written to just goes without
+    const std::string cachePath = path + ".crc";
+    const std::string temporary = cachePath + ".tmp";
+    std::FILE* out = std::fopen(temporary.c_str(), "wb");
+    if (out == nullptr)
+    {
+        return;
+    }
+    bool written = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+                   (checksums.empty() || std::fwrite(checksums.data(), sizeof(uint32_t), checksums.size(), out) == checksums.size());
+    written = std::fclose(out) == 0 && written;
+    if (!written || !Utility::replaceFile(temporary.c_str(), cachePath.c_str()))
+    {
+        std::remove(temporary.c_str());
+    }
+}
+
+long TransferSource::sendTo(SocketType socket, uint64_t offset, size_t count) const
+{
+#ifdef TRANSFER_SENDFILE
+    if (descriptor >= 0)
+    {
+        off_t position = static_cast<off_t>(offset);
+        return static_cast<long>(sendfile(socket, descriptor, &position, count));
+    }
+#endif
+    if (bytes == nullptr)
+    {
+        // a chunk is sent from the buffer its checksum was read into, unless
+        // another transfer of this file read over it since
+        const uint64_t chunk = offset - offset % TRANSFER_CHUNK_SIZE;
+        readChunk(chunk);
+        const size_t into = static_cast<size_t>(offset - chunk);
+        if (into >= bufferedLength)
+        {
+            return 0;
+        }
+        return static_cast<long>(send(socket, reinterpret_cast<const char*>(chunkBuffer.data() + into),
+                                      std::min(count, bufferedLength - into), SOCK_SEND_FLAGS));
+    }
+    return static_cast<long>(send(socket, reinterpret_cast<const char*>(bytes + offset), count, SOCK_SEND_FLAGS));
+}
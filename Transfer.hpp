@@ -0,0 +1,100 @@
+#pragma once
+
+#include "utility/platform.hpp"
+#include "utility/platform_socket.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Payloads too big for one frame (patches, large seeds) go out as a stream of
+// TransferChunk frames, TRANSFER_CHUNK_SIZE bytes of data each with its own
+// CRC-32. A client that lost its connection asks again from the first chunk
+// it is missing, and the digest tells it whether the payload is still the
+// one it was getting.
+//
+// File payloads are sent with sendfile() where there is one, so their bytes
+// go from the page cache to the socket without passing through the server.
+// Elsewhere they are read one chunk at a time into a buffer and sent from
+// there: a copy per chunk, traded for never holding (or mapping) more than
+// one chunk of the file. Opening one reads nothing: a chunk's checksum is
+// computed the first time it goes out, from the same descriptor it is sent
+// from, so a large file never stalls the poll thread all at once.
+//
+// Once every chunk of a file has its checksum they are saved next to it as
+// <path>.crc, stamped with the Utility::FileStamp the digest is made from,
+// so sending the same version again reads nothing to checksum it.
+
+constexpr uint32_t TRANSFER_CHUNK_SIZE = 64 * 1024;
+
+// CRC-32 as in zlib (and Python's binascii.crc32); pass the previous result
+// as crc to continue over more data
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+class TransferSource
+{
+public:
+    ~TransferSource();
+
+    TransferSource(const TransferSource&) = delete;
+    TransferSource& operator=(const TransferSource&) = delete;
+
+    // nullptr if path cannot be opened
+    static std::shared_ptr<TransferSource> openFile(const std::string& path);
+
+    // length bytes at data, kept alive by owner
+    static std::shared_ptr<TransferSource> fromMemory(std::shared_ptr<const void> owner, const uint8_t* data, size_t length);
+
+    uint64_t size() const { return length; }
+
+    // true if path is still the file this was opened from (Utility::FileStamp)
+    bool matchesFile(const std::string& path) const;
+
+    // The CRC-32 of the chunk at offset, computed the first time it is
+    // asked for. False if the file changed since it was opened, so its
+    // chunks no longer match the digest.
+    bool chunkChecksum(uint64_t offset, uint32_t& checksum) const;
+
+    // identifies the content: for a file a hash of its FileStamp, otherwise
+    // of the size and every chunk checksum
+    uint32_t digest() const { return contentDigest; }
+
+    // Sends up to count bytes from offset straight to socket. Like send():
+    // the bytes sent, or -1 (see Utility::socketWouldBlock). A file that
+    // shrank since it was opened sends 0.
+    long sendTo(SocketType socket, uint64_t offset, size_t count) const;
+private:
+    TransferSource() = default;
+
+    // where sendfile() is used the file is read (checksums included) through
+    // descriptor, otherwise through stream
+    int descriptor = -1;
+    std::FILE* stream = nullptr;
+    std::string path;
+    std::shared_ptr<const void> owner;
+    const uint8_t* bytes = nullptr;
+    uint64_t length = 0;
+    Utility::FileStamp stamp{};
+    uint32_t contentDigest = 0;
+    // filled in as chunks are first sent; only the poll thread
+    mutable std::vector<uint32_t> checksums;
+    mutable std::vector<uint8_t> checksummed;
+    mutable size_t unchecksummed = 0;
+    // the last chunk read from the file, at bufferedOffset
+    mutable std::vector<uint8_t> chunkBuffer;
+    mutable uint64_t bufferedOffset = UINT64_MAX;
+    mutable size_t bufferedLength = 0;
+
+    uint32_t computeChecksum(uint64_t offset) const;
+
+    // reads the chunk at offset into chunkBuffer, unless it is there already
+    void readChunk(uint64_t offset) const;
+
+    // fills in every checksum from <path>.crc if it is for this version
+    void loadChecksums();
+
+    void saveChecksums() const;
+};
@@ -0,0 +1,64 @@
+#include "WorldState.hpp"
+#include "utility/bits.hpp"
+
+#include <string.h>
+
+WorldState::WorldState(uint32_t playerCount) : sharedFlags(SHARED_FLAG_WORDS, 0)
+{
+    ensurePlayers(playerCount);
+}
+
+void WorldState::ensurePlayers(uint32_t count)
+{
+    if (count <= players)
+    {
+        return;
+    }
+    players = count;
+    checkedLocations.resize(players * LOCATION_WORDS, 0);
+    eventFlags.resize(players * EVENT_FLAG_WORDS, 0);
+    itemCounts.resize(players * MAX_ITEMS, 0);
+}
+
+size_t WorldState::mergeSharedFlags(const uint8_t* block, uint16_t* changedWords)
+{
+    return Utility::orMergeChanged(sharedFlags.data(), block, SHARED_FLAG_WORDS, changedWords);
+}
+
+void WorldState::snapshot(uint32_t player, PlayerSnapshot& out) const
+{
+    memcpy(out.checkedLocations, locationWords(player), sizeof(out.checkedLocations));
+    memcpy(out.eventFlags, eventFlagWords(player), sizeof(out.eventFlags));
+    memcpy(out.itemCounts, itemCountBytes(player), sizeof(out.itemCounts));
+}
+
+size_t WorldState::roomSnapshotSize() const
+{
+    return players * sizeof(PlayerSnapshot) + SHARED_FLAG_BYTES;
+}
+
+void WorldState::snapshotRoom(uint8_t* out) const
+{
+    const size_t locationBytes = checkedLocations.size() * sizeof(uint64_t);
+    const size_t eventBytes = eventFlags.size() * sizeof(uint64_t);
+    memcpy(out, checkedLocations.data(), locationBytes);
+    memcpy(out + locationBytes, eventFlags.data(), eventBytes);
+    memcpy(out + locationBytes + eventBytes, itemCounts.data(), itemCounts.size());
+    memcpy(out + locationBytes + eventBytes + itemCounts.size(), sharedFlags.data(), SHARED_FLAG_BYTES);
+}
+
+void WorldState::restoreRoom(uint32_t playerCount, const uint8_t* in)
+{
+    players = 0;
+    checkedLocations.clear();
+    eventFlags.clear();
+    itemCounts.clear();
+    ensurePlayers(playerCount);
+
+    const size_t locationBytes = checkedLocations.size() * sizeof(uint64_t);
+    const size_t eventBytes = eventFlags.size() * sizeof(uint64_t);
+    memcpy(checkedLocations.data(), in, locationBytes);
+    memcpy(eventFlags.data(), in + locationBytes, eventBytes);
+    memcpy(itemCounts.data(), in + locationBytes + eventBytes, itemCounts.size());
+    memcpy(sharedFlags.data(), in + locationBytes + eventBytes + itemCounts.size(), SHARED_FLAG_BYTES);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Everything the server tracks for one room (a multiworld session): per
+// player, the locations checked, items received and event flags set, all by
+// compact integer id. Each kind of state is one flat array over every player
+// (structure of arrays), so a player's state is a fixed slice of each array:
+//   checked locations  MAX_LOCATIONS bits     128 bytes
+//   event flags        MAX_EVENT_FLAGS bits   256 bytes
+//   item counts        MAX_ITEMS bytes        256 bytes
+// plus one block of event and stage flags shared by the whole room (co-op),
+// kept as raw save data bytes.
+// Callers validate ids against the limits below; out of range ids are not
+// checked again here.
+
+constexpr uint32_t MAX_PLAYERS = 256;
+constexpr uint32_t MAX_LOCATIONS = 1024;
+constexpr uint32_t MAX_EVENT_FLAGS = 2048;
+constexpr uint32_t MAX_ITEMS = 256;
+
+// the console's event flag bytes followed by its stage flag bytes
+constexpr size_t SHARED_EVENT_FLAG_BYTES = 256;
+constexpr size_t SHARED_STAGE_FLAG_BYTES = 512;
+constexpr size_t SHARED_FLAG_BYTES = SHARED_EVENT_FLAG_BYTES + SHARED_STAGE_FLAG_BYTES;
+constexpr size_t SHARED_FLAG_WORDS = SHARED_FLAG_BYTES / 8;
+
+constexpr size_t LOCATION_WORDS = MAX_LOCATIONS / 64;
+constexpr size_t EVENT_FLAG_WORDS = MAX_EVENT_FLAGS / 64;
+
+// one player's state, copied out in one go
+struct PlayerSnapshot
+{
+    uint64_t checkedLocations[LOCATION_WORDS];
+    uint64_t eventFlags[EVENT_FLAG_WORDS];
+    uint8_t itemCounts[MAX_ITEMS];
+};
+
+class WorldState
+{
+public:
+    explicit WorldState(uint32_t playerCount = 0);
+
+    uint32_t playerCount() const { return players; }
+
+    // grows the room so that player ids below count are valid
+    void ensurePlayers(uint32_t count);
+
+    // true if the location was not checked before
+    bool checkLocation(uint32_t player, uint32_t location)
+    {
+        return setBit(checkedLocations.data() + player * LOCATION_WORDS, location);
+    }
+
+    bool isLocationChecked(uint32_t player, uint32_t location) const
+    {
+        return testBit(checkedLocations.data() + player * LOCATION_WORDS, location);
+    }
+
+    bool setEventFlag(uint32_t player, uint32_t flag)
+    {
+        return setBit(eventFlags.data() + player * EVENT_FLAG_WORDS, flag);
+    }
+
+    bool testEventFlag(uint32_t player, uint32_t flag) const
+    {
+        return testBit(eventFlags.data() + player * EVENT_FLAG_WORDS, flag);
+    }
+
+    // counts saturate at 255
+    void addItem(uint32_t player, uint32_t item)
+    {
+        uint8_t& count = itemCounts[player * MAX_ITEMS + item];
+        count += count != UINT8_MAX;
+    }
+
+    uint8_t itemCount(uint32_t player, uint32_t item) const
+    {
+        return itemCounts[player * MAX_ITEMS + item];
+    }
+
+    // ORs a player's SHARED_FLAG_BYTES flag block into the room's and lists
+    // the 8 byte words that gained a bit in changedWords (SHARED_FLAG_WORDS
+    // entries); returns how many did
+    size_t mergeSharedFlags(const uint8_t* block, uint16_t* changedWords);
+
+    const uint64_t* sharedFlagWords() const { return sharedFlags.data(); }
+
+    const uint64_t* locationWords(uint32_t player) const { return checkedLocations.data() + player * LOCATION_WORDS; }
+
+    const uint64_t* eventFlagWords(uint32_t player) const { return eventFlags.data() + player * EVENT_FLAG_WORDS; }
+
+    const uint8_t* itemCountBytes(uint32_t player) const { return itemCounts.data() + player * MAX_ITEMS; }
+
+    void snapshot(uint32_t player, PlayerSnapshot& out) const;
+
+    // the whole room as raw arrays: locations, then event flags, then item
+    // counts, each covering every player in order, then the shared flags
+    size_t roomSnapshotSize() const;
+
+    void snapshotRoom(uint8_t* out) const;
+
+    // the inverse of snapshotRoom for a room of playerCount players
+    void restoreRoom(uint32_t playerCount, const uint8_t* in);
+private:
+    uint32_t players = 0;
+    std::vector<uint64_t> checkedLocations;
+    std::vector<uint64_t> eventFlags;
+    std::vector<uint8_t> itemCounts;
+    std::vector<uint64_t> sharedFlags;
+
+    static bool setBit(uint64_t* words, uint32_t bit)
+    {
+        uint64_t& word = words[bit / 64];
+        const uint64_t mask = uint64_t(1) << (bit % 64);
+        const bool wasSet = (word & mask) != 0;
+        word |= mask;
+        return !wasSet;
+    }
+
+    static bool testBit(const uint64_t* words, uint32_t bit)
+    {
+        return (words[bit / 64] >> (bit % 64)) & 1;
+    }
+};
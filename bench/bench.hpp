@@ -0,0 +1,160 @@
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal benchmark harness for wwhd_rando_bench. Each suite file exposes a
+// run*Benchmarks(Bench::Runner&) function that main.cpp calls in turn.
+// Results print as text and, with --json <path>, are also written as JSON so
+// two builds can be diffed.
+
+namespace Bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Result
+    {
+        std::string name;
+        uint64_t operations;
+        double seconds;
+        std::vector<std::pair<std::string, double>> counters;
+
+        double nsPerOp() const { return operations ? seconds * 1e9 / operations : 0.0; }
+        double opsPerSec() const { return seconds > 0.0 ? operations / seconds : 0.0; }
+    };
+
+    class Runner
+    {
+    public:
+        // only benchmarks whose name contains filter are run
+        explicit Runner(std::string filter = "");
+
+        bool enabled(const std::string& name) const;
+
+        void report(Result result);
+
+        // a check that did not hold: says why on stderr and makes
+        // wwhd_rando_bench exit nonzero
+        void fail(const std::string& name, const std::string& why);
+
+        bool failed() const { return anyFailed; }
+
+        // Calls body(iterations) with a growing iteration count until one call
+        // takes at least minTime, then reports that call. body returns the
+        // number of operations it performed.
+        template<typename Body>
+        void run(const std::string& name, Body body,
+                 std::chrono::milliseconds minTime = std::chrono::milliseconds(200))
+        {
+            if (!enabled(name))
+            {
+                return;
+            }
+            uint64_t iterations = 1;
+            while (true)
+            {
+                const auto start = Clock::now();
+                const uint64_t ops = body(iterations);
+                const auto elapsed = Clock::now() - start;
+                if (elapsed >= minTime || iterations >= (uint64_t(1) << 40))
+                {
+                    report({ name, ops, std::chrono::duration<double>(elapsed).count(), {} });
+                    return;
+                }
+                iterations *= elapsed < minTime / 10 ? 10 : 2;
+            }
+        }
+
+        const std::vector<Result>& results() const { return allResults; }
+
+        // every reported result as {"compiler", "results": [...]}
+        bool writeJson(const std::string& path) const;
+
+    private:
+        std::string nameFilter;
+        std::vector<Result> allResults;
+        bool anyFailed = false;
+    };
+
+    // keeps the optimizer from discarding a computed value
+    template<typename T>
+    inline void doNotOptimize(const T& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const T* sink;
+        sink = &value;
+#endif
+    }
+
+    // a generated logic file (LogicGraph::loadFile) the size of Wind
+    // Waker's: 900 locations, 350 macros, 72 progression items
+    std::string windWakerSizedLogic();
+
+    void runByteswapBenchmarks(Runner& runner);
+
+    void runCaptureBenchmarks(Runner& runner);
+
+    // JSON against MessagePack and CBOR, all through json.hpp
+    void runCodecBenchmarks(Runner& runner);
+
+    // event log group commit at several intervals, and recovery after a kill
+    void runEventLogBenchmarks(Runner& runner);
+
+    // shared flag block merges, scalar against SIMD, and a 60 Hz co-op room
+    void runFlagSyncBenchmarks(Runner& runner);
+
+    void runFramingBenchmarks(Runner& runner);
+
+    void runLogConsoleBenchmarks(Runner& runner);
+
+    // tracker logic for a Wind Waker sized location set: the cost of one
+    // received item, incremental against a full re-evaluation
+    void runLogicBenchmarks(Runner& runner);
+
+    void runMetricsBenchmarks(Runner& runner);
+
+    void runExporterBenchmarks(Runner& runner);
+
+    // playthrough spheres for a generated 50 world seed, and how soon an
+    // unbeatable copy of it fails
+    void runPlaythroughBenchmarks(Runner& runner);
+
+    // 1000 rooms as actors on 1 to 8 workers, to show how throughput scales,
+    // and small room latency next to a saturated big room with and without
+    // work stealing
+    void runRoomActorBenchmarks(Runner& runner);
+
+    // lookups against a full 100 world placement, both built in the hash
+    // table and loaded from a mapped file as the server does, delivery queue
+    // traffic, and loading a placement from JSON against its mapped cache;
+    // end-to-end routing latency is measured by wwhd_rando_loadgen --placement
+    void runRoutingBenchmarks(Runner& runner);
+
+    // seed generation on 1, 4 and 16 workers, in seeds per minute, and a
+    // cache hit
+    void runSeedBenchmarks(Runner& runner);
+
+    // restart from a room snapshot plus the event log tail against the log alone
+    void runSnapshotBenchmarks(Runner& runner);
+
+    // topic publishes to 10k connections over 1k topics, shared frames against copies
+    void runTopicBenchmarks(Runner& runner);
+
+    // only has benchmarks in WWHD_TRACING builds
+    void runTraceBenchmarks(Runner& runner);
+
+    // chunk checksums, and streaming a file with sendfile() against copying
+    // it through a buffer
+    void runTransferBenchmarks(Runner& runner);
+
+    // tracker updates as deltas from the change log against full TrackerStates
+    void runTrackerSyncBenchmarks(Runner& runner);
+
+    void runWorldStateBenchmarks(Runner& runner);
+}
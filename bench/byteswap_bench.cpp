@@ -0,0 +1,55 @@
+#include "bench.hpp"
+#include "../utility/byteswap.hpp"
+
+#include <numeric>
+
+namespace
+{
+    constexpr size_t BULK_WORDS = 4096;
+
+    template<typename T>
+    void benchScalar(Bench::Runner& runner, const char* name)
+    {
+        runner.run(name, [](uint64_t iterations)
+        {
+            T value = static_cast<T>(0x0123456789ABCDEFULL);
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                // feed each result into the next so the swaps cannot be folded
+                value = Utility::byteswap(static_cast<T>(value + 1));
+                Bench::doNotOptimize(value);
+            }
+            return iterations;
+        });
+    }
+
+    // whole save-data sized blocks; ops are words swapped
+    template<typename T>
+    void benchBulk(Bench::Runner& runner, const char* name)
+    {
+        std::vector<T> words(BULK_WORDS);
+        std::iota(words.begin(), words.end(), static_cast<T>(1));
+        runner.run(name, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                Utility::byteswap_array(words.data(), words.size());
+                Bench::doNotOptimize(words.front());
+            }
+            return iterations * words.size();
+        });
+    }
+}
+
+namespace Bench
+{
+    void runByteswapBenchmarks(Runner& runner)
+    {
+        benchScalar<uint16_t>(runner, "byteswap/scalar/u16");
+        benchScalar<uint32_t>(runner, "byteswap/scalar/u32");
+        benchScalar<uint64_t>(runner, "byteswap/scalar/u64");
+        benchBulk<uint16_t>(runner, "byteswap/bulk/u16");
+        benchBulk<uint32_t>(runner, "byteswap/bulk/u32");
+        benchBulk<uint64_t>(runner, "byteswap/bulk/u64");
+    }
+}
@@ -0,0 +1,38 @@
+#include "bench.hpp"
+#include "../TrafficCapture.hpp"
+#include "../Protocol.hpp"
+
+#include <cstdio>
+
+namespace Bench
+{
+    // what the poll thread pays per captured frame; the writer thread and the
+    // disk are off that path
+    void runCaptureBenchmarks(Runner& runner)
+    {
+        if (!runner.enabled("capture/record_frame"))
+        {
+            return;
+        }
+        const char* path = "wwhd_bench_capture.bin";
+        TrafficCapture capture;
+        if (!capture.open(path))
+        {
+            return;
+        }
+        std::vector<uint8_t> frame;
+        const char payload[] = "{\"world\":17,\"item\":123}";
+        Protocol::appendFrame(frame, Protocol::MessageType::ItemSend,
+                              reinterpret_cast<const uint8_t*>(payload), sizeof(payload) - 1);
+        runner.run("capture/record_frame", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                capture.recordFrame(static_cast<uint32_t>(i & 255), frame.data(), frame.size());
+            }
+            return iterations;
+        });
+        capture.close();
+        std::remove(path);
+    }
+}
@@ -0,0 +1,99 @@
+#include "bench.hpp"
+#include "../json.hpp"
+
+namespace
+{
+    using Encode = std::vector<uint8_t> (*)(const nlohmann::json&);
+    using Decode = nlohmann::json (*)(const std::vector<uint8_t>&);
+
+    std::vector<uint8_t> encodeJson(const nlohmann::json& value)
+    {
+        const std::string text = value.dump();
+        return std::vector<uint8_t>(text.begin(), text.end());
+    }
+
+    nlohmann::json decodeJson(const std::vector<uint8_t>& bytes)
+    {
+        return nlohmann::json::parse(bytes.begin(), bytes.end(), nullptr, false);
+    }
+
+    std::vector<uint8_t> encodeMsgpack(const nlohmann::json& value)
+    {
+        return nlohmann::json::to_msgpack(value);
+    }
+
+    nlohmann::json decodeMsgpack(const std::vector<uint8_t>& bytes)
+    {
+        return nlohmann::json::from_msgpack(bytes, true, false);
+    }
+
+    std::vector<uint8_t> encodeCbor(const nlohmann::json& value)
+    {
+        return nlohmann::json::to_cbor(value);
+    }
+
+    nlohmann::json decodeCbor(const std::vector<uint8_t>& bytes)
+    {
+        return nlohmann::json::from_cbor(bytes, true, false);
+    }
+
+    // the payloads the server actually sees: small requests and a tracker
+    // state for a world about halfway through a seed
+    nlohmann::json samplePayload(const std::string& shape)
+    {
+        if (shape == "item_send")
+        {
+            return { { "world", 17 }, { "item", 123 } };
+        }
+        nlohmann::json state = { { "world", 17 }, { "items", nlohmann::json::array() }, { "checked", nlohmann::json::array() } };
+        for (uint32_t item = 0; item < 80; item++)
+        {
+            state["items"].push_back({ item * 3, 1 + item % 3 });
+        }
+        for (uint32_t location = 0; location < 400; location++)
+        {
+            state["checked"].push_back(location * 2);
+        }
+        return state;
+    }
+
+    void benchCodec(Bench::Runner& runner, const std::string& shape, const char* codec, Encode encode, Decode decode)
+    {
+        const nlohmann::json value = samplePayload(shape);
+        const std::vector<uint8_t> encoded = encode(value);
+        runner.run("codec/encode/" + std::string(codec) + "/" + shape, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                Bench::doNotOptimize(encode(value).size());
+            }
+            return iterations;
+        });
+        runner.run("codec/decode/" + std::string(codec) + "/" + shape, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                Bench::doNotOptimize(decode(encoded).size());
+            }
+            return iterations;
+        });
+        if (runner.enabled("codec/size/" + std::string(codec) + "/" + shape))
+        {
+            runner.report({ "codec/size/" + std::string(codec) + "/" + shape, 0, 0.0,
+                            { { "bytes", static_cast<double>(encoded.size()) } } });
+        }
+    }
+}
+
+namespace Bench
+{
+    void runCodecBenchmarks(Runner& runner)
+    {
+        for (const char* shape : { "item_send", "tracker_state" })
+        {
+            benchCodec(runner, shape, "json", encodeJson, decodeJson);
+            benchCodec(runner, shape, "msgpack", encodeMsgpack, decodeMsgpack);
+            benchCodec(runner, shape, "cbor", encodeCbor, decodeCbor);
+        }
+    }
+}
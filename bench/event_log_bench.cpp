@@ -0,0 +1,559 @@
+#include "bench.hpp"
+#include "../EventLog.hpp"
+#include "../ProtocolServer.hpp"
+#include "../utility/byteswap.hpp"
+#include "../json.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string.h>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char* const LOG_PATH = "wwhd_bench_event_log.wal";
+    const char* const SNAPSHOT_PATH = "wwhd_bench_event_log.snap";
+    const char* const PLACEMENT_PATH = "wwhd_bench_event_log_placement.json";
+    constexpr uint16_t ROOM_PORT = 41237;
+    constexpr uint32_t ROOM_CHECKS = MAX_LOCATIONS;
+    // checks sent ahead of their Acks, so some are always mid-commit
+    constexpr uint32_t ROOM_WINDOW = 64;
+    constexpr std::chrono::microseconds ROOM_COMMIT_INTERVAL(20000);
+    constexpr std::chrono::milliseconds RUN_TIME(500);
+
+    // Closed loop, like the server holding Acks: clients each have one event
+    // in flight and send the next once it is durable, so every round is one
+    // batch of clients events. Ops are durable events.
+    void benchCommit(Bench::Runner& runner, std::chrono::microseconds interval, unsigned clients)
+    {
+        const std::string name = "event_log/commit/interval_us:" + std::to_string(interval.count()) +
+                                 "/clients:" + std::to_string(clients);
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        std::remove(LOG_PATH);
+        EventLog log;
+        if (!log.open(LOG_PATH, interval))
+        {
+            return;
+        }
+        uint64_t events = 0;
+        uint64_t batches = 0;
+        const auto start = Bench::Clock::now();
+        while (Bench::Clock::now() - start < RUN_TIME)
+        {
+            uint64_t batch = 0;
+            for (unsigned client = 0; client < clients; client++)
+            {
+                batch = log.append(LogRecord{ LoggedEvent::LocationCheck, client, static_cast<uint32_t>(events & 1023) });
+                events++;
+            }
+            while (log.durableBatch() < batch)
+            {
+                std::this_thread::yield();
+            }
+            batches++;
+        }
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        log.close();
+        std::remove(LOG_PATH);
+        runner.report({ name, events, seconds,
+                        { { "syncs_per_sec", batches / seconds },
+                          { "commit_latency_us", seconds * 1e6 / batches } } });
+    }
+
+    // Open loop at saturation: one thread appends flat out for RUN_TIME and
+    // nothing waits. Ops are events on disk once the log is closed; the
+    // number of syncs is bounded by the interval, not the event rate.
+    void benchSaturated(Bench::Runner& runner, std::chrono::microseconds interval)
+    {
+        const std::string name = "event_log/saturated/interval_us:" + std::to_string(interval.count());
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        std::remove(LOG_PATH);
+        EventLog log;
+        if (!log.open(LOG_PATH, interval))
+        {
+            return;
+        }
+        uint64_t events = 0;
+        const auto start = Bench::Clock::now();
+        while (Bench::Clock::now() - start < RUN_TIME)
+        {
+            for (int i = 0; i < 256; i++, events++)
+            {
+                log.append(LogRecord{ LoggedEvent::ItemSend, static_cast<uint32_t>(events & 63), static_cast<uint32_t>(events & 255) });
+            }
+        }
+        log.close();
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        std::remove(LOG_PATH);
+        runner.report({ name, events, seconds, { { "syncs_per_sec", log.lastBatch() / seconds } } });
+    }
+
+    // Open loop: appends as fast as the poll thread could, never waiting.
+    // Shows what an append costs the caller.
+    void benchAppend(Bench::Runner& runner)
+    {
+        const std::string name = "event_log/append/interval_us:2000";
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        std::remove(LOG_PATH);
+        EventLog log;
+        if (!log.open(LOG_PATH, std::chrono::microseconds(2000)))
+        {
+            return;
+        }
+        runner.run(name, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                log.append(LogRecord{ LoggedEvent::ItemSend, static_cast<uint32_t>(i & 63), static_cast<uint32_t>(i & 255) });
+            }
+            return iterations;
+        });
+        log.close();
+        std::remove(LOG_PATH);
+    }
+
+#ifndef _WIN32
+    // A child process appends events and is killed with SIGKILL partway
+    // through a batch; it reports over a pipe how many events were durable
+    // when it died. The parent then reopens the log (cutting off any torn
+    // tail) and checks every durable event came back, in order.
+    //
+    // SIGKILL leaves the page cache alone, so this checks that nothing is
+    // published as durable before the writer has it, not the sync itself;
+    // that takes pulling the power.
+    void checkRecovery(Bench::Runner& runner)
+    {
+        const std::string name = "event_log/recovery";
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        std::remove(LOG_PATH);
+        int report[2];
+        if (pipe(report) != 0)
+        {
+            runner.fail(name, "could not create a pipe");
+            return;
+        }
+        const pid_t child = fork();
+        if (child < 0)
+        {
+            close(report[0]);
+            close(report[1]);
+            runner.fail(name, "could not fork");
+            return;
+        }
+        if (child == 0)
+        {
+            close(report[0]);
+            EventLog log;
+            if (!log.open(LOG_PATH, std::chrono::microseconds(500)))
+            {
+                _exit(1);
+            }
+            uint64_t durableEvents = 0;
+            std::vector<uint64_t> eventsByBatch(1, 0);
+            for (uint32_t i = 0;; i++)
+            {
+                const uint64_t batch = log.append(LogRecord{ LoggedEvent::ItemSend, i, i * 7 });
+                eventsByBatch.resize(batch + 1, 0);
+                eventsByBatch[batch] = i + 1;
+                uint64_t durable = log.durableBatch();
+                if (durable > 0 && eventsByBatch[durable] > durableEvents)
+                {
+                    durableEvents = eventsByBatch[durable];
+                    if (write(report[1], &durableEvents, sizeof(durableEvents)) != sizeof(durableEvents))
+                    {
+                        _exit(1);
+                    }
+                }
+                if (durableEvents >= 200000)
+                {
+                    kill(getpid(), SIGKILL);
+                }
+            }
+        }
+        close(report[1]);
+        uint64_t acknowledged = 0;
+        uint64_t value;
+        while (read(report[0], &value, sizeof(value)) == sizeof(value))
+        {
+            acknowledged = value;
+        }
+        close(report[0]);
+        int status = 0;
+        waitpid(child, &status, 0);
+        const bool killed = WIFSIGNALED(status);
+
+        // a torn record the way a crash mid write leaves one
+        if (std::FILE* file = std::fopen(LOG_PATH, "ab"))
+        {
+            const uint8_t torn[7] = { 1, 0, 0, 0, 0, 0, 9 };
+            std::fwrite(torn, 1, sizeof(torn), file);
+            std::fclose(file);
+        }
+
+        const auto start = Bench::Clock::now();
+        std::vector<LogRecord> records;
+        EventLog log;
+        const bool opened = log.open(LOG_PATH, std::chrono::microseconds(0), &records);
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        log.close();
+        std::remove(LOG_PATH);
+
+        bool intact = killed && opened && records.size() >= acknowledged;
+        for (size_t i = 0; intact && i < records.size(); i++)
+        {
+            intact = records[i].event == LoggedEvent::ItemSend && records[i].world == i && records[i].id == i * 7;
+        }
+        if (!intact)
+        {
+            runner.fail(name, std::string(killed ? "" : "the writer was not killed, ") + std::to_string(acknowledged) +
+                        " events acknowledged, " + std::to_string(records.size()) + " recovered");
+        }
+        runner.report({ name, records.size(), seconds,
+                        { { "killed", killed ? 1.0 : 0.0 },
+                          { "acknowledged", static_cast<double>(acknowledged) },
+                          { "recovered", static_cast<double>(records.size()) },
+                          { "intact", intact ? 1.0 : 0.0 } } });
+    }
+
+    SocketType connectServer()
+    {
+        SocketType sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(ROOM_PORT);
+        if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            SOCK_CLOSE(sock);
+            return INVALID_SOCKET;
+        }
+        Utility::setSocketNoDelay(sock);
+        return sock;
+    }
+
+    void appendRequest(std::vector<uint8_t>& out, Protocol::MessageType type, const std::string& json)
+    {
+        Protocol::appendFrame(out, type, reinterpret_cast<const uint8_t*>(json.data()), json.size());
+    }
+
+    // what one client connection has been sent, frame by frame
+    struct ClientView
+    {
+        SocketType socket = INVALID_SOCKET;
+        std::vector<uint8_t> received;
+        size_t parsed = 0;
+        bool closed = false;
+        uint64_t acks = 0;
+        std::vector<uint32_t> deliveredFrom;
+        uint64_t trackerVersion = 0;
+
+        void parseFrames()
+        {
+            while (received.size() - parsed >= Protocol::FRAME_HEADER_SIZE)
+            {
+                const Protocol::FrameHeader header = Protocol::decodeHeader(received.data() + parsed);
+                if (received.size() - parsed - Protocol::FRAME_HEADER_SIZE < header.length)
+                {
+                    return;
+                }
+                const uint8_t* payload = received.data() + parsed + Protocol::FRAME_HEADER_SIZE;
+                if (header.type == Protocol::MessageType::Ack)
+                {
+                    acks++;
+                }
+                else if (header.type == Protocol::MessageType::ItemReceived)
+                {
+                    const nlohmann::json item = nlohmann::json::parse(payload, payload + header.length, nullptr, false);
+                    deliveredFrom.push_back(item.value("location", UINT32_MAX));
+                }
+                else if (header.type == Protocol::MessageType::TrackerState)
+                {
+                    const nlohmann::json state = nlohmann::json::parse(payload, payload + header.length, nullptr, false);
+                    trackerVersion = std::max<uint64_t>(trackerVersion, state.value("version", uint64_t(0)));
+                }
+                else if (header.type == Protocol::MessageType::TrackerDelta && header.length >= Protocol::TRACKER_DELTA_HEADER_SIZE)
+                {
+                    uint64_t to;
+                    memcpy(&to, payload + sizeof(uint64_t), sizeof(to));
+                    trackerVersion = std::max(trackerVersion, Utility::fromBigEndian(to));
+                }
+                parsed += Protocol::FRAME_HEADER_SIZE + header.length;
+            }
+        }
+    };
+
+    // Crash recovery of a whole room. A child process serves a room with an
+    // event log; the parent checks locations in world 0 whose items belong to
+    // world 1, with world 1 joined and tracked on a second connection, and
+    // kills the server with SIGKILL halfway through. A server rebuilt from
+    // the log must hold every check that was acknowledged, every check whose
+    // item reached world 1, and every tracker version world 1 was sent.
+    void checkRoomRecovery(Bench::Runner& runner)
+    {
+        const std::string name = "event_log/room_recovery";
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        std::remove(LOG_PATH);
+        std::remove(SNAPSHOT_PATH);
+        {
+            nlohmann::json placements = nlohmann::json::array();
+            for (uint32_t location = 0; location < ROOM_CHECKS; location++)
+            {
+                placements.push_back({ 0, location, 1, location % 64 });
+            }
+            std::ofstream out(PLACEMENT_PATH);
+            out << nlohmann::json{ { "placements", placements } }.dump();
+        }
+        const std::string placementCache = std::string(PLACEMENT_PATH) + ".bin";
+        const auto removeFiles = [&]()
+        {
+            std::remove(LOG_PATH);
+            std::remove(SNAPSHOT_PATH);
+            std::remove(PLACEMENT_PATH);
+            std::remove(placementCache.c_str());
+        };
+
+        int ready[2];
+        if (pipe(ready) != 0)
+        {
+            runner.fail(name, "could not create a pipe");
+            removeFiles();
+            return;
+        }
+        const pid_t child = fork();
+        if (child < 0)
+        {
+            close(ready[0]);
+            close(ready[1]);
+            runner.fail(name, "could not fork");
+            removeFiles();
+            return;
+        }
+        if (child == 0)
+        {
+            close(ready[0]);
+            ProtocolServer server(ROOM_PORT);
+            if (!server.loadPlacement(PLACEMENT_PATH) || !server.openEventLog(LOG_PATH, ROOM_COMMIT_INTERVAL) ||
+                !server.initialize() || !server.start())
+            {
+                _exit(1);
+            }
+            const char up = 1;
+            if (write(ready[1], &up, 1) != 1)
+            {
+                _exit(1);
+            }
+            while (true)
+            {
+                pause();
+            }
+        }
+        close(ready[1]);
+        char up = 0;
+        const bool started = read(ready[0], &up, 1) == 1;
+        close(ready[0]);
+
+        ClientView views[2];
+        ClientView& checker = views[0];
+        ClientView& owner = views[1];
+        std::vector<uint8_t> checks;
+        std::vector<size_t> checkEnds;
+        size_t checksSent = 0;
+        if (started)
+        {
+            owner.socket = connectServer();
+            checker.socket = connectServer();
+        }
+        if (!Utility::isSocketInvalid(owner.socket) && !Utility::isSocketInvalid(checker.socket))
+        {
+            std::vector<uint8_t> setup;
+            appendRequest(setup, Protocol::MessageType::Join, "{\"world\":1}");
+            appendRequest(setup, Protocol::MessageType::TrackerSubscribe, "{\"world\":1}");
+            send(owner.socket, reinterpret_cast<const char*>(setup.data()), setup.size(), SOCK_SEND_FLAGS);
+            for (uint32_t location = 0; location < ROOM_CHECKS; location++)
+            {
+                appendRequest(checks, Protocol::MessageType::LocationCheck,
+                              "{\"world\":0,\"location\":" + std::to_string(location) + "}");
+                checkEnds.push_back(checks.size());
+            }
+            Utility::setSocketNonBlocking(checker.socket);
+        }
+        else
+        {
+            checker.closed = owner.closed = true;
+        }
+
+        const auto sendable = [&]()
+        {
+            return checks.empty() ? 0 : checkEnds[std::min<uint64_t>(checker.acks + ROOM_WINDOW, ROOM_CHECKS) - 1];
+        };
+        bool killedServer = false;
+        std::vector<pollfd> pfds(2);
+        while (!checker.closed || !owner.closed)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                pfds[i].fd = views[i].closed ? -1 : views[i].socket;
+                pfds[i].events = POLLIN;
+                pfds[i].revents = 0;
+            }
+            if (!killedServer && checksSent < sendable())
+            {
+                pfds[0].events |= POLLOUT;
+            }
+            if (poll(pfds.data(), pfds.size(), 5000) <= 0)
+            {
+                break;
+            }
+            if (pfds[0].revents & POLLOUT)
+            {
+                const auto sent = send(checker.socket, reinterpret_cast<const char*>(checks.data() + checksSent),
+                                       sendable() - checksSent, SOCK_SEND_FLAGS);
+                checksSent += sent > 0 ? sent : 0;
+            }
+            for (int i = 0; i < 2; i++)
+            {
+                if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                {
+                    continue;
+                }
+                uint8_t chunk[16 * 1024];
+                const auto received = recv(views[i].socket, reinterpret_cast<char*>(chunk), sizeof(chunk), 0);
+                if (received > 0)
+                {
+                    views[i].received.insert(views[i].received.end(), chunk, chunk + received);
+                    views[i].parseFrames();
+                }
+                else if (received == 0 || !Utility::socketWouldBlock())
+                {
+                    views[i].closed = true;
+                }
+            }
+            // Once a full window is out, the server is given a quarter of a
+            // commit interval to apply it, then killed before the commit.
+            // Everything it sent before dying is still read.
+            if (!killedServer && checker.acks >= ROOM_CHECKS / 4 && checksSent == sendable())
+            {
+                std::this_thread::sleep_for(ROOM_COMMIT_INTERVAL / 4);
+                kill(child, SIGKILL);
+                killedServer = true;
+            }
+        }
+        for (ClientView& view : views)
+        {
+            if (!Utility::isSocketInvalid(view.socket))
+            {
+                SOCK_CLOSE(view.socket);
+            }
+        }
+        if (!killedServer)
+        {
+            kill(child, SIGKILL);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+
+        const auto start = Bench::Clock::now();
+        bool recovered = false;
+        {
+            ProtocolServer server(0);
+            server.setSnapshots(SNAPSHOT_PATH, std::chrono::seconds(60));
+            recovered = server.loadPlacement(PLACEMENT_PATH) && server.openEventLog(LOG_PATH, std::chrono::microseconds(0)) &&
+                        server.saveSnapshot();
+        }
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        WorldState state;
+        std::vector<ChangeLog> changeLogs(MAX_PLAYERS);
+        uint64_t logRecords = 0;
+        recovered = recovered && loadRoomSnapshot(SNAPSHOT_PATH, state, changeLogs, logRecords);
+        removeFiles();
+
+        std::string failure;
+        if (!started || !killedServer)
+        {
+            failure = "the server never ran into the kill";
+        }
+        else if (!recovered)
+        {
+            failure = "the room could not be rebuilt";
+        }
+        const auto checked = [&](uint32_t location)
+        {
+            return state.playerCount() > 1 && location < MAX_LOCATIONS && state.isLocationChecked(0, location);
+        };
+        // Acks come back in the order the checks went out
+        for (uint32_t location = 0; failure.empty() && location < checker.acks; location++)
+        {
+            if (!checked(location))
+            {
+                failure = "acknowledged check " + std::to_string(location) + " was lost";
+            }
+        }
+        for (size_t i = 0; failure.empty() && i < owner.deliveredFrom.size(); i++)
+        {
+            if (!checked(owner.deliveredFrom[i]))
+            {
+                failure = "the item from check " + std::to_string(owner.deliveredFrom[i]) + " was delivered, the check lost";
+            }
+        }
+        if (failure.empty() && owner.trackerVersion > changeLogs[1].version())
+        {
+            failure = "tracker version " + std::to_string(owner.trackerVersion) + " was sent, only " +
+                      std::to_string(changeLogs[1].version()) + " recovered";
+        }
+        if (!failure.empty())
+        {
+            runner.fail(name, failure);
+        }
+        runner.report({ name, logRecords, seconds,
+                        { { "acknowledged", static_cast<double>(checker.acks) },
+                          { "delivered", static_cast<double>(owner.deliveredFrom.size()) },
+                          { "tracker_version", static_cast<double>(owner.trackerVersion) },
+                          { "recovered", static_cast<double>(logRecords) },
+                          { "intact", failure.empty() ? 1.0 : 0.0 } } });
+    }
+#endif
+}
+
+namespace Bench
+{
+    void runEventLogBenchmarks(Runner& runner)
+    {
+        benchAppend(runner);
+        // one sync per event, what group commit saves
+        benchCommit(runner, std::chrono::microseconds(0), 1);
+        for (long interval : { 0L, 500L, 1000L, 2000L, 5000L, 10000L })
+        {
+            benchCommit(runner, std::chrono::microseconds(interval), 64);
+            benchSaturated(runner, std::chrono::microseconds(interval));
+        }
+#ifndef _WIN32
+        checkRecovery(runner);
+        checkRoomRecovery(runner);
+#endif
+    }
+}
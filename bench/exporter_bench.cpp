@@ -0,0 +1,170 @@
+
+#include "bench.hpp"
+#include "../ProtocolServer.hpp"
+#include "../utility/metrics_exporter.hpp"
+
+#ifndef PLATFORM_MSVC
+  #include <arpa/inet.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+#include <atomic>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+    constexpr uint16_t SERVER_PORT = 41234;
+    constexpr uint16_t METRICS_PORT = 49234;
+    constexpr unsigned PINGS = 20000;
+    // far more often than any real scraper, but leaves the CPU to the pings
+    // so the comparison measures event loop stalls rather than CPU contention
+    constexpr std::chrono::milliseconds SCRAPE_INTERVAL(10);
+
+    SocketType connectLoopback(uint16_t port)
+    {
+        SocketType sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            SOCK_CLOSE(sock);
+            return INVALID_SOCKET;
+        }
+        Utility::setSocketNoDelay(sock);
+        return sock;
+    }
+
+    bool recvExactly(SocketType sock, uint8_t* out, size_t length)
+    {
+        while (length != 0)
+        {
+            const auto received = recv(sock, reinterpret_cast<char*>(out), length, 0);
+            if (received <= 0)
+            {
+                return false;
+            }
+            out += received;
+            length -= received;
+        }
+        return true;
+    }
+
+    // one blocking scrape, the whole page is read and thrown away
+    void scrapeOnce(std::string& buffer)
+    {
+        SocketType sock = connectLoopback(METRICS_PORT);
+        if (Utility::isSocketInvalid(sock))
+        {
+            return;
+        }
+        const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+        send(sock, request, sizeof(request) - 1, SOCK_SEND_FLAGS);
+        char chunk[4096];
+        buffer.clear();
+        while (true)
+        {
+            const auto received = recv(sock, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                break;
+            }
+            buffer.append(chunk, received);
+        }
+        SOCK_CLOSE(sock);
+    }
+
+    // ping round trips against an in-process server, optionally while another
+    // thread scrapes the metrics endpoint every SCRAPE_INTERVAL
+    void benchPingLatency(Bench::Runner& runner, bool scraping)
+    {
+        const std::string name = std::string("exporter/ping_rtt/scraping:") + (scraping ? "1" : "0");
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+
+        ProtocolServer server(SERVER_PORT, METRICS_PORT);
+        if (!server.initialize())
+        {
+            fprintf(stderr, "%s: could not start server\n", name.c_str());
+            return;
+        }
+        server.start();
+
+        std::atomic<bool> done(false);
+        std::atomic<uint64_t> scrapes(0);
+        std::thread scraper;
+        if (scraping)
+        {
+            scraper = std::thread([&]
+            {
+                std::string page;
+                while (!done.load())
+                {
+                    scrapeOnce(page);
+                    scrapes.fetch_add(1);
+                    std::this_thread::sleep_for(SCRAPE_INTERVAL);
+                }
+            });
+        }
+
+        const Metrics::Histogram rtt = Metrics::registry().histogram("bench_ping_rtt_ns", "benchmark ping round trip",
+                                                                     std::string("scraping=\"") + (scraping ? "1" : "0") + "\"");
+        SocketType sock = connectLoopback(SERVER_PORT);
+        uint8_t frame[Protocol::FRAME_HEADER_SIZE + 16] = {};
+        Protocol::encodeHeader({ 16, Protocol::MessageType::Ping, 0 }, frame);
+        uint8_t reply[sizeof(frame)];
+
+        const auto start = Bench::Clock::now();
+        for (unsigned i = 0; i < PINGS; i++)
+        {
+            const auto sent = Bench::Clock::now();
+            send(sock, reinterpret_cast<const char*>(frame), sizeof(frame), SOCK_SEND_FLAGS);
+            if (!recvExactly(sock, reply, sizeof(reply)))
+            {
+                break;
+            }
+            rtt.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now() - sent).count());
+        }
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+
+        done = true;
+        if (scraper.joinable())
+        {
+            scraper.join();
+        }
+        SOCK_CLOSE(sock);
+        server.stop();
+
+        const Metrics::HistogramSnapshot snapshot = rtt.snapshot();
+        runner.report({ name, PINGS, seconds, {
+            { "p50_ns", static_cast<double>(snapshot.quantile(0.50)) },
+            { "p99_ns", static_cast<double>(snapshot.quantile(0.99)) },
+            { "p999_ns", static_cast<double>(snapshot.quantile(0.999)) },
+            { "scrapes", static_cast<double>(scrapes.load()) },
+        } });
+    }
+}
+
+namespace Bench
+{
+    void runExporterBenchmarks(Runner& runner)
+    {
+        Metrics::PrometheusRenderer renderer;
+        runner.run("exporter/render", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                doNotOptimize(renderer.render().size());
+            }
+            return iterations;
+        });
+
+        benchPingLatency(runner, false);
+        benchPingLatency(runner, true);
+    }
+}
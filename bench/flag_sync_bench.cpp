@@ -0,0 +1,138 @@
+#include "bench.hpp"
+#include "../WorldState.hpp"
+#include "../utility/bits.hpp"
+
+#include <cstring>
+
+namespace
+{
+    constexpr size_t BLOCK_VARIANTS = 64; // power of two
+
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // a save's worth of flags: setBits random bits over the block
+    std::vector<uint8_t> randomBlock(uint64_t& random, unsigned setBits)
+    {
+        std::vector<uint8_t> block(SHARED_FLAG_BYTES, 0);
+        for (unsigned i = 0; i < setBits; i++)
+        {
+            const uint64_t bit = nextRandom(random) % (SHARED_FLAG_BYTES * 8);
+            block[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+        }
+        return block;
+    }
+
+    using MergeFunction = size_t (*)(uint64_t*, const uint8_t*, size_t, uint16_t*);
+
+    // steady: every incoming block is already in the room, the common case
+    //   for a sync sent every frame
+    // fresh: the room starts empty each time, so the incoming bits all land
+    void benchMerge(Bench::Runner& runner, const std::string& variant, MergeFunction merge)
+    {
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        std::vector<std::vector<uint8_t>> blocks;
+        for (size_t i = 0; i < BLOCK_VARIANTS; i++)
+        {
+            blocks.push_back(randomBlock(random, 64));
+        }
+        uint16_t changed[SHARED_FLAG_WORDS];
+
+        std::vector<uint64_t> room(SHARED_FLAG_WORDS, 0);
+        for (const std::vector<uint8_t>& block : blocks)
+        {
+            merge(room.data(), block.data(), SHARED_FLAG_WORDS, changed);
+        }
+        runner.run("flag_sync/merge/" + variant + "/steady", [&](uint64_t iterations)
+        {
+            size_t total = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                total += merge(room.data(), blocks[i & (BLOCK_VARIANTS - 1)].data(), SHARED_FLAG_WORDS, changed);
+            }
+            Bench::doNotOptimize(total);
+            return iterations;
+        });
+
+        std::vector<uint64_t> fresh(SHARED_FLAG_WORDS);
+        runner.run("flag_sync/merge/" + variant + "/fresh", [&](uint64_t iterations)
+        {
+            size_t total = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                memset(fresh.data(), 0, SHARED_FLAG_BYTES);
+                total += merge(fresh.data(), blocks[i & (BLOCK_VARIANTS - 1)].data(), SHARED_FLAG_WORDS, changed);
+            }
+            Bench::doNotOptimize(total);
+            return iterations;
+        });
+    }
+
+    // A co-op room of players each syncing their whole block every frame at
+    // hz, a new flag turning up now and then. Ops are syncs handled, each a
+    // merge plus encoding the FlagUpdate when something changed; cpu_percent
+    // is the share of one core the room needs.
+    void benchRoom(Bench::Runner& runner, uint32_t players, uint32_t hz)
+    {
+        const std::string name = "flag_sync/room/players:" + std::to_string(players) + "/hz:" + std::to_string(hz);
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        uint64_t random = 0x2545F4914F6CDD1DULL;
+        std::vector<std::vector<uint8_t>> saves;
+        for (uint32_t i = 0; i < players; i++)
+        {
+            saves.push_back(randomBlock(random, 200));
+        }
+        WorldState state;
+        uint16_t changed[SHARED_FLAG_WORDS];
+        std::vector<uint8_t> update(SHARED_FLAG_WORDS * 10);
+
+        runner.run(name, [&](uint64_t iterations)
+        {
+            size_t updated = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                std::vector<uint8_t>& save = saves[i % players];
+                // roughly one new flag per player every few seconds
+                if ((nextRandom(random) & 255) == 0)
+                {
+                    const uint64_t bit = nextRandom(random) % (SHARED_FLAG_BYTES * 8);
+                    save[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+                }
+                const size_t count = state.mergeSharedFlags(save.data(), changed);
+                const uint64_t* words = state.sharedFlagWords();
+                for (size_t c = 0; c < count; c++)
+                {
+                    memcpy(&update[c * 10], &changed[c], sizeof(uint16_t));
+                    memcpy(&update[c * 10 + 2], &words[changed[c]], sizeof(uint64_t));
+                }
+                updated += count;
+            }
+            Bench::doNotOptimize(updated);
+            Bench::doNotOptimize(update[0]);
+            return iterations;
+        });
+        const Bench::Result& last = runner.results().back();
+        const double syncsPerSecond = static_cast<double>(players) * hz;
+        runner.report({ name + "/load", 0, 0.0,
+                        { { "syncs_per_second", syncsPerSecond },
+                          { "cpu_percent", last.nsPerOp() * syncsPerSecond / 1e9 * 100.0 } } });
+    }
+}
+
+namespace Bench
+{
+    void runFlagSyncBenchmarks(Runner& runner)
+    {
+        benchMerge(runner, "scalar", Utility::orMergeChangedScalar);
+        benchMerge(runner, "simd", Utility::orMergeChanged);
+        benchRoom(runner, 100, 60);
+    }
+}
@@ -0,0 +1,168 @@
+#include "bench.hpp"
+#include "../Protocol.hpp"
+#include "../utility/platform_socket.hpp"
+
+#ifndef PLATFORM_MSVC
+  #include <arpa/inet.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t PARSE_FRAMES = 1024;
+    // replies queued for one connection in one poll iteration
+    constexpr size_t BATCH_FRAMES = 64;
+
+    // a connected loopback pair, the closest thing to a client socket that
+    // works on every host
+    bool loopbackPair(SocketType& writer, SocketType& reader)
+    {
+        SocketType listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(addr);
+        if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0 ||
+            getsockname(listener, (struct sockaddr*)&addr, &length) < 0)
+        {
+            SOCK_CLOSE(listener);
+            return false;
+        }
+        writer = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(writer, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            SOCK_CLOSE(writer);
+            SOCK_CLOSE(listener);
+            return false;
+        }
+        reader = accept(listener, nullptr, nullptr);
+        SOCK_CLOSE(listener);
+        Utility::setSocketNoDelay(writer);
+        return !Utility::isSocketInvalid(reader);
+    }
+
+    void drain(SocketType reader, size_t length)
+    {
+        char chunk[4096];
+        while (length != 0)
+        {
+            const auto received = recv(reader, chunk, length < sizeof(chunk) ? length : sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                return;
+            }
+            length -= received;
+        }
+    }
+
+    // the same walk processFrames does over a read buffer, without handling
+    void benchParse(Bench::Runner& runner)
+    {
+        std::vector<uint8_t> buffer;
+        const uint8_t payload[64] = {};
+        for (size_t i = 0; i < PARSE_FRAMES; i++)
+        {
+            const Protocol::MessageType type = static_cast<Protocol::MessageType>(i % Protocol::MESSAGE_TYPE_COUNT);
+            Protocol::appendFrame(buffer, type, payload, (i * 7) % sizeof(payload));
+        }
+        runner.run("framing/parse", [&](uint64_t iterations)
+        {
+            uint64_t frames = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                size_t offset = 0;
+                while (buffer.size() - offset >= Protocol::FRAME_HEADER_SIZE)
+                {
+                    const Protocol::FrameHeader header = Protocol::decodeHeader(buffer.data() + offset);
+                    if (header.length > Protocol::MAX_FRAME_PAYLOAD ||
+                        buffer.size() - offset - Protocol::FRAME_HEADER_SIZE < header.length)
+                    {
+                        break;
+                    }
+                    Bench::doNotOptimize(header.type);
+                    offset += Protocol::FRAME_HEADER_SIZE + header.length;
+                    frames++;
+                }
+            }
+            return frames;
+        });
+    }
+
+    void benchEncode(Bench::Runner& runner)
+    {
+        std::vector<uint8_t> buffer;
+        runner.run("framing/encode_ack", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                if (buffer.size() >= 64 * 1024)
+                {
+                    buffer.clear();
+                }
+                Protocol::appendFrame(buffer, Protocol::MessageType::Ack, nullptr, 0);
+            }
+            Bench::doNotOptimize(buffer.size());
+            return iterations;
+        });
+    }
+
+    // BATCH_FRAMES acks sent one send() each versus appended to one buffer and
+    // sent together, which is what the server's per-connection write buffer
+    // does; ops are frames
+    void benchBatching(Bench::Runner& runner, bool batched)
+    {
+        const std::string name = std::string("framing/send_acks/batched:") + (batched ? "1" : "0");
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        SocketType writer;
+        SocketType reader;
+        if (!loopbackPair(writer, reader))
+        {
+            fprintf(stderr, "%s: could not open loopback sockets\n", name.c_str());
+            return;
+        }
+        std::vector<uint8_t> buffer;
+        uint8_t ack[Protocol::FRAME_HEADER_SIZE];
+        Protocol::encodeHeader({ 0, Protocol::MessageType::Ack, 0 }, ack);
+        runner.run(name, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                if (batched)
+                {
+                    buffer.clear();
+                    for (size_t frame = 0; frame < BATCH_FRAMES; frame++)
+                    {
+                        Protocol::appendFrame(buffer, Protocol::MessageType::Ack, nullptr, 0);
+                    }
+                    send(writer, reinterpret_cast<const char*>(buffer.data()), buffer.size(), SOCK_SEND_FLAGS);
+                }
+                else
+                {
+                    for (size_t frame = 0; frame < BATCH_FRAMES; frame++)
+                    {
+                        send(writer, reinterpret_cast<const char*>(ack), sizeof(ack), SOCK_SEND_FLAGS);
+                    }
+                }
+                drain(reader, BATCH_FRAMES * sizeof(ack));
+            }
+            return iterations * BATCH_FRAMES;
+        });
+        SOCK_CLOSE(writer);
+        SOCK_CLOSE(reader);
+    }
+}
+
+namespace Bench
+{
+    void runFramingBenchmarks(Runner& runner)
+    {
+        benchParse(runner);
+        benchEncode(runner);
+        benchBatching(runner, false);
+        benchBatching(runner, true);
+    }
+}
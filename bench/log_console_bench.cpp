@@ -0,0 +1,79 @@
+
+#include "bench.hpp"
+#include "../utility/log_console.hpp"
+
+#include <whb/log.h>
+#include <whb/log_console.h>
+
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    constexpr uint64_t LINES_PER_THREAD = 1000;
+
+    void benchConsole(Bench::Runner& runner, Utility::LogConsoleMode mode, unsigned threadCount)
+    {
+        const std::string name = std::string("log_console/") +
+            (mode == Utility::LogConsoleMode::Batched ? "batched" : "immediate") +
+            "/threads:" + std::to_string(threadCount);
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+
+        WHBLogConsoleInit();
+        Utility::LogConsole console;
+        console.start(mode);
+
+        const auto start = Bench::Clock::now();
+        std::vector<std::thread> writers;
+        for (unsigned t = 0; t < threadCount; t++)
+        {
+            writers.emplace_back([&console, t]
+            {
+                char line[96];
+                for (uint64_t i = 0; i < LINES_PER_THREAD; i++)
+                {
+                    snprintf(line, sizeof(line), "[net] debug: client %u connected from addr 127.0.0.1 (%llu)\n",
+                             t, static_cast<unsigned long long>(i));
+                    console.write(line);
+                }
+            });
+        }
+        for (auto& writer : writers)
+        {
+            writer.join();
+        }
+        // time spent by the logging threads only; the final drain is not theirs
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        console.stop();
+
+        const uint64_t total = LINES_PER_THREAD * threadCount;
+        if (WHBStubLogConsoleLineCount() != total || console.droppedCount() != 0)
+        {
+            runner.fail(name, "console received " + std::to_string(WHBStubLogConsoleLineCount()) + " of " +
+                        std::to_string(total) + " lines, " + std::to_string(console.droppedCount()) + " dropped");
+            WHBLogConsoleFree();
+            return;
+        }
+
+        runner.report({ name, total, seconds, {
+            { "draws", static_cast<double>(WHBStubLogConsoleDrawCount()) },
+            { "lines_per_draw", static_cast<double>(total) / WHBStubLogConsoleDrawCount() },
+        } });
+        WHBLogConsoleFree();
+    }
+}
+
+namespace Bench
+{
+    void runLogConsoleBenchmarks(Runner& runner)
+    {
+        for (unsigned threads : { 1u, 4u })
+        {
+            benchConsole(runner, Utility::LogConsoleMode::Immediate, threads);
+            benchConsole(runner, Utility::LogConsoleMode::Batched, threads);
+        }
+    }
+}
@@ -0,0 +1,244 @@
+#include "bench.hpp"
+#include "../LogicGraph.hpp"
+#include "../utility/bits.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    // about the size of Wind Waker's logic with every location enabled
+    constexpr uint32_t MACROS = 350;
+    constexpr uint32_t LOCATIONS = 900;
+    constexpr uint32_t PROGRESSION_ITEMS = 72;
+    // progressive items (sword, bow, wallet, shards...) come in several copies
+    constexpr uint32_t PROGRESSIVE_ITEMS = 12;
+    constexpr uint32_t MAX_COPIES = 8;
+
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    uint32_t copies(uint32_t item)
+    {
+        return item < PROGRESSIVE_ITEMS ? 2 + item % (MAX_COPIES - 1) : 1;
+    }
+
+    // one to three items, count()s and macros joined by and
+    std::string randomClause(uint64_t& random, uint32_t self)
+    {
+        std::string clause;
+        const uint64_t terms = 1 + nextRandom(random) % 3;
+        for (uint64_t i = 0; i < terms; i++)
+        {
+            if (i != 0)
+            {
+                clause += " and ";
+            }
+            const uint64_t pick = nextRandom(random) % 10;
+            const uint32_t item = static_cast<uint32_t>(nextRandom(random) % PROGRESSION_ITEMS);
+            const uint32_t macro = static_cast<uint32_t>(nextRandom(random) % MACROS);
+            if (pick < 2 && macro != self)
+            {
+                clause += "Macro" + std::to_string(macro);
+            }
+            else if (pick < 3 && item < PROGRESSIVE_ITEMS)
+            {
+                clause += "count(" + std::to_string(1 + nextRandom(random) % copies(item)) + ", Item" + std::to_string(item) + ")";
+            }
+            else
+            {
+                clause += "Item" + std::to_string(item);
+            }
+        }
+        return clause;
+    }
+
+    // one to three clauses joined by or, the alternatives parenthesized
+    std::string randomRequirement(uint64_t& random, uint32_t self)
+    {
+        const uint64_t clauses = 1 + nextRandom(random) % 3;
+        if (clauses == 1)
+        {
+            return randomClause(random, self);
+        }
+        std::string requirement;
+        for (uint64_t i = 0; i < clauses; i++)
+        {
+            requirement += (i != 0 ? " or (" : "(") + randomClause(random, self) + ")";
+        }
+        return requirement;
+    }
+
+    // every copy of every progression item, shuffled
+    std::vector<uint32_t> itemOrder()
+    {
+        std::vector<uint32_t> order;
+        for (uint32_t item = 0; item < PROGRESSION_ITEMS; item++)
+        {
+            order.insert(order.end(), copies(item), item);
+        }
+        uint64_t random = 0xD1B54A32D192ED03ULL;
+        for (size_t i = order.size(); i > 1; i--)
+        {
+            std::swap(order[i - 1], order[nextRandom(random) % i]);
+        }
+        return order;
+    }
+
+    uint32_t startCount(const LogicGraph& graph)
+    {
+        uint32_t count = 0;
+        for (size_t i = 0; i < LOCATION_WORDS; i++)
+        {
+            count += Utility::popCount(graph.startLocationWords()[i]);
+        }
+        return count;
+    }
+
+    // Receives the whole item order, one item at a time, updating the logic
+    // with update(state, counts, item); only the updates are timed.
+    template<typename Update>
+    void benchItems(Bench::Runner& runner, const std::string& name, const LogicGraph& graph,
+                    const std::vector<uint32_t>& order, Update update)
+    {
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        LogicState state;
+        uint8_t counts[MAX_ITEMS];
+        uint64_t items = 0;
+        Bench::Clock::duration elapsed(0);
+        while (elapsed < std::chrono::milliseconds(200))
+        {
+            memset(counts, 0, sizeof(counts));
+            state.evaluateAll(graph, counts);
+            const auto start = Bench::Clock::now();
+            for (const uint32_t item : order)
+            {
+                counts[item]++;
+                update(state, counts, item);
+            }
+            elapsed += Bench::Clock::now() - start;
+            items += order.size();
+        }
+        uint32_t inLogic = 0;
+        for (size_t i = 0; i < LOCATION_WORDS; i++)
+        {
+            inLogic += Utility::popCount(state.locationWords()[i]);
+        }
+        runner.report({ name, items, std::chrono::duration<double>(elapsed).count(), {
+            { "items_per_seed", static_cast<double>(order.size()) },
+            { "in_logic_at_start", static_cast<double>(startCount(graph)) },
+            { "in_logic_at_end", static_cast<double>(inLogic) } } });
+    }
+
+    // the incremental result has to match a from-scratch evaluation after
+    // every item
+    bool agrees(const LogicGraph& graph, const std::vector<uint32_t>& order)
+    {
+        LogicState incremental;
+        LogicState scratch;
+        uint8_t counts[MAX_ITEMS] = {};
+        std::vector<uint32_t> inLogic;
+        incremental.evaluateAll(graph, counts);
+        for (const uint32_t item : order)
+        {
+            counts[item]++;
+            incremental.addItem(graph, counts, item, inLogic);
+            scratch.evaluateAll(graph, counts);
+            if (memcmp(incremental.locationWords(), scratch.locationWords(), LOCATION_WORDS * sizeof(uint64_t)) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+namespace Bench
+{
+    // Macros for areas and enemies over the progression items, and
+    // locations gated on a macro and some items; a few need nothing.
+    std::string windWakerSizedLogic()
+    {
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        std::string file = "{\"items\": {";
+        for (uint32_t item = 0; item < MAX_ITEMS; item++)
+        {
+            file += (item != 0 ? ", \"Item" : "\"Item") + std::to_string(item) + "\": " + std::to_string(item);
+        }
+        file += "}, \"macros\": {";
+        for (uint32_t macro = 0; macro < MACROS; macro++)
+        {
+            file += (macro != 0 ? ", \"Macro" : "\"Macro") + std::to_string(macro) + "\": \"" +
+                    randomRequirement(random, macro) + "\"";
+        }
+        file += "}, \"locations\": [";
+        for (uint32_t location = 0; location < LOCATIONS; location++)
+        {
+            std::string requirement;
+            switch (nextRandom(random) % 8)
+            {
+            case 0:
+                requirement = "Nothing";
+                break;
+            case 1:
+            case 2:
+                requirement = randomRequirement(random, UINT32_MAX);
+                break;
+            default:
+                requirement = "Macro" + std::to_string(nextRandom(random) % MACROS) + " and (" +
+                              randomRequirement(random, UINT32_MAX) + ")";
+                break;
+            }
+            file += (location != 0 ? ", [" : "[") + std::to_string(location) + ", \"" + requirement + "\"]";
+        }
+        return file + "]}";
+    }
+
+    void runLogicBenchmarks(Runner& runner)
+    {
+        LogicGraph graph;
+        if (!graph.loadText(windWakerSizedLogic(), "generated logic"))
+        {
+            fprintf(stderr, "logic: could not compile the generated logic\n");
+            return;
+        }
+        const std::vector<uint32_t> order = itemOrder();
+        if (!agrees(graph, order))
+        {
+            fprintf(stderr, "logic: incremental evaluation disagrees with a full one\n");
+            return;
+        }
+
+        if (runner.enabled("logic/graph"))
+        {
+            runner.report({ "logic/graph", 0, 0.0, {
+                { "locations", static_cast<double>(graph.locationCount()) },
+                { "nodes", static_cast<double>(graph.nodeCount()) },
+                { "clauses", static_cast<double>(graph.clauseCount()) } } });
+        }
+
+        std::vector<uint32_t> cameIntoLogic;
+        benchItems(runner, "logic/item/incremental", graph, order,
+                   [&](LogicState& state, const uint8_t* counts, uint32_t item)
+        {
+            cameIntoLogic.clear();
+            state.addItem(graph, counts, item, cameIntoLogic);
+        });
+        benchItems(runner, "logic/item/from_scratch", graph, order,
+                   [&](LogicState& state, const uint8_t* counts, uint32_t)
+        {
+            cameIntoLogic.clear();
+            state.evaluateAll(graph, counts, &cameIntoLogic);
+        });
+    }
+}
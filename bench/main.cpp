@@ -0,0 +1,125 @@
+
+#include "bench.hpp"
+#include "../utility/log.hpp"
+#include "../json.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace Bench
+{
+    Runner::Runner(std::string filter) : nameFilter(std::move(filter))
+    {
+
+    }
+
+    bool Runner::enabled(const std::string& name) const
+    {
+        return nameFilter.empty() || name.find(nameFilter) != std::string::npos;
+    }
+
+    void Runner::report(Result result)
+    {
+        printf("%-48s %14.1f ns/op %16.0f op/s", result.name.c_str(), result.nsPerOp(), result.opsPerSec());
+        for (const auto& counter : result.counters)
+        {
+            printf("  %s=%g", counter.first.c_str(), counter.second);
+        }
+        printf("\n");
+        fflush(stdout);
+        allResults.push_back(std::move(result));
+    }
+
+    void Runner::fail(const std::string& name, const std::string& why)
+    {
+        fprintf(stderr, "%s: FAILED, %s\n", name.c_str(), why.c_str());
+        anyFailed = true;
+    }
+
+    bool Runner::writeJson(const std::string& path) const
+    {
+        nlohmann::json results = nlohmann::json::array();
+        for (const Result& result : allResults)
+        {
+            nlohmann::json counters = nlohmann::json::object();
+            for (const auto& counter : result.counters)
+            {
+                counters[counter.first] = counter.second;
+            }
+            results.push_back({
+                { "name", result.name },
+                { "operations", result.operations },
+                { "seconds", result.seconds },
+                { "ns_per_op", result.nsPerOp() },
+                { "ops_per_sec", result.opsPerSec() },
+                { "counters", std::move(counters) },
+            });
+        }
+#ifdef __VERSION__
+        const char* compiler = __VERSION__;
+#else
+        const char* compiler = "unknown";
+#endif
+        std::ofstream out(path);
+        out << nlohmann::json{ { "compiler", compiler }, { "results", std::move(results) } }.dump(2) << "\n";
+        return static_cast<bool>(out);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    std::string filter;
+    std::string jsonPath;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--filter <substring>] [--json <path>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // benchmarks start servers; keep their connection logging out of the results
+    Utility::setLogLevel(Utility::LogLevel::Warn);
+    Utility::configureLogLevels(getenv("WWHD_LOG"));
+
+    Bench::Runner runner(filter);
+    Bench::runByteswapBenchmarks(runner);
+    Bench::runCaptureBenchmarks(runner);
+    Bench::runCodecBenchmarks(runner);
+    Bench::runEventLogBenchmarks(runner);
+    Bench::runFlagSyncBenchmarks(runner);
+    Bench::runFramingBenchmarks(runner);
+    Bench::runLogConsoleBenchmarks(runner);
+    Bench::runLogicBenchmarks(runner);
+    Bench::runMetricsBenchmarks(runner);
+    Bench::runExporterBenchmarks(runner);
+    Bench::runPlaythroughBenchmarks(runner);
+    Bench::runRoomActorBenchmarks(runner);
+    Bench::runRoutingBenchmarks(runner);
+    Bench::runSeedBenchmarks(runner);
+    Bench::runSnapshotBenchmarks(runner);
+    Bench::runTopicBenchmarks(runner);
+    Bench::runTraceBenchmarks(runner);
+    Bench::runTrackerSyncBenchmarks(runner);
+    Bench::runTransferBenchmarks(runner);
+    Bench::runWorldStateBenchmarks(runner);
+
+    if (!jsonPath.empty() && !runner.writeJson(jsonPath))
+    {
+        fprintf(stderr, "could not write %s\n", jsonPath.c_str());
+        return 1;
+    }
+    return runner.failed() ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+
+#include "bench.hpp"
+#include "../utility/metrics.hpp"
+
+#include <thread>
+
+namespace
+{
+    // every thread records into its own counter shard; the per-op time should
+    // not grow with the thread count the way a shared atomic's would
+    void benchContendedCounter(Bench::Runner& runner, unsigned threadCount)
+    {
+        const std::string name = "metrics/counter_inc/threads:" + std::to_string(threadCount);
+        const Metrics::Counter counter = Metrics::registry().counter("bench_contended_total", "benchmark counter");
+        runner.run(name, [&](uint64_t iterations)
+        {
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < threadCount; t++)
+            {
+                threads.emplace_back([&counter, iterations]
+                {
+                    for (uint64_t i = 0; i < iterations; i++)
+                    {
+                        counter.inc();
+                    }
+                });
+            }
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+            // per-thread time: the threads ran concurrently
+            return iterations;
+        });
+    }
+}
+
+namespace Bench
+{
+    void runMetricsBenchmarks(Runner& runner)
+    {
+        Metrics::Registry& registry = Metrics::registry();
+        const Metrics::Counter counter = registry.counter("bench_counter_total", "benchmark counter");
+        const Metrics::Gauge gauge = registry.gauge("bench_gauge", "benchmark gauge");
+        const Metrics::Histogram histogram = registry.histogram("bench_latency_ns", "benchmark histogram");
+
+        runner.run("metrics/counter_inc", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                counter.inc();
+            }
+            return iterations;
+        });
+
+        runner.run("metrics/gauge_add", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                gauge.add();
+            }
+            return iterations;
+        });
+
+        runner.run("metrics/histogram_record", [&](uint64_t iterations)
+        {
+            // spread samples over a realistic latency range (1 us .. ~1 ms)
+            uint64_t value = 1000;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                histogram.record(value);
+                value = value * 1103515245 % 1000000 + 1000;
+            }
+            return iterations;
+        });
+
+        runner.run("metrics/scoped_timer", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                Metrics::ScopedTimer timer(histogram);
+            }
+            return iterations;
+        });
+
+        for (unsigned threads : { 1u, 4u })
+        {
+            benchContendedCounter(runner, threads);
+        }
+
+        runner.run("metrics/collect", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                doNotOptimize(registry.collect());
+            }
+            return iterations;
+        });
+    }
+}
@@ -0,0 +1,72 @@
+#include "bench.hpp"
+#include "../Playthrough.hpp"
+#include "../SeedService.hpp"
+
+#include <cstdio>
+
+namespace
+{
+    constexpr uint32_t WORLDS = 50;
+}
+
+namespace Bench
+{
+    void runPlaythroughBenchmarks(Runner& runner)
+    {
+        // generating the seed takes a while
+        if (!runner.enabled("playthrough/50_worlds") && !runner.enabled("playthrough/50_worlds_unbeatable"))
+        {
+            return;
+        }
+        LogicGraph logic;
+        if (!logic.loadText(windWakerSizedLogic(), "generated logic"))
+        {
+            fprintf(stderr, "playthrough: could not compile the generated logic\n");
+            return;
+        }
+        // a real 50 world fill, so the spheres are the ones a seed has
+        SeedSettings settings;
+        settings.worlds = WORLDS;
+        settings.junkItem = MAX_ITEMS - 1;
+        std::vector<SeedPlacement> placements;
+        std::string error;
+        if (!generateSeed(logic, settings, 1, placements, error))
+        {
+            fprintf(stderr, "playthrough: could not generate a seed: %s\n", error.c_str());
+            return;
+        }
+        RoutingTable beatable;
+        RoutingTable unbeatable;
+        beatable.reserve(placements.size());
+        unbeatable.reserve(placements.size());
+        for (const SeedPlacement& placement : placements)
+        {
+            beatable.insert(placement.world, placement.location, Route{ placement.owner, placement.item });
+            // the same seed with half of world 0's progression gone
+            const bool lost = placement.owner == 0 && placement.item != settings.junkItem && placement.item % 2 == 0;
+            unbeatable.insert(placement.world, placement.location, Route{ placement.owner, lost ? settings.junkItem : placement.item });
+        }
+
+        Playthrough playthrough;
+        const auto validate = [&](const char* name, const RoutingTable& placement)
+        {
+            runner.run(name, [&](uint64_t iterations)
+            {
+                for (uint64_t i = 0; i < iterations; i++)
+                {
+                    computePlaythrough(logic, placement, WORLDS, playthrough);
+                }
+                return iterations;
+            });
+            if (runner.enabled(name))
+            {
+                runner.report({ std::string(name) + "/result", 0, 0.0, {
+                    { "beatable", playthrough.beatable ? 1.0 : 0.0 },
+                    { "spheres", static_cast<double>(playthrough.sphereCount()) },
+                    { "locations_collected", static_cast<double>(playthrough.locations.size()) } } });
+            }
+        };
+        validate("playthrough/50_worlds", beatable);
+        validate("playthrough/50_worlds_unbeatable", unbeatable);
+    }
+}
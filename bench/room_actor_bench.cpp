@@ -0,0 +1,287 @@
+#include "bench.hpp"
+#include "../RoomHost.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+    constexpr uint32_t ROOMS = 1000;
+    constexpr uint32_t PLAYERS = 4;
+    constexpr uint32_t ROUTED_LOCATIONS = 256;
+    // messages each producer keeps in flight
+    constexpr size_t WINDOW = 1024;
+    const auto RUN_TIME = std::chrono::milliseconds(500);
+
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // stands in for a network thread: posts requests for random rooms and
+    // gets its messages back through the completion hook
+    struct Producer
+    {
+        std::vector<RoomMessage> pool;
+        Utility::MpscQueue<RoomMessage> returned;
+        uint64_t completed = 0;
+        uint64_t random = 0;
+    };
+
+    void handBack(RoomMessage* message, void*)
+    {
+        static_cast<Producer*>(message->sender)->returned.push(message);
+    }
+
+    void fill(Producer& producer, RoomMessage& message, uint32_t& room)
+    {
+        const uint64_t value = nextRandom(producer.random);
+        room = static_cast<uint32_t>(value % ROOMS);
+        message.request = (value >> 32) & 1 ? RoomRequest::LocationCheck : RoomRequest::ItemSend;
+        message.world = static_cast<uint32_t>((value >> 33) % PLAYERS);
+        message.id = static_cast<uint32_t>((value >> 40) % (message.request == RoomRequest::ItemSend ? MAX_ITEMS : MAX_LOCATIONS));
+    }
+
+    void produce(RoomHost& host, Producer& producer, Bench::Clock::time_point deadline)
+    {
+        uint32_t room;
+        for (RoomMessage& message : producer.pool)
+        {
+            message.sender = &producer;
+            fill(producer, message, room);
+            host.post(room, &message);
+        }
+        uint64_t outstanding = producer.pool.size();
+        bool posting = true;
+        while (outstanding > 0)
+        {
+            RoomMessage* message = producer.returned.pop();
+            if (message == nullptr)
+            {
+                if (posting && Bench::Clock::now() >= deadline)
+                {
+                    posting = false;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            producer.completed++;
+            if (posting && (producer.completed & 1023) == 0 && Bench::Clock::now() >= deadline)
+            {
+                posting = false;
+            }
+            if (!posting)
+            {
+                outstanding--;
+                continue;
+            }
+            fill(producer, *message, room);
+            host.post(room, message);
+        }
+    }
+
+    // 1000 rooms of 4 players, every room routed, with one producer per
+    // worker; messages/s should grow with workers up to the core count
+    void benchScaling(Bench::Runner& runner)
+    {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        double singleWorker = 0.0;
+        for (unsigned workers : { 1u, 2u, 4u, 8u })
+        {
+            const std::string name = "room_actor/" + std::to_string(ROOMS) + "_rooms_" + std::to_string(workers) + "_workers";
+            if (!runner.enabled(name))
+            {
+                continue;
+            }
+            std::vector<Producer> producers(workers);
+            RoomHost host(workers, &handBack, nullptr);
+            uint64_t random = 0x9E3779B97F4A7C15ULL;
+            for (uint32_t i = 0; i < ROOMS; i++)
+            {
+                Room& room = host.addRoom();
+                room.state().ensurePlayers(PLAYERS);
+                for (uint32_t world = 0; world < PLAYERS; world++)
+                {
+                    for (uint32_t location = 0; location < ROUTED_LOCATIONS; location++)
+                    {
+                        room.routing().insert(world, location, Route{ static_cast<uint32_t>(nextRandom(random) % PLAYERS), static_cast<uint32_t>(nextRandom(random) % MAX_ITEMS) });
+                    }
+                }
+            }
+            for (size_t i = 0; i < producers.size(); i++)
+            {
+                producers[i].pool = std::vector<RoomMessage>(WINDOW);
+                producers[i].random = 0xD1B54A32D192ED03ULL * (i + 1);
+            }
+
+            host.start();
+            const auto start = Bench::Clock::now();
+            std::vector<std::thread> threads;
+            for (Producer& producer : producers)
+            {
+                threads.emplace_back(produce, std::ref(host), std::ref(producer), start + RUN_TIME);
+            }
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+            const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+            host.stop();
+
+            uint64_t messages = 0;
+            for (const Producer& producer : producers)
+            {
+                messages += producer.completed;
+            }
+            const double rate = messages / seconds;
+            if (workers == 1)
+            {
+                singleWorker = rate;
+            }
+            runner.report({ name, messages, seconds, {
+                { "msgs_per_s", rate },
+                { "scaling_vs_1", singleWorker > 0.0 ? rate / singleWorker : 0.0 },
+                { "cores", static_cast<double>(cores) } } });
+        }
+    }
+
+    constexpr unsigned LATENCY_WORKERS = 4;
+    constexpr uint32_t SMALL_ROOMS = 99;
+    constexpr size_t BIG_WINDOW = 4096;
+    constexpr size_t SMALL_WINDOW = 16;
+    // what each big room message costs on top of the room itself: reply and
+    // tracker fan-out to 100 players
+    const auto BIG_MESSAGE_COST = std::chrono::microseconds(2);
+    const auto LATENCY_RUN_TIME = std::chrono::seconds(1);
+
+    struct TimedMessage : RoomMessage
+    {
+        Bench::Clock::time_point posted;
+    };
+
+    struct LatencyProducer
+    {
+        std::vector<TimedMessage> pool;
+        Utility::MpscQueue<RoomMessage> returned;
+        bool big = false;
+        std::vector<uint64_t> latencies;
+    };
+
+    void spin(Bench::Clock::duration cost)
+    {
+        const auto until = Bench::Clock::now() + cost;
+        while (Bench::Clock::now() < until)
+        {
+        }
+    }
+
+    void handBackTimed(RoomMessage* message, void*)
+    {
+        LatencyProducer& producer = *static_cast<LatencyProducer*>(message->sender);
+        if (producer.big)
+        {
+            spin(BIG_MESSAGE_COST);
+        }
+        producer.returned.push(message);
+    }
+
+    // keeps its whole window in flight until the deadline; the small
+    // producer records how long each message took to come back
+    void produceTimed(RoomHost& host, LatencyProducer& producer, Bench::Clock::time_point deadline)
+    {
+        uint64_t random = producer.big ? 1 : 0x9E3779B97F4A7C15ULL;
+        auto postNext = [&](TimedMessage& message)
+        {
+            const uint64_t value = nextRandom(random);
+            message.sender = &producer;
+            message.request = RoomRequest::ItemSend;
+            message.world = static_cast<uint32_t>(value % (producer.big ? 100 : PLAYERS));
+            message.id = static_cast<uint32_t>((value >> 32) % MAX_ITEMS);
+            message.posted = Bench::Clock::now();
+            host.post(producer.big ? 0 : 1 + static_cast<uint32_t>((value >> 16) % SMALL_ROOMS), &message);
+        };
+        for (TimedMessage& message : producer.pool)
+        {
+            postNext(message);
+        }
+        size_t outstanding = producer.pool.size();
+        while (outstanding > 0)
+        {
+            RoomMessage* returned = producer.returned.pop();
+            if (returned == nullptr)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            TimedMessage& message = static_cast<TimedMessage&>(*returned);
+            const auto now = Bench::Clock::now();
+            if (!producer.big)
+            {
+                producer.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - message.posted).count());
+            }
+            if (now >= deadline)
+            {
+                outstanding--;
+                continue;
+            }
+            postNext(message);
+        }
+    }
+
+    // one 100 player room (room 0) kept saturated next to 99 small rooms on
+    // 4 workers; reports the small rooms' post to completion latency, pinned
+    // to their home worker and with stealing
+    void benchSmallRoomLatency(Bench::Runner& runner, bool stealing)
+    {
+        const std::string name = std::string("room_actor/small_room_latency_") + (stealing ? "stealing" : "pinned");
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        LatencyProducer big;
+        big.big = true;
+        big.pool = std::vector<TimedMessage>(BIG_WINDOW);
+        LatencyProducer small;
+        small.pool = std::vector<TimedMessage>(SMALL_WINDOW);
+        small.latencies.reserve(1 << 20);
+
+        RoomHost host(LATENCY_WORKERS, &handBackTimed, nullptr, stealing);
+        host.addRoom().state().ensurePlayers(100);
+        for (uint32_t i = 0; i < SMALL_ROOMS; i++)
+        {
+            host.addRoom().state().ensurePlayers(PLAYERS);
+        }
+        host.start();
+        const auto start = Bench::Clock::now();
+        std::thread bigThread(produceTimed, std::ref(host), std::ref(big), start + LATENCY_RUN_TIME);
+        produceTimed(host, small, start + LATENCY_RUN_TIME);
+        bigThread.join();
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        host.stop();
+
+        std::vector<uint64_t>& latencies = small.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p)
+        {
+            return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))] / 1000.0;
+        };
+        runner.report({ name, latencies.size(), seconds, {
+            { "p50_us", percentile(0.50) },
+            { "p99_us", percentile(0.99) },
+            { "p999_us", percentile(0.999) },
+            { "max_us", latencies.empty() ? 0.0 : latencies.back() / 1000.0 } } });
+    }
+}
+
+namespace Bench
+{
+    void runRoomActorBenchmarks(Runner& runner)
+    {
+        benchScaling(runner);
+        benchSmallRoomLatency(runner, false);
+        benchSmallRoomLatency(runner, true);
+    }
+}
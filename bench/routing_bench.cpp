@@ -0,0 +1,384 @@
+#include "bench.hpp"
+#include "../PlacementFile.hpp"
+#include "../RoutingTable.hpp"
+#include "../json.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+
+#ifdef __linux__
+  #include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr uint32_t WORLDS = 100;
+    constexpr uint32_t LOCATIONS = 1024;
+    constexpr size_t KEY_COUNT = 1 << 16; // power of two
+
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // a full 100 world placement built with insert(), with every lookup key
+    // drawn up front; miss keys are for locations past the placed range.
+    // This is the hash table, which the server only has as an overlay; its
+    // lookups are benchLoadedLookups.
+    void benchLookups(Bench::Runner& runner)
+    {
+        RoutingTable table;
+        std::unordered_map<uint64_t, Route> baseline;
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        for (uint32_t world = 0; world < WORLDS; world++)
+        {
+            for (uint32_t location = 0; location < LOCATIONS; location++)
+            {
+                const Route route{ static_cast<uint32_t>(nextRandom(random) % WORLDS), static_cast<uint32_t>(nextRandom(random) % 256) };
+                table.insert(world, location, route);
+                baseline[(static_cast<uint64_t>(world) << 32) | location] = route;
+            }
+        }
+        std::vector<std::pair<uint32_t, uint32_t>> hits(KEY_COUNT);
+        std::vector<std::pair<uint32_t, uint32_t>> misses(KEY_COUNT);
+        for (size_t i = 0; i < KEY_COUNT; i++)
+        {
+            hits[i] = { static_cast<uint32_t>(nextRandom(random) % WORLDS), static_cast<uint32_t>(nextRandom(random) % LOCATIONS) };
+            misses[i] = { static_cast<uint32_t>(nextRandom(random) % WORLDS), LOCATIONS + static_cast<uint32_t>(nextRandom(random) % LOCATIONS) };
+        }
+
+        runner.run("routing/lookup_hit", [&](uint64_t iterations)
+        {
+            uint64_t owners = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const auto& key = hits[i & (KEY_COUNT - 1)];
+                owners += table.find(key.first, key.second)->owner;
+            }
+            Bench::doNotOptimize(owners);
+            return iterations;
+        });
+        runner.run("routing/lookup_miss", [&](uint64_t iterations)
+        {
+            uint64_t found = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const auto& key = misses[i & (KEY_COUNT - 1)];
+                found += table.find(key.first, key.second) != nullptr;
+            }
+            Bench::doNotOptimize(found);
+            return iterations;
+        });
+        runner.run("routing/baseline_unordered_map/lookup_hit", [&](uint64_t iterations)
+        {
+            uint64_t owners = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const auto& key = hits[i & (KEY_COUNT - 1)];
+                owners += baseline.find((static_cast<uint64_t>(key.first) << 32) | key.second)->second.owner;
+            }
+            Bench::doNotOptimize(owners);
+            return iterations;
+        });
+        if (runner.enabled("routing/table"))
+        {
+            runner.report({ "routing/table", 0, 0.0, {
+                { "entries", static_cast<double>(table.size()) },
+                { "bytes", static_cast<double>(table.capacity() * 16) },
+                { "avg_probes", table.averageProbeLength() },
+            } });
+        }
+    }
+
+    // a check's worth of queue traffic: push for a random recipient, then
+    // drain everything that is ready, the way the poll loop does
+    void benchDeliveryQueues(Bench::Runner& runner)
+    {
+        DeliveryQueues queues;
+        std::vector<uint32_t> ready;
+        uint64_t random = 0x2545F4914F6CDD1DULL;
+        runner.run("routing/delivery_push_drain", [&](uint64_t iterations)
+        {
+            uint64_t delivered = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                queues.push(static_cast<uint32_t>(nextRandom(random) % WORLDS), Delivery{ 1, 2, 3 });
+                if ((i & 15) == 15)
+                {
+                    queues.takeReady(ready);
+                    for (uint32_t recipient : ready)
+                    {
+                        while (!queues.queue(recipient).empty())
+                        {
+                            delivered += queues.queue(recipient).front().item;
+                            queues.popFront(recipient);
+                        }
+                    }
+                }
+            }
+            Bench::doNotOptimize(delivered);
+            return iterations;
+        });
+    }
+
+    constexpr uint32_t LOADED_LOCATIONS = 900;
+    constexpr size_t LOADED_ROOMS = 16;
+    const char* const PLACEMENT_PATH = "routing_bench_placement.json";
+
+    struct Resident
+    {
+        uint64_t total = 0;
+        // mapped file pages, which every mapping of the file shares
+        uint64_t file = 0;
+    };
+
+    Resident residentBytes()
+    {
+        Resident bytes;
+#ifdef __linux__
+        std::FILE* statm = std::fopen("/proc/self/statm", "r");
+        unsigned long long pages = 0;
+        unsigned long long residentPages = 0;
+        unsigned long long filePages = 0;
+        if (statm != nullptr)
+        {
+            if (std::fscanf(statm, "%llu %llu %llu", &pages, &residentPages, &filePages) == 3)
+            {
+                bytes.total = residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+                bytes.file = filePages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            }
+            std::fclose(statm);
+        }
+#endif
+        return bytes;
+    }
+
+    double privateKibPerRoom(const Resident& before, const Resident& after)
+    {
+        return ((after.total - after.file) - static_cast<double>(before.total - before.file)) / 1024.0 / LOADED_ROOMS;
+    }
+
+    size_t fileBytes(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        return in ? static_cast<size_t>(in.tellg()) : 0;
+    }
+
+    // a spoiler-sized file: the placements plus a per-world spoiler log
+    // naming every location and item, which is most of a real one's bytes
+    void writePlacementFile()
+    {
+        nlohmann::json placements = nlohmann::json::array();
+        nlohmann::json spoiler = nlohmann::json::object();
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        for (uint32_t world = 0; world < WORLDS; world++)
+        {
+            nlohmann::json& log = spoiler["World " + std::to_string(world + 1)];
+            for (uint32_t location = 0; location < LOADED_LOCATIONS; location++)
+            {
+                const uint32_t owner = static_cast<uint32_t>(nextRandom(random) % WORLDS);
+                const uint32_t item = static_cast<uint32_t>(nextRandom(random) % 256);
+                placements.push_back({ world, location, owner, item });
+                log["Location " + std::to_string(location)] = "Player " + std::to_string(owner + 1) + "'s Item " + std::to_string(item);
+            }
+        }
+        std::ofstream(PLACEMENT_PATH) << nlohmann::json{ { "settings", { { "worlds", WORLDS } } },
+                                                         { "placements", placements }, { "spoiler", spoiler } }.dump();
+    }
+
+    // what room creation did before PlacementFile: parse all of it, then
+    // build the hash table
+    bool loadJson(RoutingTable& table)
+    {
+        std::ifstream in(PLACEMENT_PATH);
+        const nlohmann::json file = nlohmann::json::parse(in, nullptr, false);
+        if (!file.is_object() || !file["placements"].is_array())
+        {
+            return false;
+        }
+        table.reserve(file["placements"].size());
+        for (const nlohmann::json& placement : file["placements"])
+        {
+            table.insert(placement[0].get<uint32_t>(), placement[1].get<uint32_t>(),
+                         Route{ placement[2].get<uint32_t>(), placement[3].get<uint32_t>() });
+        }
+        return true;
+    }
+
+    uint64_t lookUpEverything(const RoutingTable& table)
+    {
+        uint64_t owners = 0;
+        for (uint32_t world = 0; world < WORLDS; world++)
+        {
+            for (uint32_t location = 0; location < LOADED_LOCATIONS; location++)
+            {
+                owners += table.find(world, location)->owner;
+            }
+        }
+        return owners;
+    }
+
+    // room creation for a 100 world seed: the JSON loader against a first
+    // load through PlacementFile (which converts) and later ones (which map)
+    void benchLoading(Bench::Runner& runner)
+    {
+        const std::string cachePath = std::string(PLACEMENT_PATH) + ".bin";
+        bool any = false;
+        for (const char* name : { "routing/load/json_100_worlds", "routing/load/convert_100_worlds",
+                                  "routing/load/mapped_100_worlds", "routing/load/rss_100_worlds" })
+        {
+            any = any || runner.enabled(name);
+        }
+        if (!any)
+        {
+            return;
+        }
+        writePlacementFile();
+        std::remove(cachePath.c_str());
+
+        runner.run("routing/load/json_100_worlds", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                RoutingTable table;
+                loadJson(table);
+                Bench::doNotOptimize(table.size());
+            }
+            return iterations;
+        });
+        runner.run("routing/load/convert_100_worlds", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                std::remove(cachePath.c_str());
+                RoutingTable table;
+                table.loadFile(PLACEMENT_PATH);
+                Bench::doNotOptimize(table.size());
+            }
+            return iterations;
+        });
+        runner.run("routing/load/mapped_100_worlds", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                RoutingTable table;
+                table.loadFile(PLACEMENT_PATH);
+                Bench::doNotOptimize(table.size());
+            }
+            return iterations;
+        });
+
+        // mapped rooms first: freed JSON is not always handed back to the OS
+        std::vector<std::unique_ptr<RoutingTable>> rooms;
+        const Resident before = residentBytes();
+        for (size_t i = 0; i < LOADED_ROOMS; i++)
+        {
+            rooms.emplace_back(new RoutingTable());
+            rooms.back()->loadFile(PLACEMENT_PATH);
+        }
+        const Resident mapped = residentBytes();
+        uint64_t owners = 0;
+        for (const std::unique_ptr<RoutingTable>& room : rooms)
+        {
+            owners += lookUpEverything(*room);
+        }
+        const Resident touched = residentBytes();
+        rooms.clear();
+        const Resident jsonBefore = residentBytes();
+        for (size_t i = 0; i < LOADED_ROOMS; i++)
+        {
+            rooms.emplace_back(new RoutingTable());
+            loadJson(*rooms.back());
+        }
+        const Resident json = residentBytes();
+        for (const std::unique_ptr<RoutingTable>& room : rooms)
+        {
+            owners += lookUpEverything(*room);
+        }
+        Bench::doNotOptimize(owners);
+        rooms.clear();
+        if (runner.enabled("routing/load/rss_100_worlds"))
+        {
+            runner.report({ "routing/load/rss_100_worlds", 0, 0.0, {
+                { "json_file_kib", fileBytes(PLACEMENT_PATH) / 1024.0 },
+                { "bin_file_kib", fileBytes(cachePath) / 1024.0 },
+                { "json_room_private_kib", privateKibPerRoom(jsonBefore, json) },
+                { "mapped_room_private_kib", privateKibPerRoom(before, mapped) },
+                { "mapped_touched_room_private_kib", privateKibPerRoom(before, touched) },
+                { "mapped_touched_room_shared_kib", (touched.file - static_cast<double>(before.file)) / 1024.0 / LOADED_ROOMS },
+            } });
+        }
+        std::remove(PLACEMENT_PATH);
+        std::remove(cachePath.c_str());
+    }
+
+    // lookups the way the server does them: on a table loaded with
+    // loadFile, answered by the mapped PlacementFile
+    void benchLoadedLookups(Bench::Runner& runner)
+    {
+        if (!runner.enabled("routing/lookup_loaded_hit") && !runner.enabled("routing/lookup_loaded_miss"))
+        {
+            return;
+        }
+        const std::string cachePath = std::string(PLACEMENT_PATH) + ".bin";
+        writePlacementFile();
+        RoutingTable table;
+        // the first load converts, the second maps the .bin
+        if (!table.loadFile(PLACEMENT_PATH) || !table.loadFile(PLACEMENT_PATH))
+        {
+            runner.fail("routing/lookup_loaded_hit", "could not load the placement file");
+            std::remove(PLACEMENT_PATH);
+            std::remove(cachePath.c_str());
+            return;
+        }
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        std::vector<std::pair<uint32_t, uint32_t>> hits(KEY_COUNT);
+        std::vector<std::pair<uint32_t, uint32_t>> misses(KEY_COUNT);
+        for (size_t i = 0; i < KEY_COUNT; i++)
+        {
+            hits[i] = { static_cast<uint32_t>(nextRandom(random) % WORLDS), static_cast<uint32_t>(nextRandom(random) % LOADED_LOCATIONS) };
+            misses[i] = { static_cast<uint32_t>(nextRandom(random) % WORLDS), LOADED_LOCATIONS + static_cast<uint32_t>(nextRandom(random) % LOADED_LOCATIONS) };
+        }
+
+        runner.run("routing/lookup_loaded_hit", [&](uint64_t iterations)
+        {
+            uint64_t owners = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const auto& key = hits[i & (KEY_COUNT - 1)];
+                owners += table.find(key.first, key.second)->owner;
+            }
+            Bench::doNotOptimize(owners);
+            return iterations;
+        });
+        runner.run("routing/lookup_loaded_miss", [&](uint64_t iterations)
+        {
+            uint64_t found = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const auto& key = misses[i & (KEY_COUNT - 1)];
+                found += table.find(key.first, key.second) != nullptr;
+            }
+            Bench::doNotOptimize(found);
+            return iterations;
+        });
+        std::remove(PLACEMENT_PATH);
+        std::remove(cachePath.c_str());
+    }
+}
+
+namespace Bench
+{
+    void runRoutingBenchmarks(Runner& runner)
+    {
+        benchLookups(runner);
+        benchDeliveryQueues(runner);
+        benchLoading(runner);
+        benchLoadedLookups(runner);
+    }
+}
@@ -0,0 +1,113 @@
+#include "bench.hpp"
+#include "../SeedService.hpp"
+
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    constexpr uint32_t SEEDS_PER_RUN = 48;
+
+    // generates SEEDS_PER_RUN distinct seeds on a pool of workers, waiting
+    // on them the way the poll thread does
+    void benchService(Bench::Runner& runner, const LogicGraph& logic, const SeedSettings& settings, unsigned workers)
+    {
+        const std::string name = "seed/service/" + std::to_string(workers) + "_workers";
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        SeedService service(logic, workers);
+        service.start();
+        uint32_t finished = 0;
+        uint32_t failed = 0;
+        uint64_t progressReports = 0;
+        const auto start = Bench::Clock::now();
+        for (uint32_t seed = 0; seed < SEEDS_PER_RUN; seed++)
+        {
+            service.submit(settings, seed);
+        }
+        while (finished < SEEDS_PER_RUN)
+        {
+            service.poll([&](uint32_t, uint32_t, uint32_t)
+            {
+                progressReports++;
+            },
+            [&](uint32_t, const std::shared_ptr<const SeedResult>& result)
+            {
+                finished++;
+                failed += !result->error.empty();
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        service.stop();
+        runner.report({ name, SEEDS_PER_RUN, seconds, {
+            { "seeds_per_min", SEEDS_PER_RUN * 60.0 / seconds },
+            { "failed", static_cast<double>(failed) },
+            { "progress_reports", static_cast<double>(progressReports) },
+            { "cores", static_cast<double>(std::thread::hardware_concurrency()) } } });
+    }
+}
+
+namespace Bench
+{
+    void runSeedBenchmarks(Runner& runner)
+    {
+        LogicGraph logic;
+        if (!logic.loadText(windWakerSizedLogic(), "generated logic"))
+        {
+            fprintf(stderr, "seed: could not compile the generated logic\n");
+            return;
+        }
+        SeedSettings single;
+        single.junkItem = MAX_ITEMS - 1;
+
+        SeedSettings multiworld = single;
+        multiworld.worlds = 4;
+        for (const SeedSettings& settings : { single, multiworld })
+        {
+            runner.run("seed/generate/" + std::to_string(settings.worlds) + "_worlds", [&](uint64_t iterations)
+            {
+                std::vector<SeedPlacement> placements;
+                std::string error;
+                for (uint64_t seed = 0; seed < iterations; seed++)
+                {
+                    generateSeed(logic, settings, seed, placements, error);
+                }
+                Bench::doNotOptimize(placements.size());
+                return iterations;
+            });
+        }
+
+        for (const unsigned workers : { 1u, 4u, 16u })
+        {
+            benchService(runner, logic, single, workers);
+        }
+
+        if (runner.enabled("seed/cache_hit"))
+        {
+            SeedService service(logic, 1);
+            service.start();
+            service.submit(single, 1);
+            bool done = false;
+            while (!done)
+            {
+                service.poll([](uint32_t, uint32_t, uint32_t) {},
+                             [&](uint32_t, const std::shared_ptr<const SeedResult>&) { done = true; });
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            runner.run("seed/cache_hit", [&](uint64_t iterations)
+            {
+                uint64_t found = 0;
+                for (uint64_t i = 0; i < iterations; i++)
+                {
+                    found += service.cached(single, 1) != nullptr;
+                }
+                Bench::doNotOptimize(found);
+                return iterations;
+            });
+            service.stop();
+        }
+    }
+}
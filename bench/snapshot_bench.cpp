@@ -0,0 +1,174 @@
+#include "bench.hpp"
+#include "../EventLog.hpp"
+#include "../ProtocolServer.hpp"
+#include "../RoomSnapshot.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+    const char* const LOG_PATH = "wwhd_bench_snapshot.wal";
+    const char* const SNAPSHOT_PATH = "wwhd_bench_snapshot.snap";
+    const char* const CHECK_PATHS[2] = { "wwhd_bench_snapshot_full.snap", "wwhd_bench_snapshot_tail.snap" };
+
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    struct RaceConfig
+    {
+        uint32_t players;
+        double hours;
+        // mean seconds between one player's location checks and item sends
+        double checkInterval;
+        double sendInterval;
+        // the crash comes this long after the last periodic snapshot
+        double secondsSinceSnapshot;
+    };
+
+    // every logged event of the race, in order, one second at a time
+    std::vector<LogRecord> raceEvents(const RaceConfig& race)
+    {
+        std::vector<LogRecord> events;
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        const uint64_t seconds = static_cast<uint64_t>(race.hours * 3600);
+        for (uint64_t second = 0; second < seconds; second++)
+        {
+            for (uint32_t player = 0; player < race.players; player++)
+            {
+                if (nextRandom(random) % static_cast<uint64_t>(race.checkInterval) == 0)
+                {
+                    events.push_back(LogRecord{ LoggedEvent::LocationCheck, player, static_cast<uint32_t>(nextRandom(random) % MAX_LOCATIONS) });
+                }
+                if (nextRandom(random) % static_cast<uint64_t>(race.sendInterval) == 0)
+                {
+                    events.push_back(LogRecord{ LoggedEvent::ItemSend, player, static_cast<uint32_t>(nextRandom(random) % MAX_ITEMS) });
+                }
+            }
+        }
+        return events;
+    }
+
+    bool appendEvents(const std::vector<LogRecord>& events, size_t first, size_t last)
+    {
+        EventLog log;
+        if (!log.open(LOG_PATH, std::chrono::microseconds(0)))
+        {
+            return false;
+        }
+        for (size_t i = first; i < last; i++)
+        {
+            log.append(events[i]);
+        }
+        log.close();
+        return true;
+    }
+
+    std::vector<char> readFile(const char* path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void removeFiles()
+    {
+        std::remove(LOG_PATH);
+        std::remove(SNAPSHOT_PATH);
+        std::remove(CHECK_PATHS[0]);
+        std::remove(CHECK_PATHS[1]);
+    }
+
+    // Server startup after a crash late in a long race, restoring from the
+    // event log alone against from the last periodic snapshot plus the log
+    // records after it. Both rooms are snapshotted afterwards and compared.
+    // The files are in the page cache either way, as on a quick restart.
+    void benchStartup(Bench::Runner& runner, const RaceConfig& race)
+    {
+        const std::string name = "snapshot/startup/players:" + std::to_string(race.players) +
+                                 "/hours:" + std::to_string(static_cast<int>(race.hours));
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        removeFiles();
+        const std::vector<LogRecord> events = raceEvents(race);
+        const size_t tail = static_cast<size_t>(events.size() * race.secondsSinceSnapshot / (race.hours * 3600));
+        const size_t covered = events.size() - tail;
+
+        // the race up to the last snapshot, the snapshot, then the rest
+        appendEvents(events, 0, covered);
+        {
+            ProtocolServer server(0);
+            server.setSnapshots(SNAPSHOT_PATH, std::chrono::seconds(60));
+            server.openEventLog(LOG_PATH, std::chrono::microseconds(0));
+            server.stop();
+        }
+        appendEvents(events, covered, events.size());
+
+        double startupMs[2];
+        for (int withSnapshot = 0; withSnapshot < 2; withSnapshot++)
+        {
+            ProtocolServer server(0);
+            if (withSnapshot)
+            {
+                server.setSnapshots(SNAPSHOT_PATH, std::chrono::seconds(60));
+            }
+            const auto start = Bench::Clock::now();
+            server.openEventLog(LOG_PATH, std::chrono::microseconds(0));
+            startupMs[withSnapshot] = std::chrono::duration<double, std::milli>(Bench::Clock::now() - start).count();
+            server.setSnapshots(CHECK_PATHS[withSnapshot], std::chrono::seconds(60));
+            server.saveSnapshot();
+        }
+        const double snapshotBytes = static_cast<double>(readFile(SNAPSHOT_PATH).size());
+        const bool identical = readFile(CHECK_PATHS[0]) == readFile(CHECK_PATHS[1]);
+        if (!identical)
+        {
+            runner.fail(name, "restored rooms differ");
+        }
+        removeFiles();
+
+        runner.report({ name, 0, 0.0,
+                        { { "events", static_cast<double>(events.size()) },
+                          { "tail_events", static_cast<double>(tail) },
+                          { "log_bytes", static_cast<double>(EVENT_LOG_HEADER_SIZE + events.size() * EVENT_LOG_RECORD_SIZE) },
+                          { "snapshot_bytes", snapshotBytes },
+                          { "log_only_ms", startupMs[0] },
+                          { "snapshot_and_tail_ms", startupMs[1] },
+                          { "identical", identical ? 1.0 : 0.0 } } });
+    }
+
+    // the poll thread's share of a periodic snapshot: copying the room out
+    void benchEncode(Bench::Runner& runner, uint32_t players)
+    {
+        WorldState state(players);
+        std::vector<ChangeLog> changeLogs(MAX_PLAYERS);
+        std::vector<uint8_t> image;
+        runner.run("snapshot/encode/players:" + std::to_string(players), [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                encodeRoomSnapshot(state, changeLogs, i, image);
+                Bench::doNotOptimize(image[0]);
+            }
+            return iterations;
+        });
+    }
+}
+
+namespace Bench
+{
+    void runSnapshotBenchmarks(Runner& runner)
+    {
+        benchEncode(runner, 100);
+        // a 6 hour, 100 player race: a check every 10 s and an item send
+        // every 30 s per player, crashing 60 s (one snapshot interval) after
+        // the last snapshot
+        benchStartup(runner, RaceConfig{ 100, 6.0, 10.0, 30.0, 60.0 });
+    }
+}
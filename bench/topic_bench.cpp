@@ -0,0 +1,146 @@
+#include "bench.hpp"
+#include "../Protocol.hpp"
+#include "../TopicBus.hpp"
+
+#include <string.h>
+
+namespace
+{
+    constexpr uint32_t CONNECTIONS = 10000;
+    constexpr uint32_t TOPICS = 1000;
+    // topics each connection follows besides the room-wide one
+    constexpr uint32_t TOPICS_PER_CONNECTION = 10;
+    constexpr uint32_t ROOM_TOPIC = 0;
+    constexpr size_t BODY_SIZE = 96;
+    // publishes between drains of the send queues
+    constexpr uint64_t DRAIN_EVERY = 64;
+
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // 10k connections on 1k topics, about 100 subscribers per topic, plus
+    // a room-wide topic every connection follows
+    void subscribeAll(TopicBus& bus)
+    {
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        for (uint32_t slot = 0; slot < CONNECTIONS; slot++)
+        {
+            bus.subscribe(ROOM_TOPIC, slot);
+            for (uint32_t i = 0; i < TOPICS_PER_CONNECTION; i++)
+            {
+                bus.subscribe(1 + static_cast<uint32_t>(nextRandom(random) % (TOPICS - 1)), slot);
+            }
+        }
+    }
+
+    std::vector<uint8_t> buildFrame(uint32_t topic)
+    {
+        std::vector<uint8_t> bytes(Protocol::FRAME_HEADER_SIZE + Protocol::TOPIC_MESSAGE_HEADER_SIZE + BODY_SIZE, 0x5A);
+        Protocol::encodeHeader({ static_cast<uint32_t>(bytes.size() - Protocol::FRAME_HEADER_SIZE), Protocol::MessageType::TopicMessage, 0 }, bytes.data());
+        memcpy(bytes.data() + Protocol::FRAME_HEADER_SIZE, &topic, sizeof(topic));
+        return bytes;
+    }
+
+    // what ProtocolServer::handlePublish does: one frame, queued by reference
+    void benchShared(Bench::Runner& runner, const TopicBus& bus, const std::string& name, bool roomWide)
+    {
+        std::vector<SharedFrameQueue> queues(CONNECTIONS);
+        uint64_t random = 1;
+        runner.run(name, [&](uint64_t iterations)
+        {
+            uint64_t delivered = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const uint32_t topic = roomWide ? ROOM_TOPIC : 1 + static_cast<uint32_t>(nextRandom(random) % (TOPICS - 1));
+                SharedFrame* frame = SharedFrame::create(buildFrame(topic));
+                bus.forEachSubscriber(topic, [&](uint32_t slot)
+                {
+                    queues[slot].push(frame);
+                    delivered++;
+                });
+                frame->release();
+                if ((i + 1) % DRAIN_EVERY == 0)
+                {
+                    for (SharedFrameQueue& queue : queues)
+                    {
+                        queue.clear();
+                    }
+                }
+            }
+            for (SharedFrameQueue& queue : queues)
+            {
+                queue.clear();
+            }
+            Bench::doNotOptimize(delivered);
+            return iterations;
+        });
+    }
+
+    // the same fan-out copying the frame into each connection's write buffer
+    void benchCopied(Bench::Runner& runner, const TopicBus& bus, const std::string& name, bool roomWide)
+    {
+        std::vector<std::vector<uint8_t>> buffers(CONNECTIONS);
+        uint64_t random = 1;
+        runner.run(name, [&](uint64_t iterations)
+        {
+            uint64_t delivered = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const uint32_t topic = roomWide ? ROOM_TOPIC : 1 + static_cast<uint32_t>(nextRandom(random) % (TOPICS - 1));
+                const std::vector<uint8_t> frame = buildFrame(topic);
+                bus.forEachSubscriber(topic, [&](uint32_t slot)
+                {
+                    buffers[slot].insert(buffers[slot].end(), frame.begin(), frame.end());
+                    delivered++;
+                });
+                if ((i + 1) % DRAIN_EVERY == 0)
+                {
+                    for (std::vector<uint8_t>& buffer : buffers)
+                    {
+                        buffer.clear();
+                    }
+                }
+            }
+            Bench::doNotOptimize(delivered);
+            return iterations;
+        });
+    }
+
+    void benchSubscribe(Bench::Runner& runner)
+    {
+        runner.run("topic/subscribe_10k_connections", [&](uint64_t iterations)
+        {
+            uint64_t subscriptions = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                TopicBus bus;
+                subscribeAll(bus);
+                for (uint32_t slot = 0; slot < CONNECTIONS; slot++)
+                {
+                    bus.removeSlot(slot);
+                }
+                subscriptions += CONNECTIONS * (TOPICS_PER_CONNECTION + 1);
+            }
+            return subscriptions;
+        });
+    }
+}
+
+namespace Bench
+{
+    void runTopicBenchmarks(Runner& runner)
+    {
+        TopicBus bus;
+        subscribeAll(bus);
+        benchShared(runner, bus, "topic/publish_100_subscribers_shared", false);
+        benchCopied(runner, bus, "topic/publish_100_subscribers_copied", false);
+        benchShared(runner, bus, "topic/publish_10k_subscribers_shared", true);
+        benchCopied(runner, bus, "topic/publish_10k_subscribers_copied", true);
+        benchSubscribe(runner);
+    }
+}
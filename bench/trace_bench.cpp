@@ -0,0 +1,32 @@
+
+#include "bench.hpp"
+#include "../utility/trace.hpp"
+
+namespace Bench
+{
+    void runTraceBenchmarks(Runner& runner)
+    {
+#ifdef WWHD_TRACING
+        // one sampling decision plus the four spans a frame records
+        for (uint32_t rate : { 0u, 1u, 100u })
+        {
+            Trace::setSampleRate(rate);
+            runner.run("trace/frame_spans/rate:" + std::to_string(rate), [](uint64_t iterations)
+            {
+                for (uint64_t i = 0; i < iterations; i++)
+                {
+                    TRACE_SAMPLE();
+                    TRACE_SPAN(Decode, 1, 0);
+                    TRACE_SPAN(Handle, 1, 0);
+                    TRACE_SPAN(Encode, 1, 1);
+                    TRACE_SPAN(Enqueue, 1, 1);
+                }
+                return iterations;
+            });
+        }
+        Trace::setSampleRate(0);
+#else
+        (void)runner;
+#endif
+    }
+}
@@ -0,0 +1,152 @@
+#include "bench.hpp"
+#include "../Protocol.hpp"
+#include "../TrackerSync.hpp"
+#include "../WorldState.hpp"
+
+namespace
+{
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    struct RaceConfig
+    {
+        uint32_t players;
+        // mean seconds between one player's location checks
+        double checkInterval;
+        double raceSeconds;
+        // the server's poll round, which batches changes into one update
+        double roundSeconds;
+    };
+
+    // Plays a race through a room the way the server sees it: each round some
+    // players check a location, which marks it for them and hands its item to
+    // a random owner. Every world has one tracker subscriber. With deltas a
+    // subscriber gets the changes since its last update; without, the full
+    // TrackerState every time its world changes. Counts the frame bytes each
+    // way.
+    void benchRace(Bench::Runner& runner, const RaceConfig& race)
+    {
+        const std::string name = "tracker_sync/race/players:" + std::to_string(race.players);
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        WorldState state(race.players);
+        std::vector<ChangeLog> logs(race.players);
+        std::vector<uint64_t> sentVersion(race.players, 0);
+        std::vector<uint8_t> changed(race.players, 0);
+        std::vector<uint8_t> delta;
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+
+        const uint64_t rounds = static_cast<uint64_t>(race.raceSeconds / race.roundSeconds);
+        const uint64_t checkOdds = static_cast<uint64_t>(race.checkInterval / race.roundSeconds);
+        uint64_t deltaBytes = 0;
+        uint64_t fullBytes = 0;
+        uint64_t updates = 0;
+        uint64_t changes = 0;
+
+        const auto start = Bench::Clock::now();
+        for (uint64_t round = 0; round < rounds; round++)
+        {
+            for (uint32_t player = 0; player < race.players; player++)
+            {
+                if (nextRandom(random) % checkOdds != 0)
+                {
+                    continue;
+                }
+                const uint32_t location = static_cast<uint32_t>(nextRandom(random) % MAX_LOCATIONS);
+                if (!state.checkLocation(player, location))
+                {
+                    continue;
+                }
+                logs[player].append(StateChange{ ChangeKind::LocationChecked, 0, static_cast<uint16_t>(location) });
+                changed[player] = 1;
+                const uint32_t owner = static_cast<uint32_t>(nextRandom(random) % race.players);
+                const uint32_t item = static_cast<uint32_t>(nextRandom(random) % MAX_ITEMS);
+                state.addItem(owner, item);
+                logs[owner].append(StateChange{ ChangeKind::ItemCount, state.itemCount(owner, item), static_cast<uint16_t>(item) });
+                changed[owner] = 1;
+                changes += 2;
+            }
+            for (uint32_t world = 0; world < race.players; world++)
+            {
+                if (!changed[world])
+                {
+                    continue;
+                }
+                changed[world] = 0;
+                delta.clear();
+                logs[world].encodeDelta(sentVersion[world], delta);
+                sentVersion[world] = logs[world].version();
+                deltaBytes += Protocol::FRAME_HEADER_SIZE + delta.size();
+                fullBytes += Protocol::FRAME_HEADER_SIZE + encodeTrackerState(state, world, logs[world].version()).size();
+                updates++;
+            }
+        }
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+
+        const double perSubscriber = race.raceSeconds * race.players;
+        runner.report({ name, updates, seconds,
+                        { { "changes", static_cast<double>(changes) },
+                          { "delta_bytes_per_sec_per_subscriber", deltaBytes / perSubscriber },
+                          { "full_bytes_per_sec_per_subscriber", fullBytes / perSubscriber },
+                          { "full_to_delta_ratio", deltaBytes ? static_cast<double>(fullBytes) / deltaBytes : 0.0 } } });
+    }
+
+    // one update's encode cost for a world half way through a race
+    void benchEncode(Bench::Runner& runner)
+    {
+        WorldState state(1);
+        ChangeLog log;
+        uint64_t random = 0x2545F4914F6CDD1DULL;
+        for (int i = 0; i < 300; i++)
+        {
+            const uint32_t location = static_cast<uint32_t>(nextRandom(random) % MAX_LOCATIONS);
+            if (state.checkLocation(0, location))
+            {
+                log.append(StateChange{ ChangeKind::LocationChecked, 0, static_cast<uint16_t>(location) });
+            }
+            const uint32_t item = static_cast<uint32_t>(nextRandom(random) % MAX_ITEMS);
+            state.addItem(0, item);
+            log.append(StateChange{ ChangeKind::ItemCount, state.itemCount(0, item), static_cast<uint16_t>(item) });
+        }
+
+        std::vector<uint8_t> delta;
+        runner.run("tracker_sync/encode_delta/changes:2", [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                delta.clear();
+                log.encodeDelta(log.version() - 2, delta);
+                Bench::doNotOptimize(delta[0]);
+            }
+            return iterations;
+        });
+        runner.run("tracker_sync/encode_state", [&](uint64_t iterations)
+        {
+            size_t bytes = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                bytes += encodeTrackerState(state, 0, log.version()).size();
+            }
+            Bench::doNotOptimize(bytes);
+            return iterations;
+        });
+    }
+}
+
+namespace Bench
+{
+    void runTrackerSyncBenchmarks(Runner& runner)
+    {
+        benchEncode(runner);
+        // a 50 player race over two hours, each player checking a location
+        // every 10 s or so, with the server's 10 ms poll rounds
+        benchRace(runner, RaceConfig{ 50, 10.0, 2 * 3600.0, 0.01 });
+    }
+}
@@ -0,0 +1,148 @@
+#include "bench.hpp"
+#include "../Transfer.hpp"
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t PAYLOAD_BYTES = 64 * 1024 * 1024;
+    const char* const PAYLOAD_PATH = "transfer_bench_payload.bin";
+
+#ifdef __linux__
+    // streams the payload over a socket pair to a thread that drains it,
+    // chunk by chunk and checksummed the way the server does: straight from
+    // the file with sendfile(), or read into a buffer and sent from there
+    void benchStream(Bench::Runner& runner, const std::string& name, const TransferSource& source, bool copy)
+    {
+        if (!runner.enabled(name))
+        {
+            return;
+        }
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+        {
+            return;
+        }
+        std::thread drain([&]()
+        {
+            std::vector<char> sink(256 * 1024);
+            while (read(sockets[1], sink.data(), sink.size()) > 0)
+            {
+            }
+        });
+        std::FILE* file = copy ? std::fopen(PAYLOAD_PATH, "rb") : nullptr;
+        std::vector<uint8_t> buffer(TRANSFER_CHUNK_SIZE);
+        const auto start = Bench::Clock::now();
+        for (uint64_t offset = 0; offset < source.size(); offset += TRANSFER_CHUNK_SIZE)
+        {
+            const size_t length = static_cast<size_t>(std::min<uint64_t>(TRANSFER_CHUNK_SIZE, source.size() - offset));
+            uint32_t checksum = 0;
+            if (copy ? std::fread(buffer.data(), 1, length, file) != length : !source.chunkChecksum(offset, checksum))
+            {
+                break;
+            }
+            if (copy)
+            {
+                checksum = crc32(buffer.data(), length);
+            }
+            Bench::doNotOptimize(checksum);
+            for (size_t sent = 0; sent < length;)
+            {
+                const long count = copy ? static_cast<long>(send(sockets[0], buffer.data() + sent, length - sent, 0)) :
+                                          source.sendTo(sockets[0], offset + sent, length - sent);
+                if (count <= 0)
+                {
+                    break;
+                }
+                sent += count;
+            }
+        }
+        const double seconds = std::chrono::duration<double>(Bench::Clock::now() - start).count();
+        if (file != nullptr)
+        {
+            std::fclose(file);
+        }
+        close(sockets[0]);
+        drain.join();
+        close(sockets[1]);
+        runner.report({ name, source.size() / TRANSFER_CHUNK_SIZE, seconds, {
+            { "mib_per_s", source.size() / (1024.0 * 1024.0) / seconds } } });
+    }
+#endif
+}
+
+namespace Bench
+{
+    void runTransferBenchmarks(Runner& runner)
+    {
+        std::vector<uint8_t> chunk(TRANSFER_CHUNK_SIZE);
+        for (size_t i = 0; i < chunk.size(); i++)
+        {
+            chunk[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+        }
+        runner.run("transfer/crc32_64k", [&](uint64_t iterations)
+        {
+            uint32_t crc = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                crc = crc32(chunk.data(), chunk.size(), crc);
+            }
+            Bench::doNotOptimize(crc);
+            return iterations;
+        });
+
+#ifdef __linux__
+        if (!runner.enabled("transfer/sendfile_64mb") && !runner.enabled("transfer/copy_64mb") &&
+            !runner.enabled("transfer/open_64mb") && !runner.enabled("transfer/sendfile_cached_crc_64mb"))
+        {
+            return;
+        }
+        std::FILE* file = std::fopen(PAYLOAD_PATH, "wb");
+        if (file == nullptr)
+        {
+            fprintf(stderr, "transfer: could not create %s\n", PAYLOAD_PATH);
+            return;
+        }
+        for (size_t written = 0; written < PAYLOAD_BYTES; written += chunk.size())
+        {
+            std::fwrite(chunk.data(), 1, chunk.size(), file);
+        }
+        std::fclose(file);
+
+        // opening reads nothing; the checksums come as chunks go out
+        const auto start = Clock::now();
+        const std::shared_ptr<TransferSource> source = TransferSource::openFile(PAYLOAD_PATH);
+        const double openSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (source && runner.enabled("transfer/open_64mb"))
+        {
+            runner.report({ "transfer/open_64mb", 1, openSeconds, {} });
+        }
+        const std::string cachePath = std::string(PAYLOAD_PATH) + ".crc";
+        std::remove(cachePath.c_str());
+        if (source)
+        {
+            benchStream(runner, "transfer/sendfile_64mb", *source, false);
+            benchStream(runner, "transfer/copy_64mb", *source, true);
+        }
+        // opened again, the checksums come from the .crc the first pass saved
+        uint32_t checksum = 0;
+        for (uint64_t offset = 0; source && offset < source->size() && source->chunkChecksum(offset, checksum); offset += TRANSFER_CHUNK_SIZE)
+        {
+        }
+        const std::shared_ptr<TransferSource> cached = TransferSource::openFile(PAYLOAD_PATH);
+        if (cached)
+        {
+            benchStream(runner, "transfer/sendfile_cached_crc_64mb", *cached, false);
+        }
+        std::remove(PAYLOAD_PATH);
+        std::remove(cachePath.c_str());
+#endif
+    }
+}
@@ -0,0 +1,156 @@
+#include "bench.hpp"
+#include "../WorldState.hpp"
+
+#include <map>
+#include <set>
+
+namespace
+{
+    constexpr size_t INDEX_COUNT = 4096; // power of two
+
+    struct Access
+    {
+        uint32_t player;
+        uint32_t id;
+    };
+
+    // random (player, id) pairs drawn up front so the loops measure the store
+    std::vector<Access> randomAccesses(uint32_t players, uint32_t ids)
+    {
+        std::vector<Access> accesses(INDEX_COUNT);
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (Access& access : accesses)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            access.player = static_cast<uint32_t>(state % players);
+            access.id = static_cast<uint32_t>((state >> 32) % ids);
+        }
+        return accesses;
+    }
+
+    void benchRoom(Bench::Runner& runner, uint32_t players)
+    {
+        const std::string suffix = "/players:" + std::to_string(players);
+        WorldState state(players);
+        const std::vector<Access> locations = randomAccesses(players, MAX_LOCATIONS);
+        const std::vector<Access> flags = randomAccesses(players, MAX_EVENT_FLAGS);
+        const std::vector<Access> items = randomAccesses(players, MAX_ITEMS);
+
+        runner.run("world_state/check_location" + suffix, [&](uint64_t iterations)
+        {
+            uint64_t fresh = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const Access& access = locations[i & (INDEX_COUNT - 1)];
+                fresh += state.checkLocation(access.player, access.id);
+            }
+            Bench::doNotOptimize(fresh);
+            return iterations;
+        });
+        runner.run("world_state/test_location" + suffix, [&](uint64_t iterations)
+        {
+            uint64_t set = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const Access& access = locations[i & (INDEX_COUNT - 1)];
+                set += state.isLocationChecked(access.player, access.id ^ 1);
+            }
+            Bench::doNotOptimize(set);
+            return iterations;
+        });
+        runner.run("world_state/set_event_flag" + suffix, [&](uint64_t iterations)
+        {
+            uint64_t fresh = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const Access& access = flags[i & (INDEX_COUNT - 1)];
+                fresh += state.setEventFlag(access.player, access.id);
+            }
+            Bench::doNotOptimize(fresh);
+            return iterations;
+        });
+        runner.run("world_state/add_item" + suffix, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const Access& access = items[i & (INDEX_COUNT - 1)];
+                state.addItem(access.player, access.id);
+            }
+            Bench::doNotOptimize(state.itemCount(0, 0));
+            return iterations;
+        });
+
+        // ops are players copied
+        PlayerSnapshot snapshot;
+        runner.run("world_state/player_snapshot" + suffix, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                state.snapshot(static_cast<uint32_t>(i % players), snapshot);
+                Bench::doNotOptimize(snapshot.itemCounts[0]);
+            }
+            return iterations;
+        });
+
+        // ops are whole rooms copied
+        std::vector<uint8_t> room(state.roomSnapshotSize());
+        const std::string roomName = "world_state/room_snapshot" + suffix;
+        runner.run(roomName, [&](uint64_t iterations)
+        {
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                state.snapshotRoom(room.data());
+                Bench::doNotOptimize(room[0]);
+            }
+            return iterations;
+        });
+        if (runner.enabled(roomName))
+        {
+            runner.report({ roomName + "/size", 0, 0.0, { { "bytes", static_cast<double>(room.size()) } } });
+        }
+    }
+
+    // the map of sets the server used to keep, for comparison
+    void benchMapBaseline(Bench::Runner& runner, uint32_t players)
+    {
+        const std::string suffix = "/players:" + std::to_string(players);
+        std::map<uint32_t, std::set<uint32_t>> checked;
+        const std::vector<Access> locations = randomAccesses(players, MAX_LOCATIONS);
+        runner.run("world_state/baseline_map_set/check_location" + suffix, [&](uint64_t iterations)
+        {
+            uint64_t fresh = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const Access& access = locations[i & (INDEX_COUNT - 1)];
+                fresh += checked[access.player].insert(access.id).second;
+            }
+            Bench::doNotOptimize(fresh);
+            return iterations;
+        });
+        runner.run("world_state/baseline_map_set/test_location" + suffix, [&](uint64_t iterations)
+        {
+            uint64_t set = 0;
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                const Access& access = locations[i & (INDEX_COUNT - 1)];
+                set += checked[access.player].count(access.id ^ 1);
+            }
+            Bench::doNotOptimize(set);
+            return iterations;
+        });
+    }
+}
+
+namespace Bench
+{
+    void runWorldStateBenchmarks(Runner& runner)
+    {
+        for (uint32_t players : { 2u, 8u, 32u, 100u })
+        {
+            benchRoom(runner, players);
+        }
+        benchMapBaseline(runner, 100);
+    }
+}
@@ -0,0 +1,776 @@
+
+#include "LoadGenerator.hpp"
+#include "../utility/platform_socket.hpp"
+#include "../json.hpp"
+
+#ifndef PLATFORM_MSVC
+  #include <arpa/inet.h>
+  #include <sys/socket.h>
+  #include <poll.h>
+  #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+    constexpr size_t FRAME_VARIANTS = 256;
+    constexpr uint32_t ITEM_IDS = 256;
+    constexpr uint32_t LOCATION_IDS = 1024;
+    constexpr std::chrono::seconds DRAIN_TIMEOUT(2);
+
+    const char* const KIND_NAMES[] = { "item_send", "location_check", "ping", "tracker_query", "flag_sync" };
+    const char* const MIX_NAMES[] = { "item", "check", "ping", "tracker", "flags" };
+
+    uint64_t nowNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // xorshift64*, plenty for picking request kinds and ids
+    uint64_t nextRandom(uint64_t& state)
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+
+    SocketType connectTo(const std::string& host, uint16_t port)
+    {
+        SocketType sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (Utility::isSocketInvalid(sock))
+        {
+            return INVALID_SOCKET;
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+            connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            SOCK_CLOSE(sock);
+            return INVALID_SOCKET;
+        }
+        Utility::setSocketNoDelay(sock);
+        Utility::setSocketNonBlocking(sock);
+        return sock;
+    }
+
+    void mergeInto(KindReport& total, const KindReport& kind)
+    {
+        total.sent += kind.sent;
+        total.received += kind.received;
+        total.errors += kind.errors;
+        if (total.latency.buckets.empty())
+        {
+            total.latency.buckets.assign(kind.latency.buckets.size(), 0);
+        }
+        for (size_t i = 0; i < kind.latency.buckets.size(); i++)
+        {
+            total.latency.buckets[i] += kind.latency.buckets[i];
+        }
+        total.latency.count += kind.latency.count;
+        total.latency.sum += kind.latency.sum;
+    }
+
+    nlohmann::json kindJson(const KindReport& kind)
+    {
+        return {
+            { "sent", kind.sent },
+            { "received", kind.received },
+            { "errors", kind.errors },
+            { "p50_ns", kind.latency.quantile(0.50) },
+            { "p99_ns", kind.latency.quantile(0.99) },
+            { "p999_ns", kind.latency.quantile(0.999) },
+            { "mean_ns", kind.latency.count ? kind.latency.sum / kind.latency.count : 0 },
+        };
+    }
+}
+
+const char* requestKindName(RequestKind kind)
+{
+    return KIND_NAMES[static_cast<size_t>(kind)];
+}
+
+bool LoadConfig::parseMix(const std::string& spec)
+{
+    unsigned parsed[REQUEST_KIND_COUNT] = {};
+    size_t start = 0;
+    while (start < spec.size())
+    {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = spec.size();
+        }
+        const std::string entry = spec.substr(start, end - start);
+        const size_t eq = entry.find('=');
+        bool known = false;
+        for (size_t i = 0; eq != std::string::npos && i < REQUEST_KIND_COUNT; i++)
+        {
+            if (entry.compare(0, eq, MIX_NAMES[i]) == 0)
+            {
+                parsed[i] = static_cast<unsigned>(strtoul(entry.c_str() + eq + 1, nullptr, 10));
+                known = true;
+            }
+        }
+        if (!known)
+        {
+            return false;
+        }
+        start = end + 1;
+    }
+    unsigned total = 0;
+    for (size_t i = 0; i < REQUEST_KIND_COUNT; i++)
+    {
+        total += parsed[i];
+    }
+    if (total == 0)
+    {
+        return false;
+    }
+    std::copy(parsed, parsed + REQUEST_KIND_COUNT, mix);
+    return true;
+}
+
+void LoadReport::print() const
+{
+    printf("%u connections, %.1f s, %.0f replies/s", connections, seconds, throughput());
+    printf(" (%llu connect failures, %llu disconnects, %llu reconnects, %llu throttled)\n",
+           static_cast<unsigned long long>(connectFailures), static_cast<unsigned long long>(disconnects),
+           static_cast<unsigned long long>(reconnects), static_cast<unsigned long long>(throttled));
+    printf("%-16s %10s %10s %8s %10s %10s %10s\n", "kind", "sent", "received", "errors", "p50 us", "p99 us", "p999 us");
+    for (size_t i = 0; i <= REQUEST_KIND_COUNT; i++)
+    {
+        const KindReport& kind = i < REQUEST_KIND_COUNT ? kinds[i] : total;
+        printf("%-16s %10llu %10llu %8llu %10.1f %10.1f %10.1f\n",
+               i < REQUEST_KIND_COUNT ? KIND_NAMES[i] : "total",
+               static_cast<unsigned long long>(kind.sent), static_cast<unsigned long long>(kind.received),
+               static_cast<unsigned long long>(kind.errors),
+               kind.latency.quantile(0.50) / 1000.0, kind.latency.quantile(0.99) / 1000.0,
+               kind.latency.quantile(0.999) / 1000.0);
+    }
+    if (trackerUpdates != 0)
+    {
+        printf("%-16s %10llu updates, %.0f B/s\n", "tracker feeds",
+               static_cast<unsigned long long>(trackerUpdates), seconds > 0.0 ? trackerBytes / seconds : 0.0);
+    }
+    if (deliveries != 0)
+    {
+        printf("%-16s %10llu %10s %8s %10.1f %10.1f %10.1f\n", "check->delivery",
+               static_cast<unsigned long long>(deliveries), "", "",
+               deliveryLatency.quantile(0.50) / 1000.0, deliveryLatency.quantile(0.99) / 1000.0,
+               deliveryLatency.quantile(0.999) / 1000.0);
+    }
+}
+
+void LoadReport::subtract(const LoadReport& earlier)
+{
+    connectFailures -= earlier.connectFailures;
+    disconnects -= earlier.disconnects;
+    reconnects -= earlier.reconnects;
+    throttled -= earlier.throttled;
+    deliveries -= earlier.deliveries;
+    trackerUpdates -= earlier.trackerUpdates;
+    trackerBytes -= earlier.trackerBytes;
+    deliveryLatency.subtract(earlier.deliveryLatency);
+    total = KindReport();
+    for (size_t i = 0; i < REQUEST_KIND_COUNT; i++)
+    {
+        kinds[i].sent -= earlier.kinds[i].sent;
+        kinds[i].received -= earlier.kinds[i].received;
+        kinds[i].errors -= earlier.kinds[i].errors;
+        kinds[i].latency.subtract(earlier.kinds[i].latency);
+        mergeInto(total, kinds[i]);
+    }
+}
+
+std::string LoadReport::toJson() const
+{
+    nlohmann::json kindsJson = nlohmann::json::object();
+    for (size_t i = 0; i < REQUEST_KIND_COUNT; i++)
+    {
+        kindsJson[KIND_NAMES[i]] = kindJson(kinds[i]);
+    }
+    return nlohmann::json{
+        { "seconds", seconds },
+        { "connections", connections },
+        { "connect_failures", connectFailures },
+        { "disconnects", disconnects },
+        { "reconnects", reconnects },
+        { "throttled", throttled },
+        { "throughput", throughput() },
+        { "deliveries", deliveries },
+        { "delivery_p50_ns", deliveryLatency.quantile(0.50) },
+        { "delivery_p99_ns", deliveryLatency.quantile(0.99) },
+        { "delivery_p999_ns", deliveryLatency.quantile(0.999) },
+        { "tracker_updates", trackerUpdates },
+        { "tracker_bytes", trackerBytes },
+        { "total", kindJson(total) },
+        { "kinds", kindsJson },
+    }.dump(2);
+}
+
+struct LoadGenerator::Client
+{
+    SocketType socket = INVALID_SOCKET;
+    // picks the world this client resumes after a reconnect
+    uint32_t index = 0;
+    // the world this client plays: it joins it, checks its locations and
+    // receives its items
+    uint32_t world = 0;
+    std::vector<uint8_t> readBuffer;
+    size_t readLength = 0;
+    std::vector<uint8_t> writeBuffer;
+    size_t writeOffset = 0;
+    // requests awaiting a reply, oldest first; replies arrive in order
+    // (RequestKind::Count marks a Join, which is not measured)
+    std::deque<std::pair<RequestKind, uint64_t>> inFlight;
+    uint64_t nextSendNs = 0;
+    bool open = false;
+    // picked by churn: stops sending and reconnects once its replies are in
+    bool closing = false;
+    // follows world's tracker feed and sends nothing else
+    bool spectator = false;
+};
+
+struct LoadGenerator::Worker
+{
+    std::vector<Client> clients;
+    uint64_t random = 0;
+    uint64_t nextChurnNs = UINT64_MAX;
+    uint64_t churnIntervalNs = UINT64_MAX;
+};
+
+LoadGenerator::LoadGenerator(const LoadConfig& config) : config(config), stopRequested(false)
+{
+    Metrics::Registry& registry = Metrics::registry();
+    for (size_t i = 0; i < REQUEST_KIND_COUNT; i++)
+    {
+        const std::string labels = std::string("kind=\"") + KIND_NAMES[i] + "\"";
+        latency[i] = registry.histogram("loadgen_latency_ns", "Request round trip in nanoseconds", labels);
+        sent[i] = registry.counter("loadgen_sent_total", "Requests sent", labels);
+        received[i] = registry.counter("loadgen_received_total", "Replies received", labels);
+        errors[i] = registry.counter("loadgen_errors_total", "Error replies received", labels);
+    }
+    connectFailures = registry.counter("loadgen_connect_failures_total", "Failed connection attempts");
+    disconnects = registry.counter("loadgen_disconnects_total", "Connections closed by the server");
+    reconnects = registry.counter("loadgen_reconnects_total", "Connections closed and reopened by churn");
+    throttled = registry.counter("loadgen_throttled_total", "Requests skipped because too many were in flight");
+    openConnections = registry.gauge("loadgen_open_connections", "Currently open connections");
+    deliveries = registry.counter("loadgen_deliveries_total", "Items pushed by the server");
+    deliveryLatency = registry.histogram("loadgen_delivery_latency_ns", "First check of a location to its item arriving, in nanoseconds");
+    trackerUpdates = registry.counter("loadgen_tracker_updates_total", "TrackerDelta and TrackerState frames received by spectators");
+    trackerBytes = registry.counter("loadgen_tracker_update_bytes_total", "Bytes of tracker updates received by spectators");
+    checkSentNs.reset(new std::atomic<uint64_t>[std::max(1u, config.worlds) * LOCATION_IDS]);
+    for (size_t i = 0; i < std::max(1u, config.worlds) * LOCATION_IDS; i++)
+    {
+        checkSentNs[i] = 0;
+    }
+    buildFrames();
+}
+
+void LoadGenerator::buildFrames()
+{
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    const uint32_t worlds = std::max(1u, config.worlds);
+    for (size_t kind = 0; kind < REQUEST_KIND_COUNT; kind++)
+    {
+        frames[kind].resize(FRAME_VARIANTS);
+        for (auto& frame : frames[kind])
+        {
+            const uint32_t world = static_cast<uint32_t>(nextRandom(random) % worlds);
+            std::string payload;
+            Protocol::MessageType type;
+            switch (static_cast<RequestKind>(kind))
+            {
+            case RequestKind::ItemSend:
+                type = Protocol::MessageType::ItemSend;
+                payload = nlohmann::json{ { "world", world }, { "item", nextRandom(random) % ITEM_IDS } }.dump();
+                break;
+            case RequestKind::LocationCheck:
+                type = Protocol::MessageType::LocationCheck;
+                payload = nlohmann::json{ { "world", world }, { "location", nextRandom(random) % LOCATION_IDS } }.dump();
+                break;
+            case RequestKind::Ping:
+                type = Protocol::MessageType::Ping;
+                payload.assign(16, 'p');
+                break;
+            case RequestKind::FlagSync:
+                // a sparse save: a few bits set across the block, so most
+                // syncs change nothing once the room has seen them
+                type = Protocol::MessageType::FlagSync;
+                payload.assign(Protocol::FLAG_SYNC_PAYLOAD_SIZE, '\0');
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    const uint64_t index = nextRandom(random) % (Protocol::FLAG_SYNC_PAYLOAD_SIZE * 8);
+                    payload[index / 8] |= static_cast<char>(1 << (index % 8));
+                }
+                break;
+            default:
+                type = Protocol::MessageType::TrackerQuery;
+                payload = nlohmann::json{ { "world", world } }.dump();
+                break;
+            }
+            Protocol::appendFrame(frame, type, reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+        }
+    }
+}
+
+LoadReport LoadGenerator::collect() const
+{
+    LoadReport report;
+    report.connections = config.connections;
+    report.openConnections = openConnections.value();
+    report.connectFailures = connectFailures.value();
+    report.disconnects = disconnects.value();
+    report.reconnects = reconnects.value();
+    report.throttled = throttled.value();
+    report.deliveries = deliveries.value();
+    report.deliveryLatency = deliveryLatency.snapshot();
+    report.trackerUpdates = trackerUpdates.value();
+    report.trackerBytes = trackerBytes.value();
+    for (size_t i = 0; i < REQUEST_KIND_COUNT; i++)
+    {
+        KindReport& kind = report.kinds[i];
+        kind.sent = sent[i].value();
+        kind.received = received[i].value();
+        kind.errors = errors[i].value();
+        kind.latency = latency[i].snapshot();
+        mergeInto(report.total, kind);
+    }
+    return report;
+}
+
+void LoadGenerator::recordDelivery(const uint8_t* payload, size_t length, uint64_t now)
+{
+    deliveries.inc();
+    const nlohmann::json delivery = nlohmann::json::parse(payload, payload + length, nullptr, false);
+    if (!delivery.is_object() || !delivery["from"].is_number_unsigned() || !delivery["location"].is_number_unsigned())
+    {
+        return;
+    }
+    const uint32_t from = delivery["from"].get<uint32_t>();
+    const uint32_t location = delivery["location"].get<uint32_t>();
+    if (from < std::max(1u, config.worlds) && location < LOCATION_IDS)
+    {
+        const uint64_t sentNs = checkSentNs[from * LOCATION_IDS + location].load(std::memory_order_relaxed);
+        if (sentNs != 0 && now >= sentNs)
+        {
+            deliveryLatency.record(now - sentNs);
+        }
+    }
+}
+
+void LoadGenerator::recordTrackerUpdate(Client& client, const Protocol::FrameHeader& header, const uint8_t* payload)
+{
+    trackerUpdates.inc();
+    trackerBytes.inc(Protocol::FRAME_HEADER_SIZE + header.length);
+    uint64_t version = 0;
+    if (header.type == Protocol::MessageType::TrackerDelta)
+    {
+        if (header.length < Protocol::TRACKER_DELTA_HEADER_SIZE)
+        {
+            return;
+        }
+        // the to version, already big-endian
+        memcpy(&version, payload + sizeof(uint64_t), sizeof(version));
+    }
+    else
+    {
+        const nlohmann::json state = nlohmann::json::parse(payload, payload + header.length, nullptr, false);
+        if (!state.is_object() || !state["version"].is_number_unsigned())
+        {
+            return;
+        }
+        uint8_t bigEndian[sizeof(uint64_t)];
+        const uint64_t value = state["version"].get<uint64_t>();
+        for (size_t i = 0; i < sizeof(bigEndian); i++)
+        {
+            bigEndian[i] = static_cast<uint8_t>(value >> (56 - 8 * i));
+        }
+        memcpy(&version, bigEndian, sizeof(version));
+    }
+    Protocol::appendFrame(client.writeBuffer, Protocol::MessageType::TrackerAck, reinterpret_cast<const uint8_t*>(&version), sizeof(version));
+}
+
+bool LoadGenerator::writePlacement(const std::string& path) const
+{
+    // every location of every world holds a random item for a random world
+    uint64_t random = 0xD1B54A32D192ED03ULL;
+    const uint32_t worlds = std::max(1u, config.worlds);
+    nlohmann::json placements = nlohmann::json::array();
+    for (uint32_t world = 0; world < worlds; world++)
+    {
+        for (uint32_t location = 0; location < LOCATION_IDS; location++)
+        {
+            placements.push_back({ world, location, nextRandom(random) % worlds, nextRandom(random) % ITEM_IDS });
+        }
+    }
+    std::ofstream out(path);
+    out << nlohmann::json{ { "placements", std::move(placements) } };
+    return static_cast<bool>(out);
+}
+
+bool LoadGenerator::connectClient(Client& client)
+{
+    client.socket = connectTo(config.host, config.port);
+    client.open = !Utility::isSocketInvalid(client.socket);
+    client.closing = false;
+    client.readLength = 0;
+    client.writeBuffer.clear();
+    client.writeOffset = 0;
+    client.inFlight.clear();
+    if (!client.open)
+    {
+        connectFailures.inc();
+        return false;
+    }
+    openConnections.add();
+    char payload[64];
+    if (client.spectator)
+    {
+        const int length = config.spectatorRateHz != 0 ?
+            snprintf(payload, sizeof(payload), "{\"world\":%u,\"rate_hz\":%u}", client.world, config.spectatorRateHz) :
+            snprintf(payload, sizeof(payload), "{\"world\":%u}", client.world);
+        Protocol::appendFrame(client.writeBuffer, Protocol::MessageType::TrackerSubscribe, reinterpret_cast<const uint8_t*>(payload), length);
+        client.inFlight.emplace_back(RequestKind::Count, nowNs());
+        return true;
+    }
+    const int length = snprintf(payload, sizeof(payload), "{\"world\":%u}", client.world);
+    Protocol::appendFrame(client.writeBuffer, Protocol::MessageType::Join, reinterpret_cast<const uint8_t*>(payload), length);
+    client.inFlight.emplace_back(RequestKind::Count, nowNs());
+    return true;
+}
+
+bool LoadGenerator::run(LoadReport& report, double intervalSeconds, IntervalCallback onInterval)
+{
+    unsigned threadCount = config.threads;
+    if (threadCount == 0)
+    {
+        threadCount = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    threadCount = std::max(1u, std::min(threadCount, config.connections));
+
+    const LoadReport baseline = collect();
+    std::vector<Worker> workers(threadCount);
+    const double perClientRate = config.rate / std::max(1u, config.connections);
+    const uint64_t intervalNs = perClientRate > 0.0 ? static_cast<uint64_t>(1e9 / perClientRate) : UINT64_MAX;
+    uint64_t random = 0x2545F4914F6CDD1DULL;
+    const uint64_t startNs = nowNs();
+    unsigned connected = 0;
+    for (unsigned i = 0; i < config.connections; i++)
+    {
+        Client client;
+        client.index = i;
+        client.world = i % std::max(1u, config.worlds);
+        if (!connectClient(client))
+        {
+            continue;
+        }
+        connected++;
+        // stagger the first sends so connections do not fire in lockstep
+        client.nextSendNs = startNs + (intervalNs == UINT64_MAX ? 0 : nextRandom(random) % intervalNs);
+        workers[i % threadCount].clients.push_back(std::move(client));
+    }
+    for (unsigned i = 0; i < config.spectators; i++)
+    {
+        Client client;
+        client.index = config.connections + i;
+        client.world = i % std::max(1u, config.worlds);
+        client.spectator = true;
+        if (connectClient(client))
+        {
+            client.nextSendNs = UINT64_MAX;
+            workers[i % threadCount].clients.push_back(std::move(client));
+        }
+    }
+    if (connected == 0)
+    {
+        fprintf(stderr, "could not connect to %s:%u\n", config.host.c_str(), config.port);
+        return false;
+    }
+
+    stopRequested = false;
+    const uint64_t runStartNs = nowNs();
+    const uint64_t endNs = runStartNs + static_cast<uint64_t>(config.durationSeconds * 1e9);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        Worker& worker = workers[t];
+        worker.random = 0x853C49E6748FEA9BULL + t;
+        if (config.churnPerSecond > 0.0)
+        {
+            worker.churnIntervalNs = static_cast<uint64_t>(1e9 * threadCount / config.churnPerSecond);
+            worker.nextChurnNs = runStartNs + worker.churnIntervalNs;
+        }
+        threads.emplace_back(&LoadGenerator::runWorker, this, std::ref(worker), runStartNs, endNs);
+    }
+
+    if (onInterval && intervalSeconds > 0.0)
+    {
+        LoadReport previous = baseline;
+        uint64_t intervalStartNs = runStartNs;
+        while (intervalStartNs < endNs)
+        {
+            const uint64_t intervalEndNs = std::min(endNs, intervalStartNs + static_cast<uint64_t>(intervalSeconds * 1e9));
+            std::this_thread::sleep_for(std::chrono::nanoseconds(intervalEndNs - std::min(intervalEndNs, nowNs())));
+            const LoadReport current = collect();
+            LoadReport interval = current;
+            interval.subtract(previous);
+            interval.seconds = (intervalEndNs - intervalStartNs) / 1e9;
+            previous = current;
+            intervalStartNs = intervalEndNs;
+            if (!onInterval(interval, (intervalEndNs - runStartNs) / 1e9))
+            {
+                stopRequested = true;
+                break;
+            }
+        }
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    const uint64_t stoppedNs = std::min(nowNs(), endNs);
+
+    for (Worker& worker : workers)
+    {
+        for (Client& client : worker.clients)
+        {
+            if (client.open)
+            {
+                SOCK_CLOSE(client.socket);
+                openConnections.sub();
+            }
+        }
+    }
+    report = collect();
+    report.subtract(baseline);
+    report.seconds = (stoppedNs - runStartNs) / 1e9;
+    return true;
+}
+
+void LoadGenerator::runWorker(Worker& worker, uint64_t startNs, uint64_t endNs)
+{
+    const double perClientRate = config.rate / std::max(1u, config.connections);
+    const uint64_t intervalNs = perClientRate > 0.0 ? static_cast<uint64_t>(1e9 / perClientRate) : UINT64_MAX;
+    unsigned mixTotal = 0;
+    for (unsigned weight : config.mix)
+    {
+        mixTotal += weight;
+    }
+
+    std::vector<pollfd> pfds(worker.clients.size());
+    const uint64_t drainTimeoutNs = std::chrono::duration_cast<std::chrono::nanoseconds>(DRAIN_TIMEOUT).count();
+    uint64_t drainEndNs = endNs + drainTimeoutNs;
+    uint64_t now = startNs;
+    while (true)
+    {
+        if (stopRequested.load(std::memory_order_relaxed) && now < endNs)
+        {
+            endNs = now;
+            drainEndNs = now + drainTimeoutNs;
+        }
+        const bool sending = now < endNs;
+        bool anyInFlight = false;
+        uint64_t nextDue = sending ? std::min(endNs, worker.nextChurnNs) : drainEndNs;
+        for (size_t i = 0; i < worker.clients.size(); i++)
+        {
+            Client& client = worker.clients[i];
+            pfds[i].fd = client.open ? client.socket : INVALID_SOCKET;
+            pfds[i].events = POLLIN;
+            if (client.writeOffset < client.writeBuffer.size())
+            {
+                pfds[i].events |= POLLOUT;
+            }
+            pfds[i].revents = 0;
+            anyInFlight |= client.open && !client.inFlight.empty();
+            if (sending && client.open && !client.closing)
+            {
+                nextDue = std::min(nextDue, client.nextSendNs);
+            }
+        }
+        if (!sending && (!anyInFlight || now >= drainEndNs))
+        {
+            break;
+        }
+
+        const int timeoutMs = nextDue > now ? static_cast<int>(std::min<uint64_t>((nextDue - now) / 1000000, 10)) : 0;
+        SOCK_POLL(pfds.data(), pfds.size(), timeoutMs);
+        now = nowNs();
+
+        if (sending && now >= worker.nextChurnNs)
+        {
+            Client& victim = worker.clients[nextRandom(worker.random) % worker.clients.size()];
+            if (victim.open)
+            {
+                victim.closing = true;
+            }
+            worker.nextChurnNs += worker.churnIntervalNs;
+        }
+
+        for (size_t i = 0; i < worker.clients.size(); i++)
+        {
+            Client& client = worker.clients[i];
+            if (!client.open)
+            {
+                continue;
+            }
+            bool keep = (pfds[i].revents & (POLLERR | POLLNVAL)) == 0;
+
+            // replies
+            if (keep && (pfds[i].revents & (POLLIN | POLLHUP)))
+            {
+                if (client.readBuffer.size() < client.readLength + 16384)
+                {
+                    client.readBuffer.resize(client.readLength + 16384);
+                }
+                const auto got = recv(client.socket, reinterpret_cast<char*>(client.readBuffer.data() + client.readLength), 16384, 0);
+                if (got == 0 || (got < 0 && !Utility::socketWouldBlock()))
+                {
+                    keep = false;
+                }
+                else if (got > 0)
+                {
+                    client.readLength += got;
+                    size_t offset = 0;
+                    while (client.readLength - offset >= Protocol::FRAME_HEADER_SIZE)
+                    {
+                        const Protocol::FrameHeader header = Protocol::decodeHeader(client.readBuffer.data() + offset);
+                        if (client.readLength - offset - Protocol::FRAME_HEADER_SIZE < header.length)
+                        {
+                            break;
+                        }
+                        const uint8_t* payload = client.readBuffer.data() + offset + Protocol::FRAME_HEADER_SIZE;
+                        offset += Protocol::FRAME_HEADER_SIZE + header.length;
+                        if (header.type == Protocol::MessageType::ItemReceived)
+                        {
+                            recordDelivery(payload, header.length, now);
+                            continue;
+                        }
+                        if (header.type == Protocol::MessageType::FlagUpdate)
+                        {
+                            // pushed by other clients' syncs, not a reply
+                            continue;
+                        }
+                        if (client.spectator && (header.type == Protocol::MessageType::TrackerDelta ||
+                                                 header.type == Protocol::MessageType::TrackerState))
+                        {
+                            recordTrackerUpdate(client, header, payload);
+                            continue;
+                        }
+                        if (client.inFlight.empty())
+                        {
+                            continue;
+                        }
+                        const size_t kind = static_cast<size_t>(client.inFlight.front().first);
+                        if (kind == REQUEST_KIND_COUNT)
+                        {
+                            client.inFlight.pop_front();
+                            continue;
+                        }
+                        latency[kind].record(now - client.inFlight.front().second);
+                        received[kind].inc();
+                        if (header.type == Protocol::MessageType::Error)
+                        {
+                            errors[kind].inc();
+                        }
+                        client.inFlight.pop_front();
+                    }
+                    memmove(client.readBuffer.data(), client.readBuffer.data() + offset, client.readLength - offset);
+                    client.readLength -= offset;
+                }
+            }
+
+            // requests that are due
+            while (keep && sending && !client.closing && client.nextSendNs <= now)
+            {
+                if (client.inFlight.size() >= config.maxInFlight)
+                {
+                    throttled.inc();
+                    client.nextSendNs += intervalNs;
+                    continue;
+                }
+                uint64_t pick = nextRandom(worker.random) % mixTotal;
+                size_t kind = 0;
+                while (pick >= config.mix[kind])
+                {
+                    pick -= config.mix[kind];
+                    kind++;
+                }
+                if (kind == static_cast<size_t>(RequestKind::LocationCheck))
+                {
+                    // checks are built per request: each is for the client's
+                    // own world, and the first one of a location starts its
+                    // delivery clock
+                    const uint32_t location = static_cast<uint32_t>(nextRandom(worker.random) % LOCATION_IDS);
+                    char payload[48];
+                    const int length = snprintf(payload, sizeof(payload), "{\"world\":%u,\"location\":%u}", client.world, location);
+                    Protocol::appendFrame(client.writeBuffer, Protocol::MessageType::LocationCheck,
+                                          reinterpret_cast<const uint8_t*>(payload), length);
+                    uint64_t unsent = 0;
+                    checkSentNs[client.world * LOCATION_IDS + location].compare_exchange_strong(unsent, now, std::memory_order_relaxed);
+                }
+                else
+                {
+                    const std::vector<uint8_t>& frame = frames[kind][nextRandom(worker.random) % FRAME_VARIANTS];
+                    client.writeBuffer.insert(client.writeBuffer.end(), frame.begin(), frame.end());
+                }
+                client.inFlight.emplace_back(static_cast<RequestKind>(kind), now);
+                sent[kind].inc();
+                client.nextSendNs += intervalNs;
+            }
+
+            while (keep && client.writeOffset < client.writeBuffer.size())
+            {
+                const auto wrote = send(client.socket, reinterpret_cast<const char*>(client.writeBuffer.data() + client.writeOffset),
+                                        client.writeBuffer.size() - client.writeOffset, SOCK_SEND_FLAGS);
+                if (wrote < 0)
+                {
+                    keep = Utility::socketWouldBlock();
+                    break;
+                }
+                client.writeOffset += wrote;
+            }
+            if (client.writeOffset == client.writeBuffer.size())
+            {
+                client.writeBuffer.clear();
+                client.writeOffset = 0;
+            }
+
+            if (!keep)
+            {
+                SOCK_CLOSE(client.socket);
+                openConnections.sub();
+                client.open = false;
+                client.inFlight.clear();
+                disconnects.inc();
+            }
+            else if (client.closing && client.inFlight.empty() && client.writeBuffer.empty())
+            {
+                SOCK_CLOSE(client.socket);
+                openConnections.sub();
+                reconnects.inc();
+                if (connectClient(client) && sending && !client.spectator)
+                {
+                    // resume: resync this client's world before sending anything else
+                    const size_t kind = static_cast<size_t>(RequestKind::TrackerQuery);
+                    const std::vector<uint8_t>& frame = frames[kind][client.index % FRAME_VARIANTS];
+                    client.writeBuffer.insert(client.writeBuffer.end(), frame.begin(), frame.end());
+                    client.inFlight.emplace_back(RequestKind::TrackerQuery, now);
+                    sent[kind].inc();
+                    client.nextSendNs = std::max(client.nextSendNs, now);
+                }
+                pfds[i].fd = INVALID_SOCKET;
+            }
+        }
+    }
+}
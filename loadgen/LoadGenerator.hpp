@@ -0,0 +1,159 @@
+
+#pragma once
+
+#include "../utility/metrics.hpp"
+#include "../Protocol.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Simulated Wii U clients: opens a number of connections to a ProtocolServer
+// and replays a weighted mix of multiworld requests at a fixed total rate,
+// measuring the round trip of every request.
+
+enum class RequestKind
+{
+    ItemSend,
+    LocationCheck,
+    Ping,
+    TrackerQuery,
+    FlagSync,
+    Count
+};
+
+constexpr size_t REQUEST_KIND_COUNT = static_cast<size_t>(RequestKind::Count);
+
+const char* requestKindName(RequestKind kind);
+
+struct LoadConfig
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 1234;
+    unsigned connections = 200;
+    // worker threads driving the connections, 0 picks one per core (up to 8)
+    unsigned threads = 0;
+    // requests per second across all connections
+    double rate = 10000.0;
+    double durationSeconds = 10.0;
+    // world ids used in requests are spread over [0, worlds)
+    unsigned worlds = 100;
+    // relative weights, indexed by RequestKind
+    unsigned mix[REQUEST_KIND_COUNT] = { 40, 40, 15, 5, 0 };
+    // a connection stops sending while this many requests are unanswered
+    unsigned maxInFlight = 64;
+    // connections closed (once their replies are in) and reopened per second
+    // across all workers; a reopened connection resumes the way a console
+    // does, by asking for its world's tracker state before anything else
+    double churnPerSecond = 0.0;
+    // extra connections that send nothing and follow a world's tracker
+    // feed, as spectators and stream overlays do, spread over the worlds
+    unsigned spectators = 0;
+    // the rate_hz they subscribe with, 0 for every change as it happens
+    unsigned spectatorRateHz = 0;
+
+    // parses "item=40,check=40,ping=15,tracker=5"; unlisted kinds get 0
+    bool parseMix(const std::string& spec);
+};
+
+struct KindReport
+{
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t errors = 0;
+    Metrics::HistogramSnapshot latency;
+};
+
+struct LoadReport
+{
+    double seconds = 0.0;
+    unsigned connections = 0;
+    // connected at the time of the report
+    int64_t openConnections = 0;
+    uint64_t connectFailures = 0;
+    // connections the server closed
+    uint64_t disconnects = 0;
+    // connections closed and reopened by churn
+    uint64_t reconnects = 0;
+    // requests that were due but not sent because of maxInFlight
+    uint64_t throttled = 0;
+    // items the server pushed, and the time from the first check of their
+    // location to their arrival at the owner's connection
+    uint64_t deliveries = 0;
+    Metrics::HistogramSnapshot deliveryLatency;
+    // TrackerDelta and TrackerState frames the spectators got, and their
+    // bytes, headers included
+    uint64_t trackerUpdates = 0;
+    uint64_t trackerBytes = 0;
+    KindReport kinds[REQUEST_KIND_COUNT];
+    KindReport total;
+
+    double throughput() const { return seconds > 0.0 ? total.received / seconds : 0.0; }
+
+    // turns two cumulative reports into the difference between them
+    void subtract(const LoadReport& earlier);
+
+    void print() const;
+
+    std::string toJson() const;
+};
+
+class LoadGenerator
+{
+public:
+    // called with what happened during each interval and the seconds since
+    // the run started; returning false ends the run early
+    using IntervalCallback = std::function<bool(const LoadReport& interval, double elapsedSeconds)>;
+
+    explicit LoadGenerator(const LoadConfig& config);
+
+    // writes a random placement over config.worlds worlds for the server's
+    // --placement, so location checks route items between the clients
+    bool writePlacement(const std::string& path) const;
+
+    // connects, runs for the configured duration, drains and disconnects;
+    // with a callback, it is also called every intervalSeconds meanwhile
+    bool run(LoadReport& report, double intervalSeconds = 0.0, IntervalCallback onInterval = nullptr);
+
+private:
+    struct Client;
+    struct Worker;
+
+    LoadConfig config;
+    // pre-encoded request frames per kind, cycled through while sending
+    std::vector<std::vector<uint8_t>> frames[REQUEST_KIND_COUNT];
+    Metrics::Histogram latency[REQUEST_KIND_COUNT];
+    Metrics::Counter sent[REQUEST_KIND_COUNT];
+    Metrics::Counter received[REQUEST_KIND_COUNT];
+    Metrics::Counter errors[REQUEST_KIND_COUNT];
+    Metrics::Counter connectFailures;
+    Metrics::Counter disconnects;
+    Metrics::Counter reconnects;
+    Metrics::Counter throttled;
+    Metrics::Gauge openConnections;
+    Metrics::Counter deliveries;
+    Metrics::Histogram deliveryLatency;
+    Metrics::Counter trackerUpdates;
+    Metrics::Counter trackerBytes;
+    // when each (world, location) was first checked, 0 if never
+    std::unique_ptr<std::atomic<uint64_t>[]> checkSentNs;
+    std::atomic<bool> stopRequested;
+
+    void buildFrames();
+
+    // everything since the generator was created
+    LoadReport collect() const;
+
+    // connects and queues the client's Join, or a spectator's TrackerSubscribe
+    bool connectClient(Client& client);
+
+    void recordDelivery(const uint8_t* payload, size_t length, uint64_t now);
+
+    // counts a spectator's tracker update and acknowledges its version
+    void recordTrackerUpdate(Client& client, const Protocol::FrameHeader& header, const uint8_t* payload);
+
+    void runWorker(Worker& worker, uint64_t startNs, uint64_t endNs);
+};
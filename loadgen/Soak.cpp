@@ -0,0 +1,177 @@
+
+#include "Soak.hpp"
+#include "../json.hpp"
+
+#ifdef __linux__
+  #include <dirent.h>
+  #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+
+bool readProcessStats(int pid, ProcessStats& stats)
+{
+#ifdef __linux__
+    const std::string proc = pid == 0 ? "/proc/self" : "/proc/" + std::to_string(pid);
+    std::FILE* statm = std::fopen((proc + "/statm").c_str(), "r");
+    if (statm == nullptr)
+    {
+        return false;
+    }
+    unsigned long long pages = 0;
+    unsigned long long residentPages = 0;
+    const bool parsed = std::fscanf(statm, "%llu %llu", &pages, &residentPages) == 2;
+    std::fclose(statm);
+    if (!parsed)
+    {
+        return false;
+    }
+    stats.rssBytes = residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    DIR* fds = opendir((proc + "/fd").c_str());
+    if (fds == nullptr)
+    {
+        return false;
+    }
+    stats.openFds = 0;
+    while (const dirent* entry = readdir(fds))
+    {
+        if (entry->d_name[0] != '.')
+        {
+            stats.openFds++;
+        }
+    }
+    closedir(fds);
+    // the directory handle itself
+    if (pid == 0 && stats.openFds != 0)
+    {
+        stats.openFds--;
+    }
+    return true;
+#else
+    (void)pid;
+    (void)stats;
+    return false;
+#endif
+}
+
+SoakMonitor::SoakMonitor(const SoakConfig& config) : config(config)
+{
+
+}
+
+bool SoakMonitor::onInterval(const LoadReport& interval, double elapsedSeconds)
+{
+    if (samples.empty())
+    {
+        printf("%10s %10s %6s %6s %10s %10s %10s %10s %10s\n",
+               "elapsed s", "rss MiB", "fds", "conns", "replies/s", "reconnects", "p50 us", "p99 us", "p999 us");
+    }
+    SoakSample sample{ elapsedSeconds, ProcessStats(), interval };
+    readProcessStats(config.serverPid, sample.process);
+    samples.push_back(sample);
+
+    const Metrics::HistogramSnapshot& latency = interval.total.latency;
+    printf("%10.0f %10.1f %6u %6lld %10.0f %10llu %10.1f %10.1f %10.1f\n",
+           elapsedSeconds, sample.process.rssBytes / (1024.0 * 1024.0), sample.process.openFds,
+           static_cast<long long>(interval.openConnections), interval.throughput(),
+           static_cast<unsigned long long>(interval.reconnects),
+           latency.quantile(0.50) / 1000.0, latency.quantile(0.99) / 1000.0, latency.quantile(0.999) / 1000.0);
+    fflush(stdout);
+
+    if (elapsedSeconds < config.warmupSeconds)
+    {
+        return true;
+    }
+    if (baselineIndex == SIZE_MAX)
+    {
+        baselineIndex = samples.size() - 1;
+    }
+    const uint64_t p99 = latency.quantile(0.99);
+    if (p99 > config.maxP99Ns)
+    {
+        char failure[128];
+        snprintf(failure, sizeof(failure), "p99 %.1f ms at %.0f s exceeds %.1f ms",
+                 p99 / 1e6, elapsedSeconds, config.maxP99Ns / 1e6);
+        failureList.push_back(failure);
+        return false;
+    }
+    return true;
+}
+
+bool SoakMonitor::finish()
+{
+    if (baselineIndex == SIZE_MAX)
+    {
+        failureList.push_back("run ended before warmup did, nothing was judged");
+    }
+    else if (samples.back().process.rssBytes != 0)
+    {
+        // the smallest RSS over the last quarter of the run, so a single
+        // allocator high-water mark is not mistaken for a leak
+        const SoakSample& baseline = samples[baselineIndex];
+        const size_t judged = samples.size() - baselineIndex;
+        uint64_t recentRss = UINT64_MAX;
+        for (size_t i = samples.size() - std::max<size_t>(1, judged / 4); i < samples.size(); i++)
+        {
+            recentRss = std::min(recentRss, samples[i].process.rssBytes);
+        }
+        char failure[128];
+        if (recentRss > baseline.process.rssBytes + config.maxRssGrowthBytes)
+        {
+            snprintf(failure, sizeof(failure), "RSS grew from %.1f MiB to %.1f MiB (limit +%.1f MiB)",
+                     baseline.process.rssBytes / (1024.0 * 1024.0), recentRss / (1024.0 * 1024.0),
+                     config.maxRssGrowthBytes / (1024.0 * 1024.0));
+            failureList.push_back(failure);
+        }
+        const unsigned finalFds = samples.back().process.openFds;
+        if (finalFds > baseline.process.openFds + config.maxFdGrowth)
+        {
+            snprintf(failure, sizeof(failure), "open fds grew from %u to %u (limit +%u)",
+                     baseline.process.openFds, finalFds, config.maxFdGrowth);
+            failureList.push_back(failure);
+        }
+    }
+    else
+    {
+        printf("process stats unavailable, only latency was judged\n");
+    }
+
+    for (const std::string& failure : failureList)
+    {
+        printf("SOAK FAILED: %s\n", failure.c_str());
+    }
+    if (failureList.empty())
+    {
+        printf("soak passed\n");
+    }
+    return failureList.empty();
+}
+
+std::string SoakMonitor::toJson() const
+{
+    nlohmann::json series = nlohmann::json::array();
+    for (const SoakSample& sample : samples)
+    {
+        const Metrics::HistogramSnapshot& latency = sample.interval.total.latency;
+        series.push_back({
+            { "elapsed_s", sample.elapsedSeconds },
+            { "rss_bytes", sample.process.rssBytes },
+            { "open_fds", sample.process.openFds },
+            { "open_connections", sample.interval.openConnections },
+            { "throughput", sample.interval.throughput() },
+            { "reconnects", sample.interval.reconnects },
+            { "disconnects", sample.interval.disconnects },
+            { "errors", sample.interval.total.errors },
+            { "p50_ns", latency.quantile(0.50) },
+            { "p99_ns", latency.quantile(0.99) },
+            { "p999_ns", latency.quantile(0.999) },
+        });
+    }
+    return nlohmann::json{
+        { "passed", failureList.empty() },
+        { "failures", failureList },
+        { "samples", std::move(series) },
+    }.dump(2);
+}
@@ -0,0 +1,64 @@
+
+#pragma once
+
+#include "LoadGenerator.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Soak mode: the load generator runs for hours with churn while this samples
+// the server process every interval and fails the run on a latency SLO
+// breach, resident memory growth or a file descriptor leak.
+
+struct ProcessStats
+{
+    uint64_t rssBytes = 0;
+    unsigned openFds = 0;
+};
+
+// reads /proc/<pid> (0 for this process); false where that is unavailable
+bool readProcessStats(int pid, ProcessStats& stats);
+
+struct SoakConfig
+{
+    double intervalSeconds = 60.0;
+    // nothing is judged until this has passed; the baselines for memory and
+    // descriptors are taken at its end
+    double warmupSeconds = 300.0;
+    // any interval after warmup with a higher p99 fails the soak at once
+    uint64_t maxP99Ns = 50 * 1000 * 1000;
+    uint64_t maxRssGrowthBytes = 32 * 1024 * 1024;
+    unsigned maxFdGrowth = 32;
+    // server process to watch, 0 for this one (--spawn-server)
+    int serverPid = 0;
+};
+
+struct SoakSample
+{
+    double elapsedSeconds;
+    ProcessStats process;
+    LoadReport interval;
+};
+
+class SoakMonitor
+{
+public:
+    explicit SoakMonitor(const SoakConfig& config);
+
+    // LoadGenerator::IntervalCallback; prints a line per interval
+    bool onInterval(const LoadReport& interval, double elapsedSeconds);
+
+    // judges the whole run and prints the verdict; true if it passed
+    bool finish();
+
+    const std::vector<std::string>& failures() const { return failureList; }
+
+    std::string toJson() const;
+private:
+    SoakConfig config;
+    std::vector<SoakSample> samples;
+    // index of the first sample after warmup, samples.size() until then
+    size_t baselineIndex = SIZE_MAX;
+    std::vector<std::string> failureList;
+};
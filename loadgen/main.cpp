@@ -0,0 +1,238 @@
+
+#include "LoadGenerator.hpp"
+#include "Soak.hpp"
+#include "../ProtocolServer.hpp"
+#include "../utility/log.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+namespace
+{
+    void usage(const char* program)
+    {
+        fprintf(stderr,
+                "usage: %s [options]\n"
+                "  --host <ipv4>          server address, loopback only (127.0.0.1)\n"
+                "  --port <n>             server port (1234)\n"
+                "  --connections <n>      simulated clients (200)\n"
+                "  --threads <n>          worker threads, 0 for one per core (0)\n"
+                "  --rate <n>             requests per second over all clients (10000)\n"
+                "  --duration <seconds>   length of the run (10)\n"
+                "  --worlds <n>           world ids to spread requests over (100)\n"
+                "  --mix <spec>           weights, e.g. item=40,check=40,ping=15,tracker=5,flags=0\n"
+                "  --max-in-flight <n>    unanswered requests per client before throttling (64)\n"
+                "  --churn <n>            connections closed and reopened per second (0)\n"
+                "  --spectators <n>       extra connections that only follow tracker feeds (0)\n"
+                "  --spectator-rate <hz>  their coalesced update rate, 0 for every change (0)\n"
+                "  --placement <path>     write a random placement there (and load it into\n"
+                "                         --spawn-server) so checks route items\n"
+                "  --spawn-server         run a server in this process on --port\n"
+                "  --json <path>          also write the report (or the soak series) as JSON\n"
+                "soak mode, for --duration in the hours:\n"
+                "  --soak                 sample the server every interval and fail on the limits below\n"
+                "  --interval <seconds>   sampling interval (60)\n"
+                "  --warmup <seconds>     time before anything is judged (300)\n"
+                "  --max-p99-ms <ms>      p99 limit for any interval (50)\n"
+                "  --max-rss-growth-mb <n> resident memory growth limit (32)\n"
+                "  --max-fd-growth <n>    open descriptor growth limit (32)\n"
+                "  --server-pid <pid>     server to watch; with --spawn-server this process\n",
+                program);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    LoadConfig config;
+    bool spawnServer = false;
+    bool soak = false;
+    SoakConfig soakConfig;
+    std::string jsonPath;
+    std::string placementPath;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--spawn-server") == 0)
+        {
+            spawnServer = true;
+        }
+        else if (strcmp(argv[i], "--host") == 0 && hasValue)
+        {
+            config.host = argv[++i];
+        }
+        else if (strcmp(argv[i], "--port") == 0 && hasValue)
+        {
+            config.port = static_cast<uint16_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--connections") == 0 && hasValue)
+        {
+            config.connections = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            config.threads = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--rate") == 0 && hasValue)
+        {
+            config.rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--duration") == 0 && hasValue)
+        {
+            config.durationSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--worlds") == 0 && hasValue)
+        {
+            config.worlds = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--mix") == 0 && hasValue)
+        {
+            if (!config.parseMix(argv[++i]))
+            {
+                fprintf(stderr, "bad --mix %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--max-in-flight") == 0 && hasValue)
+        {
+            config.maxInFlight = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--placement") == 0 && hasValue)
+        {
+            placementPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--churn") == 0 && hasValue)
+        {
+            config.churnPerSecond = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--spectators") == 0 && hasValue)
+        {
+            config.spectators = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--spectator-rate") == 0 && hasValue)
+        {
+            config.spectatorRateHz = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--soak") == 0)
+        {
+            soak = true;
+        }
+        else if (strcmp(argv[i], "--interval") == 0 && hasValue)
+        {
+            soakConfig.intervalSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+        {
+            soakConfig.warmupSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-p99-ms") == 0 && hasValue)
+        {
+            soakConfig.maxP99Ns = static_cast<uint64_t>(atof(argv[++i]) * 1e6);
+        }
+        else if (strcmp(argv[i], "--max-rss-growth-mb") == 0 && hasValue)
+        {
+            soakConfig.maxRssGrowthBytes = static_cast<uint64_t>(atof(argv[++i]) * 1024 * 1024);
+        }
+        else if (strcmp(argv[i], "--max-fd-growth") == 0 && hasValue)
+        {
+            soakConfig.maxFdGrowth = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--server-pid") == 0 && hasValue)
+        {
+            soakConfig.serverPid = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--json") == 0 && hasValue)
+        {
+            jsonPath = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // this is a tool for benchmarking our own server, not anyone else's
+    if (config.host.compare(0, 4, "127.") != 0)
+    {
+        fprintf(stderr, "--host must be a loopback address\n");
+        return 1;
+    }
+    if (config.connections == 0 || config.maxInFlight == 0 || (soak && soakConfig.intervalSeconds <= 0.0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Utility::netInit();
+    Utility::setLogLevel(Utility::LogLevel::Warn);
+    Utility::configureLogLevels(getenv("WWHD_LOG"));
+
+    LoadGenerator generator(config);
+    if (!placementPath.empty() && !generator.writePlacement(placementPath))
+    {
+        fprintf(stderr, "could not write %s\n", placementPath.c_str());
+        return 1;
+    }
+
+    std::unique_ptr<ProtocolServer> server;
+    if (spawnServer)
+    {
+        server.reset(new ProtocolServer(config.port));
+        if (!placementPath.empty() && !server->loadPlacement(placementPath))
+        {
+            return 1;
+        }
+        if (!server->initialize())
+        {
+            fprintf(stderr, "could not start server on port %u\n", config.port);
+            return 1;
+        }
+        server->start();
+    }
+
+    if (soak && !spawnServer && soakConfig.serverPid == 0)
+    {
+        // this process is not the server, so its memory says nothing
+        fprintf(stderr, "soak without --server-pid only judges latency\n");
+        soakConfig.serverPid = -1;
+    }
+
+    LoadReport report;
+    SoakMonitor monitor(soakConfig);
+    bool ok;
+    if (soak)
+    {
+        using namespace std::placeholders;
+        ok = generator.run(report, soakConfig.intervalSeconds, std::bind(&SoakMonitor::onInterval, &monitor, _1, _2));
+    }
+    else
+    {
+        ok = generator.run(report);
+    }
+    if (server)
+    {
+        server->stop();
+    }
+    if (!ok)
+    {
+        return 1;
+    }
+
+    report.print();
+    const bool passed = !soak || monitor.finish();
+    if (!jsonPath.empty())
+    {
+        std::ofstream out(jsonPath);
+        out << (soak ? monitor.toJson() : report.toJson()) << "\n";
+        if (!out)
+        {
+            fprintf(stderr, "could not write %s\n", jsonPath.c_str());
+            return 1;
+        }
+    }
+    return passed ? 0 : 2;
+}
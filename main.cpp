@@ -1,9 +1,13 @@
 
 #include "utility/platform_socket.hpp"
+#include "utility/log.hpp"
+#include "utility/trace.hpp"
 
 #include <thread>
 #include <chrono>
 #include <cstring>
+#include <cstdlib>
+#include <string>
 
 #include "ProtocolServer.hpp"
 
@@ -37,11 +41,125 @@ main(int argc, char **argv)
    Utility::netInit();
    Utility::platformInit();
 
-   ProtocolServer server(1234);
+   // e.g. WWHD_LOG=info,net=warn to turn connection-level logging off
+   Utility::configureLogLevels(getenv("WWHD_LOG"));
+
+   // WWHD_TRACE=N traces 1 in N requests (builds with WWHD_TRACING only);
+   // SIGUSR1 or shutdown writes them to WWHD_TRACE_FILE
+   const char* traceRate = getenv("WWHD_TRACE");
+   const char* traceFile = getenv("WWHD_TRACE_FILE");
+   if (traceRate != nullptr)
+   {
+      Trace::setSampleRate(static_cast<uint32_t>(atoi(traceRate)));
+      Trace::installDumpSignal(traceFile != nullptr ? traceFile : "wwhd_trace.json");
+   }
+
+   uint16_t port = 1234;
+   uint16_t metricsPort = 0;
+   std::string capturePath;
+   std::string placementPath;
+   std::string logicPath;
+   unsigned seedWorkers = 0;
+   std::string transferDirectory;
+   std::string eventLogPath;
+   long commitIntervalUs = 2000;
+   std::string snapshotPath;
+   long snapshotIntervalS = 60;
+   for (int i = 1; i + 1 < argc; i += 2)
+   {
+      if (strcmp(argv[i], "--port") == 0)
+      {
+         port = static_cast<uint16_t>(atoi(argv[i + 1]));
+      }
+      else if (strcmp(argv[i], "--metrics-port") == 0)
+      {
+         metricsPort = static_cast<uint16_t>(atoi(argv[i + 1]));
+      }
+      else if (strcmp(argv[i], "--placement") == 0)
+      {
+         placementPath = argv[i + 1];
+      }
+      else if (strcmp(argv[i], "--logic") == 0)
+      {
+         // trackers then also get what each world has in logic
+         logicPath = argv[i + 1];
+      }
+      else if (strcmp(argv[i], "--seed-workers") == 0)
+      {
+         // with --logic: threads generating seeds, 0 for one per core
+         seedWorkers = static_cast<unsigned>(atoi(argv[i + 1]));
+      }
+      else if (strcmp(argv[i], "--transfer-dir") == 0)
+      {
+         // files clients can fetch with TransferRequest, such as patches
+         transferDirectory = argv[i + 1];
+      }
+      else if (strcmp(argv[i], "--event-log") == 0)
+      {
+         // replayed on startup, then appended to
+         eventLogPath = argv[i + 1];
+      }
+      else if (strcmp(argv[i], "--commit-interval-us") == 0)
+      {
+         commitIntervalUs = atol(argv[i + 1]);
+      }
+      else if (strcmp(argv[i], "--snapshot") == 0)
+      {
+         // with --event-log: restored on startup, rewritten periodically
+         snapshotPath = argv[i + 1];
+      }
+      else if (strcmp(argv[i], "--snapshot-interval-s") == 0)
+      {
+         snapshotIntervalS = atol(argv[i + 1]);
+      }
+      else if (strcmp(argv[i], "--capture") == 0)
+      {
+         // replay it with wwhd_rando_replay
+         capturePath = argv[i + 1];
+      }
+      else
+      {
+         PLATFORM_LOG_WARN(General, "ignoring unknown option %s\n", argv[i]);
+      }
+   }
+
+   ProtocolServer server(port, metricsPort);
+   if (!placementPath.empty() && !server.loadPlacement(placementPath))
+   {
+      PLATFORM_LOG_WARN(General, "running without item routing\n");
+   }
+   if (!logicPath.empty() && !server.loadLogic(logicPath))
+   {
+      PLATFORM_LOG_WARN(General, "running without logic tracking\n");
+   }
+   if (!server.validatePlacement())
+   {
+      Utility::platformShutdown();
+      Utility::netShutdown();
+      return 1;
+   }
+   server.setSeedWorkers(seedWorkers);
+   server.setTransferDirectory(transferDirectory);
+   if (!snapshotPath.empty())
+   {
+      server.setSnapshots(snapshotPath, std::chrono::seconds(snapshotIntervalS));
+   }
+   if (!eventLogPath.empty() && !server.openEventLog(eventLogPath, std::chrono::microseconds(commitIntervalUs)))
+   {
+      PLATFORM_LOG_ERROR(General, "could not open event log %s\n", eventLogPath.c_str());
+      Utility::platformShutdown();
+      Utility::netShutdown();
+      return 1;
+   }
+   TrafficCapture capture;
+   if (!capturePath.empty() && capture.open(capturePath))
+   {
+      server.setCapture(&capture);
+   }
 
    if (!server.initialize())
    {
-     Utility::platformLog("server.initialize() failed\n");
+     PLATFORM_LOG_ERROR(General, "server.initialize() failed\n");
    }
    else
    {
@@ -50,11 +168,16 @@ main(int argc, char **argv)
 
    // wait until termination signal is received. In the case of wii u this is
    // the home button, otherwise, ctrl-c
-   Utility::waitForPlatformStop();
+   Utility::waitForPlatformStop(Trace::dumpIfRequested);
 
    // if server never started, this does nothing
    server.stop();
-   Utility::platformLog("server successfully stopped\n");
+   capture.close();
+   if (Trace::sampleRate() != 0)
+   {
+      Trace::dumpChromeTrace(traceFile != nullptr ? traceFile : "wwhd_trace.json");
+   }
+   PLATFORM_LOG_INFO(General, "server successfully stopped\n");
 
    Utility::platformShutdown();
    Utility::netShutdown();
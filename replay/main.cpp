@@ -0,0 +1,178 @@
+
+#include "../ProtocolServer.hpp"
+#include "../TrafficCapture.hpp"
+#include "../utility/log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <thread>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    void usage(const char* program)
+    {
+        fprintf(stderr,
+                "usage: %s <capture> [options]\n"
+                "  --timing           keep the captured gaps between frames\n"
+                "  --speed <x>        with --timing, play x times faster (1)\n"
+                "  --loop <n>         replay the capture n times (1)\n"
+                "  --placement <path> route checks by this placement, as the server does\n"
+                "  --logic <path>     track logic, as the server does\n"
+                "  --event-log <path> replay this log first, then append to it\n"
+                "  --commit-interval-us <us>\n"
+                "                     with --event-log, the group commit interval (2000)\n"
+                "  --snapshot <path>  with --event-log, restore from and save to this snapshot\n",
+                program);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const std::string path = argv[1];
+    bool timing = false;
+    double speed = 1.0;
+    unsigned loops = 1;
+    std::string placementPath;
+    std::string logicPath;
+    std::string eventLogPath;
+    long commitIntervalUs = 2000;
+    std::string snapshotPath;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--timing") == 0)
+        {
+            timing = true;
+        }
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+        {
+            speed = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--loop") == 0 && i + 1 < argc)
+        {
+            loops = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--placement") == 0 && i + 1 < argc)
+        {
+            placementPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--logic") == 0 && i + 1 < argc)
+        {
+            logicPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--event-log") == 0 && i + 1 < argc)
+        {
+            eventLogPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--commit-interval-us") == 0 && i + 1 < argc)
+        {
+            commitIntervalUs = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+        {
+            snapshotPath = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (speed <= 0.0 || (!snapshotPath.empty() && eventLogPath.empty()))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Utility::setLogLevel(Utility::LogLevel::Warn);
+    Utility::configureLogLevels(getenv("WWHD_LOG"));
+
+    // never initialized or started: replayFrame drives the handlers directly
+    ProtocolServer server(0);
+    // set up the same way main.cpp does, so the handlers take the same paths
+    if (!placementPath.empty() && !server.loadPlacement(placementPath))
+    {
+        fprintf(stderr, "could not load placement %s\n", placementPath.c_str());
+        return 1;
+    }
+    if (!logicPath.empty() && !server.loadLogic(logicPath))
+    {
+        fprintf(stderr, "could not load logic %s\n", logicPath.c_str());
+        return 1;
+    }
+    if (!snapshotPath.empty())
+    {
+        server.setSnapshots(snapshotPath, std::chrono::seconds(0));
+    }
+    if (!eventLogPath.empty() && !server.openEventLog(eventLogPath, std::chrono::microseconds(commitIntervalUs)))
+    {
+        fprintf(stderr, "could not open event log %s\n", eventLogPath.c_str());
+        return 1;
+    }
+    const Metrics::Histogram frameLatency = Metrics::registry().histogram("replay_frame_ns", "Replay time per frame in nanoseconds");
+    uint64_t records = 0;
+    uint64_t frames = 0;
+    uint64_t frameBytes = 0;
+    uint64_t replyBytes = 0;
+    std::set<uint32_t> connections;
+    const Clock::time_point start = Clock::now();
+    for (unsigned loop = 0; loop < loops; loop++)
+    {
+        CaptureReader reader;
+        if (!reader.open(path))
+        {
+            fprintf(stderr, "%s is not a capture file\n", path.c_str());
+            return 1;
+        }
+        const Clock::time_point loopStart = Clock::now();
+        CaptureRecord record;
+        while (reader.next(record))
+        {
+            records++;
+            if (timing)
+            {
+                std::this_thread::sleep_until(loopStart + std::chrono::nanoseconds(static_cast<uint64_t>(record.timeNs / speed)));
+            }
+            switch (record.event)
+            {
+            case CaptureEvent::Frame:
+            {
+                connections.insert(record.connection);
+                const Clock::time_point frameStart = Clock::now();
+                replyBytes += server.replayFrame(record.connection, record.data.data(), record.data.size());
+                frameLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frameStart).count());
+                frames++;
+                frameBytes += record.data.size();
+                break;
+            }
+            case CaptureEvent::Close:
+                server.replayClose(record.connection);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    // closes the event log and saves the snapshot
+    server.stop();
+
+    const Metrics::HistogramSnapshot latency = frameLatency.snapshot();
+    printf("%llu records, %llu frames (%llu bytes) from %zu connections in %.3f s\n",
+           static_cast<unsigned long long>(records), static_cast<unsigned long long>(frames),
+           static_cast<unsigned long long>(frameBytes), connections.size(), seconds);
+    printf("%.0f frames/s, %llu reply bytes, per frame p50 %.1f us p99 %.1f us p999 %.1f us\n",
+           seconds > 0.0 ? frames / seconds : 0.0, static_cast<unsigned long long>(replyBytes),
+           latency.quantile(0.50) / 1000.0, latency.quantile(0.99) / 1000.0, latency.quantile(0.999) / 1000.0);
+    return 0;
+}
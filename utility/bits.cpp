@@ -0,0 +1,104 @@
+#include "bits.hpp"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define BITS_USE_SSE2
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+namespace Utility
+{
+	size_t orMergeChangedScalar(uint64_t* state, const uint8_t* incoming, size_t wordCount, uint16_t* changed)
+	{
+		size_t changedCount = 0;
+		for (size_t i = 0; i < wordCount; i++)
+		{
+			uint64_t word;
+			memcpy(&word, incoming + i * sizeof(word), sizeof(word));
+			// bits set in incoming that state does not have yet
+			const uint64_t gained = (state[i] | word) ^ state[i];
+			state[i] |= word;
+			changed[changedCount] = static_cast<uint16_t>(i);
+			changedCount += gained != 0;
+		}
+		return changedCount;
+	}
+
+	size_t orMergeChanged(uint64_t* state, const uint8_t* incoming, size_t wordCount, uint16_t* changed)
+	{
+		size_t changedCount = 0;
+		size_t i = 0;
+#if defined(__AVX2__)
+		for (; i + 4 <= wordCount; i += 4)
+		{
+			const __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + i));
+			const __m256i word = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(incoming + i * 8));
+			const __m256i merged = _mm256_or_si256(current, word);
+			const __m256i gained = _mm256_xor_si256(merged, current);
+			// one bit per word that is entirely zero
+			const unsigned unchanged = static_cast<unsigned>(_mm256_movemask_pd(
+				_mm256_castsi256_pd(_mm256_cmpeq_epi64(gained, _mm256_setzero_si256()))));
+			if (unchanged != 0xF)
+			{
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + i), merged);
+				for (unsigned lane = 0; lane < 4; lane++)
+				{
+					changed[changedCount] = static_cast<uint16_t>(i + lane);
+					changedCount += ((unchanged >> lane) & 1) == 0;
+				}
+			}
+		}
+#elif defined(BITS_USE_SSE2)
+		for (; i + 2 <= wordCount; i += 2)
+		{
+			const __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + i));
+			const __m128i word = _mm_loadu_si128(reinterpret_cast<const __m128i*>(incoming + i * 8));
+			const __m128i merged = _mm_or_si128(current, word);
+			const __m128i gained = _mm_xor_si128(merged, current);
+			// SSE2 has no 64-bit compare; one bit per zero byte, eight per word
+			const unsigned zeroBytes = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(gained, _mm_setzero_si128())));
+			if (zeroBytes != 0xFFFF)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(state + i), merged);
+				changed[changedCount] = static_cast<uint16_t>(i);
+				changedCount += (zeroBytes & 0xFF) != 0xFF;
+				changed[changedCount] = static_cast<uint16_t>(i + 1);
+				changedCount += (zeroBytes >> 8) != 0xFF;
+			}
+		}
+#elif defined(__ARM_NEON)
+		for (; i + 2 <= wordCount; i += 2)
+		{
+			const uint64x2_t current = vld1q_u64(state + i);
+			const uint64x2_t word = vreinterpretq_u64_u8(vld1q_u8(incoming + i * 8));
+			const uint64x2_t merged = vorrq_u64(current, word);
+			const uint64x2_t gained = veorq_u64(merged, current);
+			const uint64_t low = vgetq_lane_u64(gained, 0);
+			const uint64_t high = vgetq_lane_u64(gained, 1);
+			if ((low | high) != 0)
+			{
+				vst1q_u64(state + i, merged);
+				changed[changedCount] = static_cast<uint16_t>(i);
+				changedCount += low != 0;
+				changed[changedCount] = static_cast<uint16_t>(i + 1);
+				changedCount += high != 0;
+			}
+		}
+#endif
+		for (; i < wordCount; i++)
+		{
+			uint64_t word;
+			memcpy(&word, incoming + i * sizeof(word), sizeof(word));
+			const uint64_t gained = (state[i] | word) ^ state[i];
+			state[i] |= word;
+			changed[changedCount] = static_cast<uint16_t>(i);
+			changedCount += gained != 0;
+		}
+		return changedCount;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+#endif
+
+namespace Utility
+{
+	// index of the lowest set bit; value must not be 0
+	inline unsigned countTrailingZeros(uint64_t value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<unsigned>(__builtin_ctzll(value));
+#elif defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<unsigned>(index);
+#else
+		unsigned count = 0;
+		while ((value & 1) == 0)
+		{
+			value >>= 1;
+			count++;
+		}
+		return count;
+#endif
+	}
+
+	inline unsigned popCount(uint64_t value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<unsigned>(__builtin_popcountll(value));
+#else
+		value = value - ((value >> 1) & 0x5555555555555555ULL);
+		value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+		value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		return static_cast<unsigned>((value * 0x0101010101010101ULL) >> 56);
+#endif
+	}
+
+	// ORs wordCount 64-bit words of incoming (any alignment, any byte order:
+	// the merge is bitwise) into state and writes the index of every word
+	// that gained a bit to changed (which must have room for wordCount
+	// entries), in order. Returns how many did. Uses
+	// SSE2, AVX2 or NEON where the build targets them.
+	size_t orMergeChanged(uint64_t* state, const uint8_t* incoming, size_t wordCount, uint16_t* changed);
+
+	// the same one word at a time, for platforms without vectors and for
+	// comparing against
+	size_t orMergeChangedScalar(uint64_t* state, const uint8_t* incoming, size_t wordCount, uint16_t* changed);
+}
@@ -1,12 +1,14 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 namespace Utility
 {
 
-    uint64_t byteswap(const uint64_t& value)
+    inline uint64_t byteswap(const uint64_t& value)
     {
         return ((value & 0xFF00000000000000) >> 56) | 
             ((value & 0x00FF000000000000) >> 40) | 
@@ -18,7 +20,7 @@ namespace Utility
             ((value & 0x00000000000000FF) << 56);
     }
 
-    uint32_t byteswap(const uint32_t& value)
+    inline uint32_t byteswap(const uint32_t& value)
     {
         return ((value & 0xFF000000) >> 24) |
             ((value & 0x00FF0000) >> 8) | 
@@ -26,39 +28,59 @@ namespace Utility
             ((value & 0x000000FF) << 24);
     }
 
-    uint16_t byteswap(const uint16_t& value)
+    inline uint16_t byteswap(const uint16_t& value)
     {
         return ((value & 0xFF00) >> 8) | ((value & 0x00FF) << 8);
     }
 
-    int64_t byteswap(const int64_t& value)
+    inline int64_t byteswap(const int64_t& value)
     {
-        uint64_t result = byteswap(reinterpret_cast<const uint64_t&>(value));
-        return *(reinterpret_cast<int64_t*>(&result));
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = byteswap(bits);
+        int64_t result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
     }
 
-    int32_t byteswap(const int32_t& value)
+    inline int32_t byteswap(const int32_t& value)
     {
-        uint32_t result = byteswap(reinterpret_cast<const uint32_t&>(value));
-        return *(reinterpret_cast<int32_t*>(&result));
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = byteswap(bits);
+        int32_t result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
     }
 
-    int16_t byteswap(const int16_t& value)
+    inline int16_t byteswap(const int16_t& value)
     {
-        uint16_t result = byteswap(reinterpret_cast<const uint16_t&>(value));
-        return *(reinterpret_cast<int16_t*>(&result));
+        uint16_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = byteswap(bits);
+        int16_t result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
     }
 
-    float byteswap(const float& value)
+    inline float byteswap(const float& value)
     {
-        uint32_t result = byteswap(reinterpret_cast<const uint32_t&>(value));
-        return *(reinterpret_cast<float*>(&result));
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = byteswap(bits);
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
     }
 
-    double byteswap(const double& value)
+    inline double byteswap(const double& value)
     {
-        uint64_t result = byteswap(reinterpret_cast<const uint64_t&>(value));
-        return *(reinterpret_cast<double*>(&result));
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = byteswap(bits);
+        double result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
     }
 
     template<typename T>
@@ -66,4 +88,33 @@ namespace Utility
     {
         value = byteswap(value);
     }
+
+    // swaps count values in place; a plain loop over the shift-and-mask
+    // swaps above, which compilers turn into vector shuffles
+    template<typename T>
+    void byteswap_array(T* values, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            values[i] = byteswap(values[i]);
+        }
+    }
+
+    // the console and the wire protocol are big-endian; these are no-ops on
+    // big-endian hosts
+    template<typename T>
+    T toBigEndian(const T& value)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return value;
+#else
+        return byteswap(value);
+#endif
+    }
+
+    template<typename T>
+    T fromBigEndian(const T& value)
+    {
+        return toBigEndian(value);
+    }
 }
@@ -0,0 +1,141 @@
+#include "log.hpp"
+
+#include <cstring>
+
+namespace
+{
+	const char* const LEVEL_NAMES[] = { "trace", "debug", "info", "warn", "error", "none" };
+
+	const char* const SUBSYSTEM_NAMES[] = { "general", "platform", "net" };
+
+	static_assert(sizeof(SUBSYSTEM_NAMES) / sizeof(SUBSYSTEM_NAMES[0]) == static_cast<size_t>(Utility::LogSubsystem::Count),
+		"every LogSubsystem needs a name");
+
+	constexpr size_t SUBSYSTEM_COUNT = static_cast<size_t>(Utility::LogSubsystem::Count);
+
+	bool parseLevel(const char* name, size_t len, Utility::LogLevel& out)
+	{
+		for (size_t i = 0; i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); i++)
+		{
+			if (strlen(LEVEL_NAMES[i]) == len && strncmp(LEVEL_NAMES[i], name, len) == 0)
+			{
+				out = static_cast<Utility::LogLevel>(i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool parseSubsystem(const char* name, size_t len, Utility::LogSubsystem& out)
+	{
+		for (size_t i = 0; i < SUBSYSTEM_COUNT; i++)
+		{
+			if (strlen(SUBSYSTEM_NAMES[i]) == len && strncmp(SUBSYSTEM_NAMES[i], name, len) == 0)
+			{
+				out = static_cast<Utility::LogSubsystem>(i);
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+namespace Utility
+{
+	// everything starts at the compile-time minimum; runtime filtering can only
+	// raise it, since lower levels are not compiled in
+	std::atomic<uint8_t> logSubsystemLevels[SUBSYSTEM_COUNT] = {
+		{ PLATFORM_LOG_MIN_LEVEL },
+		{ PLATFORM_LOG_MIN_LEVEL },
+		{ PLATFORM_LOG_MIN_LEVEL },
+	};
+
+	void setLogLevel(LogSubsystem subsystem, LogLevel level)
+	{
+		logSubsystemLevels[static_cast<size_t>(subsystem)].store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+	}
+
+	void setLogLevel(LogLevel level)
+	{
+		for (size_t i = 0; i < SUBSYSTEM_COUNT; i++)
+		{
+			setLogLevel(static_cast<LogSubsystem>(i), level);
+		}
+	}
+
+	bool configureLogLevels(const char* spec)
+	{
+		bool ok = true;
+		if (spec == nullptr)
+		{
+			return ok;
+		}
+
+		const char* entry = spec;
+		while (*entry != '\0')
+		{
+			const char* end = strchr(entry, ',');
+			if (end == nullptr)
+			{
+				end = entry + strlen(entry);
+			}
+			const char* eq = static_cast<const char*>(memchr(entry, '=', end - entry));
+
+			LogLevel level;
+			if (eq == nullptr)
+			{
+				if (parseLevel(entry, end - entry, level))
+				{
+					setLogLevel(level);
+				}
+				else
+				{
+					platformLog("unknown log level '%.*s'\n", static_cast<int>(end - entry), entry);
+					ok = false;
+				}
+			}
+			else
+			{
+				LogSubsystem subsystem;
+				if (!parseSubsystem(entry, eq - entry, subsystem))
+				{
+					platformLog("unknown log subsystem '%.*s'\n", static_cast<int>(eq - entry), entry);
+					ok = false;
+				}
+				else if (!parseLevel(eq + 1, end - eq - 1, level))
+				{
+					platformLog("unknown log level '%.*s'\n", static_cast<int>(end - eq - 1), eq + 1);
+					ok = false;
+				}
+				else
+				{
+					setLogLevel(subsystem, level);
+				}
+			}
+
+			entry = (*end == ',') ? end + 1 : end;
+		}
+		return ok;
+	}
+
+	const char* logLevelName(LogLevel level)
+	{
+		return LEVEL_NAMES[static_cast<size_t>(level)];
+	}
+
+	const char* logSubsystemName(LogSubsystem subsystem)
+	{
+		return SUBSYSTEM_NAMES[static_cast<size_t>(subsystem)];
+	}
+
+	void platformLogTagged(LogLevel level, LogSubsystem subsystem, const char* f, ...)
+	{
+		char prefix[32];
+		snprintf(prefix, sizeof(prefix), "[%s] %s: ", logSubsystemName(subsystem), logLevelName(level));
+
+		va_list args;
+		va_start(args, f);
+		platformLogV(prefix, f, args);
+		va_end(args);
+	}
+}
@@ -0,0 +1,132 @@
+
+#pragma once
+
+#include "platform.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Numeric levels so the compile-time threshold can be compared by the
+// preprocessor. Override with -DPLATFORM_LOG_MIN_LEVEL=<n>; CMakeLists.txt sets
+// info outside Debug builds.
+#define PLATFORM_LOG_LEVEL_TRACE 0
+#define PLATFORM_LOG_LEVEL_DEBUG 1
+#define PLATFORM_LOG_LEVEL_INFO  2
+#define PLATFORM_LOG_LEVEL_WARN  3
+#define PLATFORM_LOG_LEVEL_ERROR 4
+#define PLATFORM_LOG_LEVEL_NONE  5
+
+#ifndef PLATFORM_LOG_MIN_LEVEL
+	#define PLATFORM_LOG_MIN_LEVEL PLATFORM_LOG_LEVEL_DEBUG
+#endif
+
+namespace Utility
+{
+	enum class LogLevel : uint8_t
+	{
+		Trace = PLATFORM_LOG_LEVEL_TRACE,
+		Debug = PLATFORM_LOG_LEVEL_DEBUG,
+		Info = PLATFORM_LOG_LEVEL_INFO,
+		Warn = PLATFORM_LOG_LEVEL_WARN,
+		Error = PLATFORM_LOG_LEVEL_ERROR,
+		None = PLATFORM_LOG_LEVEL_NONE,
+	};
+
+	// new subsystems also need a name and an initial level in log.cpp
+	enum class LogSubsystem : uint8_t
+	{
+		General = 0,
+		Platform,
+		Net,
+		Count
+	};
+
+	// runtime minimum level per subsystem, indexed by LogSubsystem
+	extern std::atomic<uint8_t> logSubsystemLevels[static_cast<size_t>(LogSubsystem::Count)];
+
+	inline bool logEnabled(LogLevel level, LogSubsystem subsystem)
+	{
+		return static_cast<uint8_t>(level) >=
+			logSubsystemLevels[static_cast<size_t>(subsystem)].load(std::memory_order_relaxed);
+	}
+
+	void setLogLevel(LogSubsystem subsystem, LogLevel level);
+
+	void setLogLevel(LogLevel level);
+
+	// parses "level" or "subsystem=level[,subsystem=level...]", e.g. "info,net=warn".
+	// Unknown names are reported and skipped. Returns false if anything was skipped.
+	bool configureLogLevels(const char* spec);
+
+	const char* logLevelName(LogLevel level);
+
+	const char* logSubsystemName(LogSubsystem subsystem);
+
+#if defined(PLATFORM_GCC) || defined(PLATFORM_CLANG)
+	__attribute__((format(printf, 3, 4)))
+#endif
+	void platformLogTagged(LogLevel level, LogSubsystem subsystem, const char* f, ...);
+}
+
+// The runtime level check happens before any argument is evaluated, so a
+// disabled subsystem costs one relaxed load and one branch. A level below
+// PLATFORM_LOG_MIN_LEVEL compiles to nothing at all.
+#define PLATFORM_LOG_AT(level, subsystem, ...) \
+	do { \
+		if (Utility::logEnabled(Utility::LogLevel::level, Utility::LogSubsystem::subsystem)) \
+		{ \
+			Utility::platformLogTagged(Utility::LogLevel::level, Utility::LogSubsystem::subsystem, __VA_ARGS__); \
+		} \
+	} while (0)
+
+// disabled levels keep the call inside an if (false) so the arguments are still
+// type checked (and variables only used for logging stay "used") but are never
+// evaluated or emitted
+#define PLATFORM_LOG_DISABLED(subsystem, ...) \
+	do { \
+		if (false) \
+		{ \
+			Utility::platformLogTagged(Utility::LogLevel::None, Utility::LogSubsystem::subsystem, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#if PLATFORM_LOG_MIN_LEVEL <= PLATFORM_LOG_LEVEL_TRACE
+	#define PLATFORM_LOG_TRACE(subsystem, ...) PLATFORM_LOG_AT(Trace, subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_TRACE_ENABLED(subsystem) Utility::logEnabled(Utility::LogLevel::Trace, Utility::LogSubsystem::subsystem)
+#else
+	#define PLATFORM_LOG_TRACE(subsystem, ...) PLATFORM_LOG_DISABLED(subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_TRACE_ENABLED(subsystem) false
+#endif
+
+#if PLATFORM_LOG_MIN_LEVEL <= PLATFORM_LOG_LEVEL_DEBUG
+	#define PLATFORM_LOG_DEBUG(subsystem, ...) PLATFORM_LOG_AT(Debug, subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_DEBUG_ENABLED(subsystem) Utility::logEnabled(Utility::LogLevel::Debug, Utility::LogSubsystem::subsystem)
+#else
+	#define PLATFORM_LOG_DEBUG(subsystem, ...) PLATFORM_LOG_DISABLED(subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_DEBUG_ENABLED(subsystem) false
+#endif
+
+#if PLATFORM_LOG_MIN_LEVEL <= PLATFORM_LOG_LEVEL_INFO
+	#define PLATFORM_LOG_INFO(subsystem, ...) PLATFORM_LOG_AT(Info, subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_INFO_ENABLED(subsystem) Utility::logEnabled(Utility::LogLevel::Info, Utility::LogSubsystem::subsystem)
+#else
+	#define PLATFORM_LOG_INFO(subsystem, ...) PLATFORM_LOG_DISABLED(subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_INFO_ENABLED(subsystem) false
+#endif
+
+#if PLATFORM_LOG_MIN_LEVEL <= PLATFORM_LOG_LEVEL_WARN
+	#define PLATFORM_LOG_WARN(subsystem, ...) PLATFORM_LOG_AT(Warn, subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_WARN_ENABLED(subsystem) Utility::logEnabled(Utility::LogLevel::Warn, Utility::LogSubsystem::subsystem)
+#else
+	#define PLATFORM_LOG_WARN(subsystem, ...) PLATFORM_LOG_DISABLED(subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_WARN_ENABLED(subsystem) false
+#endif
+
+#if PLATFORM_LOG_MIN_LEVEL <= PLATFORM_LOG_LEVEL_ERROR
+	#define PLATFORM_LOG_ERROR(subsystem, ...) PLATFORM_LOG_AT(Error, subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_ERROR_ENABLED(subsystem) Utility::logEnabled(Utility::LogLevel::Error, Utility::LogSubsystem::subsystem)
+#else
+	#define PLATFORM_LOG_ERROR(subsystem, ...) PLATFORM_LOG_DISABLED(subsystem, __VA_ARGS__)
+	#define PLATFORM_LOG_ERROR_ENABLED(subsystem) false
+#endif
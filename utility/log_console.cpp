@@ -0,0 +1,130 @@
+#include "log_console.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <whb/log.h>
+#include <whb/log_console.h>
+
+namespace Utility
+{
+	constexpr std::chrono::microseconds LogConsole::DEFAULT_FRAME_INTERVAL;
+	constexpr size_t LogConsole::MAX_PENDING_BYTES;
+
+	LogConsole::~LogConsole()
+	{
+		stop();
+	}
+
+	void LogConsole::start(LogConsoleMode mode, std::chrono::microseconds frameInterval)
+	{
+		stop();
+		consoleMode = mode;
+		interval = frameInterval;
+		if (consoleMode == LogConsoleMode::Batched)
+		{
+			running = true;
+			drawThread = std::thread(&LogConsole::drawCallback, this);
+		}
+	}
+
+	void LogConsole::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			running = false;
+		}
+		pendingCondition.notify_one();
+		if (drawThread.joinable())
+		{
+			drawThread.join();
+		}
+	}
+
+	void LogConsole::write(const char* line)
+	{
+		lines.fetch_add(1, std::memory_order_relaxed);
+		if (consoleMode == LogConsoleMode::Immediate)
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			WHBLogWrite(line);
+			WHBLogConsoleDraw();
+			draws.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		const size_t length = strlen(line) + 1;
+		bool wasEmpty;
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			// nothing would ever draw it, or the drawing thread is too far behind
+			if (!running || pending.size() + length > MAX_PENDING_BYTES)
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			wasEmpty = pending.empty();
+			pending.append(line, length);
+		}
+		// only the first line of a batch has to wake the drawing thread
+		if (wasEmpty)
+		{
+			pendingCondition.notify_one();
+		}
+	}
+
+	void LogConsole::drawCallback()
+	{
+		std::string batch;
+		std::unique_lock<std::mutex> lock(pendingMutex);
+		while (running)
+		{
+			pendingCondition.wait(lock, [this] { return !running || !pending.empty(); });
+			if (pending.empty())
+			{
+				continue;
+			}
+			// swapping keeps both buffers' capacity, so steady state does not allocate
+			batch.swap(pending);
+			lock.unlock();
+
+			const auto drawnAt = std::chrono::steady_clock::now();
+			drainAndDraw(batch);
+			// lines arriving while we wait pile up and go out in the next draw
+			std::this_thread::sleep_until(drawnAt + interval);
+
+			lock.lock();
+		}
+
+		batch.swap(pending);
+		lock.unlock();
+		if (!batch.empty())
+		{
+			drainAndDraw(batch);
+		}
+	}
+
+	void LogConsole::drainAndDraw(std::string& batch)
+	{
+		const char* line = batch.data();
+		const char* end = line + batch.size();
+		while (line < end)
+		{
+			WHBLogWrite(line);
+			line += strlen(line) + 1;
+		}
+		batch.clear();
+
+		const uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+		if (droppedNow != droppedDrawn)
+		{
+			char note[64];
+			snprintf(note, sizeof(note), "[log] %llu lines dropped\n", static_cast<unsigned long long>(droppedNow - droppedDrawn));
+			WHBLogWrite(note);
+			droppedDrawn = droppedNow;
+		}
+
+		WHBLogConsoleDraw();
+		draws.fetch_add(1, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,78 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Only built where the WHB console API exists: on the console itself, or on a
+// host build against the stub in utility/whb_stub (WWHD_WHB_STUB).
+
+namespace Utility
+{
+	enum class LogConsoleMode
+	{
+		// write the line and redraw the whole console from the calling thread
+		Immediate,
+		// queue the line; a single drawing thread appends queued lines to the
+		// console buffer and redraws at most once per frame interval. Lines
+		// that would grow the queue past MAX_PENDING_BYTES, or that come after
+		// stop(), are dropped and counted
+		Batched,
+	};
+
+	class LogConsole
+	{
+	public:
+		static constexpr std::chrono::microseconds DEFAULT_FRAME_INTERVAL{ 16667 }; // 60 Hz
+		static constexpr size_t MAX_PENDING_BYTES = 512 * 1024;
+
+		LogConsole() = default;
+		~LogConsole();
+
+		LogConsole(const LogConsole&) = delete;
+		LogConsole& operator=(const LogConsole&) = delete;
+
+		// starts the drawing thread in Batched mode
+		void start(LogConsoleMode mode, std::chrono::microseconds frameInterval = DEFAULT_FRAME_INTERVAL);
+
+		// drains anything queued, does a final redraw and stops the drawing thread
+		void stop();
+
+		void write(const char* line);
+
+		LogConsoleMode mode() const { return consoleMode; }
+
+		uint64_t drawCount() const { return draws.load(std::memory_order_relaxed); }
+
+		uint64_t lineCount() const { return lines.load(std::memory_order_relaxed); }
+
+		uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+	private:
+		LogConsoleMode consoleMode = LogConsoleMode::Immediate;
+		std::chrono::microseconds interval = DEFAULT_FRAME_INTERVAL;
+
+		// lines are stored back to back, each terminated by '\0'
+		std::string pending;
+		std::mutex pendingMutex;
+		std::condition_variable pendingCondition;
+		bool running = false;
+		std::thread drawThread;
+
+		std::atomic<uint64_t> draws{ 0 };
+		std::atomic<uint64_t> lines{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+		// dropped as of the last draw; only the drawing thread
+		uint64_t droppedDrawn = 0;
+
+		void drawCallback();
+
+		void drainAndDraw(std::string& batch);
+	};
+}
@@ -0,0 +1,83 @@
+#include "mapped_file.hpp"
+#include "platform.hpp"
+
+#include <cstdio>
+
+#if !defined(PLATFORM_MSVC) && !defined(PLATFORM_DKP)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define MAPPED_FILE_MMAP
+#endif
+
+namespace Utility
+{
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+#ifdef MAPPED_FILE_MMAP
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		length = static_cast<size_t>(info.st_size);
+		if (length != 0)
+		{
+			void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping != MAP_FAILED)
+			{
+				bytes = static_cast<const uint8_t*>(mapping);
+				mapped = true;
+			}
+		}
+		::close(fd);
+		if (mapped || length == 0)
+		{
+			return true;
+		}
+#endif
+		// no mmap here (or it failed): read the whole file
+		std::FILE* file = std::fopen(path.c_str(), "rb");
+		if (file == nullptr)
+		{
+			length = 0;
+			return false;
+		}
+		std::fseek(file, 0, SEEK_END);
+		const long end = std::ftell(file);
+		std::fseek(file, 0, SEEK_SET);
+		buffer.resize(end > 0 ? static_cast<size_t>(end) : 0);
+		length = std::fread(buffer.data(), 1, buffer.size(), file);
+		std::fclose(file);
+		bytes = buffer.data();
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+#ifdef MAPPED_FILE_MMAP
+		if (mapped)
+		{
+			munmap(const_cast<uint8_t*>(bytes), length);
+		}
+#endif
+		bytes = nullptr;
+		length = 0;
+		mapped = false;
+		buffer.clear();
+		buffer.shrink_to_fit();
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Utility
+{
+	// A whole file, read only, mapped into memory where the platform can
+	// (mmap), otherwise read into a buffer. Pages are only read as they are
+	// touched, so opening a large file costs next to nothing.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// false if the file cannot be opened; an empty file maps to size() 0
+		bool open(const std::string& path);
+
+		void close();
+
+		const uint8_t* data() const { return bytes; }
+
+		size_t size() const { return length; }
+
+		// true if the data is a mapping rather than a copy
+		bool isMapped() const { return mapped; }
+	private:
+		const uint8_t* bytes = nullptr;
+		size_t length = 0;
+		bool mapped = false;
+		std::vector<uint8_t> buffer;
+	};
+}
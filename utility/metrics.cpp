@@ -0,0 +1,261 @@
+#include "metrics.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	// folds a thread's shard into the retired totals when the thread exits
+	struct ShardOwner
+	{
+		Metrics::Shard* shard = nullptr;
+
+		~ShardOwner()
+		{
+			if (shard != nullptr)
+			{
+				Metrics::currentShard = nullptr;
+				Metrics::registry().detach(shard);
+			}
+		}
+	};
+
+	thread_local ShardOwner shardOwner;
+}
+
+namespace Metrics
+{
+	thread_local Shard* currentShard = nullptr;
+
+	std::atomic<int64_t> unregisteredGauge{ 0 };
+
+	uint64_t histogramBucketUpperBound(unsigned bucket)
+	{
+		if (bucket < HISTOGRAM_SUB_BUCKETS)
+		{
+			return bucket + 1;
+		}
+		if (bucket >= HISTOGRAM_BUCKETS - 1)
+		{
+			return UINT64_MAX;
+		}
+		const unsigned exponent = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+		const uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+		return (uint64_t(1) << exponent) + ((sub + 1) << (exponent - HISTOGRAM_SUB_BITS));
+	}
+
+	Shard* attachShard()
+	{
+		Shard* shard = registry().attach();
+		currentShard = shard;
+		shardOwner.shard = shard;
+		return shard;
+	}
+
+	uint64_t Counter::value() const
+	{
+		uint64_t total;
+		registry().sumSlots(slot, 1, &total);
+		return total;
+	}
+
+	uint64_t HistogramSnapshot::quantile(double q) const
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+		const uint64_t rank = static_cast<uint64_t>(q * (count - 1)) + 1;
+		uint64_t seen = 0;
+		for (unsigned i = 0; i < buckets.size(); i++)
+		{
+			seen += buckets[i];
+			if (seen >= rank)
+			{
+				return histogramBucketUpperBound(i) - 1;
+			}
+		}
+		return histogramBucketUpperBound(HISTOGRAM_BUCKETS - 1);
+	}
+
+	void HistogramSnapshot::subtract(const HistogramSnapshot& earlier)
+	{
+		for (size_t i = 0; i < buckets.size() && i < earlier.buckets.size(); i++)
+		{
+			buckets[i] -= earlier.buckets[i];
+		}
+		count -= earlier.count;
+		sum -= earlier.sum;
+	}
+
+	HistogramSnapshot Histogram::snapshot() const
+	{
+		HistogramSnapshot result;
+		std::vector<uint64_t> raw(HISTOGRAM_BUCKETS + 2);
+		registry().sumSlots(firstSlot, HISTOGRAM_BUCKETS + 2, raw.data());
+		result.buckets.assign(raw.begin(), raw.begin() + HISTOGRAM_BUCKETS);
+		result.sum = raw[HISTOGRAM_BUCKETS];
+		result.count = raw[HISTOGRAM_BUCKETS + 1];
+		return result;
+	}
+
+	Registry::Registry() : retired(MAX_SLOTS, 0)
+	{
+
+	}
+
+	const MetricInfo* Registry::find(const std::string& name, const std::string& labels, MetricKind kind) const
+	{
+		for (const auto& metric : metrics)
+		{
+			if (metric->name == name && metric->labels == labels)
+			{
+				if (metric->kind != kind)
+				{
+					PLATFORM_LOG_ERROR(General, "metric %s registered with two different kinds\n", name.c_str());
+				}
+				return metric.get();
+			}
+		}
+		return nullptr;
+	}
+
+	uint32_t Registry::reserveSlots(const std::string& name, uint32_t count)
+	{
+		if (nextSlot + count > MAX_SLOTS)
+		{
+			// recording still works, it just lands in the shared overflow slot
+			PLATFORM_LOG_ERROR(General, "out of metric slots registering %s\n", name.c_str());
+			return 0;
+		}
+		const uint32_t first = nextSlot;
+		nextSlot += count;
+		return first;
+	}
+
+	Counter Registry::counter(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (const MetricInfo* existing = find(name, labels, MetricKind::Counter))
+		{
+			return Counter(existing->slot);
+		}
+		const uint32_t slot = reserveSlots(name, 1);
+		metrics.emplace_back(new MetricInfo{ name, help, labels, MetricKind::Counter, slot });
+		return Counter(slot);
+	}
+
+	Gauge Registry::gauge(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (const MetricInfo* existing = find(name, labels, MetricKind::Gauge))
+		{
+			return Gauge(gauges[existing->slot].get());
+		}
+		const uint32_t index = static_cast<uint32_t>(gauges.size());
+		gauges.emplace_back(new std::atomic<int64_t>(0));
+		metrics.emplace_back(new MetricInfo{ name, help, labels, MetricKind::Gauge, index });
+		return Gauge(gauges.back().get());
+	}
+
+	Histogram Registry::histogram(const std::string& name, const std::string& help, const std::string& labels)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (const MetricInfo* existing = find(name, labels, MetricKind::Histogram))
+		{
+			return Histogram(existing->slot);
+		}
+		uint32_t slot = reserveSlots(name, HISTOGRAM_BUCKETS + 2);
+		metrics.emplace_back(new MetricInfo{ name, help, labels, MetricKind::Histogram, slot });
+		return Histogram(slot);
+	}
+
+	void Registry::sumSlotsLocked(uint32_t first, uint32_t count, uint64_t* out) const
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			out[i] = retired[first + i];
+		}
+		for (const Shard* shard : shards)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				out[i] += shard->slots[first + i].load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void Registry::sumSlots(uint32_t first, uint32_t count, uint64_t* out) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		sumSlotsLocked(first, count, out);
+	}
+
+	std::vector<MetricSample> Registry::collect() const
+	{
+		std::vector<MetricSample> samples;
+		collect(samples);
+		return samples;
+	}
+
+	void Registry::collect(std::vector<MetricSample>& out) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		out.resize(metrics.size());
+		uint64_t raw[HISTOGRAM_BUCKETS + 2];
+		for (size_t i = 0; i < metrics.size(); i++)
+		{
+			const MetricInfo& info = *metrics[i];
+			MetricSample& sample = out[i];
+			sample.info = &info;
+			switch (info.kind)
+			{
+			case MetricKind::Counter:
+				sumSlotsLocked(info.slot, 1, &sample.counter);
+				break;
+			case MetricKind::Gauge:
+				sample.gauge = gauges[info.slot]->load(std::memory_order_relaxed);
+				break;
+			case MetricKind::Histogram:
+				sumSlotsLocked(info.slot, HISTOGRAM_BUCKETS + 2, raw);
+				sample.histogram.buckets.assign(raw, raw + HISTOGRAM_BUCKETS);
+				sample.histogram.sum = raw[HISTOGRAM_BUCKETS];
+				sample.histogram.count = raw[HISTOGRAM_BUCKETS + 1];
+				break;
+			}
+		}
+	}
+
+	Shard* Registry::attach()
+	{
+		Shard* shard = new Shard();
+		for (auto& slot : shard->slots)
+		{
+			slot.store(0, std::memory_order_relaxed);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		shards.push_back(shard);
+		return shard;
+	}
+
+	void Registry::detach(Shard* shard)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < MAX_SLOTS; i++)
+			{
+				retired[i] += shard->slots[i].load(std::memory_order_relaxed);
+			}
+			shards.erase(std::remove(shards.begin(), shards.end(), shard), shards.end());
+		}
+		delete shard;
+	}
+
+	Registry& registry()
+	{
+		// leaked on purpose so threads exiting during static destruction can
+		// still fold their shards into it
+		static Registry* instance = new Registry();
+		return *instance;
+	}
+}
@@ -0,0 +1,253 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide metrics. Counters and histograms are sharded per thread: each
+// thread that records gets its own flat array of slots, written with plain
+// relaxed load/store (no locked instructions, no sharing of cache lines with
+// other writers), and readers sum the shards on demand. Gauges are a single
+// atomic since they are set as well as added to.
+
+namespace Metrics
+{
+	enum class MetricKind : uint8_t
+	{
+		Counter,
+		Gauge,
+		Histogram,
+	};
+
+	// Log-linear histogram buckets: values below 2^HISTOGRAM_SUB_BITS get a
+	// bucket each, every power of two above that is split into
+	// 2^HISTOGRAM_SUB_BITS linear sub-buckets (about 19% worst case relative
+	// error). Values of 2^HISTOGRAM_MAX_EXPONENT and above share the last bucket.
+	constexpr unsigned HISTOGRAM_SUB_BITS = 2;
+	constexpr unsigned HISTOGRAM_SUB_BUCKETS = 1u << HISTOGRAM_SUB_BITS;
+	constexpr unsigned HISTOGRAM_MAX_EXPONENT = 36; // ~68 s when recording nanoseconds
+	constexpr unsigned HISTOGRAM_BUCKETS = (HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+	// slots per thread shard; one per counter, HISTOGRAM_BUCKETS + 2 per histogram
+	constexpr size_t MAX_SLOTS = 8192;
+
+	inline unsigned histogramBucket(uint64_t value)
+	{
+		if (value < HISTOGRAM_SUB_BUCKETS)
+		{
+			return static_cast<unsigned>(value);
+		}
+#if defined(__GNUC__) || defined(__clang__)
+		const unsigned exponent = 63 - __builtin_clzll(value);
+#else
+		unsigned exponent = 0;
+		for (uint64_t v = value; v > 1; v >>= 1)
+		{
+			exponent++;
+		}
+#endif
+		if (exponent >= HISTOGRAM_MAX_EXPONENT)
+		{
+			return HISTOGRAM_BUCKETS - 1;
+		}
+		const unsigned sub = static_cast<unsigned>(value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+		return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+	}
+
+	// smallest value that lands in the bucket after this one
+	uint64_t histogramBucketUpperBound(unsigned bucket);
+
+	struct Shard
+	{
+		std::atomic<uint64_t> slots[MAX_SLOTS];
+	};
+
+	extern thread_local Shard* currentShard;
+
+	Shard* attachShard();
+
+	inline Shard& localShard()
+	{
+		Shard* shard = currentShard;
+		return shard != nullptr ? *shard : *attachShard();
+	}
+
+	// only the owning thread writes its shard, so a relaxed load/store pair is
+	// enough and avoids a locked read-modify-write
+	inline void shardAdd(Shard& shard, uint32_t slot, uint64_t n)
+	{
+		std::atomic<uint64_t>& cell = shard.slots[slot];
+		cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	class Counter
+	{
+	public:
+		Counter() = default;
+
+		void inc(uint64_t n = 1) const
+		{
+			shardAdd(localShard(), slot, n);
+		}
+
+		uint64_t value() const;
+
+	private:
+		friend class Registry;
+		explicit Counter(uint32_t slot) : slot(slot) {}
+
+		uint32_t slot = 0;
+	};
+
+	// target of default-constructed gauges
+	extern std::atomic<int64_t> unregisteredGauge;
+
+	class Gauge
+	{
+	public:
+		Gauge() = default;
+
+		void set(int64_t v) const { cell->store(v, std::memory_order_relaxed); }
+		void add(int64_t n = 1) const { cell->fetch_add(n, std::memory_order_relaxed); }
+		void sub(int64_t n = 1) const { cell->fetch_sub(n, std::memory_order_relaxed); }
+		int64_t value() const { return cell->load(std::memory_order_relaxed); }
+
+	private:
+		friend class Registry;
+		explicit Gauge(std::atomic<int64_t>* cell) : cell(cell) {}
+
+		std::atomic<int64_t>* cell = &unregisteredGauge;
+	};
+
+	struct HistogramSnapshot
+	{
+		std::vector<uint64_t> buckets; // HISTOGRAM_BUCKETS entries, not cumulative
+		uint64_t count = 0;
+		uint64_t sum = 0;
+
+		// value at quantile q (0..1), reported as the upper bound of its bucket
+		uint64_t quantile(double q) const;
+
+		// removes an earlier snapshot of the same histogram, leaving what was
+		// recorded in between
+		void subtract(const HistogramSnapshot& earlier);
+	};
+
+	class Histogram
+	{
+	public:
+		Histogram() = default;
+
+		void record(uint64_t value) const
+		{
+			Shard& shard = localShard();
+			shardAdd(shard, firstSlot + histogramBucket(value), 1);
+			shardAdd(shard, firstSlot + HISTOGRAM_BUCKETS, value);
+			shardAdd(shard, firstSlot + HISTOGRAM_BUCKETS + 1, 1);
+		}
+
+		HistogramSnapshot snapshot() const;
+
+	private:
+		friend class Registry;
+		explicit Histogram(uint32_t firstSlot) : firstSlot(firstSlot) {}
+
+		uint32_t firstSlot = 0;
+	};
+
+	// records the lifetime of the scope, in nanoseconds, into a histogram
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(const Histogram& histogram) :
+			histogram(histogram), start(std::chrono::steady_clock::now())
+		{
+
+		}
+
+		~ScopedTimer()
+		{
+			histogram.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count()));
+		}
+
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	private:
+		const Histogram& histogram;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	struct MetricInfo
+	{
+		std::string name;
+		std::string help;
+		// preformatted label set without braces, e.g. type="ping"; may be empty
+		std::string labels;
+		MetricKind kind;
+		uint32_t slot; // first shard slot, or gauge index
+	};
+
+	struct MetricSample
+	{
+		const MetricInfo* info;
+		uint64_t counter = 0;
+		int64_t gauge = 0;
+		HistogramSnapshot histogram;
+	};
+
+	class Registry
+	{
+	public:
+		Registry();
+
+		Registry(const Registry&) = delete;
+		Registry& operator=(const Registry&) = delete;
+
+		// Registering the same name and labels twice returns the same metric.
+		// Registration takes a lock and is meant for startup, not hot paths.
+		Counter counter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+		Gauge gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+
+		Histogram histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+		// merged view of every metric in registration order
+		std::vector<MetricSample> collect() const;
+
+		// same, reusing out's storage so repeated collection does not allocate
+		void collect(std::vector<MetricSample>& out) const;
+
+		// totals of count consecutive slots across all shards, written to out
+		void sumSlots(uint32_t first, uint32_t count, uint64_t* out) const;
+
+		Shard* attach();
+
+		void detach(Shard* shard);
+
+	private:
+		// metrics are never removed, so handles can keep raw pointers into these
+		std::vector<std::unique_ptr<MetricInfo>> metrics;
+		std::vector<std::unique_ptr<std::atomic<int64_t>>> gauges;
+		uint32_t nextSlot = 1; // slot 0 absorbs default-constructed handles
+		std::vector<Shard*> shards;
+		// totals of threads that have exited
+		std::vector<uint64_t> retired;
+		mutable std::mutex mutex;
+
+		const MetricInfo* find(const std::string& name, const std::string& labels, MetricKind kind) const;
+
+		uint32_t reserveSlots(const std::string& name, uint32_t count);
+
+		void sumSlotsLocked(uint32_t first, uint32_t count, uint64_t* out) const;
+	};
+
+	Registry& registry();
+}
@@ -0,0 +1,195 @@
+#include "metrics_exporter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// writes the decimal digits of value to out (at least 20 bytes), returns the length
+	size_t formatUnsigned(char* out, uint64_t value)
+	{
+		char digits[20];
+		size_t count = 0;
+		do
+		{
+			digits[count++] = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value != 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = digits[count - 1 - i];
+		}
+		return count;
+	}
+
+	void appendUnsigned(std::string& out, uint64_t value)
+	{
+		char digits[20];
+		out.append(digits, formatUnsigned(digits, value));
+	}
+
+	void appendSigned(std::string& out, int64_t value)
+	{
+		if (value < 0)
+		{
+			out.push_back('-');
+			appendUnsigned(out, 0 - static_cast<uint64_t>(value));
+		}
+		else
+		{
+			appendUnsigned(out, static_cast<uint64_t>(value));
+		}
+	}
+
+	// name{labels} or name{labels,extra}, or just name when both are empty
+	void appendSeries(std::string& out, const std::string& name, const char* suffix,
+	                  const std::string& labels, const char* extra = nullptr)
+	{
+		out += name;
+		out += suffix;
+		const bool hasExtra = extra != nullptr;
+		if (!labels.empty() || hasExtra)
+		{
+			out.push_back('{');
+			out += labels;
+			if (hasExtra)
+			{
+				if (!labels.empty())
+				{
+					out.push_back(',');
+				}
+				out += extra;
+			}
+			out.push_back('}');
+		}
+		out.push_back(' ');
+	}
+
+	const char* kindName(Metrics::MetricKind kind)
+	{
+		switch (kind)
+		{
+		case Metrics::MetricKind::Counter:
+			return "counter";
+		case Metrics::MetricKind::Gauge:
+			return "gauge";
+		case Metrics::MetricKind::Histogram:
+			return "histogram";
+		}
+		return "untyped";
+	}
+}
+
+namespace Metrics
+{
+	PrometheusRenderer::PrometheusRenderer(const Registry& registry) : source(registry)
+	{
+
+	}
+
+	const std::string& PrometheusRenderer::render()
+	{
+		source.collect(samples);
+
+		// registration order interleaves families (e.g. per-type counters and
+		// histograms registered in one loop); sorting by name, then by
+		// registration order, groups them while keeping label order
+		order.resize(samples.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [this](size_t a, size_t b)
+		{
+			const int byName = samples[a].info->name.compare(samples[b].info->name);
+			return byName != 0 ? byName < 0 : a < b;
+		});
+
+		const size_t previousSize = page.size();
+		page.clear();
+		page.reserve(previousSize + previousSize / 4);
+
+		const std::string* family = nullptr;
+		for (size_t index : order)
+		{
+			const MetricSample& sample = samples[index];
+			const MetricInfo& info = *sample.info;
+			if (family == nullptr || *family != info.name)
+			{
+				family = &info.name;
+				page += "# HELP ";
+				page += info.name;
+				page.push_back(' ');
+				page += info.help;
+				page += "\n# TYPE ";
+				page += info.name;
+				page.push_back(' ');
+				page += kindName(info.kind);
+				page.push_back('\n');
+			}
+
+			switch (info.kind)
+			{
+			case MetricKind::Counter:
+				appendSeries(page, info.name, "", info.labels);
+				appendUnsigned(page, sample.counter);
+				page.push_back('\n');
+				break;
+			case MetricKind::Gauge:
+				appendSeries(page, info.name, "", info.labels);
+				appendSigned(page, sample.gauge);
+				page.push_back('\n');
+				break;
+			case MetricKind::Histogram:
+				renderHistogram(sample);
+				break;
+			}
+		}
+		return page;
+	}
+
+	void PrometheusRenderer::renderHistogram(const MetricSample& sample)
+	{
+		const MetricInfo& info = *sample.info;
+		const HistogramSnapshot& histogram = sample.histogram;
+
+		// one bucket line per power of two keeps a page small; the sub-buckets
+		// are folded into the cumulative count. The set of bounds never changes
+		// between scrapes, which histogram_quantile relies on.
+		char le[32];
+		uint64_t cumulative = 0;
+		for (unsigned i = 0; i + 1 < histogram.buckets.size(); i++)
+		{
+			cumulative += histogram.buckets[i];
+			const bool octaveEnd = i < HISTOGRAM_SUB_BUCKETS || (i % HISTOGRAM_SUB_BUCKETS) == HISTOGRAM_SUB_BUCKETS - 1;
+			if (!octaveEnd)
+			{
+				continue;
+			}
+
+			// le is inclusive and buckets are half-open, so the bound is one less
+			// than the next bucket's start
+			memcpy(le, "le=\"", 4);
+			size_t length = 4 + formatUnsigned(le + 4, histogramBucketUpperBound(i) - 1);
+			le[length++] = '"';
+			le[length] = '\0';
+
+			appendSeries(page, info.name, "_bucket", info.labels, le);
+			appendUnsigned(page, cumulative);
+			page.push_back('\n');
+		}
+
+		// +Inf and _count come from the buckets too: the separate count slot is
+		// merged at a different moment and can disagree with them
+		const uint64_t total = cumulative + (histogram.buckets.empty() ? 0 : histogram.buckets.back());
+		appendSeries(page, info.name, "_bucket", info.labels, "le=\"+Inf\"");
+		appendUnsigned(page, total);
+		page.push_back('\n');
+		appendSeries(page, info.name, "_sum", info.labels);
+		appendUnsigned(page, histogram.sum);
+		page.push_back('\n');
+		appendSeries(page, info.name, "_count", info.labels);
+		appendUnsigned(page, total);
+		page.push_back('\n');
+	}
+}
@@ -0,0 +1,32 @@
+
+#pragma once
+
+#include "metrics.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Metrics
+{
+	// Renders a registry in the Prometheus text exposition format (0.0.4).
+	// The renderer keeps its sample and output buffers between calls and
+	// reserves the output for the largest page seen so far, so steady-state
+	// scrapes neither allocate nor reformat through printf.
+	class PrometheusRenderer
+	{
+	public:
+		explicit PrometheusRenderer(const Registry& registry = Metrics::registry());
+
+		// the returned page stays valid until the next call
+		const std::string& render();
+
+	private:
+		const Registry& source;
+		std::vector<MetricSample> samples;
+		// sample indices grouped by metric name, each family rendered once
+		std::vector<size_t> order;
+		std::string page;
+
+		void renderHistogram(const MetricSample& sample);
+	};
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+
+namespace Utility
+{
+	// Intrusive lock-free multi-producer single-consumer queue (Vyukov's).
+	// Node needs a std::atomic<Node*> queueNext member and a default
+	// constructor (one node is kept as a stub). push is one atomic exchange
+	// from any thread; pop and empty are for the single consumer only.
+	template<typename Node>
+	class MpscQueue
+	{
+	public:
+		MpscQueue() : head(&stub), tail(&stub)
+		{
+			stub.queueNext.store(nullptr, std::memory_order_relaxed);
+		}
+
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		void push(Node* node)
+		{
+			node->queueNext.store(nullptr, std::memory_order_relaxed);
+			Node* previous = head.exchange(node, std::memory_order_seq_cst);
+			previous->queueNext.store(node, std::memory_order_release);
+		}
+
+		// nullptr if empty, or if the only node is still being linked in by
+		// a producer (empty() is false then, so try again)
+		Node* pop()
+		{
+			Node* first = tail;
+			Node* next = first->queueNext.load(std::memory_order_acquire);
+			if (first == &stub)
+			{
+				if (next == nullptr)
+				{
+					return nullptr;
+				}
+				tail = next;
+				first = next;
+				next = next->queueNext.load(std::memory_order_acquire);
+			}
+			if (next != nullptr)
+			{
+				tail = next;
+				return first;
+			}
+			if (first != head.load(std::memory_order_acquire))
+			{
+				return nullptr;
+			}
+			// first is the last node: put the stub behind it so it can go
+			push(&stub);
+			next = first->queueNext.load(std::memory_order_acquire);
+			if (next != nullptr)
+			{
+				tail = next;
+				return first;
+			}
+			return nullptr;
+		}
+
+		bool empty() const
+		{
+			return tail == &stub && head.load(std::memory_order_seq_cst) == &stub;
+		}
+	private:
+		// producers hit head and the consumer tail: padding keeps them off
+		// one cache line (padding rather than alignas, so queues can be new'd
+		// without C++17 aligned new)
+		std::atomic<Node*> head;
+		char padding[64 - sizeof(std::atomic<Node*>)];
+		Node* tail;
+		Node stub;
+	};
+}
@@ -1,15 +1,45 @@
 
 #include "platform.hpp"
+#include <chrono>
+#include <string>
 #include <thread>
 #include <csignal>
 
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(PLATFORM_MSVC)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+	#include <io.h>
+#elif !defined(PLATFORM_DKP)
+	#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+	#include <linux/futex.h>
+	#include <sys/syscall.h>
+#endif
+
 #ifdef PLATFORM_DKP
+	#include "log_console.hpp"
 	#include <whb/proc.h>
 	#include <whb/log.h>
 	#include <whb/log_console.h>
-	#define PRINTF_BUFFER_LENGTH 2048
+
+	// PLATFORM_LOG_CONSOLE_IMMEDIATE restores the old redraw-per-line behavior
+	#ifdef PLATFORM_LOG_CONSOLE_IMMEDIATE
+		#define PLATFORM_LOG_CONSOLE_MODE Utility::LogConsoleMode::Immediate
+	#else
+		#define PLATFORM_LOG_CONSOLE_MODE Utility::LogConsoleMode::Batched
+	#endif
+
+	static Utility::LogConsole logConsole;
 #endif 
 
+#define PRINTF_BUFFER_LENGTH 2048
+
 static bool _platformIsRunning = true;
 
 static void sigHandler(int signal)
@@ -30,19 +60,44 @@ namespace Utility
 {
 	void platformLog(const char* f, ...)
 	{
-#ifdef PLATFORM_DKP
-		char buf[PRINTF_BUFFER_LENGTH];
-#endif
 		va_list args;
 		va_start(args, f);
+		platformLogV(nullptr, f, args);
+		va_end(args);
+	}
+
+	void platformLogV(const char* prefix, const char* f, va_list args)
+	{
+		char buf[PRINTF_BUFFER_LENGTH];
+		int offset = 0;
+		if (prefix != nullptr)
+		{
+			offset = snprintf(buf, PRINTF_BUFFER_LENGTH, "%s", prefix);
+			if (offset < 0 || offset >= PRINTF_BUFFER_LENGTH)
+			{
+				offset = 0;
+			}
+		}
+		va_list retry;
+		va_copy(retry, args);
+		const int length = vsnprintf(buf + offset, PRINTF_BUFFER_LENGTH - offset, f, args);
+		const char* line = buf;
+		std::string longLine;
+		if (length >= PRINTF_BUFFER_LENGTH - offset)
+		{
+			// too long for the stack buffer: formatted again on the heap rather than cut
+			longLine.assign(buf, offset);
+			longLine.resize(offset + length + 1);
+			vsnprintf(&longLine[offset], length + 1, f, retry);
+			longLine.resize(offset + length);
+			line = longLine.c_str();
+		}
+		va_end(retry);
 #ifdef PLATFORM_DKP
-		vsnprintf(buf, PRINTF_BUFFER_LENGTH - 1, f, args);
-		WHBLogWrite(buf);
-		WHBLogConsoleDraw();
+		logConsole.write(line);
 #else
-		vprintf(f, args);
+		fputs(line, stdout);
 #endif
-		va_end(args);
 	}
 
 	bool platformInit()
@@ -50,6 +105,7 @@ namespace Utility
 #ifdef PLATFORM_DKP
 		WHBProcInit();
 		WHBLogConsoleInit();
+		logConsole.start(PLATFORM_LOG_CONSOLE_MODE);
 #else
 		signal(SIGINT, sigHandler);
 #ifdef SIGBREAK
@@ -68,19 +124,102 @@ namespace Utility
 #endif
 	}
 
-	void waitForPlatformStop()
+	void waitForPlatformStop(void (*onIdle)())
 	{
 		while (platformIsRunning())
 		{
 			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (onIdle != nullptr)
+			{
+				onIdle();
+			}
 		}
 	}
 
 	void platformShutdown()
 	{
 #ifdef PLATFORM_DKP
+		logConsole.stop();
 		WHBLogConsoleFree();
 		WHBProcShutdown();
 #endif
 	}
-}
\ No newline at end of file
+
+	bool syncFile(std::FILE* file)
+	{
+		if (std::fflush(file) != 0)
+		{
+			return false;
+		}
+#if defined(PLATFORM_DKP)
+		return true;
+#elif defined(PLATFORM_MSVC)
+		return _commit(_fileno(file)) == 0;
+#elif defined(__linux__)
+		return fdatasync(fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+
+	bool replaceFile(const char* from, const char* to)
+	{
+#if defined(PLATFORM_MSVC)
+		return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		return std::rename(from, to) == 0;
+#endif
+	}
+
+	static bool stampFrom(const struct stat& info, FileStamp& out)
+	{
+		if ((info.st_mode & S_IFMT) != S_IFREG)
+		{
+			return false;
+		}
+		out.size = static_cast<uint64_t>(info.st_size);
+#if defined(__linux__)
+		out.modifiedNs = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+		out.modifiedNs = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+		out.modifiedNs = static_cast<int64_t>(info.st_mtime) * 1000000000;
+#endif
+		out.inode = static_cast<uint64_t>(info.st_ino);
+		return true;
+	}
+
+	bool stampFile(const char* path, FileStamp& out)
+	{
+		struct stat info;
+		return stat(path, &info) == 0 && stampFrom(info, out);
+	}
+
+	bool stampFile(int descriptor, FileStamp& out)
+	{
+		struct stat info;
+		return fstat(descriptor, &info) == 0 && stampFrom(info, out);
+	}
+
+	void waitOnWord(std::atomic<uint32_t>& word, uint32_t expected)
+	{
+#if defined(__linux__)
+		static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+		if (word.load(std::memory_order_acquire) == expected)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+#endif
+	}
+
+	void wakeWord(std::atomic<uint32_t>& word)
+	{
+#if defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+		(void)word;
+#endif
+	}
+}
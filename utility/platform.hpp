@@ -1,7 +1,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 
 #ifdef _MSC_VER
@@ -24,11 +26,53 @@ namespace Utility
 {
 	void platformLog(const char* f, ...);
 
+	// prefix may be null; it is written in front of the formatted line as one write
+	void platformLogV(const char* prefix, const char* f, va_list args);
+
 	bool platformInit();
 
 	bool platformIsRunning();
 
-	void waitForPlatformStop();
+	// onIdle, if given, runs on the waiting thread about every 100 ms
+	void waitForPlatformStop(void (*onIdle)() = nullptr);
 
 	void platformShutdown();
+
+	// flushes file and asks the OS to put its data on disk; on the console
+	// there is nothing past the flush
+	bool syncFile(std::FILE* file);
+
+	// renames from over to, replacing to if it exists (which std::rename
+	// refuses on Windows)
+	bool replaceFile(const char* from, const char* to);
+
+	// What tells one version of a file from another without reading it: its
+	// size, modification time (to the nanosecond where the OS keeps one) and
+	// inode.
+	struct FileStamp
+	{
+		uint64_t size;
+		int64_t modifiedNs;
+		uint64_t inode;
+
+		bool operator==(const FileStamp& other) const
+		{
+			return size == other.size && modifiedNs == other.modifiedNs && inode == other.inode;
+		}
+
+		bool operator!=(const FileStamp& other) const { return !(*this == other); }
+	};
+
+	// false if path cannot be looked at or is not a regular file
+	bool stampFile(const char* path, FileStamp& out);
+
+	// the same for an open descriptor
+	bool stampFile(int descriptor, FileStamp& out);
+
+	// blocks while word holds expected; may return early. A futex on Linux,
+	// a short sleep elsewhere
+	void waitOnWord(std::atomic<uint32_t>& word, uint32_t expected);
+
+	// wakes every thread in waitOnWord on word
+	void wakeWord(std::atomic<uint32_t>& word);
 }
@@ -1,5 +1,17 @@
 #include "platform_socket.hpp"
 
+#ifndef PLATFORM_MSVC
+	#include <netinet/tcp.h>
+	#include <sys/socket.h>
+	#include <fcntl.h>
+	#include <errno.h>
+	#include <signal.h>
+#endif
+#ifdef __linux__
+	#include <linux/sockios.h>
+	#include <sys/ioctl.h>
+#endif
+
 namespace Utility
 {
 	bool netInit()
@@ -22,6 +34,9 @@ namespace Utility
 		}
 		return true;
 #else
+		// sendfile() has no MSG_NOSIGNAL, and a peer that went away should
+		// still be a send error
+		signal(SIGPIPE, SIG_IGN);
 		return true;
 #endif
 	}
@@ -43,4 +58,71 @@ namespace Utility
 		return sock < 0;
 #endif
 	}
-}
\ No newline at end of file
+
+	bool setSocketNonBlocking(SocketType sock)
+	{
+#ifdef PLATFORM_MSVC
+		u_long nonBlocking = 1;
+		return ioctlsocket(sock, FIONBIO, &nonBlocking) == 0;
+#else
+		int flags = fcntl(sock, F_GETFL, 0);
+		if (flags < 0)
+		{
+			return false;
+		}
+		return fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+	}
+
+	bool setSocketNoDelay(SocketType sock)
+	{
+		int enable = 1;
+		return setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable)) == 0;
+	}
+
+	bool setSocketReuseAddress(SocketType sock)
+	{
+		int enable = 1;
+		return setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable)) == 0;
+	}
+
+	bool setSocketSendLowWater(SocketType sock, int bytes)
+	{
+#if defined(__linux__) && defined(TCP_NOTSENT_LOWAT)
+		return setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(bytes)) == 0;
+#else
+		(void)sock;
+		(void)bytes;
+		return false;
+#endif
+	}
+
+	size_t socketUnsentBytes(SocketType sock)
+	{
+#ifdef __linux__
+		int unsent = 0;
+		return ioctl(sock, SIOCOUTQNSD, &unsent) == 0 && unsent > 0 ? static_cast<size_t>(unsent) : 0;
+#else
+		(void)sock;
+		return 0;
+#endif
+	}
+
+	int lastSocketError()
+	{
+#ifdef PLATFORM_MSVC
+		return WSAGetLastError();
+#else
+		return errno;
+#endif
+	}
+
+	bool socketWouldBlock()
+	{
+#ifdef PLATFORM_MSVC
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+	}
+}
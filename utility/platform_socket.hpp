@@ -10,12 +10,19 @@
 	#define SocketType SOCKET
   #define SOCK_POLL WSAPoll
 	#define SOCK_CLOSE closesocket
+	#define SOCK_SEND_FLAGS 0
 #else
 	#include <netinet/in.h>
 	#define SocketType int
 	#define SOCK_POLL poll
 	#define SOCK_CLOSE close
 	#define INVALID_SOCKET -1
+	#ifdef MSG_NOSIGNAL
+		// a peer that went away should be a send error, not SIGPIPE
+		#define SOCK_SEND_FLAGS MSG_NOSIGNAL
+	#else
+		#define SOCK_SEND_FLAGS 0
+	#endif
 #endif
 
 #if defined(PLATFORM_DKP)
@@ -29,4 +36,25 @@ namespace Utility
 	void netShutdown();
 
 	bool isSocketInvalid(SocketType sock);
+
+	bool setSocketNonBlocking(SocketType sock);
+
+	// disables Nagle so small frames go out immediately
+	bool setSocketNoDelay(SocketType sock);
+
+	bool setSocketReuseAddress(SocketType sock);
+
+	// poll only reports the socket writable once fewer than bytes of what
+	// was sent are still waiting in it to go out; false where unsupported
+	bool setSocketSendLowWater(SocketType sock, int bytes);
+
+	// bytes sent on the socket that are still waiting in it to go out; 0
+	// where that cannot be asked
+	size_t socketUnsentBytes(SocketType sock);
+
+	// error code of the last failed socket call
+	int lastSocketError();
+
+	// true if the last failed call only means "try again once poll says so"
+	bool socketWouldBlock();
 }
\ No newline at end of file
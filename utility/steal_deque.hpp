@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Utility
+{
+	// Lock-free work-stealing deque of pointers (Chase-Lev, with the C11
+	// orderings from Le et al. 2013). Only the owning thread pushes; any
+	// thread, the owner included, takes from the top, so items come out in
+	// the order they went in. The ring doubles when full; old rings are kept
+	// until the deque is destroyed since a thief may still be reading one.
+	template<typename T>
+	class StealDeque
+	{
+	public:
+		explicit StealDeque(size_t initialCapacity = 64) : top(0), bottom(0)
+		{
+			size_t capacity = 1;
+			while (capacity < initialCapacity)
+			{
+				capacity <<= 1;
+			}
+			rings.emplace_back(new Ring(capacity));
+			ring.store(rings.back().get(), std::memory_order_relaxed);
+		}
+
+		StealDeque(const StealDeque&) = delete;
+		StealDeque& operator=(const StealDeque&) = delete;
+
+		// owner only
+		void push(T* item)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed);
+			const int64_t t = top.load(std::memory_order_acquire);
+			Ring* current = ring.load(std::memory_order_relaxed);
+			if (b - t > static_cast<int64_t>(current->mask))
+			{
+				current = grow(current, t, b);
+			}
+			current->slot(b).store(item, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		// the oldest item, or nullptr if empty or another taker won the race
+		// for it (check empty() to tell the two apart)
+		T* steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b)
+			{
+				return nullptr;
+			}
+			T* item = ring.load(std::memory_order_acquire)->slot(t).load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				return nullptr;
+			}
+			return item;
+		}
+
+		bool empty() const
+		{
+			const int64_t t = top.load(std::memory_order_seq_cst);
+			return bottom.load(std::memory_order_seq_cst) <= t;
+		}
+	private:
+		struct Ring
+		{
+			explicit Ring(size_t capacity) : mask(capacity - 1), slots(new std::atomic<T*>[capacity]) {}
+
+			std::atomic<T*>& slot(int64_t index) { return slots[static_cast<size_t>(index) & mask]; }
+
+			size_t mask;
+			std::unique_ptr<std::atomic<T*>[]> slots;
+		};
+
+		// thieves hit top and the owner bottom: keep them off one cache line
+		std::atomic<int64_t> top;
+		char padding[64 - sizeof(std::atomic<int64_t>)];
+		std::atomic<int64_t> bottom;
+		std::atomic<Ring*> ring;
+		// owner only
+		std::vector<std::unique_ptr<Ring>> rings;
+
+		Ring* grow(Ring* old, int64_t t, int64_t b)
+		{
+			rings.emplace_back(new Ring((old->mask + 1) * 2));
+			Ring* bigger = rings.back().get();
+			for (int64_t i = t; i < b; i++)
+			{
+				bigger->slot(i).store(old->slot(i).load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+			ring.store(bigger, std::memory_order_release);
+			return bigger;
+		}
+	};
+}
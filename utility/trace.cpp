@@ -0,0 +1,216 @@
+#include "trace.hpp"
+#include "log.hpp"
+
+#include <csignal>
+
+#ifdef WWHD_TRACING
+	#include "../json.hpp"
+
+	#include <fstream>
+	#include <memory>
+	#include <mutex>
+	#include <vector>
+#endif
+
+namespace
+{
+	const char* const SPAN_NAMES[] = { "accept", "read", "decode", "handle", "encode", "enqueue", "flush" };
+
+	static_assert(sizeof(SPAN_NAMES) / sizeof(SPAN_NAMES[0]) == static_cast<size_t>(Trace::Span::Count),
+		"every Span needs a name");
+
+	volatile std::sig_atomic_t dumpRequested = 0;
+	std::string dumpPath;
+
+	void dumpSignalHandler(int)
+	{
+		dumpRequested = 1;
+	}
+
+#ifdef WWHD_TRACING
+	constexpr size_t EVENTS_PER_THREAD = 16384; // power of two
+
+	struct Event
+	{
+		uint64_t start;
+		uint32_t duration;
+		uint32_t id;
+		uint32_t arg;
+		Trace::Span span;
+	};
+
+	// Single writer ring. The writer fills a slot and then publishes the new
+	// head; a reader copies the newest slots and drops any the writer may have
+	// lapped while it was copying.
+	struct ThreadBuffer
+	{
+		uint32_t tid;
+		std::atomic<uint64_t> head{ 0 };
+		Event events[EVENTS_PER_THREAD];
+	};
+
+	std::mutex buffersMutex;
+	// buffers outlive their threads so spans from exited threads still dump
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	thread_local ThreadBuffer* localBuffer = nullptr;
+
+	const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+	ThreadBuffer* attachBuffer()
+	{
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffer->tid = static_cast<uint32_t>(buffers.size() + 1);
+		buffers.push_back(std::move(buffer));
+		localBuffer = buffers.back().get();
+		return localBuffer;
+	}
+
+	const char* spanArgName(Trace::Span span)
+	{
+		switch (span)
+		{
+		case Trace::Span::Accept:
+			return "unused";
+		case Trace::Span::Read:
+			return "buffered";
+		case Trace::Span::Flush:
+			return "pending";
+		default:
+			return "type";
+		}
+	}
+#endif
+}
+
+namespace Trace
+{
+	const char* spanName(Span span)
+	{
+		return SPAN_NAMES[static_cast<size_t>(span)];
+	}
+
+#ifdef WWHD_TRACING
+	std::atomic<uint32_t> currentSampleRate{ 0 };
+	thread_local bool sampling = false;
+	thread_local uint32_t sampleCountdown = 0;
+
+	uint64_t nowNs()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - traceEpoch).count());
+	}
+
+	void record(Span span, uint64_t startNs, uint64_t endNs, uint32_t id, uint32_t arg)
+	{
+		ThreadBuffer* buffer = localBuffer != nullptr ? localBuffer : attachBuffer();
+		const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+		Event& event = buffer->events[head & (EVENTS_PER_THREAD - 1)];
+		event.start = startNs;
+		event.duration = static_cast<uint32_t>(endNs - startNs);
+		event.id = id;
+		event.arg = arg;
+		event.span = span;
+		buffer->head.store(head + 1, std::memory_order_release);
+	}
+
+	void setSampleRate(uint32_t rate)
+	{
+		currentSampleRate.store(rate, std::memory_order_relaxed);
+	}
+
+	uint32_t sampleRate()
+	{
+		return currentSampleRate.load(std::memory_order_relaxed);
+	}
+
+	bool dumpChromeTrace(const std::string& path)
+	{
+		nlohmann::json events = nlohmann::json::array();
+		std::vector<Event> copy;
+		{
+			std::lock_guard<std::mutex> lock(buffersMutex);
+			for (const auto& buffer : buffers)
+			{
+				const uint64_t head = buffer->head.load(std::memory_order_acquire);
+				const uint64_t count = head < EVENTS_PER_THREAD ? head : EVENTS_PER_THREAD;
+				copy.resize(count);
+				for (uint64_t i = 0; i < count; i++)
+				{
+					copy[i] = buffer->events[(head - count + i) & (EVENTS_PER_THREAD - 1)];
+				}
+				// anything the writer reached while we copied may be torn, and
+				// so may the slot it is writing now, headAfter's; the fence
+				// keeps the copy from being read after headAfter
+				std::atomic_thread_fence(std::memory_order_acquire);
+				const uint64_t headAfter = buffer->head.load(std::memory_order_relaxed);
+				const uint64_t firstValid = headAfter >= EVENTS_PER_THREAD ? headAfter - EVENTS_PER_THREAD + 1 : 0;
+				const uint64_t skip = firstValid > head - count ? firstValid - (head - count) : 0;
+
+				for (uint64_t i = skip; i < count; i++)
+				{
+					const Event& event = copy[i];
+					events.push_back({
+						{ "name", spanName(event.span) },
+						{ "cat", "protocol" },
+						{ "ph", "X" },
+						{ "ts", event.start / 1000.0 },
+						{ "dur", event.duration / 1000.0 },
+						{ "pid", 1 },
+						{ "tid", buffer->tid },
+						{ "args", { { "conn", event.id }, { spanArgName(event.span), event.arg } } },
+					});
+				}
+			}
+		}
+
+		std::ofstream out(path);
+		if (!out)
+		{
+			PLATFORM_LOG_ERROR(General, "could not write trace to %s\n", path.c_str());
+			return false;
+		}
+		const size_t eventCount = events.size();
+		out << nlohmann::json{ { "traceEvents", std::move(events) }, { "displayTimeUnit", "ns" } };
+		PLATFORM_LOG_INFO(General, "wrote %zu trace events to %s\n", eventCount, path.c_str());
+		return static_cast<bool>(out);
+	}
+#else
+	void setSampleRate(uint32_t rate)
+	{
+		if (rate != 0)
+		{
+			PLATFORM_LOG_WARN(General, "tracing requested but not compiled in (WWHD_TRACING)\n");
+		}
+	}
+
+	uint32_t sampleRate()
+	{
+		return 0;
+	}
+
+	bool dumpChromeTrace(const std::string&)
+	{
+		return false;
+	}
+#endif
+
+	void installDumpSignal(const std::string& path)
+	{
+		dumpPath = path;
+#ifdef SIGUSR1
+		std::signal(SIGUSR1, dumpSignalHandler);
+#else
+		(void)dumpSignalHandler;
+#endif
+	}
+
+	void dumpIfRequested()
+	{
+		if (dumpRequested)
+		{
+			dumpRequested = 0;
+			dumpChromeTrace(dumpPath);
+		}
+	}
+}
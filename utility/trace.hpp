@@ -0,0 +1,139 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Request lifecycle tracing, dumped as Chrome trace-event JSON (load it in
+// chrome://tracing or Perfetto).
+//
+// Compiled in only with WWHD_TRACING (CMake: WWHD_TRACING=ON); otherwise every
+// TRACE_* macro expands to nothing. When compiled in, the sample rate set at
+// runtime picks 1 in N samples per thread; a rate of 0 (the default) turns it
+// off at the cost of one load and branch per TRACE_SAMPLE.
+//
+// TRACE_SAMPLE() decides, for the rest of the enclosing scope, whether the
+// spans opened on this thread are recorded; TRACE_SPAN(span, id, arg) then
+// records the lifetime of its own scope. id is the connection; arg is the
+// message type for per-frame spans, the bytes already buffered for read and
+// the bytes pending for flush. Each thread writes spans into its own ring
+// buffer, so recording takes no locks and the newest spans win.
+
+namespace Trace
+{
+	enum class Span : uint8_t
+	{
+		Accept,
+		Read,
+		Decode,
+		Handle,
+		Encode,
+		Enqueue,
+		Flush,
+		Count
+	};
+
+	const char* spanName(Span span);
+
+	// 1 in rate samples are traced, 0 disables tracing
+	void setSampleRate(uint32_t rate);
+
+	uint32_t sampleRate();
+
+	// Writes every buffered span to path as Chrome trace-event JSON. Safe to
+	// call while other threads keep recording. Returns false if path could not
+	// be written (or tracing is compiled out).
+	bool dumpChromeTrace(const std::string& path);
+
+	// on POSIX hosts, SIGUSR1 requests a dump to path; dumpIfRequested performs
+	// it outside the signal handler
+	void installDumpSignal(const std::string& path);
+
+	void dumpIfRequested();
+
+#ifdef WWHD_TRACING
+	extern std::atomic<uint32_t> currentSampleRate;
+	extern thread_local bool sampling;
+	extern thread_local uint32_t sampleCountdown;
+
+	inline bool shouldSample()
+	{
+		const uint32_t rate = currentSampleRate.load(std::memory_order_relaxed);
+		if (rate == 0)
+		{
+			return false;
+		}
+		if (sampleCountdown == 0)
+		{
+			sampleCountdown = rate - 1;
+			return true;
+		}
+		sampleCountdown--;
+		return false;
+	}
+
+	uint64_t nowNs();
+
+	void record(Span span, uint64_t startNs, uint64_t endNs, uint32_t id, uint32_t arg);
+
+	class SampleGuard
+	{
+	public:
+		SampleGuard() : previous(sampling)
+		{
+			sampling = shouldSample();
+		}
+
+		~SampleGuard()
+		{
+			sampling = previous;
+		}
+
+		SampleGuard(const SampleGuard&) = delete;
+		SampleGuard& operator=(const SampleGuard&) = delete;
+
+	private:
+		bool previous;
+	};
+
+	class Scope
+	{
+	public:
+		Scope(Span span, uint32_t id, uint32_t arg) :
+			active(sampling), span(span), id(id), arg(arg), start(active ? nowNs() : 0)
+		{
+
+		}
+
+		~Scope()
+		{
+			if (active)
+			{
+				record(span, start, nowNs(), id, arg);
+			}
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		bool active;
+		Span span;
+		uint32_t id;
+		uint32_t arg;
+		uint64_t start;
+	};
+#endif
+}
+
+#ifdef WWHD_TRACING
+	#define TRACE_CONCAT_INNER(a, b) a##b
+	#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+	#define TRACE_SAMPLE() Trace::SampleGuard TRACE_CONCAT(traceSample, __LINE__)
+	#define TRACE_SPAN(span, id, arg) Trace::Scope TRACE_CONCAT(traceSpan, __LINE__)(Trace::Span::span, id, arg)
+#else
+	#define TRACE_SAMPLE() do { } while (0)
+	#define TRACE_SPAN(span, id, arg) do { } while (0)
+#endif
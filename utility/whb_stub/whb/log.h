@@ -0,0 +1,17 @@
+#pragma once
+
+// Host-side stub of <whb/log.h>, see whb_stub.cpp.
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BOOL WHBLogWrite(const char* str);
+
+BOOL WHBLogPrint(const char* str);
+
+#ifdef __cplusplus
+}
+#endif
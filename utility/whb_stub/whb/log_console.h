@@ -0,0 +1,26 @@
+#pragma once
+
+// Host-side stub of <whb/log_console.h>, see whb_stub.cpp.
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BOOL WHBLogConsoleInit();
+
+void WHBLogConsoleFree();
+
+void WHBLogConsoleSetColor(uint32_t color);
+
+void WHBLogConsoleDraw();
+
+// stub only: number of redraws and of lines added since WHBLogConsoleInit
+uint64_t WHBStubLogConsoleDrawCount();
+
+uint64_t WHBStubLogConsoleLineCount();
+
+#ifdef __cplusplus
+}
+#endif
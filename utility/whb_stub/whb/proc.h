@@ -0,0 +1,21 @@
+#pragma once
+
+// Host-side stub of <whb/proc.h>, see whb_stub.cpp.
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void WHBProcInit();
+
+void WHBProcShutdown();
+
+void WHBProcStopRunning();
+
+BOOL WHBProcIsRunning();
+
+#ifdef __cplusplus
+}
+#endif
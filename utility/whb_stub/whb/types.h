@@ -0,0 +1,14 @@
+#pragma once
+
+// Host-side stand-in for the parts of wut's types the WHB stub needs.
+
+#include <stdint.h>
+
+#ifndef TRUE
+	#define TRUE 1
+#endif
+#ifndef FALSE
+	#define FALSE 0
+#endif
+
+typedef int32_t BOOL;
@@ -0,0 +1,150 @@
+// Host-side stub of the WHB proc/log/console API so code written against it
+// (the batched log console in particular) can be built, exercised and
+// benchmarked off the console. The console mimics wut's log_console: a small
+// ring of fixed-width lines, and a draw that clears and re-renders both
+// screens' framebuffers, which is what makes per-line redraws expensive.
+// Like the real thing, none of it is thread safe.
+
+#include "whb/log.h"
+#include "whb/log_console.h"
+#include "whb/proc.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	constexpr size_t NUM_LINES = 16;
+	constexpr size_t LINE_LENGTH = 128;
+
+	// TV (1280x720) and DRC (854x480) framebuffers at 4 bytes per pixel
+	constexpr size_t FRAMEBUFFER_PIXELS = 1280 * 720 + 854 * 480;
+	constexpr size_t FONT_ROW_PIXELS = 1280 * 24;
+
+	char consoleBuffer[NUM_LINES][LINE_LENGTH];
+	size_t consoleStartLine = 0;
+	size_t consoleLineCount = 0;
+	std::vector<uint32_t> framebuffer;
+	uint32_t consoleColor = 0x993333FF;
+
+	uint64_t drawCount = 0;
+	uint64_t lineCount = 0;
+	bool consoleActive = false;
+	bool procRunning = false;
+
+	void consoleAddLine(const char* line)
+	{
+		size_t length = strlen(line);
+		if (length > LINE_LENGTH - 1)
+		{
+			length = LINE_LENGTH - 1;
+		}
+
+		size_t index;
+		if (consoleLineCount == NUM_LINES)
+		{
+			index = consoleStartLine;
+			consoleStartLine = (consoleStartLine + 1) % NUM_LINES;
+		}
+		else
+		{
+			index = consoleLineCount++;
+		}
+		memcpy(consoleBuffer[index], line, length);
+		consoleBuffer[index][length] = '\0';
+		lineCount++;
+	}
+}
+
+extern "C"
+{
+	BOOL WHBLogWrite(const char* str)
+	{
+		if (consoleActive)
+		{
+			consoleAddLine(str);
+		}
+		return TRUE;
+	}
+
+	BOOL WHBLogPrint(const char* str)
+	{
+		return WHBLogWrite(str);
+	}
+
+	BOOL WHBLogConsoleInit()
+	{
+		framebuffer.assign(FRAMEBUFFER_PIXELS, 0);
+		consoleStartLine = 0;
+		consoleLineCount = 0;
+		drawCount = 0;
+		lineCount = 0;
+		consoleActive = true;
+		return TRUE;
+	}
+
+	void WHBLogConsoleFree()
+	{
+		consoleActive = false;
+		std::vector<uint32_t>().swap(framebuffer);
+	}
+
+	void WHBLogConsoleSetColor(uint32_t color)
+	{
+		consoleColor = color;
+	}
+
+	void WHBLogConsoleDraw()
+	{
+		if (!consoleActive)
+		{
+			return;
+		}
+
+		// OSScreenClearBufferEx on both screens
+		std::fill(framebuffer.begin(), framebuffer.end(), consoleColor);
+
+		// OSScreenPutFontEx for every line, then flip
+		for (size_t i = 0; i < consoleLineCount; i++)
+		{
+			const char* line = consoleBuffer[(consoleStartLine + i) % NUM_LINES];
+			size_t offset = (i * FONT_ROW_PIXELS) % (framebuffer.size() - LINE_LENGTH);
+			for (size_t c = 0; line[c] != '\0'; c++)
+			{
+				framebuffer[offset + c] ^= static_cast<unsigned char>(line[c]);
+			}
+		}
+		drawCount++;
+	}
+
+	uint64_t WHBStubLogConsoleDrawCount()
+	{
+		return drawCount;
+	}
+
+	uint64_t WHBStubLogConsoleLineCount()
+	{
+		return lineCount;
+	}
+
+	void WHBProcInit()
+	{
+		procRunning = true;
+	}
+
+	void WHBProcShutdown()
+	{
+		procRunning = false;
+	}
+
+	void WHBProcStopRunning()
+	{
+		procRunning = false;
+	}
+
+	BOOL WHBProcIsRunning()
+	{
+		return procRunning ? TRUE : FALSE;
+	}
+}